@@ -0,0 +1,179 @@
+#include "AccumulationTarget.h"
+#include "GLState.h"
+#include "RenderTargetPool.h"
+#include "Renderer.h"
+
+namespace {
+
+struct StorageInfo {
+    AccumulationTarget::Storage storage;
+    const char* name;
+};
+
+const StorageInfo storages[] = {
+    { AccumulationTarget::Storage::Float32, "rgba32f" },
+    { AccumulationTarget::Storage::Float16, "rgba16f" },
+    { AccumulationTarget::Storage::Float16Resolved, "rgba16f-resolve" },
+};
+
+}
+
+bool AccumulationTarget::ParseStorage(const std::string& name, Storage& storage)
+{
+    for (const StorageInfo& info : storages) {
+        if (name == info.name) {
+            storage = info.storage;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* AccumulationTarget::StorageName(Storage storage)
+{
+    for (const StorageInfo& info : storages)
+        if (info.storage == storage)
+            return info.name;
+    return "unknown";
+}
+
+size_t AccumulationTarget::BytesPerPixel(Storage storage)
+{
+    switch (storage) {
+    case Storage::Float16:
+        return 8 + 2;
+    case Storage::Float16Resolved:
+        return 8 + 2 + 16 + 4;
+    default:
+        return 16 + 4;
+    }
+}
+
+size_t AccumulationTarget::PassBytesPerPixel(Storage storage)
+{
+    // Blending reads the destination and writes it back; a resolve every
+    // resolveInterval passes comes on top for Float16Resolved
+    return storage == Storage::Float32 ? 2 * (16 + 4) : 2 * (8 + 2);
+}
+
+bool AccumulationTarget::CreateTargets(Targets& targets, GLenum sumFormat, GLenum squareFormat, int width, int height,
+    const glm::vec4* sums, const float* squares)
+{
+    RenderTargetPool& pool = RenderTargetPool::Instance();
+    targets.framebuffer = GLFramebuffer::Create();
+    targets.sums = pool.acquire(sumFormat, width, height);
+    targets.squares = pool.acquire(squareFormat, width, height);
+    if (sums && squares) {
+        glBindTexture(GL_TEXTURE_2D, targets.sums);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, sums);
+        glBindTexture(GL_TEXTURE_2D, targets.squares);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, squares);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.sums, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, targets.squares, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    // Pooled textures come with undefined contents
+    if (!sums || !squares) {
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+    }
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+bool AccumulationTarget::create(Storage storage, int newWidth, int newHeight, const glm::vec4* sums, const float* squares, std::string& error)
+{
+    Delete();
+    currentStorage = storage;
+    width = newWidth;
+    height = newHeight;
+
+    if (storage == Storage::Float16Resolved) {
+        resolveShader = std::make_unique<Shader>(Renderer::ShaderPath("resolve.vert").c_str(), Renderer::ShaderPath("resolve.frag").c_str());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(resolveShader->id(), GL_LINK_STATUS, &linked);
+        if (!linked) {
+            error = "resolve shader did not build";
+            return false;
+        }
+        emptyArray = GLVertexArray::Create();
+        // The float targets take what the render starts from; the half ones start empty
+        if (!CreateTargets(total, GL_RGBA32F, GL_R32F, width, height, sums, squares)) {
+            Delete();
+            error = "float accumulation targets incomplete";
+            return false;
+        }
+        sums = nullptr;
+        squares = nullptr;
+    }
+    bool half = storage != Storage::Float32;
+    if (!CreateTargets(pass, half ? GL_RGBA16F : GL_RGBA32F, half ? GL_R16F : GL_R32F, width, height, sums, squares)) {
+        // Nothing stays taken from the pool
+        Delete();
+        error = std::string(StorageName(storage)) + " accumulation targets incomplete";
+        return false;
+    }
+    return true;
+}
+
+void AccumulationTarget::bindPass()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer.get());
+}
+
+void AccumulationTarget::endPass()
+{
+    if (currentStorage == Storage::Float16Resolved && ++batchPasses >= resolveInterval)
+        resolve();
+}
+
+void AccumulationTarget::resolve()
+{
+    if (currentStorage != Storage::Float16Resolved || batchPasses == 0)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, total.framebuffer.get());
+    glViewport(0, 0, width, height);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_BLEND);
+    resolveShader->use();
+    resolveShader->setInt("sums", 0);
+    resolveShader->setInt("squares", 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pass.sums);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, pass.squares);
+    glActiveTexture(GL_TEXTURE0);
+    GLState::BindVertexArray(emptyArray.get());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer.get());
+    const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+    batchPasses = 0;
+    ++resolveCount;
+}
+
+void AccumulationTarget::bindSums()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, currentStorage == Storage::Float16Resolved ? total.framebuffer.get() : pass.framebuffer.get());
+}
+
+void AccumulationTarget::Delete()
+{
+    RenderTargetPool& pool = RenderTargetPool::Instance();
+    for (Targets* targets : { &pass, &total }) {
+        pool.release(targets->sums);
+        pool.release(targets->squares);
+    }
+    pass = Targets();
+    total = Targets();
+    resolveShader.reset();
+    emptyArray.reset();
+    batchPasses = 0;
+    resolveCount = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef ACCUMULATION_TARGET_H
+#define ACCUMULATION_TARGET_H
+
+#include "pch.h"
+#include "GLObject.h"
+#include "Shader.h"
+
+#include <memory>
+
+// GPU targets that gather what an Accumulator holds, as default.frag's
+// ACCUMULATE variant writes it: the color sum with the sample count in alpha,
+// and the sum of squared luminance. Passes are added in by blending. The
+// storage trades precision for memory and bandwidth:
+//   Float32          RGBA32F and R32F, 20 bytes a pixel, read and written by every pass.
+//   Float16          RGBA16F and R16F, half that. A half sum stops growing once a
+//                    pass adds less than its last bit (about 1/2048 of it), so
+//                    only short runs stay accurate, and counts stop at 2048.
+//   Float16Resolved  passes blend into the half targets, which are added into
+//                    float ones every resolveInterval passes and then cleared.
+//                    30 bytes a pixel, but a pass only touches the half ones.
+class AccumulationTarget
+{
+public:
+	enum class Storage { Float32, Float16, Float16Resolved };
+
+	// "rgba32f", "rgba16f" or "rgba16f-resolve"
+	static bool ParseStorage(const std::string& name, Storage& storage);
+	static const char* StorageName(Storage storage);
+	// Texture memory, and what one blended pass reads plus writes, per pixel
+	static size_t BytesPerPixel(Storage storage);
+	static size_t PassBytesPerPixel(Storage storage);
+
+	// Passes summed at half precision before Float16Resolved adds them into the float sums
+	int resolveInterval = 16;
+
+	// Allocates the targets, holding sums and squares (width * height each,
+	// e.g. from a checkpoint) or zero when they are null. Leaves the pass
+	// targets bound, as bindPass() does.
+	bool create(Storage storage, int width, int height, const glm::vec4* sums, const float* squares, std::string& error);
+
+	// Binds the targets passes are drawn into; additive blending is the caller's
+	void bindPass();
+	// Counts a drawn pass and resolves every resolveInterval passes
+	void endPass();
+	// Adds the half sums into the float ones and clears them, then binds the
+	// pass targets again. Leaves GL_ONE, GL_ONE blending enabled. Does nothing
+	// unless the storage is Float16Resolved.
+	void resolve();
+	// Binds the targets holding the whole sums for reading, color sum on
+	// GL_COLOR_ATTACHMENT0 and squares on GL_COLOR_ATTACHMENT1; resolve() first
+	void bindSums();
+
+	Storage storage() const { return currentStorage; }
+	size_t bytes() const { return static_cast<size_t>(width) * height * BytesPerPixel(currentStorage); }
+	int resolves() const { return resolveCount; }
+	// Passes in the half targets that resolve() has yet to add; always 0 unless Float16Resolved
+	int unresolvedPasses() const { return batchPasses; }
+
+	void Delete();
+
+private:
+	// The textures are from RenderTargetPool, handed back in Delete()
+	struct Targets {
+		GLFramebuffer framebuffer;
+		GLuint sums = 0;
+		GLuint squares = 0;
+	};
+
+	Storage currentStorage = Storage::Float32;
+	int width = 0;
+	int height = 0;
+	// What passes blend into, and for Float16Resolved the float sums behind it
+	Targets pass;
+	Targets total;
+	std::unique_ptr<Shader> resolveShader;
+	// Core profile draws need one; the resolve triangle has no attributes
+	GLVertexArray emptyArray;
+	int batchPasses = 0;
+	int resolveCount = 0;
+
+	static bool CreateTargets(Targets& targets, GLenum sumFormat, GLenum squareFormat, int width, int height,
+		const glm::vec4* sums, const float* squares);
+};
+
+#endif // ACCUMULATION_TARGET_H
@@ -0,0 +1,78 @@
+#include "Accumulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float luminance(const glm::vec3& color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+}
+
+void Accumulator::resize(int newWidth, int newHeight)
+{
+    width = newWidth;
+    height = newHeight;
+    clear();
+}
+
+void Accumulator::clear()
+{
+    size_t count = static_cast<size_t>(width) * height;
+    sum.assign(count, glm::vec3(0.0f));
+    sumSquares.assign(count, 0.0f);
+    counts.assign(count, 0);
+}
+
+void Accumulator::add(const std::vector<glm::vec4>& pixels, const std::vector<uint8_t>* mask)
+{
+    for (size_t i = 0; i < sum.size(); ++i) {
+        if (mask && !(*mask)[i])
+            continue;
+        glm::vec3 color(pixels[i]);
+        float y = luminance(color);
+        sum[i] += color;
+        sumSquares[i] += y * y;
+        counts[i]++;
+    }
+}
+
+void Accumulator::resolve(std::vector<glm::vec4>& pixels) const
+{
+    pixels.resize(sum.size());
+    for (size_t i = 0; i < sum.size(); ++i)
+        pixels[i] = glm::vec4(counts[i] ? sum[i] / static_cast<float>(counts[i]) : glm::vec3(0.0f), 1.0f);
+}
+
+uint64_t Accumulator::totalSamples() const
+{
+    uint64_t total = 0;
+    for (uint32_t count : counts)
+        total += count;
+    return total;
+}
+
+float Accumulator::relativeError(size_t index) const
+{
+    uint32_t n = counts[index];
+    if (n < 2)
+        return 1e30f;
+    float mean = luminance(sum[index]) / n;
+    float variance = std::max(0.0f, (sumSquares[index] - n * mean * mean) / (n - 1));
+    // The small bias keeps near-black pixels from demanding samples forever
+    return std::sqrt(variance / n) / (mean + 0.01f);
+}
+
+size_t Accumulator::buildMask(float threshold, std::vector<uint8_t>& mask) const
+{
+    mask.resize(sum.size());
+    size_t active = 0;
+    for (size_t i = 0; i < sum.size(); ++i) {
+        mask[i] = relativeError(i) > threshold ? 1 : 0;
+        active += mask[i];
+    }
+    return active;
+}
@@ -0,0 +1,36 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vector>
+
+// Progressive per-pixel estimate: running sums of color and squared
+// luminance plus a sample count, so the mean and its standard error are
+// available for any pixel at any time.
+class Accumulator
+{
+public:
+	int width = 0;
+	int height = 0;
+	std::vector<glm::vec3> sum;
+	std::vector<float> sumSquares;
+	std::vector<uint32_t> counts;
+
+	void resize(int newWidth, int newHeight);
+	void clear();
+
+	// Adds one pass; pixels outside the mask (when given) were not rendered
+	void add(const std::vector<glm::vec4>& pixels, const std::vector<uint8_t>* mask = nullptr);
+
+	void resolve(std::vector<glm::vec4>& pixels) const;
+	uint64_t totalSamples() const;
+
+	// Standard error of the luminance mean relative to the mean itself
+	float relativeError(size_t index) const;
+	// 1 for pixels still above the threshold, 0 for converged ones
+	size_t buildMask(float threshold, std::vector<uint8_t>& mask) const;
+};
+
+#endif // ACCUMULATOR_H
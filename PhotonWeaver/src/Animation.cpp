@@ -0,0 +1,189 @@
+#include "Animation.h"
+#include "FrameCapture.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <iomanip>
+
+namespace {
+
+struct TimedFrame {
+    GLuint query;
+    int passes;
+};
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+bool Animation::Render(Renderer& renderer, Shader& shader, Scene& scene, const Options& options, std::string& error)
+{
+    TRACE_SCOPE("Animation::Render");
+    auto start = std::chrono::steady_clock::now();
+
+    GLint maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (options.width <= 0 || options.height <= 0 || options.width > maxViewport[0] || options.height > maxViewport[1]) {
+        error = "frames must be between 1x1 and " + std::to_string(maxViewport[0]) + "x" + std::to_string(maxViewport[1]);
+        return false;
+    }
+
+    const SceneAnimation& animation = scene.animation;
+    bool turntable = animation.empty();
+    int frames = turntable ? std::max(1, static_cast<int>(std::round(options.turntableSeconds * animation.fps))) : animation.frameCount();
+    bool moving = !animation.spheres.empty();
+
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLFramebuffer framebuffer = GLFramebuffer::Create();
+    GLTexture color = GLTexture::Create();
+    glBindTexture(GL_TEXTURE_2D, color.get());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, options.width, options.height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.get(), 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        error = "float frame target incomplete";
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        return false;
+    }
+    glViewport(0, 0, options.width, options.height);
+
+    FrameCapture::Options captureOptions;
+    captureOptions.directory = options.directory;
+    captureOptions.format = options.format;
+    captureOptions.exposure = options.exposure;
+    FrameCapture capture(captureOptions);
+
+    int maxPasses = std::max(1, options.samples);
+    double msPerPass = 0.0;
+    std::deque<TimedFrame> timing;
+    std::vector<GLuint> freeQueries;
+
+    // Without an estimate, time single passes of the first frame until the budget is spent
+    if (options.budgetMs > 0.0) {
+        TRACE_SCOPE("calibrate");
+        SceneCamera camera = turntable ? scene.orbit(0.0f, 360.0f) : animation.cameraAt(0.0f, scene.camera);
+        // The first pass pays for lazy driver work and is not counted
+        renderer.draw(shader, camera, options.width, options.height, 0);
+        glFinish();
+        auto calibrationStart = std::chrono::steady_clock::now();
+        int passes = 0;
+        do {
+            renderer.draw(shader, camera, options.width, options.height, passes++);
+            glFinish();
+        } while (passes < maxPasses && msSince(calibrationStart) < options.budgetMs);
+        msPerPass = msSince(calibrationStart) / passes;
+    }
+
+    scene.pose(animation.frameTime(0));
+    if (moving)
+        renderer.updateSpheres(scene.geometry());
+    std::future<void> nextPose;
+    double poseWaitMs = 0.0;
+    size_t passTotal = 0;
+
+    for (int frame = 0; frame < frames; ++frame) {
+        TRACE_SCOPE("animation frame");
+        float time = animation.frameTime(frame);
+        SceneCamera camera = turntable ? scene.orbit(static_cast<float>(frame) / frames, 360.0f) : animation.cameraAt(time, scene.camera);
+
+        if (frame > 0 && moving) {
+            auto waitStart = std::chrono::steady_clock::now();
+            nextPose.get();
+            poseWaitMs += msSince(waitStart);
+            renderer.updateSpheres(scene.geometry());
+        }
+        // The upload above copied this frame's spheres, so the next pose can start on them now
+        if (moving && frame + 1 < frames) {
+            float nextTime = animation.frameTime(frame + 1);
+            nextPose = std::async(std::launch::async, [&scene, nextTime] {
+                TRACE_SCOPE("pose and refit");
+                scene.pose(nextTime);
+            });
+        }
+
+        // Fold in whichever earlier frames' timings have landed
+        while (!timing.empty()) {
+            GLint available = 0;
+            glGetQueryObjectiv(timing.front().query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(timing.front().query, GL_QUERY_RESULT, &nanoseconds);
+            // Jumps up to a heavier frame at once and eases back down, as TileScheduler does
+            double measured = nanoseconds * 1e-6 / timing.front().passes;
+            msPerPass = measured > msPerPass ? measured : msPerPass + 0.25 * (measured - msPerPass);
+            freeQueries.push_back(timing.front().query);
+            timing.pop_front();
+        }
+        int passes = maxPasses;
+        if (options.budgetMs > 0.0 && msPerPass > 0.0)
+            passes = std::clamp(static_cast<int>(options.budgetMs / msPerPass), 1, maxPasses);
+        passTotal += passes;
+
+        if (options.budgetMs > 0.0) {
+            if (freeQueries.empty()) {
+                GLuint query = 0;
+                glGenQueries(1, &query);
+                freeQueries.push_back(query);
+            }
+            timing.push_back({ freeQueries.back(), passes });
+            freeQueries.pop_back();
+            glBeginQuery(GL_TIME_ELAPSED, timing.back().query);
+        }
+
+        // Each pass adds its share of the average straight into the target
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        float weight = 1.0f / passes;
+        glBlendColor(weight, weight, weight, weight);
+        glBlendFunc(GL_CONSTANT_COLOR, GL_ONE);
+        glEnable(GL_BLEND);
+        for (int pass = 0; pass < passes; ++pass) {
+            renderer.draw(shader, camera, options.width, options.height, pass);
+            glFlush();
+        }
+        glDisable(GL_BLEND);
+        if (options.budgetMs > 0.0)
+            glEndQuery(GL_TIME_ELAPSED);
+
+        capture.capture(framebuffer, options.width, options.height);
+
+        double seconds = msSince(start) / 1000.0;
+        std::cout << "Frame " << frame + 1 << "/" << frames << ": " << passes << " passes, " << std::fixed << std::setprecision(1)
+            << seconds << " s" << std::defaultfloat << std::endl;
+    }
+
+    capture.Delete();
+    FrameCapture::Stats stats = capture.stats();
+    double hours = msSince(start) / 3600000.0;
+    std::cout << "Animation: " << frames << " frames, " << static_cast<double>(passTotal) / frames << " passes per frame, "
+        << std::fixed << std::setprecision(0) << frames / hours << " frames/hour" << std::defaultfloat << "; waited " << poseWaitMs
+        << " ms on scene updates, " << stats.ringStallMs << " ms on readbacks, " << stats.encoder.blockedMs << " ms on the writer"
+        << std::endl;
+
+    for (const TimedFrame& timed : timing)
+        freeQueries.push_back(timed.query);
+    if (!freeQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    framebuffer.reset();
+    color.reset();
+    if (stats.encoder.failed > 0) {
+        error = std::to_string(stats.encoder.failed) + " frames could not be written";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "pch.h"
+#include "ImageEncoder.h"
+#include "Renderer.h"
+
+// Offline image sequences from the GL tracer: the scene's SceneAnimation, or
+// a turntable orbit when it has none, one numbered file per frame. Each
+// frame is work the GPU and the CPU do side by side. While the GPU traces
+// frame N, a worker thread poses the spheres for frame N+1 and refits their
+// BVH. Meanwhile the previous frames are read back and written through a
+// FrameCapture. The CPU only waits when a stage falls behind.
+class Animation
+{
+public:
+	struct Options {
+		std::filesystem::path directory;
+		ImageEncoder::Format format = ImageEncoder::Format::Png;
+		float exposure = 1.0f;
+		int width = 1920;
+		int height = 1080;
+		// Passes per frame, accumulated with blending; frameIndex 0..samples-1
+		int samples = 64;
+		// When above 0, each frame gets as many passes as fit this much GPU
+		// time, by timer queries on earlier frames, up to samples
+		double budgetMs = 0.0;
+		// Length of the turntable used when the scene has no animation
+		float turntableSeconds = 4.0f;
+	};
+
+	// Poses the scene as it goes. Prints progress every frame and the
+	// throughput in frames per hour at the end. False, with error, when the
+	// target cannot be made.
+	static bool Render(Renderer& renderer, Shader& shader, Scene& scene, const Options& options, std::string& error);
+};
+
+#endif // ANIMATION_H
@@ -0,0 +1,155 @@
+#include "BVH.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const int binCount = 16;
+const uint32_t maxLeafSize = 4;
+
+struct Bin {
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+}
+
+void BVH::Build(const std::vector<Bounds>& primitives)
+{
+    TRACE_SCOPE("BVH::Build");
+    auto start = std::chrono::steady_clock::now();
+
+    nodes.clear();
+    order.resize(primitives.size());
+    depth = 0;
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    if (!primitives.empty()) {
+        std::vector<glm::vec3> centers(primitives.size());
+        for (size_t i = 0; i < primitives.size(); ++i)
+            centers[i] = primitives[i].center();
+
+        // A binary tree over N leaves never needs more than 2N - 1 nodes
+        nodes.reserve(primitives.size() * 2);
+        BVHNode root;
+        root.leftFirst = 0;
+        root.count = static_cast<int32_t>(primitives.size());
+        nodes.push_back(root);
+        subdivide(0, primitives, centers, 1);
+    }
+
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BVH::Refit(const std::vector<Bounds>& primitives)
+{
+    TRACE_SCOPE("BVH::Refit");
+    // Children are always allocated after their parent, so one backward pass suffices
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BVHNode& node = nodes[i];
+        Bounds bounds;
+        if (node.count > 0) {
+            for (int32_t k = node.leftFirst; k < node.leftFirst + node.count; ++k)
+                bounds.grow(primitives[k]);
+        }
+        else {
+            bounds.grow(glm::min(nodes[node.leftFirst].min, nodes[node.leftFirst + 1].min));
+            bounds.grow(glm::max(nodes[node.leftFirst].max, nodes[node.leftFirst + 1].max));
+        }
+        node.min = bounds.min;
+        node.max = bounds.max;
+    }
+}
+
+void BVH::subdivide(uint32_t nodeIndex, const std::vector<Bounds>& primitives, const std::vector<glm::vec3>& centers, int level)
+{
+    depth = std::max(depth, level);
+
+    uint32_t first = nodes[nodeIndex].leftFirst;
+    uint32_t count = nodes[nodeIndex].count;
+
+    Bounds bounds, centroidBounds;
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds.grow(primitives[order[i]]);
+        centroidBounds.grow(centers[order[i]]);
+    }
+    nodes[nodeIndex].min = bounds.min;
+    nodes[nodeIndex].max = bounds.max;
+
+    if (count <= maxLeafSize)
+        return;
+
+    // Bin the centroids along each axis and keep the cheapest SAH split
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = bounds.area() * count;
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = centroidBounds.min[axis];
+        float extent = centroidBounds.max[axis] - lo;
+        if (extent <= 0.0f)
+            continue;
+
+        Bin bins[binCount];
+        float scale = binCount / extent;
+        for (uint32_t i = first; i < first + count; ++i) {
+            int b = std::min(binCount - 1, static_cast<int>((centers[order[i]][axis] - lo) * scale));
+            bins[b].bounds.grow(primitives[order[i]]);
+            bins[b].count++;
+        }
+
+        // Sweep from both ends so every plane is evaluated in O(bins)
+        float leftArea[binCount - 1], rightArea[binCount - 1];
+        uint32_t leftCount[binCount - 1], rightCount[binCount - 1];
+        Bounds leftBox, rightBox;
+        uint32_t leftSum = 0, rightSum = 0;
+        for (int i = 0; i < binCount - 1; ++i) {
+            leftSum += bins[i].count;
+            leftBox.grow(bins[i].bounds);
+            leftCount[i] = leftSum;
+            leftArea[i] = leftBox.area();
+
+            rightSum += bins[binCount - 1 - i].count;
+            rightBox.grow(bins[binCount - 1 - i].bounds);
+            rightCount[binCount - 2 - i] = rightSum;
+            rightArea[binCount - 2 - i] = rightBox.area();
+        }
+
+        for (int i = 0; i < binCount - 1; ++i) {
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    if (bestAxis < 0)
+        return;
+
+    float lo = centroidBounds.min[bestAxis];
+    float scale = binCount / (centroidBounds.max[bestAxis] - lo);
+    auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](uint32_t index) {
+        return std::min(binCount - 1, static_cast<int>((centers[index][bestAxis] - lo) * scale)) <= bestSplit;
+    });
+    uint32_t leftCount = static_cast<uint32_t>(middle - order.begin()) - first;
+
+    // Siblings are allocated together so the right child is always left + 1
+    uint32_t left = static_cast<uint32_t>(nodes.size());
+    BVHNode child;
+    child.leftFirst = first;
+    child.count = leftCount;
+    nodes.push_back(child);
+    child.leftFirst = first + leftCount;
+    child.count = count - leftCount;
+    nodes.push_back(child);
+
+    nodes[nodeIndex].leftFirst = left;
+    nodes[nodeIndex].count = 0;
+
+    subdivide(left, primitives, centers, level + 1);
+    subdivide(left + 1, primitives, centers, level + 1);
+}
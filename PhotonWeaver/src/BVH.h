@@ -0,0 +1,58 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "pch.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct Bounds {
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+	void grow(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+	void grow(const Bounds& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	float area() const
+	{
+		glm::vec3 e = max - min;
+		return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+};
+
+// 32 bytes, uploaded as two RGBA32F texels. A leaf has count > 0 and its
+// primitives start at leftFirst; an inner node's children are leftFirst and
+// leftFirst + 1.
+struct BVHNode {
+	glm::vec3 min;
+	int32_t leftFirst;
+	glm::vec3 max;
+	int32_t count;
+};
+
+// Binned SAH bounding volume hierarchy over arbitrary primitive bounds.
+// Build() only produces the node array and a primitive order; the owner
+// reorders its primitives to match so leaves address contiguous ranges.
+class BVH
+{
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> order;
+	int depth = 0;
+	double buildMs = 0.0;
+
+	void Build(const std::vector<Bounds>& primitives);
+	// Recomputes every node's bounds bottom-up for primitives that moved,
+	// given in leaf order; the tree's shape and order stay as built. Far
+	// cheaper than a rebuild, but the tree degrades as primitives wander
+	// from where it was built.
+	void Refit(const std::vector<Bounds>& primitives);
+
+	bool empty() const { return nodes.empty(); }
+
+private:
+	void subdivide(uint32_t nodeIndex, const std::vector<Bounds>& primitives, const std::vector<glm::vec3>& centers, int level);
+};
+
+#endif // BVH_H
@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Trace.h"
 
 
 Camera::Camera(int width, int height, glm::vec3 position)
@@ -26,7 +27,7 @@ void Camera::updateMatrix(float verticalFOV, float nearClip, float farClip)
 void Camera::Matrix(Shader& shader, const char* uniform)
 {
     // Exports camera matrix
-    glUniformMatrix4fv(glGetUniformLocation(shader.ID, uniform), 1, GL_FALSE, glm::value_ptr(cameraMatrix));
+    glUniformMatrix4fv(glGetUniformLocation(shader.id(), uniform), 1, GL_FALSE, glm::value_ptr(cameraMatrix));
 }
 
 void Camera::setSpeed(float newSpeed)
@@ -36,6 +37,8 @@ void Camera::setSpeed(float newSpeed)
 
 void Camera::Inputs(GLFWwindow* window, double deltaTime)
 {
+    TRACE_SCOPE("Camera::Inputs");
+
     float scalingFactor = 100.0f;
     // Determine the base speed
     float baseSpeed = speed * deltaTime;
@@ -0,0 +1,100 @@
+#include "ClusterCache.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+
+void ClusterCache::Stats::add(const Stats& other)
+{
+    hits += other.hits;
+    misses += other.misses;
+    loads += other.loads;
+    evictions += other.evictions;
+    bytesRead += other.bytesRead;
+    stallMs += other.stallMs;
+    peakBytes = std::max(peakBytes, other.peakBytes);
+}
+
+ClusterCache::ClusterCache(const ClusterFile& file, size_t budgetBytes)
+    : clusters(file), budgetBytes(budgetBytes)
+{
+}
+
+std::shared_ptr<const Cluster> ClusterCache::find(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = resident.find(index);
+    if (found == resident.end()) {
+        stats.misses++;
+        return nullptr;
+    }
+    stats.hits++;
+    recent.splice(recent.begin(), recent, found->second.position);
+    return found->second.cluster;
+}
+
+std::shared_ptr<const Cluster> ClusterCache::load(uint32_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = resident.find(index);
+        if (found != resident.end()) {
+            recent.splice(recent.begin(), recent, found->second.position);
+            return found->second.cluster;
+        }
+    }
+
+    // Read outside the lock so other threads keep finding resident clusters
+    auto start = std::chrono::steady_clock::now();
+    auto cluster = std::make_shared<Cluster>();
+    bool read = clusters.read(index, *cluster);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.stallMs += ms;
+    if (!read) {
+        std::cerr << "ERROR::CLUSTER_CACHE::READ_FAILED: cluster " << index << std::endl;
+        return nullptr;
+    }
+    stats.loads++;
+    stats.bytesRead += cluster->data.size();
+
+    // Another thread may have read the same cluster meanwhile
+    auto found = resident.find(index);
+    if (found != resident.end()) {
+        recent.splice(recent.begin(), recent, found->second.position);
+        return found->second.cluster;
+    }
+    evict(cluster->data.size());
+    recent.push_front(index);
+    resident[index] = Entry{ cluster, recent.begin() };
+    bytes += cluster->data.size();
+    stats.peakBytes = std::max(stats.peakBytes, bytes);
+    return cluster;
+}
+
+void ClusterCache::evict(size_t incoming)
+{
+    while (!recent.empty() && bytes + incoming > budgetBytes) {
+        auto victim = resident.find(recent.back());
+        bytes -= victim->second.cluster->data.size();
+        resident.erase(victim);
+        recent.pop_back();
+        stats.evictions++;
+    }
+}
+
+size_t ClusterCache::residentBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+ClusterCache::Stats ClusterCache::takeStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    stats = Stats();
+    stats.peakBytes = bytes;
+    return result;
+}
@@ -0,0 +1,67 @@
+#ifndef CLUSTER_CACHE_H
+#define CLUSTER_CACHE_H
+
+#include "pch.h"
+#include "ClusterFile.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Least-recently-used cache of a ClusterFile's clusters under a memory
+// budget. Clusters are handed out as shared pointers, so one that is evicted
+// while rays are still intersecting it stays alive until they are done; the
+// budget bounds what the cache itself keeps resident.
+class ClusterCache
+{
+public:
+	struct Stats {
+		// Ray visits to a cluster that was resident, and visits that had to wait for a read
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t loads = 0;
+		uint64_t evictions = 0;
+		uint64_t bytesRead = 0;
+		// Time spent waiting on reads, summed over threads
+		double stallMs = 0.0;
+		size_t peakBytes = 0;
+
+		double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 1.0; }
+		void add(const Stats& other);
+	};
+
+	ClusterCache(const ClusterFile& file, size_t budgetBytes);
+
+	// The cluster if it is resident, counting a hit or a miss; never reads
+	std::shared_ptr<const Cluster> find(uint32_t index);
+	// The cluster, read from disk first when it is not resident; null on a read error
+	std::shared_ptr<const Cluster> load(uint32_t index);
+
+	const ClusterFile& file() const { return clusters; }
+	size_t budget() const { return budgetBytes; }
+	size_t residentBytes() const;
+
+	// Counters since construction or the last call; resident clusters stay
+	Stats takeStats();
+
+private:
+	struct Entry {
+		std::shared_ptr<const Cluster> cluster;
+		std::list<uint32_t>::iterator position;
+	};
+
+	const ClusterFile& clusters;
+	size_t budgetBytes;
+	mutable std::mutex mutex;
+	// Most recently used first
+	std::list<uint32_t> recent;
+	std::unordered_map<uint32_t, Entry> resident;
+	size_t bytes = 0;
+	Stats stats;
+
+	void evict(size_t incoming);
+};
+
+#endif // CLUSTER_CACHE_H
@@ -0,0 +1,300 @@
+#include "ClusterFile.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+namespace {
+
+const uint32_t fileMagic = 0x4c435750; // "PWCL"
+// Bump whenever the header or the cluster layout changes
+const uint32_t fileVersion = 3;
+const uint32_t pageBytes = 4096;
+
+// Followed by the cluster table, the sphere and triangle top-level trees, the
+// materials and the texture array's texels; clusters start at page boundaries after those
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t clusterBytes;
+    uint32_t clusterCount;
+    uint32_t sphereTopCount;
+    uint32_t triangleTopCount;
+    uint32_t materialCount;
+    // Native struct layout; the strides catch a mismatched build
+    uint32_t nodeStride;
+    uint32_t sphereStride;
+    uint32_t triangleStride;
+    uint32_t shadingStride;
+    uint32_t entryStride;
+    uint64_t fileBytes;
+    uint32_t textureSize;
+    uint32_t textureLayers;
+};
+static_assert(sizeof(FileHeader) == 64, "FileHeader layout changed");
+
+uint64_t alignToPage(uint64_t offset)
+{
+    return (offset + pageBytes - 1) / pageBytes * pageBytes;
+}
+
+// Cuts one hierarchy into clusters. A subtree's primitives are contiguous in
+// the scene's arrays, since the BVH build partitions them in place.
+class Partition
+{
+public:
+    struct Piece {
+        Cluster::Kind kind;
+        uint32_t root;
+    };
+
+    Partition(const std::vector<BVHNode>& nodes, Cluster::Kind kind, uint32_t primitiveBytes)
+        : nodes(nodes), kind(kind), primitiveBytes(primitiveBytes)
+    {
+        first.resize(nodes.size());
+        primitives.resize(nodes.size());
+        subtreeNodes.resize(nodes.size());
+        if (!nodes.empty())
+            measure(0);
+    }
+
+    // Fills top with the part of the tree above the clusters and appends the clusters to pieces
+    void cut(uint32_t clusterBytes, std::vector<BVHNode>& top, std::vector<Piece>& pieces)
+    {
+        top.clear();
+        if (nodes.empty())
+            return;
+        top.push_back(nodes[0]);
+        cut(0, 0, clusterBytes, top, pieces);
+    }
+
+    uint64_t bytes(uint32_t node) const { return subtreeNodes[node] * sizeof(BVHNode) + static_cast<uint64_t>(primitives[node]) * primitiveBytes; }
+    uint32_t nodeCount(uint32_t node) const { return subtreeNodes[node]; }
+    uint32_t primitiveCount(uint32_t node) const { return primitives[node]; }
+    uint32_t firstPrimitive(uint32_t node) const { return first[node]; }
+
+    // The subtree's nodes renumbered from 0, siblings still adjacent, leaves relative to its first primitive
+    std::vector<BVHNode> localNodes(uint32_t root) const
+    {
+        std::vector<BVHNode> local(1, nodes[root]);
+        for (size_t i = 0; i < local.size(); ++i) {
+            if (local[i].count > 0) {
+                local[i].leftFirst -= static_cast<int32_t>(first[root]);
+                continue;
+            }
+            uint32_t left = static_cast<uint32_t>(local[i].leftFirst);
+            local[i].leftFirst = static_cast<int32_t>(local.size());
+            local.push_back(nodes[left]);
+            local.push_back(nodes[left + 1]);
+        }
+        return local;
+    }
+
+private:
+    const std::vector<BVHNode>& nodes;
+    Cluster::Kind kind;
+    uint32_t primitiveBytes;
+    std::vector<uint32_t> first, primitives, subtreeNodes;
+
+    void measure(uint32_t node)
+    {
+        const BVHNode& current = nodes[node];
+        if (current.count > 0) {
+            first[node] = current.leftFirst;
+            primitives[node] = current.count;
+            subtreeNodes[node] = 1;
+            return;
+        }
+        uint32_t left = current.leftFirst;
+        measure(left);
+        measure(left + 1);
+        first[node] = first[left];
+        primitives[node] = primitives[left] + primitives[left + 1];
+        subtreeNodes[node] = 1 + subtreeNodes[left] + subtreeNodes[left + 1];
+    }
+
+    void cut(uint32_t node, uint32_t topIndex, uint32_t clusterBytes, std::vector<BVHNode>& top, std::vector<Piece>& pieces)
+    {
+        // A leaf always fits: a page holds far more than the build's largest leaf
+        if (bytes(node) <= clusterBytes) {
+            top[topIndex].leftFirst = 0;
+            top[topIndex].count = -static_cast<int32_t>(pieces.size()) - 1;
+            pieces.push_back(Piece{ kind, node });
+            return;
+        }
+        uint32_t left = nodes[node].leftFirst;
+        uint32_t child = static_cast<uint32_t>(top.size());
+        top[topIndex].leftFirst = static_cast<int32_t>(child);
+        top[topIndex].count = 0;
+        top.push_back(nodes[left]);
+        top.push_back(nodes[left + 1]);
+        cut(left, child, clusterBytes, top, pieces);
+        cut(left + 1, child + 1, clusterBytes, top, pieces);
+    }
+};
+
+}
+
+bool ClusterFile::Write(const Scene& scene, const std::filesystem::path& path, std::string& error, uint32_t clusterBytes)
+{
+    TRACE_SCOPE("ClusterFile::Write");
+    clusterBytes = static_cast<uint32_t>(alignToPage(std::max(clusterBytes, pageBytes)));
+
+    Partition spheres(scene.bvh.nodes, Cluster::Spheres, sizeof(Sphere));
+    Partition triangles(scene.triangleBvh.nodes, Cluster::Triangles, sizeof(Triangle) + sizeof(TriangleShading));
+    std::vector<BVHNode> sphereTop, triangleTop;
+    std::vector<Partition::Piece> pieces;
+    spheres.cut(clusterBytes, sphereTop, pieces);
+    triangles.cut(clusterBytes, triangleTop, pieces);
+
+    FileHeader header = {};
+    header.magic = fileMagic;
+    header.version = fileVersion;
+    header.clusterBytes = clusterBytes;
+    header.clusterCount = static_cast<uint32_t>(pieces.size());
+    header.sphereTopCount = static_cast<uint32_t>(sphereTop.size());
+    header.triangleTopCount = static_cast<uint32_t>(triangleTop.size());
+    header.materialCount = static_cast<uint32_t>(scene.materials.size());
+    header.nodeStride = sizeof(BVHNode);
+    header.sphereStride = sizeof(Sphere);
+    header.triangleStride = sizeof(Triangle);
+    header.shadingStride = sizeof(TriangleShading);
+    header.entryStride = sizeof(Entry);
+    header.textureSize = static_cast<uint32_t>(scene.textures.size);
+    header.textureLayers = static_cast<uint32_t>(scene.textures.layers);
+
+    // Every size is known up front, so the table goes before the clusters
+    std::vector<Entry> table(pieces.size());
+    uint64_t offset = alignToPage(sizeof(FileHeader) + table.size() * sizeof(Entry)
+        + (sphereTop.size() + triangleTop.size()) * sizeof(BVHNode) + scene.materials.size() * sizeof(Material)
+        + scene.textures.bytes());
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const Partition& partition = pieces[i].kind == Cluster::Spheres ? spheres : triangles;
+        table[i].offset = offset;
+        table[i].kind = pieces[i].kind;
+        table[i].nodeCount = partition.nodeCount(pieces[i].root);
+        table[i].primitiveCount = partition.primitiveCount(pieces[i].root);
+        table[i].bytes = static_cast<uint32_t>(partition.bytes(pieces[i].root));
+        offset = alignToPage(offset + table[i].bytes);
+    }
+    header.fileBytes = offset;
+
+    // Written under a temporary name first, as compiled scenes are
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            error = "cannot write " + temporary.string();
+            return false;
+        }
+        auto write = [&](const void* data, size_t bytes) { out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes)); };
+        const char padding[pageBytes] = {};
+        auto pad = [&](uint64_t to) { write(padding, static_cast<size_t>(to - static_cast<uint64_t>(out.tellp()))); };
+
+        write(&header, sizeof(header));
+        write(table.data(), table.size() * sizeof(Entry));
+        write(sphereTop.data(), sphereTop.size() * sizeof(BVHNode));
+        write(triangleTop.data(), triangleTop.size() * sizeof(BVHNode));
+        write(scene.materials.data(), scene.materials.size() * sizeof(Material));
+        write(scene.textures.texels.data(), scene.textures.bytes());
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            pad(table[i].offset);
+            const Partition& partition = pieces[i].kind == Cluster::Spheres ? spheres : triangles;
+            std::vector<BVHNode> local = partition.localNodes(pieces[i].root);
+            uint32_t first = partition.firstPrimitive(pieces[i].root);
+            uint32_t count = table[i].primitiveCount;
+            write(local.data(), local.size() * sizeof(BVHNode));
+            if (pieces[i].kind == Cluster::Spheres) {
+                write(&scene.spheres[first], count * sizeof(Sphere));
+            }
+            else {
+                write(&scene.triangles[first], count * sizeof(Triangle));
+                write(&scene.shading[first], count * sizeof(TriangleShading));
+            }
+        }
+        pad(header.fileBytes);
+        if (!out) {
+            error = "cannot write " + temporary.string();
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        error = "cannot write " + path.string() + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool ClusterFile::open(const std::filesystem::path& path, std::string& error)
+{
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.close();
+    file.clear();
+    file.open(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    FileHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || ec || header.magic != fileMagic || header.version != fileVersion || header.fileBytes != size
+        || header.nodeStride != sizeof(BVHNode) || header.sphereStride != sizeof(Sphere) || header.triangleStride != sizeof(Triangle)
+        || header.shadingStride != sizeof(TriangleShading) || header.entryStride != sizeof(Entry)
+        || header.textureSize > 16384 || static_cast<uint64_t>(header.textureSize) * header.textureSize * header.textureLayers * 4 > size) {
+        error = path.string() + ": not a cluster file of this version";
+        file.close();
+        return false;
+    }
+
+    entries.resize(header.clusterCount);
+    sphereTop.resize(header.sphereTopCount);
+    triangleTop.resize(header.triangleTopCount);
+    materials.resize(header.materialCount);
+    file.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+    file.read(reinterpret_cast<char*>(sphereTop.data()), static_cast<std::streamsize>(sphereTop.size() * sizeof(BVHNode)));
+    file.read(reinterpret_cast<char*>(triangleTop.data()), static_cast<std::streamsize>(triangleTop.size() * sizeof(BVHNode)));
+    file.read(reinterpret_cast<char*>(materials.data()), static_cast<std::streamsize>(materials.size() * sizeof(Material)));
+    std::vector<uint32_t> texels(static_cast<size_t>(header.textureSize) * header.textureSize * header.textureLayers);
+    file.read(reinterpret_cast<char*>(texels.data()), static_cast<std::streamsize>(texels.size() * sizeof(uint32_t)));
+    textures.assign(static_cast<int>(header.textureSize), texels.data(), texels.size());
+
+    bool valid = static_cast<bool>(file);
+    totalBytes = 0;
+    for (const Entry& entry : entries) {
+        uint64_t stride = entry.kind == Cluster::Spheres ? sizeof(Sphere) : sizeof(Triangle) + sizeof(TriangleShading);
+        valid = valid && entry.kind <= Cluster::Triangles && entry.bytes <= header.clusterBytes && entry.offset <= size
+            && entry.bytes <= size - entry.offset && entry.bytes == entry.nodeCount * sizeof(BVHNode) + entry.primitiveCount * stride;
+        totalBytes += entry.bytes;
+    }
+    if (!valid) {
+        error = path.string() + ": truncated or corrupt";
+        file.close();
+        return false;
+    }
+    maxClusterBytes = header.clusterBytes;
+    return true;
+}
+
+bool ClusterFile::read(uint32_t index, Cluster& cluster) const
+{
+    TRACE_SCOPE("ClusterFile::read");
+    if (index >= entries.size())
+        return false;
+    const Entry& entry = entries[index];
+    cluster.index = index;
+    cluster.kind = static_cast<Cluster::Kind>(entry.kind);
+    cluster.nodeCount = entry.nodeCount;
+    cluster.primitiveCount = entry.primitiveCount;
+    cluster.data.resize(entry.bytes);
+
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(entry.offset));
+    file.read(reinterpret_cast<char*>(cluster.data.data()), static_cast<std::streamsize>(entry.bytes));
+    return static_cast<bool>(file);
+}
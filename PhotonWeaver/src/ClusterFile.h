@@ -0,0 +1,82 @@
+#ifndef CLUSTER_FILE_H
+#define CLUSTER_FILE_H
+
+#include "pch.h"
+#include "Scene.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// A BVH subtree with its primitives, laid out as stored on disk: local nodes
+// (children and leaf ranges relative to the cluster), then spheres, or
+// triangles followed by their shading records.
+struct Cluster {
+	enum Kind : uint32_t { Spheres = 0, Triangles = 1 };
+
+	uint32_t index = 0;
+	Kind kind = Spheres;
+	uint32_t nodeCount = 0;
+	uint32_t primitiveCount = 0;
+	std::vector<unsigned char> data;
+
+	const BVHNode* nodes() const { return reinterpret_cast<const BVHNode*>(data.data()); }
+	const Sphere* spheres() const { return reinterpret_cast<const Sphere*>(data.data() + nodeCount * sizeof(BVHNode)); }
+	const Triangle* triangles() const { return reinterpret_cast<const Triangle*>(data.data() + nodeCount * sizeof(BVHNode)); }
+	const TriangleShading* shading() const { return reinterpret_cast<const TriangleShading*>(triangles() + primitiveCount); }
+};
+
+// Out-of-core scene for the CPU tracer. Write() cuts both hierarchies into
+// subtrees that fit a cluster size (a multiple of the page size) and stores
+// each with its primitives at a page-aligned offset. What stays resident
+// after open() is small: the materials, the texture array and a top-level
+// tree per primitive type whose leaves refer to clusters instead of
+// primitives. Clusters are read on demand through a ClusterCache.
+//
+// Building the file needs the whole scene in memory once; rendering from it
+// only needs the top-level trees and the cache budget.
+class ClusterFile
+{
+public:
+	// In the top-level trees a leaf with count < 0 is cluster -(count + 1)
+	std::vector<BVHNode> sphereTop;
+	std::vector<BVHNode> triangleTop;
+	std::vector<Material> materials;
+	// Kept whole; TextureCache tiles and mips it on demand
+	TextureArray textures;
+
+	ClusterFile() = default;
+	ClusterFile(const ClusterFile&) = delete;
+	ClusterFile& operator=(const ClusterFile&) = delete;
+
+	// The scene must have its BVHs built. clusterBytes is rounded up to whole pages.
+	static bool Write(const Scene& scene, const std::filesystem::path& path, std::string& error, uint32_t clusterBytes = 64 * 1024);
+
+	bool open(const std::filesystem::path& path, std::string& error);
+
+	size_t clusterCount() const { return entries.size(); }
+	uint32_t clusterBytes() const { return maxClusterBytes; }
+	// Sum of all clusters' payloads, i.e. what a cache holding everything would use
+	uint64_t geometryBytes() const { return totalBytes; }
+	const std::vector<BVHNode>& top(Cluster::Kind kind) const { return kind == Cluster::Spheres ? sphereTop : triangleTop; }
+
+	// Reads one cluster from disk. Safe to call from several threads; the reads are serialised.
+	bool read(uint32_t index, Cluster& cluster) const;
+
+private:
+	struct Entry {
+		uint64_t offset;
+		uint32_t kind;
+		uint32_t nodeCount;
+		uint32_t primitiveCount;
+		uint32_t bytes;
+	};
+
+	std::vector<Entry> entries;
+	uint32_t maxClusterBytes = 0;
+	uint64_t totalBytes = 0;
+	mutable std::ifstream file;
+	mutable std::mutex fileMutex;
+};
+
+#endif // CLUSTER_FILE_H
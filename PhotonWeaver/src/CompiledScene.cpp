@@ -0,0 +1,298 @@
+#include "CompiledScene.h"
+#include "SceneFile.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const uint32_t blobMagic = 0x42535750; // "PWSB"
+// Bump whenever the header or a section layout changes
+const uint32_t blobVersion = 4;
+const uint64_t sectionAlignment = 64;
+
+enum Section {
+    NameSection,
+    SphereSection,
+    SphereNodeSection,
+    MaterialSection,
+    TriangleSection,
+    ShadingSection,
+    TriangleNodeSection,
+    // The texture array's layers, one after another
+    TexelSection,
+    // Absolute paths of the scene file and its meshes, each NUL terminated
+    DependencySection,
+    SectionCount
+};
+
+struct SectionEntry {
+    uint64_t offset;
+    uint64_t count;
+    // Bytes per element; catches a build with a different struct layout
+    uint32_t stride;
+    uint32_t reserved;
+};
+
+// Native endianness and struct layout
+struct BlobHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t stamp;
+    uint64_t fileBytes;
+    int32_t bvhDepth;
+    int32_t triangleBvhDepth;
+    int32_t textureSize;
+    float fov;
+    float position[3];
+    float target[3];
+    float up[3];
+    SectionEntry sections[SectionCount];
+    uint32_t reserved[22];
+};
+static_assert(sizeof(BlobHeader) == 384, "BlobHeader must stay a multiple of the section alignment");
+
+const uint32_t sectionStrides[SectionCount] = {
+    1, sizeof(Sphere), sizeof(BVHNode), sizeof(Material), sizeof(Triangle), sizeof(TriangleShading), sizeof(BVHNode),
+    sizeof(uint32_t), 1
+};
+
+uint64_t align(uint64_t offset)
+{
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+// 64-bit FNV-1a, as in ShaderCache
+uint64_t hashBytes(uint64_t hash, const void* data, size_t bytes)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Changes whenever one of the files changes size or modification time, or the format changes
+bool sourceStamp(const std::vector<std::filesystem::path>& files, uint64_t& stamp)
+{
+    stamp = hashBytes(14695981039346656037ull, &blobVersion, sizeof(blobVersion));
+    for (const std::filesystem::path& file : files) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(file, ec);
+        if (ec)
+            return false;
+        int64_t modified = static_cast<int64_t>(std::filesystem::last_write_time(file, ec).time_since_epoch().count());
+        if (ec)
+            return false;
+        std::string name = std::filesystem::absolute(file).string();
+        stamp = hashBytes(stamp, name.data(), name.size());
+        stamp = hashBytes(stamp, &size, sizeof(size));
+        stamp = hashBytes(stamp, &modified, sizeof(modified));
+    }
+    return true;
+}
+
+bool sectionFits(const SectionEntry& section, uint32_t stride, uint64_t fileBytes)
+{
+    return section.stride == stride && section.offset % sectionAlignment == 0 && section.offset <= fileBytes
+        && section.count <= (fileBytes - section.offset) / stride;
+}
+
+std::vector<std::filesystem::path> splitPaths(const char* data, size_t bytes)
+{
+    std::vector<std::filesystem::path> paths;
+    for (size_t begin = 0, end; begin < bytes; begin = end + 1) {
+        end = begin;
+        while (end < bytes && data[end])
+            ++end;
+        paths.emplace_back(std::string(data + begin, end - begin));
+    }
+    return paths;
+}
+
+}
+
+bool CompiledScene::load(const std::filesystem::path& sceneFile, std::string& error)
+{
+    TRACE_SCOPE("CompiledScene::load");
+    auto start = std::chrono::steady_clock::now();
+
+    std::filesystem::path path = blobPath(sceneFile);
+    cached = open(path);
+    if (!cached) {
+        Scene scene;
+        std::vector<std::filesystem::path> dependencies;
+        if (!SceneFile::Load(sceneFile, scene, error, &dependencies))
+            return false;
+        scene.buildBVH();
+
+        uint64_t stamp = 0;
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDirectory, ec);
+        if (!sourceStamp(dependencies, stamp) || !Write(scene, dependencies, stamp, path) || !open(path)) {
+            std::cerr << "WARNING::COMPILED_SCENE::NOT_CACHED: " << path.string() << std::endl;
+            fallback = std::move(scene);
+            sceneName = fallback.name;
+            sceneCamera = fallback.camera;
+            view = fallback.geometry();
+        }
+    }
+
+    elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool CompiledScene::open(const std::filesystem::path& path)
+{
+    if (!blob.open(path))
+        return false;
+
+    BlobHeader header;
+    bool valid = blob.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, blob.data(), sizeof(header));
+        valid = header.magic == blobMagic && header.version == blobVersion && header.fileBytes == blob.size();
+        for (int i = 0; valid && i < SectionCount; ++i)
+            valid = sectionFits(header.sections[i], sectionStrides[i], blob.size());
+        valid = valid && header.sections[ShadingSection].count == header.sections[TriangleSection].count;
+        valid = valid && header.textureSize >= 0 && header.textureSize <= 16384
+            && (header.textureSize == 0 ? header.sections[TexelSection].count == 0
+                : header.sections[TexelSection].count % (static_cast<uint64_t>(header.textureSize) * header.textureSize) == 0);
+    }
+    // The blob lists the files it was compiled from; any of them changing makes it stale
+    uint64_t stamp = 0;
+    if (valid) {
+        const SectionEntry& dependencies = header.sections[DependencySection];
+        valid = sourceStamp(splitPaths(reinterpret_cast<const char*>(blob.data() + dependencies.offset), dependencies.count), stamp)
+            && header.stamp == stamp;
+    }
+    if (!valid) {
+        blob.close();
+        return false;
+    }
+
+    const SectionEntry& name = header.sections[NameSection];
+    sceneName.assign(reinterpret_cast<const char*>(blob.data() + name.offset), name.count);
+    sceneCamera.position = glm::vec3(header.position[0], header.position[1], header.position[2]);
+    sceneCamera.target = glm::vec3(header.target[0], header.target[1], header.target[2]);
+    sceneCamera.up = glm::vec3(header.up[0], header.up[1], header.up[2]);
+    sceneCamera.fov = header.fov;
+
+    // The mapping is page aligned, so the aligned sections are too
+    auto section = [&](Section index) { return blob.data() + header.sections[index].offset; };
+    view.spheres = reinterpret_cast<const Sphere*>(section(SphereSection));
+    view.sphereCount = static_cast<size_t>(header.sections[SphereSection].count);
+    view.nodes = reinterpret_cast<const BVHNode*>(section(SphereNodeSection));
+    view.nodeCount = static_cast<size_t>(header.sections[SphereNodeSection].count);
+    view.bvhDepth = header.bvhDepth;
+    view.materials = reinterpret_cast<const Material*>(section(MaterialSection));
+    view.materialCount = static_cast<size_t>(header.sections[MaterialSection].count);
+    view.triangles = reinterpret_cast<const Triangle*>(section(TriangleSection));
+    view.shading = reinterpret_cast<const TriangleShading*>(section(ShadingSection));
+    view.triangleCount = static_cast<size_t>(header.sections[TriangleSection].count);
+    view.triangleNodes = reinterpret_cast<const BVHNode*>(section(TriangleNodeSection));
+    view.triangleNodeCount = static_cast<size_t>(header.sections[TriangleNodeSection].count);
+    view.triangleBvhDepth = header.triangleBvhDepth;
+    view.texels = reinterpret_cast<const uint32_t*>(section(TexelSection));
+    view.textureSize = header.textureSize;
+    uint64_t layerTexels = static_cast<uint64_t>(header.textureSize) * header.textureSize;
+    view.textureLayers = layerTexels ? static_cast<int>(header.sections[TexelSection].count / layerTexels) : 0;
+    fallback = Scene();
+    return true;
+}
+
+bool CompiledScene::Write(const Scene& scene, const std::vector<std::filesystem::path>& dependencies, uint64_t stamp,
+    const std::filesystem::path& path)
+{
+    TRACE_SCOPE("CompiledScene::Write");
+
+    std::string dependencyList;
+    for (const std::filesystem::path& dependency : dependencies) {
+        dependencyList += std::filesystem::absolute(dependency).string();
+        dependencyList += '\0';
+    }
+
+    const void* data[SectionCount] = {
+        scene.name.data(), scene.spheres.data(), scene.bvh.nodes.data(), scene.materials.data(),
+        scene.triangles.data(), scene.shading.data(), scene.triangleBvh.nodes.data(),
+        scene.textures.texels.data(), dependencyList.data()
+    };
+    const uint64_t counts[SectionCount] = {
+        scene.name.size(), scene.spheres.size(), scene.bvh.nodes.size(), scene.materials.size(),
+        scene.triangles.size(), scene.shading.size(), scene.triangleBvh.nodes.size(),
+        scene.textures.texels.size(), dependencyList.size()
+    };
+
+    BlobHeader header = {};
+    header.magic = blobMagic;
+    header.version = blobVersion;
+    header.stamp = stamp;
+    uint64_t offset = sizeof(BlobHeader);
+    for (int i = 0; i < SectionCount; ++i) {
+        header.sections[i].offset = align(offset);
+        header.sections[i].count = counts[i];
+        header.sections[i].stride = sectionStrides[i];
+        offset = header.sections[i].offset + counts[i] * sectionStrides[i];
+    }
+    header.fileBytes = offset;
+    header.bvhDepth = scene.bvh.depth;
+    header.triangleBvhDepth = scene.triangleBvh.depth;
+    header.textureSize = scene.textures.size;
+    header.fov = scene.camera.fov;
+    for (int i = 0; i < 3; ++i) {
+        header.position[i] = scene.camera.position[i];
+        header.target[i] = scene.camera.target[i];
+        header.up[i] = scene.camera.up[i];
+    }
+
+    // Write to a temporary name first so a crash never leaves a truncated blob behind
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        const char padding[sectionAlignment] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (int i = 0; i < SectionCount; ++i) {
+            file.write(padding, static_cast<std::streamsize>(header.sections[i].offset - static_cast<uint64_t>(file.tellp())));
+            file.write(static_cast<const char*>(data[i]), static_cast<std::streamsize>(counts[i] * sectionStrides[i]));
+        }
+        if (!file)
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    return !ec;
+}
+
+Scene CompiledScene::toScene() const
+{
+    Scene scene;
+    scene.name = sceneName;
+    scene.camera = sceneCamera;
+    scene.spheres.assign(view.spheres, view.spheres + view.sphereCount);
+    scene.bvh.nodes.assign(view.nodes, view.nodes + view.nodeCount);
+    scene.bvh.depth = view.bvhDepth;
+    scene.materials.assign(view.materials, view.materials + view.materialCount);
+    scene.triangles.assign(view.triangles, view.triangles + view.triangleCount);
+    scene.shading.assign(view.shading, view.shading + view.triangleCount);
+    scene.triangleBvh.nodes.assign(view.triangleNodes, view.triangleNodes + view.triangleNodeCount);
+    scene.triangleBvh.depth = view.triangleBvhDepth;
+    scene.textures.assign(view.textureSize, view.texels, static_cast<size_t>(view.textureLayers) * view.textureSize * view.textureSize);
+    return scene;
+}
+
+std::filesystem::path CompiledScene::blobPath(const std::filesystem::path& sceneFile) const
+{
+    // The stem keeps the cache browsable; the path hash keeps same-named scenes apart
+    std::string absolute = std::filesystem::absolute(sceneFile).string();
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "-%016llx.pwscene",
+        static_cast<unsigned long long>(hashBytes(14695981039346656037ull, absolute.data(), absolute.size())));
+    return cacheDirectory / (sceneFile.stem().string() + suffix);
+}
@@ -0,0 +1,61 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include "pch.h"
+#include "MappedFile.h"
+#include "Scene.h"
+
+#include <cstdint>
+#include <vector>
+
+// A scene file compiled into one versioned binary blob: a fixed header with
+// a section table, then the name, the spheres, materials, triangles and
+// their shading records, both prebuilt hierarchies and the texture array
+// exactly as the renderer uploads them, each section 64-byte aligned. Blobs live in the cache
+// directory keyed by the scene file's path. They list the files the scene
+// came from (the scene file, its meshes and textures) and are stamped with their
+// sizes and modification times.
+//
+// load() memory maps a current blob and points geometry() straight into it,
+// so a cached scene needs no parsing, no BVH build and no copy before upload.
+// A missing or stale blob is compiled from the scene file first.
+class CompiledScene
+{
+public:
+	std::filesystem::path cacheDirectory = std::filesystem::current_path() / "scenecache";
+
+	// Returns false and fills error when the scene file cannot be loaded
+	bool load(const std::filesystem::path& sceneFile, std::string& error);
+
+	// Writes the blob for a scene that has its BVHs built
+	static bool Write(const Scene& scene, const std::vector<std::filesystem::path>& dependencies, uint64_t stamp,
+		const std::filesystem::path& path);
+
+	const std::string& name() const { return sceneName; }
+	const SceneCamera& camera() const { return sceneCamera; }
+	SceneGeometry geometry() const { return view; }
+
+	// Copies the geometry into an editable scene, e.g. for the CPU tracer
+	Scene toScene() const;
+
+	// Whether the last load() used an existing blob, and how long it took
+	bool fromCache() const { return cached; }
+	double loadMs() const { return elapsedMs; }
+	size_t blobBytes() const { return blob.size(); }
+
+private:
+	MappedFile blob;
+	// Holds the geometry instead when the blob could not be written
+	Scene fallback;
+	std::string sceneName;
+	SceneCamera sceneCamera;
+	SceneGeometry view;
+	bool cached = false;
+	double elapsedMs = 0.0;
+
+	// Maps the blob if it is valid and none of the files it lists have changed
+	bool open(const std::filesystem::path& path);
+	std::filesystem::path blobPath(const std::filesystem::path& sceneFile) const;
+};
+
+#endif // COMPILED_SCENE_H
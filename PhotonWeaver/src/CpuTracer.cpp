@@ -0,0 +1,1027 @@
+#include "CpuTracer.h"
+#include "Packing.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace {
+
+const float pi = 3.14159265359f;
+const int tileSize = 32;
+const int stackSize = 64;
+// R2 sequence steps, 1/g and 1/g^2 for the plastic number g
+const glm::vec2 r2Alpha(0.7548776662f, 0.5698402910f);
+
+uint32_t pcgHash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// First RNG state of a pixel. Frames of a stream cover consecutive ranges
+// of pixel indices; another stream flips the high bits of those, so its
+// states stay apart from stream 0's while the ranges stay below 2^31.
+uint32_t pixelSeed(uint32_t index, uint32_t frameIndex, uint32_t pixelCount, uint32_t stream)
+{
+    uint32_t seed = index + frameIndex * pixelCount;
+    return pcgHash(stream ? seed ^ pcgHash(stream) : seed);
+}
+
+float randomFloat(uint32_t& state)
+{
+    state = pcgHash(state);
+    return state / 4294967296.0f;
+}
+
+glm::vec3 randomUnitVector(uint32_t& state)
+{
+    float z = randomFloat(state) * 2.0f - 1.0f;
+    float phi = 2.0f * pi * randomFloat(state);
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+glm::vec3 randomOnHemisphere(const glm::vec3& normal, uint32_t& state)
+{
+    glm::vec3 direction = randomUnitVector(state);
+    return glm::dot(direction, normal) > 0.0f ? direction : -direction;
+}
+
+// Sampling of each material type, as the scatter functions in the shader:
+// Sample() picks the direction leaving a surface with normal n (facing back
+// at the incoming direction d) and returns the throughput weight, or false
+// when the path is absorbed. Specialised per type, so a caller that knows the
+// type calls straight into the right one.
+template <Material::Type Type>
+struct Bsdf;
+
+template <>
+struct Bsdf<Material::Lambertian> {
+    static bool Sample(const Material&, const glm::vec3& albedo, const glm::vec3&, const glm::vec3& n, bool, uint32_t& rng,
+        glm::vec3& direction, glm::vec3& weight)
+    {
+        // Cosine-weighted, so the weight is just the albedo
+        glm::vec3 s = n + randomUnitVector(rng);
+        direction = glm::dot(s, s) > 1e-8f ? glm::normalize(s) : n;
+        weight = albedo;
+        return true;
+    }
+
+    // Added to a ray cone's spread angle by a bounce, as in the shader: about a radian
+    static float Spread(const Material&) { return 1.0f; }
+};
+
+template <>
+struct Bsdf<Material::Metal> {
+    static float SmithG1(float cosTheta, float alpha2)
+    {
+        return 2.0f * cosTheta / (cosTheta + std::sqrt(alpha2 + (1.0f - alpha2) * cosTheta * cosTheta));
+    }
+
+    // GGX half vector sampled from the distribution, Schlick Fresnel with F0 = albedo
+    static bool Sample(const Material& material, const glm::vec3& albedo, const glm::vec3& d, const glm::vec3& n, bool, uint32_t& rng,
+        glm::vec3& direction, glm::vec3& weight)
+    {
+        float alpha = std::max(material.roughness * material.roughness, 1e-4f);
+        float alpha2 = alpha * alpha;
+        float u1 = randomFloat(rng);
+        float u2 = randomFloat(rng);
+        float phi = 2.0f * pi * u1;
+        float cosTheta = std::sqrt((1.0f - u2) / (1.0f + (alpha2 - 1.0f) * u2));
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        glm::vec3 t = glm::normalize(glm::cross(std::abs(n.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), n));
+        glm::vec3 b = glm::cross(n, t);
+        glm::vec3 h = glm::normalize(t * (sinTheta * std::cos(phi)) + b * (sinTheta * std::sin(phi)) + n * cosTheta);
+
+        direction = glm::reflect(d, h);
+        weight = glm::vec3(0.0f);
+        float nDotL = glm::dot(n, direction);
+        if (nDotL <= 0.0f)
+            return false;
+        float nDotV = std::max(glm::dot(n, -d), 1e-4f);
+        float vDotH = std::max(glm::dot(-d, h), 1e-4f);
+        float nDotH = std::max(glm::dot(n, h), 1e-4f);
+        glm::vec3 fresnel = albedo + (1.0f - albedo) * std::pow(1.0f - vDotH, 5.0f);
+        weight = fresnel * (SmithG1(nDotV, alpha2) * SmithG1(nDotL, alpha2) * vDotH / (nDotH * nDotV));
+        return true;
+    }
+
+    static float Spread(const Material& material) { return material.roughness * material.roughness; }
+};
+
+template <>
+struct Bsdf<Material::Dielectric> {
+    static bool Sample(const Material& material, const glm::vec3& albedo, const glm::vec3& d, const glm::vec3& n, bool frontFace, uint32_t& rng,
+        glm::vec3& direction, glm::vec3& weight)
+    {
+        float eta = frontFace ? 1.0f / material.ior : material.ior;
+        float cosI = std::min(glm::dot(-d, n), 1.0f);
+        float sinT2 = eta * eta * (1.0f - cosI * cosI);
+        float r0 = (1.0f - eta) / (1.0f + eta);
+        r0 *= r0;
+        float fresnel = r0 + (1.0f - r0) * std::pow(1.0f - cosI, 5.0f);
+        if (sinT2 > 1.0f || randomFloat(rng) < fresnel)
+            direction = glm::reflect(d, n);
+        else
+            direction = glm::refract(d, n, eta);
+        weight = albedo;
+        return true;
+    }
+
+    // Smooth: the cone passes through unchanged
+    static float Spread(const Material&) { return 0.0f; }
+};
+
+glm::vec3 heatmap(float t)
+{
+    t = glm::clamp(t, 0.0f, 1.0f);
+    return glm::clamp(glm::vec3(1.5f) - glm::abs(4.0f * t - glm::vec3(3.0f, 2.0f, 1.0f)), 0.0f, 1.0f);
+}
+
+glm::vec3 background(const glm::vec3& direction)
+{
+    float t = 0.5f * (glm::normalize(direction).y + 1.0f);
+    return glm::mix(glm::vec3(1.0f), glm::vec3(0.5f, 0.7f, 1.0f), t);
+}
+
+glm::vec3 getRayDirection(glm::vec2 uv, const SceneCamera& camera, float aspectRatio)
+{
+    glm::vec3 w = camera.direction();
+    glm::vec3 u = glm::normalize(glm::cross(camera.up, w));
+    glm::vec3 v = glm::cross(w, u);
+
+    float tanFov = std::tan(glm::radians(camera.fov / 2.0f));
+    uv = uv * 2.0f - 1.0f;
+    uv.x *= aspectRatio * tanFov;
+    uv.y *= tanFov;
+
+    return glm::normalize(u * uv.x + v * uv.y + w);
+}
+
+bool intersectSphere(const glm::vec3& ro, const glm::vec3& rd, const Sphere& sphere, float& t)
+{
+    glm::vec3 oc = ro - sphere.center;
+    float a = glm::dot(rd, rd);
+    float b = 2.0f * glm::dot(oc, rd);
+    float c = glm::dot(oc, oc) - sphere.radius * sphere.radius;
+    float discriminant = b * b - 4 * a * c;
+
+    if (discriminant > 0.0f) {
+        float discSqrt = std::sqrt(discriminant);
+        float t0 = (-b - discSqrt) / (2.0f * a);
+        float t1 = (-b + discSqrt) / (2.0f * a);
+
+        if (t0 > 0.0f && t0 < t1) {
+            t = t0;
+            return true;
+        }
+        else if (t1 > 0.0f) {
+            t = t1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Per-ray constants of the watertight triangle test, as RayShear in the shader
+struct RayShear {
+    int kx, ky, kz;
+    glm::vec3 s;
+};
+
+RayShear rayShear(const glm::vec3& dir)
+{
+    RayShear shear;
+    glm::vec3 a = glm::abs(dir);
+    shear.kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    shear.kx = shear.kz == 2 ? 0 : shear.kz + 1;
+    shear.ky = shear.kx == 2 ? 0 : shear.kx + 1;
+    if (dir[shear.kz] < 0.0f)
+        std::swap(shear.kx, shear.ky);
+    shear.s = glm::vec3(dir[shear.kx] / dir[shear.kz], dir[shear.ky] / dir[shear.kz], 1.0f / dir[shear.kz]);
+    return shear;
+}
+
+// Same arithmetic in the same order as the shader, so both backends agree on
+// which triangle a ray through a shared edge hits
+bool intersectTriangle(const glm::vec3& origin, const RayShear& shear, const Triangle& triangle, float& t, glm::vec3& bary)
+{
+    glm::vec3 a = triangle.v0 - origin;
+    glm::vec3 b = triangle.v1 - origin;
+    glm::vec3 c = triangle.v2 - origin;
+    float ax = a[shear.kx] - shear.s.x * a[shear.kz];
+    float ay = a[shear.ky] - shear.s.y * a[shear.kz];
+    float bx = b[shear.kx] - shear.s.x * b[shear.kz];
+    float by = b[shear.ky] - shear.s.y * b[shear.kz];
+    float cx = c[shear.kx] - shear.s.x * c[shear.kz];
+    float cy = c[shear.ky] - shear.s.y * c[shear.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+    float det = u + v + w;
+    if (det == 0.0f)
+        return false;
+
+    float tScaled = u * (shear.s.z * a[shear.kz]) + v * (shear.s.z * b[shear.kz]) + w * (shear.s.z * c[shear.kz]);
+    t = tScaled / det;
+    bary = glm::vec3(u, v, w) / det;
+    return t > 0.0f;
+}
+
+// Entry distance into the node's box, or a huge value when it is missed
+float intersectBounds(const BVHNode& node, const glm::vec3& origin, const glm::vec3& invDir, float closest)
+{
+    glm::vec3 t1 = (node.min - origin) * invDir;
+    glm::vec3 t2 = (node.max - origin) * invDir;
+    glm::vec3 near = glm::min(t1, t2);
+    glm::vec3 far = glm::max(t1, t2);
+    float tmin = std::max(std::max(near.x, near.y), near.z);
+    float tmax = std::min(std::min(far.x, far.y), far.z);
+    return tmax >= std::max(tmin, 0.0f) && tmin < closest ? tmin : 1e30f;
+}
+
+// Shading normal of a triangle hit, facing back at the ray; uv gets the
+// interpolated UVs, or the barycentrics when the mesh had none, and frontFace
+// whether the ray came from the side the winding makes the outside
+glm::vec3 triangleNormal(const Triangle& triangle, const TriangleShading& shading, const glm::vec3& bary, const glm::vec3& direction,
+    glm::vec2& uv, bool& frontFace)
+{
+    // Triangles are two-sided: face the normal back at the ray
+    glm::vec3 normal = glm::normalize(glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0));
+    frontFace = glm::dot(normal, direction) <= 0.0f;
+    if (!frontFace)
+        normal = -normal;
+    if (shading.flags & TriangleShading::HasUVs)
+        uv = bary.x * Packing::DecodeHalf2(shading.uvs[0]) + bary.y * Packing::DecodeHalf2(shading.uvs[1]) + bary.z * Packing::DecodeHalf2(shading.uvs[2]);
+    else
+        uv = glm::vec2(bary.y, bary.z);
+    if (!(shading.flags & TriangleShading::HasNormals))
+        return normal;
+    glm::vec3 shadingNormal = glm::normalize(bary.x * Packing::DecodeOctahedral(shading.normals[0])
+        + bary.y * Packing::DecodeOctahedral(shading.normals[1]) + bary.z * Packing::DecodeOctahedral(shading.normals[2]));
+    return glm::dot(shadingNormal, normal) < 0.0f ? -shadingNormal : shadingNormal;
+}
+
+// Constant over a triangle: half log2 of its UV area against its world area.
+// Barycentrics span a UV area of 1.
+float triangleLodBias(const Triangle& triangle, const TriangleShading& shading)
+{
+    float uvArea = 1.0f;
+    if (shading.flags & TriangleShading::HasUVs) {
+        glm::vec2 t0 = Packing::DecodeHalf2(shading.uvs[0]);
+        glm::vec2 e1 = Packing::DecodeHalf2(shading.uvs[1]) - t0;
+        glm::vec2 e2 = Packing::DecodeHalf2(shading.uvs[2]) - t0;
+        uvArea = std::abs(e1.x * e2.y - e1.y * e2.x);
+    }
+    float worldArea = glm::length(glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0));
+    return 0.5f * std::log2(std::max(uvArea, 1e-20f) / std::max(worldArea, 1e-20f));
+}
+
+// Longitude and latitude of a sphere hit; the whole UV square covers 4 pi r^2
+void sphereSurface(const glm::vec3& outward, float radius, glm::vec2& uv, float& lodBias)
+{
+    uv = glm::vec2(std::atan2(outward.z, outward.x) / (2.0f * pi) + 0.5f, std::asin(glm::clamp(outward.y, -1.0f, 1.0f)) / pi + 0.5f);
+    lodBias = 0.5f * std::log2(1.0f / (4.0f * pi * radius * radius));
+}
+
+// Angle one pixel subtends at the camera, the spread of a primary ray cone
+float pixelSpread(const SceneCamera& camera, int height)
+{
+    return std::atan(2.0f * std::tan(glm::radians(camera.fov) * 0.5f) / static_cast<float>(height));
+}
+
+// Walks one hierarchy, tightening closest, and returns the nearest primitive
+// hit or -1. intersect(i, t) tests primitive i, as the leaf loop in the shader.
+template <typename Intersect>
+int traverse(const BVHNode* nodes, const glm::vec3& origin, const glm::vec3& invDir, float& closest, glm::uvec4& counters, Intersect intersect)
+{
+    int hitIndex = -1;
+    int stack[stackSize];
+    int sp = 0;
+    counters.x++;
+    int node = intersectBounds(nodes[0], origin, invDir, closest) < 1e30f ? 0 : -1;
+    while (node >= 0) {
+        const BVHNode& current = nodes[node];
+        if (current.count > 0) {
+            counters.y += current.count;
+            for (int i = current.leftFirst; i < current.leftFirst + current.count; ++i) {
+                float t;
+                if (intersect(i, t) && t < closest) {
+                    closest = t;
+                    hitIndex = i;
+                }
+            }
+        }
+        else {
+            // Visit the nearer child first so the far one is often culled
+            int nearChild = current.leftFirst;
+            int farChild = current.leftFirst + 1;
+            counters.x += 2;
+            float nearDist = intersectBounds(nodes[nearChild], origin, invDir, closest);
+            float farDist = intersectBounds(nodes[farChild], origin, invDir, closest);
+            if (nearDist > farDist) {
+                std::swap(nearChild, farChild);
+                std::swap(nearDist, farDist);
+            }
+            if (nearDist < 1e30f) {
+                if (farDist < 1e30f && sp < stackSize)
+                    stack[sp++] = farChild;
+                node = nearChild;
+                continue;
+            }
+        }
+        node = sp > 0 ? stack[--sp] : -1;
+    }
+    return hitIndex;
+}
+
+const int topStackSize = 64;
+
+// One ray of the streamed renderer: its place in the top-level trees and a
+// copy of the closest primitive so far, which stays valid after the cluster
+// it came from is evicted
+struct StreamedRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 invDir;
+    RayShear shear;
+    float closest;
+    // Top-level tree being walked (Cluster::Spheres, then Triangles), its next node and stack
+    int hierarchy;
+    int node;
+    int sp;
+    int stack[topStackSize];
+    // Cluster the ray is parked on, -1 when none
+    int32_t pending;
+
+    // -1 for no hit yet, else a Cluster::Kind
+    int hitKind;
+    Sphere sphere;
+    Triangle triangle;
+    TriangleShading shading;
+    glm::vec3 bary;
+};
+
+void beginRay(StreamedRay& ray, const glm::vec3& origin, const glm::vec3& direction)
+{
+    ray.origin = origin;
+    ray.direction = direction;
+    ray.invDir = 1.0f / direction;
+    ray.shear = rayShear(direction);
+    ray.closest = 100000.0f;
+    ray.hierarchy = -1;
+    ray.node = -1;
+    ray.sp = 0;
+    ray.pending = -1;
+    ray.hitKind = -1;
+}
+
+void intersectCluster(StreamedRay& ray, const Cluster& cluster, glm::uvec4& counters)
+{
+    if (cluster.kind == Cluster::Spheres) {
+        const Sphere* spheres = cluster.spheres();
+        int found = traverse(cluster.nodes(), ray.origin, ray.invDir, ray.closest, counters, [&](int i, float& t) {
+            return intersectSphere(ray.origin, ray.direction, spheres[i], t);
+        });
+        if (found >= 0) {
+            ray.hitKind = Cluster::Spheres;
+            ray.sphere = spheres[found];
+        }
+        return;
+    }
+
+    const Triangle* triangles = cluster.triangles();
+    glm::vec3 bary(0.0f);
+    int found = traverse(cluster.nodes(), ray.origin, ray.invDir, ray.closest, counters, [&](int i, float& t) {
+        glm::vec3 b;
+        if (!intersectTriangle(ray.origin, ray.shear, triangles[i], t, b))
+            return false;
+        if (t < ray.closest)
+            bary = b;
+        return true;
+    });
+    if (found >= 0) {
+        ray.hitKind = Cluster::Triangles;
+        ray.triangle = triangles[found];
+        ray.shading = cluster.shading()[found];
+        ray.bary = bary;
+    }
+}
+
+// Walks the top-level trees, intersecting resident clusters on the way.
+// Returns true once the ray is finished, false when it parks on a cluster
+// that is not resident; it picks up from there after the cluster was read.
+bool advanceRay(StreamedRay& ray, ClusterCache& cache, glm::uvec4& counters)
+{
+    const ClusterFile& file = cache.file();
+    while (true) {
+        if (ray.node < 0) {
+            if (ray.sp > 0) {
+                ray.node = ray.stack[--ray.sp];
+                continue;
+            }
+            if (++ray.hierarchy > static_cast<int>(Cluster::Triangles))
+                return true;
+            const std::vector<BVHNode>& top = file.top(static_cast<Cluster::Kind>(ray.hierarchy));
+            if (!top.empty()) {
+                counters.x++;
+                ray.node = intersectBounds(top[0], ray.origin, ray.invDir, ray.closest) < 1e30f ? 0 : -1;
+            }
+            continue;
+        }
+
+        const std::vector<BVHNode>& top = file.top(static_cast<Cluster::Kind>(ray.hierarchy));
+        const BVHNode& current = top[ray.node];
+        if (current.count < 0) {
+            uint32_t index = static_cast<uint32_t>(-(current.count + 1));
+            ray.node = -1;
+            std::shared_ptr<const Cluster> cluster = cache.find(index);
+            if (!cluster) {
+                ray.pending = static_cast<int32_t>(index);
+                return false;
+            }
+            intersectCluster(ray, *cluster, counters);
+            continue;
+        }
+
+        int nearChild = current.leftFirst;
+        int farChild = current.leftFirst + 1;
+        counters.x += 2;
+        float nearDist = intersectBounds(top[nearChild], ray.origin, ray.invDir, ray.closest);
+        float farDist = intersectBounds(top[farChild], ray.origin, ray.invDir, ray.closest);
+        if (nearDist > farDist) {
+            std::swap(nearChild, farChild);
+            std::swap(nearDist, farDist);
+        }
+        ray.node = -1;
+        if (nearDist < 1e30f) {
+            if (farDist < 1e30f && ray.sp < topStackSize)
+                ray.stack[ray.sp++] = farChild;
+            ray.node = nearChild;
+        }
+    }
+}
+
+// Runs body(thread) on count threads, the calling thread included
+template <typename Body>
+void runThreads(unsigned count, Body body)
+{
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < count; ++i)
+        threads.emplace_back(body, i);
+    body(0u);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Traces every listed ray to its closest hit. Rays first go as far as the
+// resident clusters take them; the clusters the rest parked on are then read
+// once each, in file order, and intersected with all of their rays, which
+// continue in the next round.
+void traceWave(std::vector<StreamedRay>& rays, std::vector<glm::uvec4>& counters, std::vector<uint32_t> waiting, ClusterCache& cache, unsigned threadCount)
+{
+    TRACE_SCOPE("trace wave");
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> parkedPerThread(threadCount);
+    while (!waiting.empty()) {
+        runThreads(threadCount, [&](unsigned thread) {
+            std::vector<std::pair<uint32_t, uint32_t>>& parked = parkedPerThread[thread];
+            parked.clear();
+            size_t begin = waiting.size() * thread / threadCount;
+            size_t end = waiting.size() * (thread + 1) / threadCount;
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t ray = waiting[i];
+                if (!advanceRay(rays[ray], cache, counters[ray]))
+                    parked.emplace_back(static_cast<uint32_t>(rays[ray].pending), ray);
+            }
+        });
+
+        std::vector<std::pair<uint32_t, uint32_t>> parked;
+        for (const auto& local : parkedPerThread)
+            parked.insert(parked.end(), local.begin(), local.end());
+        if (parked.empty())
+            break;
+        // Clusters are stored in index order, so this also reads the file front to back
+        std::sort(parked.begin(), parked.end());
+        std::vector<size_t> groups;
+        for (size_t i = 0; i < parked.size(); ++i) {
+            if (i == 0 || parked[i].first != parked[i - 1].first)
+                groups.push_back(i);
+        }
+        groups.push_back(parked.size());
+
+        std::atomic<size_t> nextGroup(0);
+        runThreads(threadCount, [&](unsigned) {
+            for (size_t group = nextGroup++; group + 1 < groups.size(); group = nextGroup++) {
+                std::shared_ptr<const Cluster> cluster = cache.load(parked[groups[group]].first);
+                for (size_t i = groups[group]; i < groups[group + 1]; ++i) {
+                    uint32_t ray = parked[i].second;
+                    // A cluster that cannot be read is skipped, as if the ray had missed it
+                    if (cluster)
+                        intersectCluster(rays[ray], *cluster, counters[ray]);
+                    rays[ray].pending = -1;
+                }
+            }
+        });
+
+        waiting.clear();
+        for (const auto& entry : parked)
+            waiting.push_back(entry.second);
+    }
+}
+
+}
+
+bool CpuTracer::hit(const Scene& scene, const glm::vec3& origin, const glm::vec3& direction, Hit& rec, glm::uvec4& counters) const
+{
+    counters.z++;
+    glm::vec3 invDir = 1.0f / direction;
+    float closestSoFar = 100000.0f;
+
+    int sphereIndex = -1;
+    if (!scene.bvh.empty()) {
+        sphereIndex = traverse(scene.bvh.nodes.data(), origin, invDir, closestSoFar, counters, [&](int i, float& t) {
+            return intersectSphere(origin, direction, scene.spheres[i], t);
+        });
+    }
+    // Anything found here is closer than the sphere hit
+    int triangleIndex = -1;
+    glm::vec3 bary(0.0f);
+    if (!scene.triangleBvh.empty()) {
+        RayShear shear = rayShear(direction);
+        triangleIndex = traverse(scene.triangleBvh.nodes.data(), origin, invDir, closestSoFar, counters, [&](int i, float& t) {
+            glm::vec3 b;
+            if (!intersectTriangle(origin, shear, scene.triangles[i], t, b))
+                return false;
+            // Only kept when it becomes the closest hit, which is the next one traverse() records
+            if (t < closestSoFar)
+                bary = b;
+            return true;
+        });
+    }
+
+    if (sphereIndex < 0 && triangleIndex < 0)
+        return false;
+
+    rec.t = closestSoFar;
+    rec.point = origin + closestSoFar * direction;
+    if (triangleIndex >= 0) {
+        const Triangle& triangle = scene.triangles[triangleIndex];
+        rec.normal = triangleNormal(triangle, scene.shading[triangleIndex], bary, direction, rec.uv, rec.frontFace);
+        rec.material = scene.materials[triangle.material];
+        rec.albedo = rec.material.albedo;
+        if (rec.material.texture >= 0)
+            rec.lodBias = triangleLodBias(triangle, scene.shading[triangleIndex]);
+    }
+    else {
+        const Sphere& sphere = scene.spheres[sphereIndex];
+        glm::vec3 outward = glm::normalize(rec.point - sphere.center);
+        rec.frontFace = glm::dot(outward, direction) <= 0.0f;
+        rec.normal = rec.frontFace ? outward : -outward;
+        rec.material = scene.materials[sphere.material];
+        rec.albedo = sphere.albedo;
+        rec.uv = glm::vec2(0.0f);
+        if (rec.material.texture >= 0)
+            sphereSurface(outward, sphere.radius, rec.uv, rec.lodBias);
+    }
+    return true;
+}
+
+bool CpuTracer::startPath(Path& path, const glm::vec3& origin, const glm::vec3& direction, float spread) const
+{
+    path.origin = origin;
+    path.direction = direction;
+    path.color = glm::vec3(0.0f);
+    path.throughput = glm::vec3(1.0f);
+    path.albedo = glm::vec3(0.0f);
+    path.coneWidth = 0.0f;
+    path.coneSpread = spread;
+    path.bounce = 0;
+    path.shadow = false;
+    return settings.shadeNormals || settings.shadowRay || settings.maxBounces > 0;
+}
+
+TextureCache& CpuTracer::bindTextures(const TextureArray& textures) const
+{
+    if (!textureCache || textureCache->budget() != settings.textureBudget)
+        textureCache = std::make_shared<TextureCache>(settings.textureBudget);
+    textureCache->bind(textures);
+    textureCache->takeStats();
+    return *textureCache;
+}
+
+void CpuTracer::applyTexture(Path& path, Hit& rec, TextureCache& textures) const
+{
+    path.coneWidth += path.coneSpread * rec.t;
+    // The shader textures neither normals nor what a shadow ray hits
+    if (rec.material.texture < 0 || settings.shadeNormals || path.shadow)
+        return;
+    float lod = rec.lodBias + std::log2(static_cast<float>(textures.size())) + std::log2(std::max(path.coneWidth, 1e-8f))
+        - std::log2(std::max(std::abs(glm::dot(rec.normal, path.direction)), 1e-3f));
+    rec.albedo *= glm::vec3(textures.sample(rec.material.texture, rec.uv, lod));
+}
+
+bool CpuTracer::continuePath(Path& path, const Hit* rec, uint32_t& rng, glm::uvec4& counters) const
+{
+    if (settings.shadeNormals) {
+        path.color = rec ? 0.5f * (rec->normal + glm::vec3(1.0f)) : background(path.direction);
+        return false;
+    }
+
+    if (settings.shadowRay) {
+        if (path.shadow) {
+            path.color = rec ? settings.ambientColor : path.albedo;
+            return false;
+        }
+        if (!rec) {
+            path.color = background(path.direction);
+            return false;
+        }
+        counters.w++;
+        glm::vec3 normal = glm::normalize(rec->normal);
+        path.direction = randomOnHemisphere(normal, rng);
+        path.origin = rec->point + 0.001f * normal;
+        path.albedo = rec->albedo;
+        path.shadow = true;
+        return true;
+    }
+
+    if (!rec) {
+        path.color += path.throughput * background(path.direction);
+        return false;
+    }
+    switch (rec->material.type) {
+    case Material::Lambertian:
+        return scatterPath<Material::Lambertian>(path, *rec, rng, counters);
+    case Material::Metal:
+        return scatterPath<Material::Metal>(path, *rec, rng, counters);
+    case Material::Dielectric:
+        return scatterPath<Material::Dielectric>(path, *rec, rng, counters);
+    case Material::Emissive:
+        return scatterPath<Material::Emissive>(path, *rec, rng, counters);
+    default:
+        return false;
+    }
+}
+
+template <Material::Type Type>
+bool CpuTracer::scatterPath(Path& path, const Hit& rec, uint32_t& rng, glm::uvec4& counters) const
+{
+    // Lights end the path
+    if constexpr (Type == Material::Emissive) {
+        path.color += path.throughput * rec.albedo * rec.material.emission;
+        return false;
+    }
+    else {
+        counters.w++;
+        glm::vec3 direction, weight;
+        if (!Bsdf<Type>::Sample(rec.material, rec.albedo, path.direction, rec.normal, rec.frontFace, rng, direction, weight))
+            return false;
+
+        // Leave on the side the new direction points to: refraction goes through
+        path.origin = rec.point + 0.001f * (glm::dot(direction, rec.normal) >= 0.0f ? rec.normal : -rec.normal);
+        path.direction = direction;
+        path.throughput *= weight;
+        path.coneSpread += Bsdf<Type>::Spread(rec.material);
+        return ++path.bounce < settings.maxBounces;
+    }
+}
+
+glm::vec3 CpuTracer::rayColor(const Scene& scene, TextureCache& textures, glm::vec3 origin, glm::vec3 direction, float spread,
+    uint32_t& rng, glm::uvec4& counters) const
+{
+    Path path;
+    bool tracing = startPath(path, origin, direction, spread);
+    while (tracing) {
+        Hit rec;
+        bool found = hit(scene, path.origin, path.direction, rec, counters);
+        if (found)
+            applyTexture(path, rec, textures);
+        tracing = continuePath(path, found ? &rec : nullptr, rng, counters);
+    }
+    return path.color;
+}
+
+CpuTracer::Stats CpuTracer::render(const Scene& scene, const SceneCamera& camera, int width, int height, std::vector<glm::vec4>& pixels,
+    const std::vector<uint8_t>* mask, std::vector<glm::uvec4>* pixelCounters) const
+{
+    TileRect whole;
+    whole.width = width;
+    whole.height = height;
+    return renderRegion(scene, camera, width, height, whole, pixels, mask, pixelCounters);
+}
+
+CpuTracer::Stats CpuTracer::render(const Scene& scene, const SceneCamera& camera, int width, int height, const TileRect& region,
+    std::vector<glm::vec4>& pixels) const
+{
+    return renderRegion(scene, camera, width, height, region, pixels, nullptr, nullptr);
+}
+
+CpuTracer::Stats CpuTracer::renderRegion(const Scene& scene, const SceneCamera& camera, int width, int height, const TileRect& region,
+    std::vector<glm::vec4>& pixels, const std::vector<uint8_t>* mask, std::vector<glm::uvec4>* pixelCounters) const
+{
+    TRACE_SCOPE("CpuTracer::render");
+    auto start = std::chrono::steady_clock::now();
+
+    pixels.resize(region.pixels());
+    if (pixelCounters)
+        pixelCounters->assign(pixels.size(), glm::uvec4(0));
+    float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+    float spread = pixelSpread(camera, height);
+    TextureCache& textures = bindTextures(scene.textures);
+    int tilesX = (region.width + tileSize - 1) / tileSize;
+    int tilesY = (region.height + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+
+    // Threads pull tiles off a shared counter, so uneven tiles balance out
+    std::atomic<int> nextTile(0);
+    std::mutex statsMutex;
+    TraversalStats traversal;
+    auto worker = [&]() {
+        // Counted locally; the shared totals are touched once per thread
+        TraversalStats local;
+        for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+            TRACE_SCOPE("cpu tile");
+            int x0 = region.x + (tile % tilesX) * tileSize;
+            int y0 = region.y + (tile / tilesX) * tileSize;
+            for (int y = y0; y < std::min(y0 + tileSize, region.y + region.height); ++y) {
+                for (int x = x0; x < std::min(x0 + tileSize, region.x + region.width); ++x) {
+                    size_t index = static_cast<size_t>(y) * width + x;
+                    size_t out = static_cast<size_t>(y - region.y) * region.width + (x - region.x);
+                    if (mask && !(*mask)[out])
+                        continue;
+
+                    uint32_t pixelCount = static_cast<uint32_t>(width) * static_cast<uint32_t>(height);
+                    uint32_t rng = pixelSeed(static_cast<uint32_t>(index), settings.frameIndex, pixelCount, settings.stream);
+
+                    // Progressive frames jitter even at one sample so the edges converge too
+                    bool jittered = settings.samples > 1 || settings.frameIndex > 0;
+                    glm::vec2 rotation(0.0f);
+                    if (jittered && settings.sampler == Sampler::R2) {
+                        rotation.x = randomFloat(rng);
+                        rotation.y = randomFloat(rng);
+                    }
+
+                    glm::uvec4 counters(0);
+                    glm::vec3 color(0.0f);
+                    for (int s = 0; s < settings.samples; ++s) {
+                        glm::vec2 jitter(0.0f);
+                        if (jittered && settings.sampler == Sampler::R2) {
+                            jitter = glm::fract(0.5f + r2Alpha * static_cast<float>(settings.frameIndex * settings.samples + s) + rotation) - 0.5f;
+                        }
+                        else if (jittered) {
+                            jitter.x = randomFloat(rng);
+                            jitter.y = randomFloat(rng);
+                            jitter -= 0.5f;
+                        }
+                        glm::vec2 uv = (glm::vec2(x + 0.5f, y + 0.5f) + jitter) / glm::vec2(width, height);
+                        color += rayColor(scene, textures, camera.position, getRayDirection(uv, camera, aspectRatio), spread, rng, counters);
+                    }
+                    if (settings.heatmap)
+                        color = heatmap(static_cast<float>(counters.x + counters.y) / settings.samples / settings.heatmapScale);
+                    else
+                        color /= static_cast<float>(settings.samples);
+                    pixels[out] = glm::vec4(color, 1.0f);
+
+                    local.pixels++;
+                    local.nodes += counters.x;
+                    local.prims += counters.y;
+                    local.rays += counters.z;
+                    local.bounces += counters.w;
+                    local.maxNodes = std::max(local.maxNodes, counters.x);
+                    local.maxPrims = std::max(local.maxPrims, counters.y);
+                    if (pixelCounters)
+                        (*pixelCounters)[out] = counters;
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        traversal.add(local);
+    };
+
+    unsigned count = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < count; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    Stats stats;
+    stats.traversal = traversal;
+    stats.texturing = textures.takeStats();
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+CpuTracer::Stats CpuTracer::render(ClusterCache& cache, const SceneCamera& camera, int width, int height, std::vector<glm::vec4>& pixels) const
+{
+    TRACE_SCOPE("CpuTracer::render streamed");
+    auto start = std::chrono::steady_clock::now();
+    cache.takeStats();
+
+    size_t pixelTotal = static_cast<size_t>(width) * height;
+    pixels.resize(pixelTotal);
+    float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+    unsigned count = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    const ClusterFile& file = cache.file();
+    float spread = pixelSpread(camera, height);
+    TextureCache& textures = bindTextures(file.textures);
+    TraversalStats traversal;
+
+    // Per pixel of the batch: the RNG, the R2 rotation, the sum over samples and the counters
+    struct PixelState {
+        uint32_t rng;
+        glm::vec2 rotation;
+        glm::vec3 sum;
+    };
+
+    size_t batchSize = std::max<size_t>(streamBatch, 1);
+    for (size_t batchStart = 0; batchStart < pixelTotal; batchStart += batchSize) {
+        size_t batch = std::min(batchSize, pixelTotal - batchStart);
+        std::vector<PixelState> state(batch);
+        std::vector<glm::uvec4> counters(batch, glm::uvec4(0));
+        std::vector<Path> paths(batch);
+        std::vector<StreamedRay> rays(batch);
+
+        bool jittered = settings.samples > 1 || settings.frameIndex > 0;
+        for (size_t i = 0; i < batch; ++i) {
+            uint32_t pixelCount = static_cast<uint32_t>(width) * static_cast<uint32_t>(height);
+            state[i].rng = pixelSeed(static_cast<uint32_t>(batchStart + i), settings.frameIndex, pixelCount, settings.stream);
+            state[i].rotation = glm::vec2(0.0f);
+            state[i].sum = glm::vec3(0.0f);
+            if (jittered && settings.sampler == Sampler::R2) {
+                state[i].rotation.x = randomFloat(state[i].rng);
+                state[i].rotation.y = randomFloat(state[i].rng);
+            }
+        }
+
+        // Samples run one after the other, so each pixel's RNG advances exactly as in render()
+        for (int s = 0; s < settings.samples; ++s) {
+            std::vector<uint32_t> active;
+            for (size_t i = 0; i < batch; ++i) {
+                size_t index = batchStart + i;
+                int x = static_cast<int>(index % width);
+                int y = static_cast<int>(index / width);
+                glm::vec2 jitter(0.0f);
+                if (jittered && settings.sampler == Sampler::R2) {
+                    jitter = glm::fract(0.5f + r2Alpha * static_cast<float>(settings.frameIndex * settings.samples + s) + state[i].rotation) - 0.5f;
+                }
+                else if (jittered) {
+                    jitter.x = randomFloat(state[i].rng);
+                    jitter.y = randomFloat(state[i].rng);
+                    jitter -= 0.5f;
+                }
+                glm::vec2 uv = (glm::vec2(x + 0.5f, y + 0.5f) + jitter) / glm::vec2(width, height);
+                if (startPath(paths[i], camera.position, getRayDirection(uv, camera, aspectRatio), spread)) {
+                    beginRay(rays[i], paths[i].origin, paths[i].direction);
+                    counters[i].z++;
+                    active.push_back(static_cast<uint32_t>(i));
+                }
+            }
+
+            // One wave per bounce: trace every live path's ray, then shade them all
+            while (!active.empty()) {
+                traceWave(rays, counters, active, cache, count);
+
+                // Resolve the hits, then sort the wave by material type (misses and
+                // the debug modes last) so each run of one type is shaded by its
+                // own scatterPath() instantiation
+                const uint32_t generic = Material::TypeCount;
+                bool tracing = !settings.shadeNormals && !settings.shadowRay;
+                std::vector<Hit> hits(active.size());
+                std::vector<uint32_t> keys(active.size());
+                runThreads(count, [&](unsigned thread) {
+                    size_t begin = active.size() * thread / count;
+                    size_t end = active.size() * (thread + 1) / count;
+                    for (size_t a = begin; a < end; ++a) {
+                        const StreamedRay& ray = rays[active[a]];
+                        Hit& rec = hits[a];
+                        keys[a] = generic;
+                        if (ray.hitKind < 0)
+                            continue;
+                        rec.t = ray.closest;
+                        rec.point = ray.origin + ray.closest * ray.direction;
+                        if (ray.hitKind == static_cast<int>(Cluster::Triangles)) {
+                            rec.normal = triangleNormal(ray.triangle, ray.shading, ray.bary, ray.direction, rec.uv, rec.frontFace);
+                            rec.material = file.materials[ray.triangle.material];
+                            rec.albedo = rec.material.albedo;
+                            if (rec.material.texture >= 0)
+                                rec.lodBias = triangleLodBias(ray.triangle, ray.shading);
+                        }
+                        else {
+                            glm::vec3 outward = glm::normalize(rec.point - ray.sphere.center);
+                            rec.frontFace = glm::dot(outward, ray.direction) <= 0.0f;
+                            rec.normal = rec.frontFace ? outward : -outward;
+                            rec.material = file.materials[ray.sphere.material];
+                            rec.albedo = ray.sphere.albedo;
+                            rec.uv = glm::vec2(0.0f);
+                            if (rec.material.texture >= 0)
+                                sphereSurface(outward, ray.sphere.radius, rec.uv, rec.lodBias);
+                        }
+                        applyTexture(paths[active[a]], rec, textures);
+                        if (tracing)
+                            keys[a] = static_cast<uint32_t>(rec.material.type);
+                    }
+                });
+
+                std::vector<size_t> starts(generic + 2, 0);
+                for (uint32_t key : keys)
+                    starts[key + 1]++;
+                for (size_t k = 1; k < starts.size(); ++k)
+                    starts[k] += starts[k - 1];
+                std::vector<uint32_t> order(active.size());
+                for (size_t a = 0; a < active.size(); ++a)
+                    order[starts[keys[a]]++] = static_cast<uint32_t>(a);
+
+                std::vector<uint8_t> live(active.size());
+                auto finish = [&](size_t a) {
+                    if (live[a]) {
+                        uint32_t i = active[a];
+                        beginRay(rays[i], paths[i].origin, paths[i].direction);
+                        counters[i].z++;
+                    }
+                };
+                auto shadeRun = [&](auto type, const uint32_t* run, const uint32_t* runEnd) {
+                    for (; run != runEnd; ++run) {
+                        uint32_t i = active[*run];
+                        live[*run] = scatterPath<decltype(type)::value>(paths[i], hits[*run], state[i].rng, counters[i]);
+                        finish(*run);
+                    }
+                };
+                runThreads(count, [&](unsigned thread) {
+                    const uint32_t* run = order.data() + order.size() * thread / count;
+                    const uint32_t* end = order.data() + order.size() * (thread + 1) / count;
+                    while (run != end) {
+                        uint32_t key = keys[*run];
+                        const uint32_t* runEnd = run;
+                        while (runEnd != end && keys[*runEnd] == key)
+                            ++runEnd;
+                        switch (key) {
+                        case Material::Lambertian:
+                            shadeRun(std::integral_constant<Material::Type, Material::Lambertian>(), run, runEnd);
+                            break;
+                        case Material::Metal:
+                            shadeRun(std::integral_constant<Material::Type, Material::Metal>(), run, runEnd);
+                            break;
+                        case Material::Dielectric:
+                            shadeRun(std::integral_constant<Material::Type, Material::Dielectric>(), run, runEnd);
+                            break;
+                        case Material::Emissive:
+                            shadeRun(std::integral_constant<Material::Type, Material::Emissive>(), run, runEnd);
+                            break;
+                        default:
+                            for (const uint32_t* a = run; a != runEnd; ++a) {
+                                uint32_t i = active[*a];
+                                live[*a] = continuePath(paths[i], rays[i].hitKind >= 0 ? &hits[*a] : nullptr, state[i].rng, counters[i]);
+                                finish(*a);
+                            }
+                            break;
+                        }
+                        run = runEnd;
+                    }
+                });
+
+                size_t kept = 0;
+                for (size_t a = 0; a < active.size(); ++a) {
+                    if (live[a])
+                        active[kept++] = active[a];
+                }
+                active.resize(kept);
+            }
+
+            for (size_t i = 0; i < batch; ++i)
+                state[i].sum += paths[i].color;
+        }
+
+        for (size_t i = 0; i < batch; ++i) {
+            glm::vec3 color = settings.heatmap
+                ? heatmap(static_cast<float>(counters[i].x + counters[i].y) / settings.samples / settings.heatmapScale)
+                : state[i].sum / static_cast<float>(settings.samples);
+            pixels[batchStart + i] = glm::vec4(color, 1.0f);
+
+            traversal.pixels++;
+            traversal.nodes += counters[i].x;
+            traversal.prims += counters[i].y;
+            traversal.rays += counters[i].z;
+            traversal.bounces += counters[i].w;
+            traversal.maxNodes = std::max(traversal.maxNodes, counters[i].x);
+            traversal.maxPrims = std::max(traversal.maxPrims, counters[i].y);
+        }
+    }
+
+    Stats stats;
+    stats.traversal = traversal;
+    stats.streaming = cache.takeStats();
+    stats.texturing = textures.takeStats();
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,141 @@
+#ifndef CPU_TRACER_H
+#define CPU_TRACER_H
+
+#include "pch.h"
+#include "ClusterCache.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "TextureCache.h"
+#include "TraversalStats.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Multithreaded CPU port of default.frag. It follows the shader line for line
+// (same RNG, camera model, BVH traversal and shading) so the two backends can
+// be benchmarked and compared on the same scenes.
+class CpuTracer
+{
+public:
+	enum class Sampler { Pcg, R2 };
+
+	struct Settings {
+		int maxBounces = 5;
+		int samples = 1;
+		bool shadeNormals = false;
+		bool shadowRay = false;
+		glm::vec3 ambientColor = glm::vec3(0.0f);
+		// Seeds the per-pixel RNG; successive frames give independent samples
+		uint32_t frameIndex = 0;
+		// Runs in different streams never share random numbers at the same
+		// frame index, e.g. a reference and the runs measured against it.
+		// Stream 0 draws what the GL tracer draws.
+		uint32_t stream = 0;
+		// Pcg jitters with the path's own random numbers, R2 with a per-pixel
+		// rotated R2 low-discrepancy sequence
+		Sampler sampler = Sampler::Pcg;
+		// Traversal cost in false color instead of the image, as HEATMAP in the shader
+		bool heatmap = false;
+		float heatmapScale = 200.0f;
+		// Memory for decoded texture tiles and their mip levels
+		size_t textureBudget = 64u << 20;
+	};
+
+	struct Stats {
+		// Counted per thread and merged once the frame is done
+		TraversalStats traversal;
+		// Cluster cache activity during the frame; zero for in-memory scenes
+		ClusterCache::Stats streaming;
+		// Texture tile lookups during the frame
+		TextureCache::Stats texturing;
+		double ms = 0.0;
+	};
+
+	Settings settings;
+	// 0 uses every hardware thread
+	unsigned threadCount = 0;
+	// Paths the streamed render() keeps in flight at once
+	size_t streamBatch = 65536;
+
+	// Pixels are written bottom row first, matching glReadPixels. With a mask,
+	// only pixels whose entry is non-zero are traced; the rest are left as they were.
+	// pixelCounters, when given, receives each pixel's (nodes, prims, rays, bounces).
+	Stats render(const Scene& scene, const SceneCamera& camera, int width, int height, std::vector<glm::vec4>& pixels,
+		const std::vector<uint8_t>* mask = nullptr, std::vector<glm::uvec4>* pixelCounters = nullptr) const;
+	// Only the region of the width x height image, region.width pixels per
+	// row. Each pixel gets the random sequence it gets in the whole image, so
+	// regions traced apart, even by other processes, assemble into the same picture.
+	Stats render(const Scene& scene, const SceneCamera& camera, int width, int height, const TileRect& region,
+		std::vector<glm::vec4>& pixels) const;
+
+	// The same image from an out-of-core scene whose clusters come through the
+	// cache. Paths advance in waves, one bounce at a time; a ray that reaches a
+	// cluster that is not resident is parked on it instead of waiting, and the
+	// parked rays are served cluster by cluster, each read once per round.
+	// Node counts differ from render() since clusters are entered from the top-level tree.
+	Stats render(ClusterCache& cache, const SceneCamera& camera, int width, int height, std::vector<glm::vec4>& pixels) const;
+
+private:
+	struct Hit {
+		glm::vec3 point;
+		// Faces back at the ray
+		glm::vec3 normal;
+		// The sphere's own, or the triangle's material's
+		glm::vec3 albedo;
+		float t;
+		// Interpolated mesh UVs (barycentrics without them); on spheres only when textured
+		glm::vec2 uv;
+		// Half log2 of UV area over world area, for the ray cone LOD; only when textured
+		float lodBias;
+		// The ray arrived from the outside of the surface
+		bool frontFace;
+		Material material;
+	};
+
+	// A path between two rays: the next ray to trace and what the path has gathered
+	struct Path {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 color;
+		// Product of the scatter weights so far
+		glm::vec3 throughput;
+		// Of the surface a SHADOW_RAY-style shadow ray left from
+		glm::vec3 albedo;
+		// Ray cone as in the shader: width at the last hit and spread angle
+		float coneWidth;
+		float coneSpread;
+		int bounce;
+		bool shadow;
+	};
+
+	// Shared so copies of a tracer keep one set of decoded tiles; created on first use
+	mutable std::shared_ptr<TextureCache> textureCache;
+
+	// Both scene render()s; mask, pixelCounters and pixels are indexed within region
+	Stats renderRegion(const Scene& scene, const SceneCamera& camera, int width, int height, const TileRect& region,
+		std::vector<glm::vec4>& pixels, const std::vector<uint8_t>* mask, std::vector<glm::uvec4>* pixelCounters) const;
+	// false when the settings trace no ray at all. spread is the angle of one pixel.
+	bool startPath(Path& path, const glm::vec3& origin, const glm::vec3& direction, float spread) const;
+	// Points the texture cache at the scene's textures and clears its counters
+	TextureCache& bindTextures(const TextureArray& textures) const;
+	// Widens the path's cone to the hit and multiplies in the hit's texture
+	void applyTexture(Path& path, Hit& rec, TextureCache& textures) const;
+	// Shades the hit of the path's last ray (null for a miss) and sets up the
+	// next one; false once the path is finished
+	bool continuePath(Path& path, const Hit* rec, uint32_t& rng, glm::uvec4& counters) const;
+	// The path-tracing step of continuePath() for a hit on a material of a
+	// type known at compile time. continuePath() dispatches to it once per
+	// hit; the streamed render() sorts each wave by type and calls it on whole
+	// runs, so no material is looked up through a branch or an indirect call
+	// in the inner loop, and adding a type costs the existing ones nothing.
+	template <Material::Type Type>
+	bool scatterPath(Path& path, const Hit& rec, uint32_t& rng, glm::uvec4& counters) const;
+
+	// counters is (nodes, prims, rays, bounces) for the pixel being traced
+	bool hit(const Scene& scene, const glm::vec3& origin, const glm::vec3& direction, Hit& rec, glm::uvec4& counters) const;
+	glm::vec3 rayColor(const Scene& scene, TextureCache& textures, glm::vec3 origin, glm::vec3 direction, float spread, uint32_t& rng,
+		glm::uvec4& counters) const;
+};
+
+#endif // CPU_TRACER_H
@@ -0,0 +1,388 @@
+#include "DistributedRender.h"
+#include "CpuTracer.h"
+#include "ImageEncoder.h"
+#include "Json.h"
+#include "LocalSocket.h"
+#include "SceneFile.h"
+#include "TileScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace {
+
+#ifdef _WIN32
+typedef HANDLE Process;
+
+bool spawnWorker(const std::string& executable, const std::filesystem::path& socketPath, Process& process)
+{
+    std::string command = "\"" + executable + "\" --worker \"" + socketPath.string() + "\"";
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info = {};
+    if (!CreateProcessA(nullptr, &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info))
+        return false;
+    CloseHandle(info.hThread);
+    process = info.hProcess;
+    return true;
+}
+
+void waitForWorker(Process process)
+{
+    WaitForSingleObject(process, INFINITE);
+    CloseHandle(process);
+}
+
+void stopWorker(Process process)
+{
+    TerminateProcess(process, 1);
+}
+#else
+typedef pid_t Process;
+
+bool spawnWorker(const std::string& executable, const std::filesystem::path& socketPath, Process& process)
+{
+    std::string socket = socketPath.string();
+    char* arguments[] = { const_cast<char*>(executable.c_str()), const_cast<char*>("--worker"), const_cast<char*>(socket.c_str()), nullptr };
+    return posix_spawnp(&process, executable.c_str(), nullptr, nullptr, arguments, environ) == 0;
+}
+
+void waitForWorker(Process process)
+{
+    waitpid(process, nullptr, 0);
+}
+
+void stopWorker(Process process)
+{
+    kill(process, SIGKILL);
+}
+#endif
+
+const size_t noTile = ~static_cast<size_t>(0);
+
+struct WorkerStats {
+    size_t tiles = 0;
+    double ms = 0.0;
+    bool lost = false;
+};
+
+// State shared by the connection threads; every member below mutex is guarded by it
+struct Coordinator {
+    const DistributedRender::Options& options;
+    std::vector<TileRect> tiles;
+    // The output image; disjoint tiles are received into it by several threads at once
+    std::vector<glm::vec4> pixels;
+    Json job;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<size_t> pending;
+    size_t completed = 0;
+    size_t reissued = 0;
+    int connected = 0;
+    // Slowest tile traced so far, which scales the worker timeout
+    double slowestTileMs = 0.0;
+    bool abandoned = false;
+    std::chrono::steady_clock::time_point lastConnected;
+    std::vector<WorkerStats> workers;
+    std::string workerError;
+
+    explicit Coordinator(const DistributedRender::Options& options) : options(options) {}
+
+    void serve(LocalSocket& socket, size_t worker);
+    // Receives a tile's rows in place; false when the worker went away mid-tile
+    bool receive(LocalSocket& socket, const TileRect& tile);
+};
+
+void Coordinator::serve(LocalSocket& socket, size_t worker)
+{
+    TRACE_THREAD_NAME("tile connection");
+    size_t inFlight = noTile;
+    bool finished = false;
+    if (socket.writeLine(job.dump(0))) {
+        for (;;) {
+            std::string line, error;
+            Json message;
+            // A worker that stops answering but keeps its connection open must not hold its tile forever
+            double timeout;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                timeout = std::max(options.workerTimeoutSeconds, 4.0 * slowestTileMs / 1000.0);
+            }
+            socket.setReceiveTimeout(timeout);
+            if (!socket.readLine(line, 1 << 20, timeout) || !Json::parse(line, message, error) || !message.isObject())
+                break;
+            if (message["error"].isString()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                workerError = message["error"].asString();
+                break;
+            }
+            if (message.has("tile")) {
+                if (inFlight == noTile || message["tile"].asNumber(-1.0) != static_cast<double>(inFlight) || !receive(socket, tiles[inFlight]))
+                    break;
+                std::lock_guard<std::mutex> lock(mutex);
+                completed++;
+                workers[worker].tiles++;
+                workers[worker].ms += message["ms"].asNumber();
+                slowestTileMs = std::max(slowestTileMs, message["ms"].asNumber());
+                inFlight = noTile;
+                changed.notify_all();
+            }
+
+            // Every message is also a request for the next tile. One can come
+            // back from a worker that dies, so an idle worker waits for the end.
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return !pending.empty() || completed == tiles.size() || abandoned; });
+                if (pending.empty() || abandoned) {
+                    lock.unlock();
+                    Json reply = Json::object();
+                    reply.set("done", true);
+                    socket.writeLine(reply.dump(0));
+                    finished = true;
+                    break;
+                }
+                inFlight = pending.front();
+                pending.pop_front();
+            }
+            const TileRect& tile = tiles[inFlight];
+            Json rect = Json::array();
+            rect.push(tile.x);
+            rect.push(tile.y);
+            rect.push(tile.width);
+            rect.push(tile.height);
+            Json reply = Json::object();
+            reply.set("tile", static_cast<double>(inFlight));
+            reply.set("rect", rect);
+            if (!socket.writeLine(reply.dump(0)))
+                break;
+        }
+    }
+    socket.close();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (inFlight != noTile) {
+        pending.push_front(inFlight);
+        reissued++;
+    }
+    workers[worker].lost = !finished;
+    connected--;
+    lastConnected = std::chrono::steady_clock::now();
+    changed.notify_all();
+}
+
+bool Coordinator::receive(LocalSocket& socket, const TileRect& tile)
+{
+    TRACE_SCOPE("receive tile");
+    for (int row = 0; row < tile.height; ++row) {
+        glm::vec4* destination = &pixels[static_cast<size_t>(tile.y + row) * options.width + tile.x];
+        if (!socket.readBytes(destination, static_cast<size_t>(tile.width) * sizeof(glm::vec4)))
+            return false;
+    }
+    return true;
+}
+
+}
+
+bool DistributedRender::Render(const Options& options, const std::string& executable, const std::filesystem::path& path,
+    std::string& error)
+{
+    TRACE_SCOPE("DistributedRender::Render");
+    auto start = std::chrono::steady_clock::now();
+    if (options.width <= 0 || options.height <= 0) {
+        error = "the image must be at least 1x1";
+        return false;
+    }
+    ImageEncoder::Format format;
+    std::string extension = path.extension().string();
+    if (extension.empty() || !ImageEncoder::ParseFormat(extension.substr(1), format)) {
+        error = "output must end in .png, .exr or .pfm";
+        return false;
+    }
+
+    Coordinator coordinator(options);
+    coordinator.tiles = TileScheduler::Split(options.width, options.height, options.tileSize);
+    coordinator.pixels.assign(static_cast<size_t>(options.width) * options.height, glm::vec4(0.0f));
+    for (size_t i = 0; i < coordinator.tiles.size(); ++i)
+        coordinator.pending.push_back(i);
+    // Workers share the machine, so each gets its share of the cores
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency() / static_cast<unsigned>(std::max(1, options.workers)));
+    coordinator.job = Json::object();
+    coordinator.job.set("scene", options.scene);
+    coordinator.job.set("width", options.width);
+    coordinator.job.set("height", options.height);
+    coordinator.job.set("spp", options.samples);
+    coordinator.job.set("bounces", options.bounces);
+    coordinator.job.set("threads", threads);
+
+    LocalSocket listener;
+    if (!listener.listen(options.socketPath, error))
+        return false;
+    coordinator.lastConnected = std::chrono::steady_clock::now();
+
+    std::vector<Process> processes;
+    for (int i = 0; i < options.workers; ++i) {
+        Process process;
+        if (spawnWorker(executable, options.socketPath, process))
+            processes.push_back(process);
+        else
+            std::cerr << "ERROR::DISTRIBUTED::SPAWN_FAILED: cannot start " << executable << std::endl;
+    }
+    std::cout << "Rendering " << coordinator.tiles.size() << " tiles of " << options.scene << " on " << processes.size()
+        << " worker processes (" << options.socketPath.string() << ")" << std::endl;
+
+    // Connections own their sockets; the threads are joined once the listener closes
+    std::vector<std::thread> connections;
+    std::vector<std::unique_ptr<LocalSocket>> sockets;
+    std::thread acceptor([&] {
+        TRACE_THREAD_NAME("tile acceptor");
+        for (;;) {
+            auto socket = std::make_unique<LocalSocket>();
+            if (!listener.accept(*socket))
+                break;
+            size_t worker;
+            {
+                std::lock_guard<std::mutex> lock(coordinator.mutex);
+                worker = coordinator.workers.size();
+                coordinator.workers.emplace_back();
+                coordinator.connected++;
+            }
+            LocalSocket* connection = socket.get();
+            sockets.push_back(std::move(socket));
+            connections.emplace_back([&coordinator, connection, worker] { coordinator.serve(*connection, worker); });
+        }
+    });
+
+    bool complete = false;
+    {
+        std::unique_lock<std::mutex> lock(coordinator.mutex);
+        auto timeout = std::chrono::duration<double>(options.idleTimeoutSeconds);
+        for (;;) {
+            if (coordinator.completed == coordinator.tiles.size()) {
+                complete = true;
+                break;
+            }
+            if (coordinator.connected == 0 && std::chrono::steady_clock::now() - coordinator.lastConnected > timeout) {
+                coordinator.abandoned = true;
+                coordinator.changed.notify_all();
+                break;
+            }
+            coordinator.changed.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+    listener.close();
+    acceptor.join();
+    for (std::thread& connection : connections)
+        connection.join();
+    // A lost worker may be hung rather than dead, and waiting on it would never return
+    bool anyLost = std::any_of(coordinator.workers.begin(), coordinator.workers.end(), [](const WorkerStats& worker) { return worker.lost; });
+    for (Process process : processes) {
+        if (anyLost)
+            stopWorker(process);
+        waitForWorker(process);
+    }
+
+    if (!complete) {
+        error = "no worker left with " + std::to_string(coordinator.tiles.size() - coordinator.completed) + " tiles to go";
+        if (!coordinator.workerError.empty())
+            error += " (" + coordinator.workerError + ")";
+        return false;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << options.width << "x" << options.height << " in " << ms << " ms, " << coordinator.reissued
+        << " tiles reissued" << std::endl;
+    for (size_t i = 0; i < coordinator.workers.size(); ++i) {
+        const WorkerStats& worker = coordinator.workers[i];
+        std::cout << "  worker " << i << ": " << worker.tiles << " tiles, " << worker.ms << " ms tracing"
+            << (worker.lost ? ", lost" : "") << std::endl;
+    }
+    ImageEncoder::Job image;
+    image.path = path;
+    image.format = format;
+    image.exposure = options.exposure;
+    image.width = options.width;
+    image.height = options.height;
+    image.pixels = std::move(coordinator.pixels);
+    if (!ImageEncoder::Write(image)) {
+        error = "cannot write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+int DistributedRender::Work(const std::filesystem::path& socketPath)
+{
+    TRACE_SCOPE("DistributedRender::Work");
+    LocalSocket socket;
+    std::string line, error;
+    Json job;
+    if (!socket.connect(socketPath, error) || !socket.readLine(line) || !Json::parse(line, job, error) || !job.isObject()) {
+        std::cerr << "ERROR::WORKER::NO_JOB: " << (error.empty() ? "the coordinator closed the connection" : error) << std::endl;
+        return 1;
+    }
+
+    Scene scene;
+    std::string name = job["scene"].asString();
+    if (!Scene::Builtin(name, scene) && !SceneFile::Load(name, scene, error)) {
+        Json reply = Json::object();
+        reply.set("error", error);
+        socket.writeLine(reply.dump(0));
+        std::cerr << "ERROR::WORKER::SCENE_NOT_LOADED: " << error << std::endl;
+        return 1;
+    }
+    scene.buildBVH();
+
+    int width = static_cast<int>(job["width"].asNumber());
+    int height = static_cast<int>(job["height"].asNumber());
+    CpuTracer tracer;
+    tracer.settings.samples = std::max(1, static_cast<int>(job["spp"].asNumber(1.0)));
+    tracer.settings.maxBounces = std::max(1, static_cast<int>(job["bounces"].asNumber(5.0)));
+    tracer.threadCount = static_cast<unsigned>(std::max(1.0, job["threads"].asNumber(1.0)));
+
+    Json request = Json::object();
+    request.set("next", true);
+    if (!socket.writeLine(request.dump(0)))
+        return 1;
+    std::vector<glm::vec4> pixels;
+    for (;;) {
+        Json message;
+        if (!socket.readLine(line) || !Json::parse(line, message, error))
+            return 1;
+        if (message["done"].asBool())
+            return 0;
+        const Json& rect = message["rect"];
+        if (!rect.isArray() || rect.size() != 4)
+            return 1;
+        TileRect tile;
+        tile.x = static_cast<int>(rect[0].asNumber());
+        tile.y = static_cast<int>(rect[1].asNumber());
+        tile.width = static_cast<int>(rect[2].asNumber());
+        tile.height = static_cast<int>(rect[3].asNumber());
+        CpuTracer::Stats stats = tracer.render(scene, scene.camera, width, height, tile, pixels);
+
+        Json result = Json::object();
+        result.set("next", true);
+        result.set("tile", message["tile"].asNumber());
+        result.set("ms", stats.ms);
+        if (!socket.writeLine(result.dump(0)) || !socket.writeBytes(pixels.data(), pixels.size() * sizeof(glm::vec4)))
+            return 1;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DISTRIBUTED_RENDER_H
+#define DISTRIBUTED_RENDER_H
+
+#include "pch.h"
+
+// Stills from the CPU tracer spread over worker processes. The coordinator
+// splits the frame into tiles and listens on a Unix domain socket. Workers
+// are copies of this executable started with --worker <socket>, and each
+// loads the scene itself. Nothing is assigned up front: a worker asks for a
+// tile, renders it and sends it back with its next request, so fast workers
+// simply take more tiles. Returned rows are received straight into the
+// output image. A worker that dies, hangs up or stops answering has its
+// tile handed to the next worker that asks. The image is bit for bit what CpuTracer gives in
+// one process.
+//
+// Messages are lines of JSON. The coordinator opens with the job,
+// { "scene", "width", "height", "spp", "bounces", "threads" }, then answers
+// every request with { "tile": i, "rect": [x, y, w, h] } or { "done": true }.
+// Workers send { "next": true }, or { "next": true, "tile": i, "ms": t }
+// followed by the tile's w * h RGBA floats, bottom row first; a worker that
+// cannot load the scene sends { "error": "..." } and exits.
+class DistributedRender
+{
+public:
+	struct Options {
+		std::string scene = "two-spheres";
+		int width = 1920;
+		int height = 1080;
+		// Samples per pixel, traced in one CpuTracer pass per tile
+		int samples = 16;
+		int bounces = 5;
+		int tileSize = 64;
+		// Started on this machine; 0 waits for workers started by hand
+		int workers = 4;
+		std::filesystem::path socketPath = "photonweaver-tiles.sock";
+		// The render fails once no worker has been connected this long
+		double idleTimeoutSeconds = 10.0;
+		// A worker silent this long while it loads the scene or holds a tile
+		// counts as lost; raised to four times the slowest tile seen so far
+		double workerTimeoutSeconds = 60.0;
+		float exposure = 1.0f;
+	};
+
+	// Coordinator side. executable is what the workers run, normally argv[0].
+	// Writes path in its extension's format (.png, .exr or .pfm) and prints
+	// the tiles each worker took. False, with error, when the socket cannot
+	// be bound, the workers all go away or the file fails.
+	static bool Render(const Options& options, const std::string& executable, const std::filesystem::path& path,
+		std::string& error);
+
+	// Worker side: renders tiles for the coordinator on socketPath until it
+	// is done. Returns the process exit code.
+	static int Work(const std::filesystem::path& socketPath);
+};
+
+#endif // DISTRIBUTED_RENDER_H
@@ -1,19 +1,20 @@
 #include "EBO.h"
 
-EBO::EBO(const GLuint* indices, GLsizeiptr size) {
-    glGenBuffers(1, &ID);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
+EBO::EBO(const GLuint* indices, GLsizeiptr size)
+    : buffer(GLBuffer::Create())
+{
+    Bind();
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices, GL_STATIC_DRAW);
 }
 
 void EBO::Bind() const {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
+    GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.get());
 }
 
 void EBO::Unbind() const {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void EBO::Delete() {
-    glDeleteBuffers(1, &ID);
-}
\ No newline at end of file
+    buffer.reset();
+}
@@ -2,18 +2,23 @@
 #define EBO_H
 
 #include "pch.h"
+#include "GLObject.h"
 
 class EBO {
 public:
-    GLuint ID;
-
     EBO(const GLuint* indices, GLsizeiptr size);
 
+    GLuint id() const { return buffer.get(); }
+
+    // The binding is part of the bound VAO
     void Bind() const;
 
     void Unbind() const;
 
     void Delete();
+
+private:
+    GLBuffer buffer;
 };
 
 #endif // !EBO
@@ -0,0 +1,94 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher(const std::filesystem::path& directory)
+    : directory(directory)
+{
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Editors either rewrite in place (close after write) or save to a temporary and rename over
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        std::cerr << "WARNING::FILE_WATCHER::INOTIFY_FAILED: " << directory.string() << std::endl;
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+    if (inotifyFd < 0)
+        return changed;
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (ssize_t offset = 0; offset < length; ) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0 && std::find(changed.begin(), changed.end(), event->name) == changed.end())
+                changed.push_back(event->name);
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+#else
+
+FileWatcher::FileWatcher(const std::filesystem::path& directory)
+    : directory(directory)
+{
+    scan(nullptr);
+    lastScan = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+
+    // A directory listing per frame is wasteful; a quarter second is plenty for editing
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastScan < std::chrono::milliseconds(250))
+        return changed;
+    lastScan = now;
+
+    scan(&changed);
+    return changed;
+}
+
+void FileWatcher::scan(std::vector<std::string>* changed)
+{
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (!entry.is_regular_file(ec))
+            continue;
+
+        std::string name = entry.path().filename().string();
+        auto writeTime = entry.last_write_time(ec);
+        auto it = writeTimes.find(name);
+        if (it == writeTimes.end() || it->second != writeTime) {
+            writeTimes[name] = writeTime;
+            if (changed)
+                changed->push_back(name);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include "pch.h"
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Reports files in one directory that were written since the last poll.
+// Uses inotify on Linux; elsewhere it compares modification times at a
+// throttled interval. poll() never blocks.
+class FileWatcher
+{
+public:
+	explicit FileWatcher(const std::filesystem::path& directory);
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	const std::filesystem::path& getDirectory() const { return directory; }
+
+	// File names (without directory) changed since the previous call
+	std::vector<std::string> poll();
+
+private:
+	std::filesystem::path directory;
+
+#ifdef __linux__
+	int inotifyFd = -1;
+#else
+	std::map<std::string, std::filesystem::file_time_type> writeTimes;
+	std::chrono::steady_clock::time_point lastScan;
+
+	void scan(std::vector<std::string>* changed);
+#endif
+};
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,122 @@
+#include "FrameCapture.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+FrameCapture::FrameCapture(const Options& options)
+    : options(options), encoder(options.threads, options.queueCapacity), ring(std::max(options.ringSize, 1))
+{
+    std::error_code error;
+    std::filesystem::create_directories(options.directory, error);
+    if (error)
+        std::cerr << "ERROR::CAPTURE::DIRECTORY_NOT_CREATED: " << options.directory.string() << ": " << error.message() << std::endl;
+}
+
+void FrameCapture::capture(const GLFramebuffer& source, int width, int height)
+{
+    TRACE_SCOPE("FrameCapture::capture");
+    poll();
+    if (pending == ring.size()) {
+        // Every readback is still on the GPU; the oldest is the first to land
+        auto start = std::chrono::steady_clock::now();
+        glClientWaitSync(oldest().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        ++totals.ringStalls;
+        totals.ringStallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        deliver();
+    }
+
+    Slot& slot = ring[next];
+    size_t bytes = static_cast<size_t>(width) * height * sizeof(glm::vec4);
+    if (!slot.buffer)
+        slot.buffer = GLBuffer::Create();
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer.get());
+    if (slot.bytes != bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        slot.bytes = bytes;
+    }
+    // Lands in the buffer; nothing waits until the buffer is mapped
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source.get());
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, nullptr);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.frame = totals.captured++;
+
+    next = (next + 1) % ring.size();
+    ++pending;
+}
+
+void FrameCapture::poll()
+{
+    // Fences signal in submission order, so stop at the first one that has not
+    while (pending > 0) {
+        GLenum status = glClientWaitSync(oldest().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        deliver();
+    }
+}
+
+void FrameCapture::deliver()
+{
+    TRACE_SCOPE("FrameCapture::deliver");
+    Slot& slot = oldest();
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    --pending;
+
+    ImageEncoder::Job job;
+    job.format = options.format;
+    job.exposure = options.exposure;
+    job.width = slot.width;
+    job.height = slot.height;
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06zu", slot.frame);
+    job.path = options.directory / (name + std::string(ImageEncoder::Extension(options.format)));
+
+    job.pixels = encoder.takeBuffer();
+    job.pixels.resize(static_cast<size_t>(slot.width) * slot.height);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer.get());
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT);
+    if (mapped) {
+        std::memcpy(job.pixels.data(), mapped, slot.bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped) {
+        std::cerr << "ERROR::CAPTURE::MAP_FAILED: " << job.path.string() << std::endl;
+        return;
+    }
+    encoder.push(std::move(job));
+}
+
+void FrameCapture::finish()
+{
+    while (pending > 0) {
+        glClientWaitSync(oldest().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        deliver();
+    }
+    encoder.finish();
+}
+
+FrameCapture::Stats FrameCapture::stats()
+{
+    Stats result = totals;
+    result.encoder = encoder.stats();
+    return result;
+}
+
+void FrameCapture::Delete()
+{
+    finish();
+    for (Slot& slot : ring)
+        slot = Slot();
+    encoder.Delete();
+}
@@ -0,0 +1,84 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "pch.h"
+#include "GLObject.h"
+#include "ImageEncoder.h"
+
+#include <vector>
+
+// Saves rendered frames without stalling the pipeline. capture() starts a
+// glReadPixels of a float framebuffer into the next pixel-pack buffer of a
+// ring, fences it, and returns at once. Frame N is copied back while N+1
+// renders. poll() maps buffers whose fence has signalled and hands the
+// pixels to an ImageEncoder.
+//
+// Memory stays bounded at both ends. When every ring slot is still in
+// flight, capture() waits for the oldest. When the encoder is full, poll()
+// waits for a worker. Either way the render loop slows to the rate frames
+// can be saved rather than dropping them or buffering without limit.
+class FrameCapture
+{
+public:
+	struct Options {
+		std::filesystem::path directory;
+		ImageEncoder::Format format = ImageEncoder::Format::Png;
+		float exposure = 1.0f;
+		// Readbacks in flight; three covers a frame of CPU-GPU latency plus one spare
+		int ringSize = 3;
+		// Encoder threads (0: all cores but one) and images it may hold
+		unsigned threads = 0;
+		size_t queueCapacity = 8;
+	};
+
+	struct Stats {
+		size_t captured = 0;
+		// capture() calls that had to wait for a readback still in flight
+		size_t ringStalls = 0;
+		double ringStallMs = 0.0;
+		ImageEncoder::Stats encoder;
+	};
+
+	explicit FrameCapture(const Options& options);
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	// Queues a read of source's lower-left width x height pixels, saved as
+	// frame_NNNNNN in the directory. source should hold the linear float frame,
+	// not the 8-bit window it is shown in, so exr and pfm keep the full range
+	// and png applies the exposure once.
+	void capture(const GLFramebuffer& source, int width, int height);
+	// Passes finished readbacks on to the encoder; call once per frame
+	void poll();
+	// Waits until every captured frame is on disk
+	void finish();
+	Stats stats();
+
+	// Finishes, then frees the buffers and stops the encoder
+	void Delete();
+
+private:
+	struct Slot {
+		GLBuffer buffer;
+		size_t bytes = 0;
+		GLsync fence = nullptr;
+		int width = 0;
+		int height = 0;
+		size_t frame = 0;
+	};
+
+	Options options;
+	ImageEncoder encoder;
+	std::vector<Slot> ring;
+	// Next slot to fill; the oldest in flight is pending slots behind it
+	size_t next = 0;
+	size_t pending = 0;
+	Stats totals;
+
+	Slot& oldest() { return ring[(next + ring.size() - pending) % ring.size()]; }
+	// Maps the oldest slot, which must have signalled, and queues its pixels
+	void deliver();
+};
+
+#endif // FRAME_CAPTURE_H
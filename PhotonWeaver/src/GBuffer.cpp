@@ -0,0 +1,101 @@
+#include "GBuffer.h"
+#include "Packing.h"
+#include "RenderTargetPool.h"
+
+bool GBuffer::ParseFormat(const std::string& name, Format& format)
+{
+    if (name == "full")
+        format = Format::Float32;
+    else if (name == "packed")
+        format = Format::Packed;
+    else
+        return false;
+    return true;
+}
+
+const char* GBuffer::FormatName(Format format)
+{
+    return format == Format::Packed ? "packed" : "full";
+}
+
+size_t GBuffer::BytesPerPixel(Format format)
+{
+    return format == Format::Packed ? 4 + 4 : 16 + 8;
+}
+
+bool GBuffer::create(Format format, int newWidth, int newHeight, std::string& error)
+{
+    Delete();
+    currentFormat = format;
+    width = newWidth;
+    height = newHeight;
+    bool packed = format == Format::Packed;
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    RenderTargetPool& pool = RenderTargetPool::Instance();
+    framebuffer = GLFramebuffer::Create();
+    albedoTexture = pool.acquire(packed ? GL_R11F_G11F_B10F : GL_RGBA32F, width, height);
+    normalTexture = pool.acquire(packed ? GL_RG16 : GL_RG32F, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normalTexture, 0);
+    // The traced color (location 0) is not kept
+    const GLenum drawBuffers[] = { GL_NONE, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, drawBuffers);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    if (!complete) {
+        // Nothing stays taken from the pool
+        Delete();
+        error = std::string(FormatName(format)) + " G-buffer targets incomplete";
+        return false;
+    }
+    return true;
+}
+
+void GBuffer::draw(Renderer& renderer, Shader& shader, const SceneCamera& camera)
+{
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+    glViewport(0, 0, width, height);
+    glDisable(GL_BLEND);
+    renderer.draw(shader, camera, width, height, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void GBuffer::read(std::vector<glm::vec3>& albedo, std::vector<glm::vec3>& normals)
+{
+    size_t count = static_cast<size_t>(width) * height;
+    std::vector<glm::vec4> pixels(count);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.get());
+
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+    albedo.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        albedo[i] = glm::vec3(pixels[i]);
+
+    glReadBuffer(GL_COLOR_ATTACHMENT2);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+    normals.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        normals[i] = Packing::DecodeOctahedral(glm::vec2(pixels[i]) * 2.0f - 1.0f);
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+}
+
+void GBuffer::Delete()
+{
+    framebuffer.reset();
+    RenderTargetPool::Instance().release(albedoTexture);
+    RenderTargetPool::Instance().release(normalTexture);
+    albedoTexture = normalTexture = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "pch.h"
+#include "GLObject.h"
+#include "Renderer.h"
+
+#include <vector>
+
+// The first hit's albedo and normal at every pixel, as default.frag's
+// GBUFFER variant writes them, e.g. as guides for a denoiser. Float32 keeps
+// albedo in RGBA32F and the normal's octahedral coordinates in RG32F, 24
+// bytes a pixel. Packed keeps albedo in R11G11B10F (six or five mantissa
+// bits, no sign) and the coordinates in RG16, 8 bytes a pixel, with normals
+// off by a few thousandths of a degree at most.
+class GBuffer
+{
+public:
+	enum class Format { Float32, Packed };
+
+	// "full" or "packed"
+	static bool ParseFormat(const std::string& name, Format& format);
+	static const char* FormatName(Format format);
+	static size_t BytesPerPixel(Format format);
+
+	bool create(Format format, int width, int height, std::string& error);
+	// One pass of shader, a GBUFFER variant, at frameIndex 0, so every ray
+	// goes through its pixel's centre. Blending is left off; the bound
+	// framebuffer and the viewport are restored.
+	void draw(Renderer& renderer, Shader& shader, const SceneCamera& camera);
+	// Albedo, and unit normals decoded from the coordinates; bottom row first
+	void read(std::vector<glm::vec3>& albedo, std::vector<glm::vec3>& normals);
+
+	Format format() const { return currentFormat; }
+	size_t bytes() const { return static_cast<size_t>(width) * height * BytesPerPixel(currentFormat); }
+
+	void Delete();
+
+private:
+	Format currentFormat = Format::Packed;
+	int width = 0;
+	int height = 0;
+	GLFramebuffer framebuffer;
+	// From RenderTargetPool, handed back in Delete()
+	GLuint albedoTexture = 0;
+	GLuint normalTexture = 0;
+};
+
+#endif // GBUFFER_H
@@ -0,0 +1,88 @@
+#ifndef GL_OBJECT_H
+#define GL_OBJECT_H
+
+#include "pch.h"
+#include "GLState.h"
+
+// Owns one GL object name and deletes it when the owner goes away or is
+// given another. Move-only: ownership can be handed on, e.g. into a member
+// or a vector, but never duplicated, since a copy would delete the same
+// name twice. Deleting needs the context current, so owners that outlive it
+// call reset() first, as the Delete() methods do.
+template <typename Kind>
+class GLObject
+{
+public:
+	GLObject() = default;
+	// Takes over a name made elsewhere, e.g. a program from Shader::StartBuild
+	explicit GLObject(GLuint name) : name(name) {}
+	~GLObject() { reset(); }
+
+	GLObject(GLObject&& other) noexcept : name(other.release()) {}
+	GLObject& operator=(GLObject&& other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			name = other.release();
+		}
+		return *this;
+	}
+	GLObject(const GLObject&) = delete;
+	GLObject& operator=(const GLObject&) = delete;
+
+	static GLObject Create() { return GLObject(Kind::Create()); }
+
+	GLuint get() const { return name; }
+	explicit operator bool() const { return name != 0; }
+
+	// Gives up ownership without deleting
+	GLuint release()
+	{
+		GLuint released = name;
+		name = 0;
+		return released;
+	}
+
+	void reset()
+	{
+		if (name)
+			Kind::Destroy(name);
+		name = 0;
+	}
+
+private:
+	GLuint name = 0;
+};
+
+struct GLBufferKind {
+	static GLuint Create() { GLuint name = 0; glGenBuffers(1, &name); return name; }
+	static void Destroy(GLuint name) { GLState::ForgetBuffer(name); glDeleteBuffers(1, &name); }
+};
+
+struct GLVertexArrayKind {
+	static GLuint Create() { GLuint name = 0; glGenVertexArrays(1, &name); return name; }
+	static void Destroy(GLuint name) { GLState::ForgetVertexArray(name); glDeleteVertexArrays(1, &name); }
+};
+
+struct GLTextureKind {
+	static GLuint Create() { GLuint name = 0; glGenTextures(1, &name); return name; }
+	static void Destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+
+struct GLFramebufferKind {
+	static GLuint Create() { GLuint name = 0; glGenFramebuffers(1, &name); return name; }
+	static void Destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+
+struct GLProgramKind {
+	static GLuint Create() { return glCreateProgram(); }
+	static void Destroy(GLuint name) { GLState::ForgetProgram(name); glDeleteProgram(name); }
+};
+
+typedef GLObject<GLBufferKind> GLBuffer;
+typedef GLObject<GLVertexArrayKind> GLVertexArray;
+typedef GLObject<GLTextureKind> GLTexture;
+typedef GLObject<GLFramebufferKind> GLFramebuffer;
+typedef GLObject<GLProgramKind> GLProgram;
+
+#endif // GL_OBJECT_H
@@ -0,0 +1,112 @@
+#include "GLState.h"
+
+namespace {
+
+// Not known yet: the next bind always goes through
+const GLuint unknown = ~0u;
+
+const GLenum bufferTargets[] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+    GL_TEXTURE_BUFFER, GL_UNIFORM_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER
+};
+const int bufferTargetCount = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+
+// One per thread, since each thread has at most one context current
+struct Tracked {
+    GLuint buffers[bufferTargetCount];
+    GLuint vertexArray = unknown;
+    GLuint program = unknown;
+    GLState::Counts counts;
+
+    Tracked() { reset(); }
+
+    void reset()
+    {
+        for (GLuint& buffer : buffers)
+            buffer = unknown;
+        vertexArray = unknown;
+        program = unknown;
+    }
+};
+
+thread_local Tracked tracked;
+
+int bufferSlot(GLenum target)
+{
+    for (int i = 0; i < bufferTargetCount; ++i)
+        if (bufferTargets[i] == target)
+            return i;
+    return -1;
+}
+
+// True when the call has to go to the driver
+bool change(GLuint& current, GLuint value)
+{
+    if (current == value) {
+        tracked.counts.skipped++;
+        return false;
+    }
+    current = value;
+    tracked.counts.issued++;
+    return true;
+}
+
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = bufferSlot(target);
+    if (slot < 0) {
+        tracked.counts.issued++;
+        glBindBuffer(target, buffer);
+    }
+    else if (change(tracked.buffers[slot], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::BindVertexArray(GLuint array)
+{
+    if (change(tracked.vertexArray, array)) {
+        glBindVertexArray(array);
+        tracked.buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+    }
+}
+
+void GLState::UseProgram(GLuint program)
+{
+    if (change(tracked.program, program))
+        glUseProgram(program);
+}
+
+void GLState::ForgetBuffer(GLuint buffer)
+{
+    for (GLuint& bound : tracked.buffers)
+        if (bound == buffer)
+            bound = unknown;
+}
+
+void GLState::ForgetVertexArray(GLuint array)
+{
+    if (tracked.vertexArray == array)
+        tracked.vertexArray = unknown;
+    // The element buffer binding went with it
+    tracked.buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+}
+
+void GLState::ForgetProgram(GLuint program)
+{
+    if (tracked.program == program)
+        tracked.program = unknown;
+}
+
+void GLState::Invalidate()
+{
+    tracked.reset();
+}
+
+GLState::Counts GLState::TakeCounts()
+{
+    Counts counts = tracked.counts;
+    tracked.counts = Counts();
+    return counts;
+}
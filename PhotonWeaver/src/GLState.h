@@ -0,0 +1,40 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "pch.h"
+
+#include <cstdint>
+
+// Buffer, vertex array and program bindings as last set through here on the
+// calling thread's context. A call that would leave them as they are never
+// reaches the driver. The tracked state is only right while every such bind
+// goes through here. Code that calls glBindBuffer, glBindVertexArray or
+// glUseProgram itself, or makes another context current on the thread,
+// must call Invalidate() afterwards.
+class GLState
+{
+public:
+	struct Counts {
+		// Calls that went to the driver
+		uint64_t issued = 0;
+		// Calls that matched the tracked binding and were dropped
+		uint64_t skipped = 0;
+	};
+
+	static void BindBuffer(GLenum target, GLuint buffer);
+	// Also forgets GL_ELEMENT_ARRAY_BUFFER, which belongs to the vertex array
+	static void BindVertexArray(GLuint array);
+	static void UseProgram(GLuint program);
+
+	// Deleting a bound object unbinds it, and its name may come back for a
+	// new object; GLObject reports every delete here
+	static void ForgetBuffer(GLuint buffer);
+	static void ForgetVertexArray(GLuint array);
+	static void ForgetProgram(GLuint program);
+	static void Invalidate();
+
+	// Calls on this thread since the last TakeCounts(), e.g. once per frame
+	static Counts TakeCounts();
+};
+
+#endif // GL_STATE_H
@@ -0,0 +1,208 @@
+#include "GpuProfiler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <iomanip>
+
+GpuProfiler::GpuProfiler(size_t window)
+    : window(window)
+{
+    // A counter width of zero means the implementation has no usable timestamps
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    enabled = bits > 0;
+    if (!enabled)
+        std::cerr << "WARNING::GPU_PROFILER::NO_TIMESTAMP_QUERIES" << std::endl;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
+
+void GpuProfiler::Delete()
+{
+    for (const auto& frame : pending) {
+        for (const Sample& sample : frame) {
+            freeQueries.push_back(sample.startQuery);
+            freeQueries.push_back(sample.endQuery);
+        }
+    }
+    for (const Sample& sample : current) {
+        freeQueries.push_back(sample.startQuery);
+        freeQueries.push_back(sample.endQuery);
+    }
+    pending.clear();
+    current.clear();
+    openSamples.clear();
+
+    if (!freeQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+    freeQueries.clear();
+}
+
+GLuint GpuProfiler::acquire()
+{
+    // Queries are recycled once read, so the pool settles at a few frames' worth
+    if (freeQueries.empty()) {
+        GLuint queries[16];
+        glGenQueries(16, queries);
+        freeQueries.insert(freeQueries.end(), queries, queries + 16);
+    }
+    GLuint query = freeQueries.back();
+    freeQueries.pop_back();
+    return query;
+}
+
+size_t GpuProfiler::passIndex(const std::string& pass)
+{
+    auto it = std::find(passNames.begin(), passNames.end(), pass);
+    if (it != passNames.end())
+        return it - passNames.begin();
+
+    passNames.push_back(pass);
+    traceNames.push_back(Trace::intern("GPU " + pass));
+    durations.emplace_back();
+    return passNames.size() - 1;
+}
+
+void GpuProfiler::beginFrame()
+{
+    if (!enabled)
+        return;
+
+    // Passes left open are dropped rather than guessed at
+    for (size_t index : openSamples) {
+        freeQueries.push_back(current[index].startQuery);
+        freeQueries.push_back(current[index].endQuery);
+        current[index].startQuery = current[index].endQuery = 0;
+    }
+    current.erase(std::remove_if(current.begin(), current.end(), [](const Sample& sample) { return sample.startQuery == 0; }), current.end());
+    openSamples.clear();
+
+#ifdef PHOTONWEAVER_TRACE
+    // Pair the GPU clock with the CPU timeline once, when tracing starts
+    if (Trace::enabled() && !gpuClockSynced) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        Trace::syncGpuClock(static_cast<uint64_t>(gpuNow));
+        gpuClockSynced = true;
+    }
+#endif
+
+    if (!current.empty())
+        pending.push_back(std::move(current));
+    current.clear();
+
+    collect();
+}
+
+void GpuProfiler::begin(const std::string& pass)
+{
+    if (!enabled)
+        return;
+
+    Sample sample = { passIndex(pass), acquire(), acquire() };
+    glQueryCounter(sample.startQuery, GL_TIMESTAMP);
+    // Tilers such as llvmpipe resolve timestamps queued with the pass's draws per tile,
+    // so the start would land near the last tile; submitting it first keeps it ahead of the pass
+    glFlush();
+    openSamples.push_back(current.size());
+    current.push_back(sample);
+}
+
+void GpuProfiler::end()
+{
+    if (!enabled || openSamples.empty())
+        return;
+
+    glQueryCounter(current[openSamples.back()].endQuery, GL_TIMESTAMP);
+    openSamples.pop_back();
+}
+
+void GpuProfiler::collect()
+{
+    // Frames complete in submission order, so stop at the first one still in flight
+    while (!pending.empty()) {
+        std::vector<Sample>& frame = pending.front();
+
+        // Nested passes end out of order, so every end query has to be checked
+        GLuint available = 1;
+        for (size_t i = 0; i < frame.size() && available; ++i)
+            glGetQueryObjectuiv(frame[i].endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        for (const Sample& sample : frame) {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(sample.startQuery, GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(sample.endQuery, GL_QUERY_RESULT, &end);
+
+#ifdef PHOTONWEAVER_TRACE
+            if (gpuClockSynced)
+                Trace::recordGpu(traceNames[sample.pass], start, end);
+#endif
+
+            std::deque<double>& history = durations[sample.pass];
+            history.push_back((end - start) / 1.0e6);
+            if (history.size() > window)
+                history.pop_front();
+
+            freeQueries.push_back(sample.startQuery);
+            freeQueries.push_back(sample.endQuery);
+        }
+        pending.pop_front();
+    }
+}
+
+std::vector<GpuProfiler::PassStats> GpuProfiler::stats() const
+{
+    std::vector<PassStats> result;
+    for (size_t i = 0; i < passNames.size(); ++i) {
+        PassStats pass;
+        pass.name = passNames[i];
+        pass.samples = durations[i].size();
+        if (pass.samples == 0) {
+            result.push_back(pass);
+            continue;
+        }
+
+        std::vector<double> sorted(durations[i].begin(), durations[i].end());
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+        for (double duration : sorted)
+            total += duration;
+
+        pass.minMs = sorted.front();
+        pass.avgMs = total / sorted.size();
+        pass.p99Ms = sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99))];
+        result.push_back(pass);
+    }
+    return result;
+}
+
+std::string GpuProfiler::summary() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (const PassStats& pass : stats())
+        out << " | " << pass.name << " " << pass.avgMs << "ms";
+    return out.str();
+}
+
+void GpuProfiler::print(std::ostream& out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "GPU pass        min ms    avg ms    p99 ms  frames" << std::endl;
+    for (const PassStats& pass : stats()) {
+        out << "  " << std::left << std::setw(12) << pass.name << std::right
+            << std::setw(10) << pass.minMs
+            << std::setw(10) << pass.avgMs
+            << std::setw(10) << pass.p99Ms
+            << std::setw(8) << pass.samples << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,85 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "pch.h"
+
+#include <deque>
+#include <vector>
+
+// Measures GPU time per render pass with GL_TIMESTAMP queries. Results are
+// read back several frames later, and only once the driver reports them
+// available, so the CPU never waits on the GPU for a measurement.
+class GpuProfiler
+{
+public:
+	struct PassStats {
+		std::string name;
+		double minMs = 0.0;
+		double avgMs = 0.0;
+		double p99Ms = 0.0;
+		size_t samples = 0;
+	};
+
+	// window is the number of most recent frames the statistics cover
+	explicit GpuProfiler(size_t window = 240);
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	bool supported() const { return enabled; }
+
+	// Collects finished frames and opens a new one
+	void beginFrame();
+	void begin(const std::string& pass);
+	void end();
+
+	std::vector<PassStats> stats() const;
+	// Compact "pass avg" list for the window title
+	std::string summary() const;
+	// min/avg/p99 table, one line per pass
+	void print(std::ostream& out) const;
+
+	void Delete();
+
+private:
+	struct Sample {
+		size_t pass;
+		GLuint startQuery;
+		GLuint endQuery;
+	};
+
+	bool enabled = false;
+	size_t window;
+
+	std::vector<std::string> passNames;
+	// Stable copies of the names for the trace timeline
+	std::vector<const char*> traceNames;
+	bool gpuClockSynced = false;
+	std::vector<std::deque<double>> durations;
+
+	// Frames whose queries were issued but not yet read, oldest first
+	std::deque<std::vector<Sample>> pending;
+	std::vector<Sample> current;
+	// Indices into current of passes begun but not ended, so passes may nest
+	std::vector<size_t> openSamples;
+
+	std::vector<GLuint> freeQueries;
+
+	GLuint acquire();
+	size_t passIndex(const std::string& pass);
+	void collect();
+};
+
+// Brackets a pass for the lifetime of the scope
+class GpuScope
+{
+public:
+	GpuScope(GpuProfiler& profiler, const std::string& pass) : profiler(profiler) { profiler.begin(pass); }
+	~GpuScope() { profiler.end(); }
+
+private:
+	GpuProfiler& profiler;
+};
+
+#endif // GPU_PROFILER_H
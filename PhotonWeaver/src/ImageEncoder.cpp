@@ -0,0 +1,138 @@
+#include "ImageEncoder.h"
+#include "ImageIO.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+
+ImageEncoder::ImageEncoder(unsigned threads, size_t capacity)
+    : capacity(std::max<size_t>(capacity, 1))
+{
+    unsigned count = threads ? threads : std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (unsigned i = 0; i < count; ++i)
+        workers.emplace_back(&ImageEncoder::run, this);
+}
+
+ImageEncoder::~ImageEncoder()
+{
+    Delete();
+}
+
+std::vector<glm::vec4> ImageEncoder::takeBuffer()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeBuffers.empty())
+        return std::vector<glm::vec4>();
+    std::vector<glm::vec4> buffer = std::move(freeBuffers.back());
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+void ImageEncoder::push(Job&& job)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (outstanding >= capacity) {
+        TRACE_SCOPE("encoder full");
+        auto start = std::chrono::steady_clock::now();
+        room.wait(lock, [this] { return outstanding < capacity; });
+        totals.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    ++outstanding;
+    jobs.push_back(std::move(job));
+    wake.notify_one();
+}
+
+void ImageEncoder::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    room.wait(lock, [this] { return outstanding == 0; });
+}
+
+ImageEncoder::Stats ImageEncoder::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
+
+void ImageEncoder::run()
+{
+    TRACE_THREAD_NAME("image encoder");
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                break;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool written = false;
+        {
+            TRACE_SCOPE("encode image");
+            written = Write(job);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (job.done)
+            job.done(written, ms);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++(written ? totals.written : totals.failed);
+        totals.encodeMs += ms;
+        freeBuffers.push_back(std::move(job.pixels));
+        --outstanding;
+        room.notify_all();
+    }
+}
+
+void ImageEncoder::Delete()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+bool ImageEncoder::Write(const Job& job)
+{
+    switch (job.format) {
+    case Format::Png:
+        return ImageIO::WritePng(job.path, job.width, job.height, job.pixels, job.exposure);
+    case Format::Exr:
+        return ImageIO::WriteExr(job.path, job.width, job.height, job.pixels);
+    case Format::Pfm:
+        return ImageIO::WritePfm(job.path, job.width, job.height, job.pixels);
+    }
+    return false;
+}
+
+bool ImageEncoder::ParseFormat(const std::string& name, Format& format)
+{
+    if (name == "png")
+        format = Format::Png;
+    else if (name == "exr")
+        format = Format::Exr;
+    else if (name == "pfm")
+        format = Format::Pfm;
+    else
+        return false;
+    return true;
+}
+
+const char* ImageEncoder::Extension(Format format)
+{
+    switch (format) {
+    case Format::Exr:
+        return ".exr";
+    case Format::Pfm:
+        return ".pfm";
+    default:
+        return ".png";
+    }
+}
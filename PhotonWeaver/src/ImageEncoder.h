@@ -0,0 +1,87 @@
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include "pch.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tonemaps and writes images on a pool of worker threads. The queue is
+// bounded: push() blocks while capacity images are waiting or being
+// written. A producer that outruns the disk is slowed down to its pace
+// rather than piling frames up in memory. Pixel buffers go back to a free
+// list once written, so steady capture allocates nothing.
+class ImageEncoder
+{
+public:
+	enum class Format {
+		Png, // 8-bit sRGB after exposure, see ImageIO::WritePng
+		Exr,
+		Pfm  // raw float
+	};
+
+	struct Job {
+		std::filesystem::path path;
+		Format format = Format::Png;
+		float exposure = 1.0f;
+		int width = 0;
+		int height = 0;
+		// RGBA, bottom row first
+		std::vector<glm::vec4> pixels;
+		// Called on the worker once the file is written, or failed to be
+		std::function<void(bool written, double encodeMs)> done;
+	};
+
+	struct Stats {
+		size_t written = 0;
+		size_t failed = 0;
+		// Time push() spent waiting for room, i.e. how far the workers fell behind
+		double blockedMs = 0.0;
+		// Summed over the workers
+		double encodeMs = 0.0;
+	};
+
+	// threads 0 uses all cores but one, which is left to the render loop
+	explicit ImageEncoder(unsigned threads = 0, size_t capacity = 8);
+	~ImageEncoder();
+
+	ImageEncoder(const ImageEncoder&) = delete;
+	ImageEncoder& operator=(const ImageEncoder&) = delete;
+
+	// A buffer for the next job's pixels, recycled when one is free
+	std::vector<glm::vec4> takeBuffer();
+	void push(Job&& job);
+	// Blocks until every pushed image is written
+	void finish();
+	Stats stats();
+
+	// Writes what is queued, then stops the workers
+	void Delete();
+
+	// Writes job's image on the calling thread; done is not called
+	static bool Write(const Job& job);
+	// "png", "exr" or "pfm"
+	static bool ParseFormat(const std::string& name, Format& format);
+	static const char* Extension(Format format);
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable room;
+	std::deque<Job> jobs;
+	std::vector<std::vector<glm::vec4>> freeBuffers;
+	size_t capacity;
+	// Queued plus being written
+	size_t outstanding = 0;
+	bool stopping = false;
+	Stats totals;
+
+	void run();
+};
+
+#endif // IMAGE_ENCODER_H
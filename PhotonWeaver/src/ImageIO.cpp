@@ -0,0 +1,496 @@
+#include "ImageIO.h"
+#include "Packing.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const uint32_t exrMagic = 20000630;
+const int32_t exrFloat = 2;
+
+// EXR is little-endian throughout, like every platform this builds on
+template <typename T>
+void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void putAttribute(std::string& out, const char* name, const char* type, const std::string& value)
+{
+    out.append(name, std::strlen(name) + 1);
+    out.append(type, std::strlen(type) + 1);
+    put<int32_t>(out, static_cast<int32_t>(value.size()));
+    out += value;
+}
+
+class Reader
+{
+public:
+    explicit Reader(const std::string& data) : data(data) {}
+
+    template <typename T>
+    bool get(T& value)
+    {
+        if (position + sizeof(T) > data.size())
+            return false;
+        std::memcpy(&value, data.data() + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool string(std::string& value)
+    {
+        size_t end = data.find('\0', position);
+        if (end == std::string::npos)
+            return false;
+        value = data.substr(position, end - position);
+        position = end + 1;
+        return true;
+    }
+
+    const std::string& data;
+    size_t position = 0;
+};
+
+// Next whitespace-separated header field of a netpbm file, skipping comments
+bool ppmField(const std::string& data, size_t& position, int& value)
+{
+    for (;;) {
+        while (position < data.size() && std::isspace(static_cast<unsigned char>(data[position])))
+            ++position;
+        if (position >= data.size() || data[position] != '#')
+            break;
+        while (position < data.size() && data[position] != '\n')
+            ++position;
+    }
+    if (position >= data.size() || !std::isdigit(static_cast<unsigned char>(data[position])))
+        return false;
+    value = 0;
+    while (position < data.size() && std::isdigit(static_cast<unsigned char>(data[position])) && value < 1 << 24)
+        value = value * 10 + (data[position++] - '0');
+    return true;
+}
+
+struct CrcTable {
+    std::array<uint32_t, 256> entries;
+
+    CrcTable()
+    {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const CrcTable table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Linear value to an sRGB byte, finely enough sampled that dark values land
+// within a fifth of a step of the exact curve
+struct SrgbEncodeTable {
+    static const int size = 1 << 14;
+    std::array<uint8_t, size + 1> bytes;
+
+    SrgbEncodeTable()
+    {
+        for (int i = 0; i <= size; ++i)
+            bytes[i] = static_cast<uint8_t>(Packing::LinearToSrgb(static_cast<float>(i) / size) * 255.0f + 0.5f);
+    }
+
+    uint8_t operator()(float value) const
+    {
+        // glm::clamp passes NaN through, and NaN cast to an index is undefined
+        if (!(value > 0.0f))
+            return bytes[0];
+        return bytes[static_cast<int>(glm::clamp(value, 0.0f, 1.0f) * size + 0.5f)];
+    }
+};
+
+void putBigEndian(std::string& out, uint32_t value)
+{
+    const char bytes[4] = { static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8), static_cast<char>(value) };
+    out.append(bytes, 4);
+}
+
+void putPngChunk(std::string& out, const char* type, const std::string& data)
+{
+    putBigEndian(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.append(type, 4);
+    out += data;
+    putBigEndian(out, crc32(0, reinterpret_cast<const uint8_t*>(out.data() + start), out.size() - start));
+}
+
+}
+
+bool ImageIO::WriteExr(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels)
+{
+    ExrWriter writer;
+    return writer.open(path, width, height) && writer.writeRows(pixels.data(), height) && writer.close();
+}
+
+bool ImageIO::WritePng(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels, float exposure)
+{
+    static const SrgbEncodeTable encode;
+
+    // Filter byte 0 then RGB, top row first
+    size_t rowBytes = static_cast<size_t>(width) * 3 + 1;
+    std::vector<uint8_t> raw(rowBytes * height);
+    for (int y = 0; y < height; ++y) {
+        const glm::vec4* row = pixels.data() + static_cast<size_t>(height - 1 - y) * width;
+        uint8_t* out = raw.data() + y * rowBytes;
+        *out++ = 0;
+        for (int x = 0; x < width; ++x) {
+            *out++ = encode(row[x].r * exposure);
+            *out++ = encode(row[x].g * exposure);
+            *out++ = encode(row[x].b * exposure);
+        }
+    }
+
+    // zlib stream of stored deflate blocks, at most 65535 bytes each
+    std::string zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib += '\x78';
+    zlib += '\x01';
+    uint32_t a = 1, b = 0;
+    for (size_t offset = 0; offset < raw.size() || offset == 0;) {
+        size_t size = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + size == raw.size();
+        uint16_t length = static_cast<uint16_t>(size);
+        uint16_t inverse = static_cast<uint16_t>(~length);
+        zlib += static_cast<char>(last ? 1 : 0);
+        put<uint16_t>(zlib, length);
+        put<uint16_t>(zlib, inverse);
+        zlib.append(reinterpret_cast<const char*>(raw.data() + offset), size);
+        // Adler-32, reduced once per block; 65535 bytes cannot overflow b
+        for (size_t i = offset; i < offset + size; ++i) {
+            a += raw[i];
+            b += a;
+            if (a >= 65521)
+                a -= 65521;
+        }
+        b %= 65521;
+        offset += size;
+        if (last)
+            break;
+    }
+    putBigEndian(zlib, b << 16 | a);
+
+    std::string header;
+    putBigEndian(header, static_cast<uint32_t>(width));
+    putBigEndian(header, static_cast<uint32_t>(height));
+    header += '\x08'; // bit depth
+    header += '\x02'; // truecolor
+    header.append(3, '\0'); // deflate, adaptive filtering, no interlace
+
+    std::string png = "\x89PNG\r\n\x1a\n";
+    putPngChunk(png, "IHDR", header);
+    putPngChunk(png, "IDAT", zlib);
+    putPngChunk(png, "IEND", std::string());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(png.data(), png.size());
+    if (!file) {
+        std::cerr << "ERROR::IMAGE::FILE_NOT_WRITTEN: " << path.string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ImageIO::WritePfm(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels)
+{
+    // A negative scale marks the data little-endian
+    std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    std::vector<float> rgb(static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+        rgb[i * 3] = pixels[i].r;
+        rgb[i * 3 + 1] = pixels[i].g;
+        rgb[i * 3 + 2] = pixels[i].b;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size() * sizeof(float));
+    if (!file) {
+        std::cerr << "ERROR::IMAGE::FILE_NOT_WRITTEN: " << path.string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ExrWriter::open(const std::filesystem::path& path, int width, int height)
+{
+    std::string header;
+    put<uint32_t>(header, exrMagic);
+    put<uint32_t>(header, 2);
+
+    // Channels are stored in alphabetical order
+    std::string channels;
+    for (const char* name : { "B", "G", "R" }) {
+        channels.append(name, 2);
+        put<int32_t>(channels, exrFloat);
+        put<uint32_t>(channels, 0); // pLinear and reserved
+        put<int32_t>(channels, 1);
+        put<int32_t>(channels, 1);
+    }
+    channels += '\0';
+
+    std::string window;
+    put<int32_t>(window, 0);
+    put<int32_t>(window, 0);
+    put<int32_t>(window, width - 1);
+    put<int32_t>(window, height - 1);
+
+    std::string one, center;
+    put<float>(one, 1.0f);
+    put<float>(center, 0.0f);
+    put<float>(center, 0.0f);
+
+    putAttribute(header, "channels", "chlist", channels);
+    putAttribute(header, "compression", "compression", std::string(1, '\0'));
+    putAttribute(header, "dataWindow", "box2i", window);
+    putAttribute(header, "displayWindow", "box2i", window);
+    putAttribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+    putAttribute(header, "pixelAspectRatio", "float", one);
+    putAttribute(header, "screenWindowCenter", "v2f", center);
+    putAttribute(header, "screenWindowWidth", "float", one);
+    header += '\0';
+
+    // One chunk per scanline: y, byte count, then each channel's row in turn.
+    // Chunks are all the same size, so the offset table is known before any pixel.
+    uint64_t lineBytes = static_cast<uint64_t>(width) * 3 * sizeof(float);
+    uint64_t chunkBytes = 8 + lineBytes;
+    uint64_t firstChunk = header.size() + static_cast<uint64_t>(height) * 8;
+    for (int y = 0; y < height; ++y)
+        put<uint64_t>(header, firstChunk + y * chunkBytes);
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR::IMAGE::FILE_NOT_WRITTEN: " << path.string() << std::endl;
+        return false;
+    }
+    file.write(header.data(), header.size());
+    this->path = path;
+    this->width = width;
+    this->height = height;
+    nextLine = 0;
+    line.resize(static_cast<size_t>(width) * 3);
+    return static_cast<bool>(file);
+}
+
+bool ExrWriter::writeRows(const glm::vec4* pixels, int rows)
+{
+    if (!file.is_open() || nextLine + rows > height)
+        return false;
+    uint32_t lineBytes = static_cast<uint32_t>(line.size() * sizeof(float));
+    // EXR rows run top to bottom, so the band's last row goes first
+    for (int k = rows - 1; k >= 0; --k) {
+        const glm::vec4* row = pixels + static_cast<size_t>(k) * width;
+        for (int x = 0; x < width; ++x) {
+            line[x] = row[x].b;
+            line[width + x] = row[x].g;
+            line[2 * width + x] = row[x].r;
+        }
+        int32_t chunk[2] = { nextLine++, static_cast<int32_t>(lineBytes) };
+        file.write(reinterpret_cast<const char*>(chunk), sizeof(chunk));
+        file.write(reinterpret_cast<const char*>(line.data()), lineBytes);
+    }
+    return static_cast<bool>(file);
+}
+
+bool ExrWriter::close()
+{
+    bool complete = file.is_open() && nextLine == height && static_cast<bool>(file);
+    file.close();
+    if (!complete)
+        std::cerr << "ERROR::IMAGE::FILE_INCOMPLETE: " << path.string() << " (" << nextLine << " of " << height << " rows)" << std::endl;
+    return complete;
+}
+
+bool ImageIO::ReadExr(const std::filesystem::path& path, int& width, int& height, std::vector<glm::vec4>& pixels, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string data = stream.str();
+
+    Reader reader(data);
+    uint32_t magic = 0, version = 0;
+    if (!reader.get(magic) || magic != exrMagic || !reader.get(version) || (version & 0xFF) != 2 || (version & ~0xFFu) != 0) {
+        error = "not a single-part scanline EXR";
+        return false;
+    }
+
+    int32_t window[4] = { 0, 0, -1, -1 };
+    std::vector<std::string> channelNames;
+    for (;;) {
+        std::string name, type;
+        int32_t size = 0;
+        if (!reader.string(name)) {
+            error = "truncated header";
+            return false;
+        }
+        if (name.empty())
+            break;
+        if (!reader.string(type) || !reader.get(size) || reader.position + size > data.size()) {
+            error = "truncated header";
+            return false;
+        }
+        size_t valueStart = reader.position;
+
+        if (name == "channels") {
+            std::string channel;
+            while (reader.string(channel) && !channel.empty()) {
+                int32_t pixelType = 0, sampling[2];
+                uint32_t reserved;
+                reader.get(pixelType);
+                reader.get(reserved);
+                reader.get(sampling[0]);
+                reader.get(sampling[1]);
+                if (pixelType != exrFloat || sampling[0] != 1 || sampling[1] != 1) {
+                    error = "channel " + channel + " is not full-resolution 32-bit float";
+                    return false;
+                }
+                channelNames.push_back(channel);
+            }
+        }
+        else if (name == "compression") {
+            if (data[valueStart] != 0) {
+                error = "compressed EXR files are not supported";
+                return false;
+            }
+        }
+        else if (name == "dataWindow") {
+            for (int32_t& value : window)
+                reader.get(value);
+        }
+        reader.position = valueStart + size;
+    }
+
+    // The offset table follows the header; chunks are located through it
+    size_t table = reader.position;
+
+    width = window[2] - window[0] + 1;
+    height = window[3] - window[1] + 1;
+    if (width <= 0 || height <= 0) {
+        error = "empty data window";
+        return false;
+    }
+
+    std::vector<int> target(channelNames.size(), -1);
+    for (size_t c = 0; c < channelNames.size(); ++c) {
+        if (channelNames[c] == "R")
+            target[c] = 0;
+        else if (channelNames[c] == "G")
+            target[c] = 1;
+        else if (channelNames[c] == "B")
+            target[c] = 2;
+    }
+
+    pixels.assign(static_cast<size_t>(width) * height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    size_t lineBytes = static_cast<size_t>(width) * channelNames.size() * sizeof(float);
+    for (int i = 0; i < height; ++i) {
+        uint64_t offset = 0;
+        int32_t y = 0, size = 0;
+        reader.position = table + static_cast<size_t>(i) * 8;
+        if (!reader.get(offset) || offset + 8 + lineBytes > data.size()) {
+            error = "truncated scanline table";
+            return false;
+        }
+        reader.position = static_cast<size_t>(offset);
+        reader.get(y);
+        reader.get(size);
+        y -= window[1];
+        if (y < 0 || y >= height || static_cast<size_t>(size) != lineBytes) {
+            error = "unexpected scanline chunk";
+            return false;
+        }
+
+        glm::vec4* row = pixels.data() + static_cast<size_t>(height - 1 - y) * width;
+        const char* source = data.data() + reader.position;
+        for (size_t c = 0; c < channelNames.size(); ++c) {
+            if (target[c] < 0)
+                continue;
+            for (int x = 0; x < width; ++x) {
+                float value;
+                std::memcpy(&value, source + (c * width + x) * sizeof(float), sizeof(float));
+                row[x][target[c]] = value;
+            }
+        }
+    }
+    return true;
+}
+
+bool ImageIO::ReadPpm(const std::filesystem::path& path, int& width, int& height, std::vector<glm::vec4>& pixels, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string data = stream.str();
+
+    bool binary = data.compare(0, 2, "P6") == 0;
+    if (!binary && data.compare(0, 2, "P3") != 0) {
+        error = "not a P6 or P3 PPM";
+        return false;
+    }
+    size_t position = 2;
+    int maxValue = 0;
+    if (!ppmField(data, position, width) || !ppmField(data, position, height) || !ppmField(data, position, maxValue)
+        || width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 65535) {
+        error = "bad PPM header";
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(width) * height;
+    int sampleBytes = maxValue < 256 ? 1 : 2;
+    // A single whitespace byte ends the header of a binary file
+    ++position;
+    if (binary && data.size() < position + count * 3 * sampleBytes) {
+        error = "truncated PPM";
+        return false;
+    }
+    pixels.assign(count, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    float scale = 1.0f / maxValue;
+    for (size_t i = 0; i < count * 3; ++i) {
+        int value = 0;
+        if (!binary) {
+            if (!ppmField(data, position, value)) {
+                error = "truncated PPM";
+                return false;
+            }
+        }
+        else if (sampleBytes == 1) {
+            value = static_cast<unsigned char>(data[position + i]);
+        }
+        else {
+            // Two-byte samples are big-endian
+            value = static_cast<unsigned char>(data[position + i * 2]) << 8 | static_cast<unsigned char>(data[position + i * 2 + 1]);
+        }
+        // Files store the top row first
+        size_t pixel = i / 3;
+        size_t row = static_cast<size_t>(height) - 1 - pixel / width;
+        pixels[row * width + pixel % width][static_cast<int>(i % 3)] = std::min(value, maxValue) * scale;
+    }
+    return true;
+}
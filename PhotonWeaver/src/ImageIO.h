@@ -0,0 +1,54 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "pch.h"
+
+#include <vector>
+
+// Float image files. Pixels are RGBA, bottom row first as glReadPixels
+// returns them; alpha is not stored.
+class ImageIO
+{
+public:
+	// Scanline OpenEXR, 32-bit float R, G, B, no compression
+	static bool WriteExr(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels);
+	// Reads back what WriteExr writes; other EXR variants are rejected with a message
+	static bool ReadExr(const std::filesystem::path& path, int& width, int& height, std::vector<glm::vec4>& pixels, std::string& error);
+	// Binary (P6) or ASCII (P3) netpbm, up to 16 bits per channel. Values are
+	// scaled to [0, 1] and left sRGB encoded, as the file stores them.
+	static bool ReadPpm(const std::filesystem::path& path, int& width, int& height, std::vector<glm::vec4>& pixels, std::string& error);
+
+	// 8-bit sRGB PNG of the pixels times exposure, clamped to [0, 1]. The
+	// deflate stream uses stored blocks only, so encoding is a table lookup
+	// and a checksum per byte; files are as large as the raw pixels.
+	static bool WritePng(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels, float exposure = 1.0f);
+	// Portable float map (PF): raw little-endian RGB floats, bottom row first
+	// like the pixels, so writing it is one conversion and one write
+	static bool WritePfm(const std::filesystem::path& path, int width, int height, const std::vector<glm::vec4>& pixels);
+};
+
+// Writes the same file as ImageIO::WriteExr a band of rows at a time, top
+// band first, so an image larger than memory can go to disk as it is rendered
+class ExrWriter
+{
+public:
+	bool open(const std::filesystem::path& path, int width, int height);
+	// rows full rows, bottom row first like every image here, lying directly
+	// below the rows written so far
+	bool writeRows(const glm::vec4* pixels, int rows);
+	// False, with a message, unless every row was written
+	bool close();
+
+	int rowsLeft() const { return height - nextLine; }
+
+private:
+	std::ofstream file;
+	std::filesystem::path path;
+	int width = 0;
+	int height = 0;
+	// Next EXR scanline, counted from the top
+	int nextLine = 0;
+	std::vector<float> line;
+};
+
+#endif // IMAGE_IO_H
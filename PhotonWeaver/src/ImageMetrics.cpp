@@ -0,0 +1,81 @@
+#include "ImageMetrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float labCurve(float t)
+{
+    return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+// Reinhard tonemap, then linear sRGB to CIELAB under D65
+glm::vec3 toLab(const glm::vec3& color)
+{
+    glm::vec3 c = glm::max(color, glm::vec3(0.0f));
+    c = c / (glm::vec3(1.0f) + c);
+
+    float x = (0.4124f * c.r + 0.3576f * c.g + 0.1805f * c.b) / 0.95047f;
+    float y = 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    float z = (0.0193f * c.r + 0.1192f * c.g + 0.9505f * c.b) / 1.08883f;
+
+    float fx = labCurve(x), fy = labCurve(y), fz = labCurve(z);
+    return glm::vec3(116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz));
+}
+
+// 3x3 binomial blur standing in for FLIP's contrast sensitivity filter
+std::vector<glm::vec3> blurredLab(const std::vector<glm::vec4>& image, int width, int height)
+{
+    std::vector<glm::vec3> lab(image.size());
+    for (size_t i = 0; i < image.size(); ++i)
+        lab[i] = toLab(glm::vec3(image[i]));
+
+    const float weights[3] = { 0.25f, 0.5f, 0.25f };
+    std::vector<glm::vec3> blurred(image.size());
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec3 total(0.0f);
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int sx = std::clamp(x + dx, 0, width - 1);
+                    int sy = std::clamp(y + dy, 0, height - 1);
+                    total += weights[dx + 1] * weights[dy + 1] * lab[static_cast<size_t>(sy) * width + sx];
+                }
+            }
+            blurred[static_cast<size_t>(y) * width + x] = total;
+        }
+    }
+    return blurred;
+}
+
+}
+
+ImageMetrics::Error ImageMetrics::Compare(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference, int width, int height)
+{
+    Error error;
+    size_t count = static_cast<size_t>(width) * height;
+    if (count == 0 || image.size() < count || reference.size() < count)
+        return error;
+
+    double squared = 0.0, relative = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            double difference = image[i][c] - reference[i][c];
+            double value = reference[i][c];
+            squared += difference * difference;
+            relative += difference * difference / (value * value + 0.01);
+        }
+    }
+    error.rmse = std::sqrt(squared / (count * 3));
+    error.relMse = relative / (count * 3);
+
+    // A Lab distance of 100 (black against white) maps to full error
+    std::vector<glm::vec3> a = blurredLab(image, width, height);
+    std::vector<glm::vec3> b = blurredLab(reference, width, height);
+    double perceptual = 0.0;
+    for (size_t i = 0; i < count; ++i)
+        perceptual += std::min(1.0f, glm::length(a[i] - b[i]) / 100.0f);
+    error.flip = perceptual / count;
+    return error;
+}
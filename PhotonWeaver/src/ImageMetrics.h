@@ -0,0 +1,25 @@
+#ifndef IMAGE_METRICS_H
+#define IMAGE_METRICS_H
+
+#include "pch.h"
+
+#include <vector>
+
+// Error of a rendered image against a converged reference
+class ImageMetrics
+{
+public:
+	struct Error {
+		double rmse = 0.0;
+		// Squared error relative to the reference, so dark regions count too
+		double relMse = 0.0;
+		// FLIP-style perceptual difference in [0, 1]: both images are tonemapped,
+		// converted to CIELAB, blurred slightly and compared per pixel. A cheap
+		// stand-in for NVIDIA FLIP, good for ranking but not for comparing with it.
+		double flip = 0.0;
+	};
+
+	static Error Compare(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference, int width, int height);
+};
+
+#endif // IMAGE_METRICS_H
@@ -0,0 +1,415 @@
+#include "Json.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+namespace {
+
+const Json nullValue;
+
+class Parser
+{
+public:
+    explicit Parser(const std::string& source) : source(source) {}
+
+    bool document(Json& result, std::string& error)
+    {
+        skipSpace();
+        if (!value(result) || (skipSpace(), position != source.size())) {
+            if (message.empty())
+                message = "unexpected trailing characters";
+            error = "line " + std::to_string(line()) + ": " + message;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const std::string& source;
+    size_t position = 0;
+    int depth = 0;
+    std::string message;
+
+    static constexpr int maxDepth = 256;
+
+    int line() const
+    {
+        return 1 + static_cast<int>(std::count(source.begin(), source.begin() + std::min(position, source.size()), '\n'));
+    }
+
+    bool fail(const std::string& text)
+    {
+        if (message.empty())
+            message = text;
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while (position < source.size()) {
+            char c = source[position];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                ++position;
+            }
+            // Scene files are edited by hand, so // comments are tolerated
+            else if (c == '/' && position + 1 < source.size() && source[position + 1] == '/') {
+                while (position < source.size() && source[position] != '\n')
+                    ++position;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    bool literal(const char* word)
+    {
+        size_t length = std::strlen(word);
+        if (source.compare(position, length, word) != 0)
+            return false;
+        position += length;
+        return true;
+    }
+
+    bool value(Json& result)
+    {
+        if (position >= source.size())
+            return fail("unexpected end of input");
+
+        char c = source[position];
+        if (c == '{' || c == '[') {
+            // Each level recurses, so a line of brackets from a client must not exhaust the stack
+            if (depth >= maxDepth)
+                return fail("nesting too deep");
+            ++depth;
+            bool parsed = c == '{' ? object(result) : array(result);
+            --depth;
+            return parsed;
+        }
+        if (c == '"') {
+            std::string text;
+            if (!string(text))
+                return false;
+            result = Json(text);
+            return true;
+        }
+        if (literal("true")) {
+            result = Json(true);
+            return true;
+        }
+        if (literal("false")) {
+            result = Json(false);
+            return true;
+        }
+        if (literal("null")) {
+            result = Json();
+            return true;
+        }
+        return numberValue(result);
+    }
+
+    bool numberValue(Json& result)
+    {
+        // from_chars ignores the locale, which strtod would follow for the decimal point
+        const char* begin = source.data() + position;
+        double number = 0.0;
+        std::from_chars_result parsed = std::from_chars(begin, source.data() + source.size(), number);
+        if (parsed.ec == std::errc::result_out_of_range)
+            return fail("number out of range");
+        if (parsed.ec != std::errc())
+            return fail(std::string("unexpected character '") + source[position] + "'");
+        position += parsed.ptr - begin;
+        result = Json(number);
+        return true;
+    }
+
+    bool hexDigit(char c, unsigned& digit)
+    {
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        return true;
+    }
+
+    bool string(std::string& text)
+    {
+        ++position;
+        while (position < source.size()) {
+            char c = source[position++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                text += c;
+                continue;
+            }
+            if (position >= source.size())
+                break;
+            char escape = source[position++];
+            switch (escape) {
+            case 'n': text += '\n'; break;
+            case 't': text += '\t'; break;
+            case 'r': text += '\r'; break;
+            case 'b': text += '\b'; break;
+            case 'f': text += '\f'; break;
+            case 'u': {
+                if (position + 4 > source.size())
+                    return fail("truncated \\u escape");
+                unsigned code = 0;
+                for (int i = 0; i < 4; ++i) {
+                    unsigned digit;
+                    if (!hexDigit(source[position + i], digit))
+                        return fail("expected four hex digits after \\u");
+                    code = code * 16 + digit;
+                }
+                position += 4;
+                // Only the Basic Multilingual Plane; enough for names and paths
+                if (code < 0x80) {
+                    text += static_cast<char>(code);
+                }
+                else if (code < 0x800) {
+                    text += static_cast<char>(0xC0 | (code >> 6));
+                    text += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else {
+                    text += static_cast<char>(0xE0 | (code >> 12));
+                    text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    text += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: text += escape; break;
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool array(Json& result)
+    {
+        ++position;
+        result = Json::array();
+        skipSpace();
+        if (position < source.size() && source[position] == ']') {
+            ++position;
+            return true;
+        }
+        for (;;) {
+            Json element;
+            skipSpace();
+            if (!value(element))
+                return false;
+            result.push(element);
+            skipSpace();
+            if (position < source.size() && source[position] == ',') {
+                ++position;
+                continue;
+            }
+            if (position < source.size() && source[position] == ']') {
+                ++position;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool object(Json& result)
+    {
+        ++position;
+        result = Json::object();
+        skipSpace();
+        if (position < source.size() && source[position] == '}') {
+            ++position;
+            return true;
+        }
+        for (;;) {
+            skipSpace();
+            std::string key;
+            if (position >= source.size() || source[position] != '"' || !string(key))
+                return fail("expected a quoted key");
+            skipSpace();
+            if (position >= source.size() || source[position] != ':')
+                return fail("expected ':' after \"" + key + "\"");
+            ++position;
+            skipSpace();
+            Json member;
+            if (!value(member))
+                return false;
+            result.set(key, member);
+            skipSpace();
+            if (position < source.size() && source[position] == ',') {
+                ++position;
+                continue;
+            }
+            if (position < source.size() && source[position] == '}') {
+                ++position;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+};
+
+void writeString(std::ostringstream& out, const std::string& text)
+{
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\t': out << "\\t"; break;
+        case '\r': out << "\\r"; break;
+        default: out << c; break;
+        }
+    }
+    out << '"';
+}
+
+}
+
+Json Json::array()
+{
+    Json value;
+    value.type = Type::Array;
+    return value;
+}
+
+Json Json::object()
+{
+    Json value;
+    value.type = Type::Object;
+    return value;
+}
+
+size_t Json::size() const
+{
+    return type == Type::Array ? elements.size() : type == Type::Object ? fields.size() : 0;
+}
+
+const Json& Json::operator[](size_t index) const
+{
+    return index < elements.size() ? elements[index] : nullValue;
+}
+
+Json& Json::push(const Json& value)
+{
+    type = Type::Array;
+    elements.push_back(value);
+    return elements.back();
+}
+
+bool Json::has(const std::string& key) const
+{
+    for (const auto& field : fields) {
+        if (field.first == key)
+            return true;
+    }
+    return false;
+}
+
+const Json& Json::operator[](const std::string& key) const
+{
+    for (const auto& field : fields) {
+        if (field.first == key)
+            return field.second;
+    }
+    return nullValue;
+}
+
+Json& Json::set(const std::string& key, const Json& value)
+{
+    type = Type::Object;
+    for (auto& field : fields) {
+        if (field.first == key) {
+            field.second = value;
+            return field.second;
+        }
+    }
+    fields.emplace_back(key, value);
+    return fields.back().second;
+}
+
+std::string Json::dump(int indent) const
+{
+    std::ostringstream out;
+    write(out, indent, 0);
+    return out.str();
+}
+
+void Json::write(std::ostringstream& out, int indent, int depth) const
+{
+    std::string pad = indent > 0 ? "\n" + std::string((depth + 1) * indent, ' ') : "";
+    std::string closePad = indent > 0 ? "\n" + std::string(depth * indent, ' ') : "";
+
+    switch (type) {
+    case Type::Null:
+        out << "null";
+        break;
+    case Type::Bool:
+        out << (boolean ? "true" : "false");
+        break;
+    case Type::Number:
+        if (!std::isfinite(number))
+            out << "null";
+        else if (number == std::floor(number) && std::fabs(number) < 1e15)
+            out << static_cast<long long>(number);
+        else
+            out << std::setprecision(9) << number;
+        break;
+    case Type::String:
+        writeString(out, text);
+        break;
+    case Type::Array:
+        out << '[';
+        for (size_t i = 0; i < elements.size(); ++i) {
+            out << (i ? "," : "") << pad;
+            elements[i].write(out, indent, depth + 1);
+        }
+        out << (elements.empty() ? "" : closePad) << ']';
+        break;
+    case Type::Object:
+        out << '{';
+        for (size_t i = 0; i < fields.size(); ++i) {
+            out << (i ? "," : "") << pad;
+            writeString(out, fields[i].first);
+            out << (indent > 0 ? ": " : ":");
+            fields[i].second.write(out, indent, depth + 1);
+        }
+        out << (fields.empty() ? "" : closePad) << '}';
+        break;
+    }
+}
+
+bool Json::parse(const std::string& source, Json& result, std::string& error)
+{
+    Parser parser(source);
+    return parser.document(result, error);
+}
+
+bool Json::load(const std::filesystem::path& path, Json& result, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return parse(stream.str(), result, error);
+}
+
+bool Json::save(const std::filesystem::path& path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file << dump() << "\n";
+    return static_cast<bool>(file);
+}
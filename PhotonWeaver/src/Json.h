@@ -0,0 +1,74 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "pch.h"
+
+#include <utility>
+#include <vector>
+
+// Small JSON document model for benchmark results and scene files.
+// Objects keep their insertion order so written files diff cleanly.
+class Json
+{
+public:
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	Json() = default;
+	Json(std::nullptr_t) {}
+	Json(bool value) : type(Type::Bool), boolean(value) {}
+	Json(int value) : type(Type::Number), number(value) {}
+	Json(unsigned value) : type(Type::Number), number(value) {}
+	Json(long value) : type(Type::Number), number(static_cast<double>(value)) {}
+	Json(long long value) : type(Type::Number), number(static_cast<double>(value)) {}
+	Json(unsigned long long value) : type(Type::Number), number(static_cast<double>(value)) {}
+	Json(unsigned long value) : type(Type::Number), number(static_cast<double>(value)) {}
+	Json(double value) : type(Type::Number), number(value) {}
+	Json(float value) : type(Type::Number), number(value) {}
+	Json(const char* value) : type(Type::String), text(value) {}
+	Json(const std::string& value) : type(Type::String), text(value) {}
+
+	static Json array();
+	static Json object();
+
+	Type getType() const { return type; }
+	bool isNull() const { return type == Type::Null; }
+	bool isNumber() const { return type == Type::Number; }
+	bool isString() const { return type == Type::String; }
+	bool isArray() const { return type == Type::Array; }
+	bool isObject() const { return type == Type::Object; }
+
+	bool asBool(bool fallback = false) const { return type == Type::Bool ? boolean : fallback; }
+	double asNumber(double fallback = 0.0) const { return type == Type::Number ? number : fallback; }
+	const std::string& asString() const { return text; }
+
+	// Arrays
+	size_t size() const;
+	const Json& operator[](size_t index) const;
+	Json& push(const Json& value);
+	const std::vector<Json>& items() const { return elements; }
+
+	// Objects; a missing key reads as null
+	bool has(const std::string& key) const;
+	const Json& operator[](const std::string& key) const;
+	Json& set(const std::string& key, const Json& value);
+	const std::vector<std::pair<std::string, Json>>& members() const { return fields; }
+
+	std::string dump(int indent = 2) const;
+
+	// Returns false and fills error ("line N: message") on malformed input
+	static bool parse(const std::string& source, Json& result, std::string& error);
+	static bool load(const std::filesystem::path& path, Json& result, std::string& error);
+	bool save(const std::filesystem::path& path) const;
+
+private:
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0.0;
+	std::string text;
+	std::vector<Json> elements;
+	std::vector<std::pair<std::string, Json>> fields;
+
+	void write(std::ostringstream& out, int indent, int depth) const;
+};
+
+#endif // JSON_H
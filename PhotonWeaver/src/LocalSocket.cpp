@@ -0,0 +1,278 @@
+#include "LocalSocket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET NativeSocket;
+const NativeSocket noSocket = INVALID_SOCKET;
+
+bool startSockets()
+{
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+void closeSocket(NativeSocket socket)
+{
+    closesocket(socket);
+}
+
+// Waits up to milliseconds for data or a close; 0 on a timeout, < 0 on an error
+int waitReadable(NativeSocket socket, int milliseconds)
+{
+    WSAPOLLFD descriptor = { socket, POLLRDNORM, 0 };
+    return WSAPoll(&descriptor, 1, milliseconds);
+}
+#else
+typedef int NativeSocket;
+const NativeSocket noSocket = -1;
+
+bool startSockets()
+{
+    return true;
+}
+
+void closeSocket(NativeSocket socket)
+{
+    ::close(socket);
+}
+
+int waitReadable(NativeSocket socket, int milliseconds)
+{
+    pollfd descriptor = { socket, POLLIN, 0 };
+    int ready;
+    do {
+        ready = ::poll(&descriptor, 1, milliseconds);
+    } while (ready < 0 && errno == EINTR);
+    return ready;
+}
+#endif
+
+bool makeAddress(const std::filesystem::path& path, sockaddr_un& address, std::string& error)
+{
+    std::string name = path.string();
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (name.size() >= sizeof(address.sun_path)) {
+        error = "socket path longer than " + std::to_string(sizeof(address.sun_path) - 1) + " bytes: " + name;
+        return false;
+    }
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+    return true;
+}
+
+}
+
+bool LocalSocket::listen(const std::filesystem::path& path, std::string& error)
+{
+    close();
+    sockaddr_un address;
+    if (!startSockets() || !makeAddress(path, address, error)) {
+        if (error.empty())
+            error = "sockets unavailable";
+        return false;
+    }
+
+    // A file nobody answers on is left over from a server that died
+    if (std::filesystem::exists(path)) {
+        LocalSocket probe;
+        std::string ignored;
+        if (probe.connect(path, ignored)) {
+            error = "a server is already listening on " + path.string();
+            return false;
+        }
+        std::error_code removeError;
+        std::filesystem::remove(path, removeError);
+    }
+
+    NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket == noSocket) {
+        error = "cannot create a socket";
+        return false;
+    }
+    if (::bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(socket, 16) != 0) {
+        error = "cannot listen on " + path.string();
+        closeSocket(socket);
+        return false;
+    }
+    handle = static_cast<uintptr_t>(socket);
+    boundPath = path;
+    return true;
+}
+
+bool LocalSocket::accept(LocalSocket& client)
+{
+    if (!isOpen())
+        return false;
+    NativeSocket socket = ::accept(static_cast<NativeSocket>(handle), nullptr, nullptr);
+    if (socket == noSocket)
+        return false;
+    client.close();
+    client.handle = static_cast<uintptr_t>(socket);
+    return true;
+}
+
+bool LocalSocket::connect(const std::filesystem::path& path, std::string& error)
+{
+    close();
+    sockaddr_un address;
+    if (!startSockets() || !makeAddress(path, address, error)) {
+        if (error.empty())
+            error = "sockets unavailable";
+        return false;
+    }
+    NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket == noSocket) {
+        error = "cannot create a socket";
+        return false;
+    }
+    if (::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        error = "no server on " + path.string();
+        closeSocket(socket);
+        return false;
+    }
+    handle = static_cast<uintptr_t>(socket);
+    return true;
+}
+
+bool LocalSocket::setReceiveTimeout(double seconds)
+{
+    if (!isOpen())
+        return false;
+    seconds = std::max(seconds, 0.0);
+#ifdef _WIN32
+    DWORD timeout = static_cast<DWORD>(seconds * 1000.0);
+#else
+    timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(seconds);
+    timeout.tv_usec = static_cast<suseconds_t>((seconds - static_cast<double>(timeout.tv_sec)) * 1e6);
+#endif
+    return setsockopt(static_cast<NativeSocket>(handle), SOL_SOCKET, SO_RCVTIMEO,
+        reinterpret_cast<const char*>(&timeout), sizeof(timeout)) == 0;
+}
+
+bool LocalSocket::readLine(std::string& line, size_t maxBytes, double timeoutSeconds)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(std::max(timeoutSeconds, 0.0));
+    char buffer[4096];
+    for (;;) {
+        size_t end = pending.find('\n');
+        if (end != std::string::npos) {
+            line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            return true;
+        }
+        if (!isOpen() || pending.size() > maxBytes)
+            return false;
+        // The deadline covers the whole line, so a peer trickling bytes cannot hold it open
+        if (timeoutSeconds > 0.0) {
+            double remaining = std::chrono::duration<double, std::milli>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0.0 || waitReadable(static_cast<NativeSocket>(handle), static_cast<int>(std::ceil(remaining))) <= 0) {
+                pending.clear();
+                return false;
+            }
+        }
+        auto received = ::recv(static_cast<NativeSocket>(handle), buffer, sizeof(buffer), 0);
+        if (received < 0) {
+            // A timeout or a reset; what came so far is not a whole message
+            pending.clear();
+            return false;
+        }
+        if (received == 0) {
+            // A last message without its newline still counts once the peer closes
+            if (pending.empty())
+                return false;
+            line.swap(pending);
+            pending.clear();
+            return true;
+        }
+        pending.append(buffer, static_cast<size_t>(received));
+    }
+}
+
+bool LocalSocket::writeLine(const std::string& line)
+{
+    std::string message = line + '\n';
+    return writeBytes(message.data(), message.size());
+}
+
+bool LocalSocket::readBytes(void* data, size_t size)
+{
+    char* out = static_cast<char*>(data);
+    size_t buffered = std::min(size, pending.size());
+    std::memcpy(out, pending.data(), buffered);
+    pending.erase(0, buffered);
+    size_t received = buffered;
+    while (received < size && isOpen()) {
+        size_t chunk = std::min<size_t>(size - received, 1 << 30);
+        auto count = ::recv(static_cast<NativeSocket>(handle), out + received, static_cast<int>(chunk), 0);
+        if (count <= 0)
+            return false;
+        received += static_cast<size_t>(count);
+    }
+    return received == size;
+}
+
+bool LocalSocket::writeBytes(const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    // A peer that hung up must not take the process down with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    size_t sent = 0;
+    while (sent < size && isOpen()) {
+        size_t chunk = std::min<size_t>(size - sent, 1 << 30);
+        auto count = ::send(static_cast<NativeSocket>(handle), bytes + sent, static_cast<int>(chunk), flags);
+        if (count <= 0)
+            return false;
+        sent += static_cast<size_t>(count);
+    }
+    return sent == size;
+}
+
+void LocalSocket::close()
+{
+    if (!isOpen())
+        return;
+    NativeSocket socket = static_cast<NativeSocket>(handle);
+    handle = invalid;
+    // Shutting down first is what wakes another thread's accept() on Linux
+#ifdef _WIN32
+    shutdown(socket, SD_BOTH);
+#else
+    shutdown(socket, SHUT_RDWR);
+#endif
+    closeSocket(socket);
+    pending.clear();
+    if (!boundPath.empty()) {
+        std::error_code error;
+        std::filesystem::remove(boundPath, error);
+        boundPath.clear();
+    }
+}
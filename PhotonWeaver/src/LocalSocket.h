@@ -0,0 +1,54 @@
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include "pch.h"
+
+#include <cstdint>
+
+// Stream socket on a Unix domain socket path, with newline-framed messages
+// and raw binary payloads between them.
+// Windows 10 (1803 and later) has AF_UNIX too, through Winsock and afunix.h.
+class LocalSocket
+{
+public:
+	LocalSocket() = default;
+	~LocalSocket() { close(); }
+	LocalSocket(const LocalSocket&) = delete;
+	LocalSocket& operator=(const LocalSocket&) = delete;
+
+	// Binds and listens, replacing a socket file left behind by a server
+	// that is gone. Fails while another server still answers on the path.
+	bool listen(const std::filesystem::path& path, std::string& error);
+	// Blocks until a client connects; false once the listener is closed
+	bool accept(LocalSocket& client);
+	bool connect(const std::filesystem::path& path, std::string& error);
+
+	// Later reads give up, and fail, after waiting this long for data; 0 waits forever
+	bool setReceiveTimeout(double seconds);
+
+	// One message without its newline; false on a closed connection, a
+	// message over maxBytes, a receive timeout, or the whole line taking
+	// longer than timeoutSeconds (0: no limit). A failure drops the partial line.
+	bool readLine(std::string& line, size_t maxBytes = 1 << 20, double timeoutSeconds = 0.0);
+	// Appends the newline
+	bool writeLine(const std::string& line);
+	// Exactly size raw bytes, e.g. a payload announced by the line before.
+	// Only what readLine() already buffered is copied; the rest is received
+	// straight into data.
+	bool readBytes(void* data, size_t size);
+	bool writeBytes(const void* data, size_t size);
+
+	bool isOpen() const { return handle != invalid; }
+	// Also wakes a thread blocked in accept()
+	void close();
+
+private:
+	static const uintptr_t invalid = ~static_cast<uintptr_t>(0);
+	uintptr_t handle = invalid;
+	// Bytes read past the last line
+	std::string pending;
+	// Set on a listener, whose socket file close() removes
+	std::filesystem::path boundPath;
+};
+
+#endif // LOCAL_SOCKET_H
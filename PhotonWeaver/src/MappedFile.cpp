@@ -0,0 +1,72 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE map = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* address = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!address) {
+        if (map)
+            CloseHandle(map);
+        CloseHandle(handle);
+        return false;
+    }
+    file = handle;
+    mapping = map;
+    view = address;
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        ::close(descriptor);
+        return false;
+    }
+    void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps its own reference to the file
+    ::close(descriptor);
+    if (address == MAP_FAILED)
+        return false;
+    view = address;
+    length = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (!view)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    file = mapping = nullptr;
+#else
+    munmap(view, length);
+#endif
+    view = nullptr;
+    length = 0;
+}
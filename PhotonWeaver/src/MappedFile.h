@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "pch.h"
+
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. The view is page aligned and stays
+// valid until close() or destruction; pages are faulted in on first touch.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False for missing or empty files
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	bool isOpen() const { return view != nullptr; }
+	const uint8_t* data() const { return static_cast<const uint8_t*>(view); }
+	size_t size() const { return length; }
+
+private:
+	void* view = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,36 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle mesh stored as a structure of arrays, so a pass over one
+// attribute (e.g. positions for a BVH build) touches only that attribute.
+// Normals and UVs are empty when the source file had none.
+struct Mesh {
+	std::string name;
+	std::vector<float> px, py, pz;
+	std::vector<float> nx, ny, nz;
+	std::vector<float> u, v;
+	// Three per triangle
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const { return px.size(); }
+	size_t triangleCount() const { return indices.size() / 3; }
+	bool hasNormals() const { return !nx.empty(); }
+	bool hasUVs() const { return !u.empty(); }
+
+	glm::vec3 position(uint32_t vertex) const { return glm::vec3(px[vertex], py[vertex], pz[vertex]); }
+	glm::vec3 normal(uint32_t vertex) const { return glm::vec3(nx[vertex], ny[vertex], nz[vertex]); }
+
+	// Memory held by the arrays
+	size_t bytes() const
+	{
+		return (px.size() + py.size() + pz.size() + nx.size() + ny.size() + nz.size() + u.size() + v.size()) * sizeof(float)
+			+ indices.size() * sizeof(uint32_t);
+	}
+};
+
+#endif // MESH_H
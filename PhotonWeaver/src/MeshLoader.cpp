@@ -0,0 +1,1082 @@
+#include "MeshLoader.h"
+#include "MappedFile.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// Several chunks per thread even out chunks with uneven content
+const size_t chunksPerThread = 4;
+const size_t minChunkBytes = 256 * 1024;
+const size_t minChunkItems = 64 * 1024;
+const uint32_t missing = 0xffffffffu;
+
+template <typename Function>
+void parallelFor(size_t count, unsigned threads, Function&& function)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            function(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(threads, count); ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool)
+        thread.join();
+}
+
+struct Range {
+    const char* begin;
+    const char* end;
+};
+
+// Splits [begin, end) into pieces that each start at the beginning of a line
+std::vector<Range> splitLines(const char* begin, const char* end, unsigned threads)
+{
+    size_t bytes = static_cast<size_t>(end - begin);
+    size_t count = std::max<size_t>(1, std::min(threads * chunksPerThread, bytes / minChunkBytes));
+    std::vector<Range> ranges;
+    const char* start = begin;
+    for (size_t i = 1; i <= count && start < end; ++i) {
+        const char* stop = i == count ? end : std::max(start, begin + bytes / count * i);
+        while (stop < end && (stop == begin || stop[-1] != '\n'))
+            ++stop;
+        if (stop > start)
+            ranges.push_back({ start, stop });
+        start = stop;
+    }
+    return ranges;
+}
+
+// Index ranges [first, last) over 'count' items, for the passes that do not read text
+std::vector<std::pair<size_t, size_t>> splitItems(size_t count, unsigned threads)
+{
+    size_t pieces = std::max<size_t>(1, std::min(threads * chunksPerThread, count / minChunkItems));
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t i = 0; i < pieces; ++i)
+        ranges.emplace_back(count * i / pieces, count * (i + 1) / pieces);
+    return ranges;
+}
+
+// Calls function(lineBegin, lineEnd) for every line without its terminator; stops when it returns false
+template <typename Function>
+bool forEachLine(Range range, Function&& function)
+{
+    const char* p = range.begin;
+    while (p < range.end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(range.end - p)));
+        if (!eol)
+            eol = range.end;
+        const char* stop = eol;
+        if (stop > p && stop[-1] == '\r')
+            --stop;
+        if (!function(p, stop))
+            return false;
+        p = eol + 1;
+    }
+    return true;
+}
+
+bool isSpace(char c) { return c == ' ' || c == '\t'; }
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+bool isBlank(const char* p, const char* end)
+{
+    p = skipSpace(p, end);
+    return p == end || *p == '#';
+}
+
+const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Locale independent and far cheaper than strtod. Keeps 19 significant
+// digits and scales once by a power of ten, which is plenty for a float.
+bool parseFloat(const char*& p, const char* end, float& value)
+{
+    p = skipSpace(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); ++p, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0;
+        }
+        else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any)
+        return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); ++q)
+                e = std::min(e * 10 + (*q - '0'), 100000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0)
+        result = exponent >= -22 ? result / powersOf10[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        result = exponent <= 22 ? result * powersOf10[exponent] : result * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return true;
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !isDigit(*p))
+        return false;
+    int64_t result = 0;
+    for (; p < end && isDigit(*p); ++p)
+        result = std::min<int64_t>(result * 10 + (*p - '0'), INT64_C(1) << 40);
+    value = negative ? -result : result;
+    return true;
+}
+
+// Per-chunk failure; the earliest chunk's error is reported with its line number
+struct ChunkError {
+    std::string message;
+    const char* at = nullptr;
+};
+
+bool reportError(const std::vector<ChunkError>& errors, const char* fileBegin, std::string& error)
+{
+    for (const ChunkError& chunk : errors) {
+        if (chunk.message.empty())
+            continue;
+        error = "line " + std::to_string(1 + std::count(fileBegin, chunk.at, '\n')) + ": " + chunk.message;
+        return true;
+    }
+    return false;
+}
+
+// ---- OBJ ----
+
+struct ObjCounts {
+    size_t positions = 0;
+    size_t uvs = 0;
+    size_t normals = 0;
+    size_t corners = 0;
+
+    void add(const ObjCounts& other)
+    {
+        positions += other.positions;
+        uvs += other.uvs;
+        normals += other.normals;
+        corners += other.corners;
+    }
+};
+
+enum class ObjLine { Other, Position, UV, Normal, Face };
+
+ObjLine classify(const char*& p, const char* end)
+{
+    p = skipSpace(p, end);
+    if (end - p < 2)
+        return ObjLine::Other;
+    if (p[0] == 'v') {
+        if (isSpace(p[1])) {
+            p += 2;
+            return ObjLine::Position;
+        }
+        if (end - p > 2 && isSpace(p[2]) && (p[1] == 't' || p[1] == 'n')) {
+            p += 3;
+            return p[-2] == 't' ? ObjLine::UV : ObjLine::Normal;
+        }
+    }
+    else if (p[0] == 'f' && isSpace(p[1])) {
+        p += 2;
+        return ObjLine::Face;
+    }
+    return ObjLine::Other;
+}
+
+size_t countTokens(const char* p, const char* end)
+{
+    size_t count = 0;
+    for (p = skipSpace(p, end); p < end && *p != '#'; p = skipSpace(p, end)) {
+        ++count;
+        while (p < end && !isSpace(*p))
+            ++p;
+    }
+    return count;
+}
+
+ObjCounts countObj(Range range)
+{
+    ObjCounts counts;
+    forEachLine(range, [&](const char* p, const char* end) {
+        switch (classify(p, end)) {
+        case ObjLine::Position: ++counts.positions; break;
+        case ObjLine::UV: ++counts.uvs; break;
+        case ObjLine::Normal: ++counts.normals; break;
+        case ObjLine::Face: {
+            size_t corners = countTokens(p, end);
+            if (corners >= 3)
+                counts.corners += 3 * (corners - 2);
+            break;
+        }
+        default: break;
+        }
+        return true;
+    });
+    return counts;
+}
+
+struct ObjArrays {
+    float* px; float* py; float* pz;
+    float* nx; float* ny; float* nz;
+    float* u; float* v;
+    uint32_t* cornerV; uint32_t* cornerT; uint32_t* cornerN;
+};
+
+// 1-based, or negative relative to what was defined so far; 0 means absent
+bool resolveIndex(int64_t index, size_t definedSoFar, size_t total, uint32_t& result)
+{
+    int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(definedSoFar) + index;
+    if (index == 0 || resolved < 0 || resolved >= static_cast<int64_t>(total))
+        return false;
+    result = static_cast<uint32_t>(resolved);
+    return true;
+}
+
+void parseObj(Range range, ObjCounts at, const ObjCounts& totals, const ObjArrays& out, ChunkError& error)
+{
+    struct Corner { uint32_t v, t, n; };
+    std::vector<Corner> face;
+
+    forEachLine(range, [&](const char* p, const char* end) {
+        const char* line = p;
+        auto fail = [&](const char* message) {
+            error.message = message;
+            error.at = line;
+            return false;
+        };
+
+        switch (classify(p, end)) {
+        case ObjLine::Position:
+            if (!parseFloat(p, end, out.px[at.positions]) || !parseFloat(p, end, out.py[at.positions]) || !parseFloat(p, end, out.pz[at.positions]))
+                return fail("malformed vertex position");
+            ++at.positions;
+            break;
+        case ObjLine::UV:
+            if (!parseFloat(p, end, out.u[at.uvs]))
+                return fail("malformed texture coordinate");
+            if (!parseFloat(p, end, out.v[at.uvs]))
+                out.v[at.uvs] = 0.0f;
+            ++at.uvs;
+            break;
+        case ObjLine::Normal:
+            if (!parseFloat(p, end, out.nx[at.normals]) || !parseFloat(p, end, out.ny[at.normals]) || !parseFloat(p, end, out.nz[at.normals]))
+                return fail("malformed vertex normal");
+            ++at.normals;
+            break;
+        case ObjLine::Face: {
+            face.clear();
+            for (p = skipSpace(p, end); p < end && *p != '#'; p = skipSpace(p, end)) {
+                Corner corner = { 0, missing, missing };
+                int64_t index = 0;
+                if (!parseInt(p, end, index) || !resolveIndex(index, at.positions, totals.positions, corner.v))
+                    return fail("face references a missing vertex");
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (p < end && *p != '/' && (!parseInt(p, end, index) || !resolveIndex(index, at.uvs, totals.uvs, corner.t)))
+                        return fail("face references a missing texture coordinate");
+                    if (p < end && *p == '/') {
+                        ++p;
+                        if (!parseInt(p, end, index) || !resolveIndex(index, at.normals, totals.normals, corner.n))
+                            return fail("face references a missing normal");
+                    }
+                }
+                if (p < end && !isSpace(*p))
+                    return fail("malformed face");
+                face.push_back(corner);
+            }
+            if (face.size() < 3)
+                return fail("face with fewer than three corners");
+
+            // Fan triangulation, as counted by countObj
+            for (size_t i = 1; i + 1 < face.size(); ++i) {
+                const Corner triangle[3] = { face[0], face[i], face[i + 1] };
+                for (const Corner& corner : triangle) {
+                    out.cornerV[at.corners] = corner.v;
+                    if (out.cornerT)
+                        out.cornerT[at.corners] = corner.t;
+                    if (out.cornerN)
+                        out.cornerN[at.corners] = corner.n;
+                    ++at.corners;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return true;
+    });
+}
+
+uint64_t mixKey(uint32_t v, uint32_t t, uint32_t n)
+{
+    uint64_t hash = v * 0x9E3779B97F4A7C15ull ^ t * 0xC2B2AE3D27D4EB4Full ^ n * 0x165667B19E3779F9ull;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 32);
+}
+
+// Open addressing table of corner indices (+1, 0 is empty). Every slot holds
+// the smallest corner with its key, which is how the merged vertices come out
+// in first-use order whatever order the threads insert in.
+class CornerTable
+{
+public:
+    CornerTable(const uint32_t* v, const uint32_t* t, const uint32_t* n, size_t corners, unsigned threads)
+        : v(v), t(t), n(n)
+    {
+        size_t size = 16;
+        while (size < corners * 2)
+            size *= 2;
+        mask = size - 1;
+        slots.reset(new std::atomic<uint32_t>[size]);
+        auto ranges = splitItems(size, threads);
+        parallelFor(ranges.size(), threads, [&](size_t r) {
+            for (size_t i = ranges[r].first; i < ranges[r].second; ++i)
+                slots[i].store(0, std::memory_order_relaxed);
+        });
+    }
+
+    void insert(uint32_t corner)
+    {
+        for (size_t slot = hash(corner);; slot = (slot + 1) & mask) {
+            uint32_t current = 0;
+            if (slots[slot].compare_exchange_strong(current, corner + 1))
+                return;
+            if (!same(current - 1, corner))
+                continue;
+            while (corner + 1 < current && !slots[slot].compare_exchange_weak(current, corner + 1)) {
+            }
+            return;
+        }
+    }
+
+    // The first corner with the same key; only valid once every insert is done
+    uint32_t first(uint32_t corner) const
+    {
+        for (size_t slot = hash(corner);; slot = (slot + 1) & mask) {
+            uint32_t current = slots[slot].load(std::memory_order_relaxed);
+            if (same(current - 1, corner))
+                return current - 1;
+        }
+    }
+
+private:
+    const uint32_t* v;
+    const uint32_t* t;
+    const uint32_t* n;
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    size_t mask = 0;
+
+    size_t hash(uint32_t corner) const
+    {
+        return static_cast<size_t>(mixKey(v[corner], t ? t[corner] : 0, n ? n[corner] : 0)) & mask;
+    }
+
+    bool same(uint32_t a, uint32_t b) const
+    {
+        return v[a] == v[b] && (!t || t[a] == t[b]) && (!n || n[a] == n[b]);
+    }
+};
+
+bool loadObj(const char* begin, const char* end, Mesh& mesh, std::string& error, unsigned threads)
+{
+    std::vector<Range> chunks = splitLines(begin, end, threads);
+    std::vector<ObjCounts> offsets(chunks.size());
+    {
+        TRACE_SCOPE("MeshLoader count");
+        parallelFor(chunks.size(), threads, [&](size_t i) { offsets[i] = countObj(chunks[i]); });
+    }
+
+    // Exclusive prefix sums: where each chunk writes
+    ObjCounts totals;
+    for (ObjCounts& counts : offsets) {
+        ObjCounts chunk = counts;
+        counts = totals;
+        totals.add(chunk);
+    }
+    if (totals.corners == 0) {
+        error = "no faces";
+        return false;
+    }
+    if (totals.corners >= missing || totals.positions >= missing) {
+        error = "too many vertices for 32-bit indices";
+        return false;
+    }
+
+    std::vector<float> px(totals.positions), py(totals.positions), pz(totals.positions);
+    std::vector<float> nx(totals.normals), ny(totals.normals), nz(totals.normals);
+    std::vector<float> u(totals.uvs), v(totals.uvs);
+    std::vector<uint32_t> cornerV(totals.corners);
+    std::vector<uint32_t> cornerT(totals.uvs ? totals.corners : 0);
+    std::vector<uint32_t> cornerN(totals.normals ? totals.corners : 0);
+    ObjArrays arrays = {
+        px.data(), py.data(), pz.data(), nx.data(), ny.data(), nz.data(), u.data(), v.data(),
+        cornerV.data(), totals.uvs ? cornerT.data() : nullptr, totals.normals ? cornerN.data() : nullptr
+    };
+
+    std::vector<ChunkError> errors(chunks.size());
+    {
+        TRACE_SCOPE("MeshLoader parse");
+        parallelFor(chunks.size(), threads, [&](size_t i) { parseObj(chunks[i], offsets[i], totals, arrays, errors[i]); });
+    }
+    if (reportError(errors, begin, error))
+        return false;
+
+    // Positions only: the file's vertices are the mesh's vertices
+    if (!arrays.cornerT && !arrays.cornerN) {
+        mesh.px.swap(px);
+        mesh.py.swap(py);
+        mesh.pz.swap(pz);
+        mesh.indices.swap(cornerV);
+        return true;
+    }
+
+    TRACE_SCOPE("MeshLoader merge vertices");
+    std::vector<uint32_t>& indices = mesh.indices;
+    indices.resize(totals.corners);
+    CornerTable table(cornerV.data(), arrays.cornerT, arrays.cornerN, totals.corners, threads);
+    auto ranges = splitItems(totals.corners, threads);
+    parallelFor(ranges.size(), threads, [&](size_t r) {
+        for (size_t c = ranges[r].first; c < ranges[r].second; ++c)
+            table.insert(static_cast<uint32_t>(c));
+    });
+
+    // Each corner learns its first occurrence; the first ones become vertices
+    std::vector<size_t> firstVertex(ranges.size() + 1, 0);
+    parallelFor(ranges.size(), threads, [&](size_t r) {
+        size_t count = 0;
+        for (size_t c = ranges[r].first; c < ranges[r].second; ++c) {
+            indices[c] = table.first(static_cast<uint32_t>(c));
+            count += indices[c] == c;
+        }
+        firstVertex[r + 1] = count;
+    });
+    for (size_t r = 0; r < ranges.size(); ++r)
+        firstVertex[r + 1] += firstVertex[r];
+
+    size_t vertices = firstVertex.back();
+    mesh.px.resize(vertices);
+    mesh.py.resize(vertices);
+    mesh.pz.resize(vertices);
+    if (arrays.cornerN) {
+        mesh.nx.resize(vertices);
+        mesh.ny.resize(vertices);
+        mesh.nz.resize(vertices);
+    }
+    if (arrays.cornerT) {
+        mesh.u.resize(vertices);
+        mesh.v.resize(vertices);
+    }
+
+    // cornerV of a first corner is replaced by its vertex id, which the other corners then pick up
+    parallelFor(ranges.size(), threads, [&](size_t r) {
+        uint32_t id = static_cast<uint32_t>(firstVertex[r]);
+        for (size_t c = ranges[r].first; c < ranges[r].second; ++c) {
+            if (indices[c] != c)
+                continue;
+            uint32_t p = cornerV[c];
+            mesh.px[id] = px[p];
+            mesh.py[id] = py[p];
+            mesh.pz[id] = pz[p];
+            if (arrays.cornerN) {
+                uint32_t n = cornerN[c];
+                mesh.nx[id] = n == missing ? 0.0f : nx[n];
+                mesh.ny[id] = n == missing ? 0.0f : ny[n];
+                mesh.nz[id] = n == missing ? 0.0f : nz[n];
+            }
+            if (arrays.cornerT) {
+                uint32_t t = cornerT[c];
+                mesh.u[id] = t == missing ? 0.0f : u[t];
+                mesh.v[id] = t == missing ? 0.0f : v[t];
+            }
+            cornerV[c] = id++;
+        }
+    });
+    parallelFor(ranges.size(), threads, [&](size_t r) {
+        for (size_t c = ranges[r].first; c < ranges[r].second; ++c)
+            indices[c] = cornerV[indices[c]];
+    });
+    return true;
+}
+
+// ---- PLY ----
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    bool list = false;
+    PlyType countType = PlyType::Invalid;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+enum class PlyFormat { Ascii, LittleEndian, BigEndian };
+
+PlyType plyType(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+size_t plySize(PlyType type)
+{
+    switch (type) {
+    case PlyType::Int8: case PlyType::UInt8: return 1;
+    case PlyType::Int16: case PlyType::UInt16: return 2;
+    case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+    case PlyType::Float64: return 8;
+    default: return 0;
+    }
+}
+
+template <typename T>
+T readRaw(const char* p, bool swap)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (swap)
+        std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+double readBinary(const char* p, PlyType type, bool swap)
+{
+    switch (type) {
+    case PlyType::Int8: return static_cast<int8_t>(*p);
+    case PlyType::UInt8: return static_cast<uint8_t>(*p);
+    case PlyType::Int16: return readRaw<int16_t>(p, swap);
+    case PlyType::UInt16: return readRaw<uint16_t>(p, swap);
+    case PlyType::Int32: return readRaw<int32_t>(p, swap);
+    case PlyType::UInt32: return readRaw<uint32_t>(p, swap);
+    case PlyType::Float32: return readRaw<float>(p, swap);
+    case PlyType::Float64: return readRaw<double>(p, swap);
+    default: return 0.0;
+    }
+}
+
+bool readHeader(const char*& p, const char* end, PlyFormat& format, std::vector<PlyElement>& elements, std::string& error)
+{
+    bool formatSeen = false;
+    int line = 0;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol)
+            break;
+        std::istringstream words(std::string(p, eol));
+        p = eol + 1;
+        ++line;
+
+        std::string keyword;
+        words >> keyword;
+        if (line == 1) {
+            if (keyword != "ply")
+                break;
+            continue;
+        }
+        if (keyword == "format") {
+            std::string name;
+            words >> name;
+            if (name == "ascii") format = PlyFormat::Ascii;
+            else if (name == "binary_little_endian") format = PlyFormat::LittleEndian;
+            else if (name == "binary_big_endian") format = PlyFormat::BigEndian;
+            else {
+                error = "unknown PLY format " + name;
+                return false;
+            }
+            formatSeen = true;
+        }
+        else if (keyword == "element") {
+            PlyElement element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty()) {
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string countType;
+                words >> countType >> type;
+                property.list = true;
+                property.countType = plyType(countType);
+            }
+            property.type = plyType(type);
+            words >> property.name;
+            if (property.type == PlyType::Invalid || (property.list && property.countType == PlyType::Invalid)) {
+                error = "line " + std::to_string(line) + ": unknown property type";
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header") {
+            if (!formatSeen)
+                error = "PLY header has no format";
+            return formatSeen;
+        }
+    }
+    error = "not a PLY file";
+    return false;
+}
+
+// Where each vertex property lands; -1 for the ones we do not keep
+struct VertexLayout {
+    std::vector<int> slots;
+    bool normals = false;
+    bool uvs = false;
+};
+
+VertexLayout vertexLayout(const PlyElement& element)
+{
+    VertexLayout layout;
+    for (const PlyProperty& property : element.properties) {
+        const std::string& name = property.name;
+        int slot = -1;
+        if (name == "x") slot = 0;
+        else if (name == "y") slot = 1;
+        else if (name == "z") slot = 2;
+        else if (name == "nx") slot = 3;
+        else if (name == "ny") slot = 4;
+        else if (name == "nz") slot = 5;
+        else if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s") slot = 6;
+        else if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t") slot = 7;
+        layout.normals |= slot >= 3 && slot <= 5;
+        layout.uvs |= slot >= 6;
+        layout.slots.push_back(slot);
+    }
+    return layout;
+}
+
+void resizeVertices(Mesh& mesh, size_t count, const VertexLayout& layout)
+{
+    mesh.px.resize(count);
+    mesh.py.resize(count);
+    mesh.pz.resize(count);
+    if (layout.normals) {
+        mesh.nx.resize(count);
+        mesh.ny.resize(count);
+        mesh.nz.resize(count);
+    }
+    if (layout.uvs) {
+        mesh.u.resize(count);
+        mesh.v.resize(count);
+    }
+}
+
+void storeVertex(Mesh& mesh, size_t vertex, int slot, float value)
+{
+    float* targets[] = {
+        mesh.px.data(), mesh.py.data(), mesh.pz.data(), mesh.nx.data(), mesh.ny.data(), mesh.nz.data(), mesh.u.data(), mesh.v.data()
+    };
+    if (slot >= 0)
+        targets[slot][vertex] = value;
+}
+
+const PlyProperty* faceIndices(const PlyElement& element)
+{
+    for (const PlyProperty& property : element.properties) {
+        if (property.list && (property.name == "vertex_indices" || property.name == "vertex_index"))
+            return &property;
+    }
+    return nullptr;
+}
+
+bool fixedStride(const PlyElement& element, size_t& stride)
+{
+    stride = 0;
+    for (const PlyProperty& property : element.properties) {
+        if (property.list)
+            return false;
+        stride += plySize(property.type);
+    }
+    return true;
+}
+
+bool loadBinaryPly(const char* p, const char* end, bool swap, const std::vector<PlyElement>& elements, Mesh& mesh, std::string& error, unsigned threads)
+{
+    size_t vertexCount = 0;
+    for (const PlyElement& element : elements) {
+        size_t stride = 0;
+        bool fixed = fixedStride(element, stride);
+
+        if (element.name == "vertex") {
+            if (!fixed || static_cast<size_t>(end - p) / std::max<size_t>(stride, 1) < element.count) {
+                error = "truncated or unsupported vertex element";
+                return false;
+            }
+            VertexLayout layout = vertexLayout(element);
+            resizeVertices(mesh, element.count, layout);
+            vertexCount = element.count;
+            const char* base = p;
+            auto ranges = splitItems(element.count, threads);
+            parallelFor(ranges.size(), threads, [&](size_t r) {
+                for (size_t i = ranges[r].first; i < ranges[r].second; ++i) {
+                    const char* q = base + i * stride;
+                    for (size_t k = 0; k < element.properties.size(); ++k) {
+                        PlyType type = element.properties[k].type;
+                        storeVertex(mesh, i, layout.slots[k], static_cast<float>(readBinary(q, type, swap)));
+                        q += plySize(type);
+                    }
+                }
+            });
+            p += element.count * stride;
+        }
+        else if (element.name == "face" && faceIndices(element)) {
+            const PlyProperty& list = *faceIndices(element);
+            size_t countSize = plySize(list.countType), indexSize = plySize(list.type);
+            size_t triangleStride = countSize + 3 * indexSize;
+
+            // Nearly every file is all triangles: check that in parallel and then
+            // read at fixed offsets, otherwise walk the faces one by one
+            bool triangles = element.properties.size() == 1 && static_cast<size_t>(end - p) / triangleStride >= element.count;
+            auto ranges = splitItems(element.count, threads);
+            if (triangles) {
+                std::atomic<bool> allTriangles(true);
+                parallelFor(ranges.size(), threads, [&](size_t r) {
+                    for (size_t i = ranges[r].first; i < ranges[r].second && allTriangles.load(std::memory_order_relaxed); ++i) {
+                        if (readBinary(p + i * triangleStride, list.countType, swap) != 3.0)
+                            allTriangles = false;
+                    }
+                });
+                triangles = allTriangles;
+            }
+
+            if (triangles) {
+                mesh.indices.resize(element.count * 3);
+                std::atomic<bool> valid(true);
+                parallelFor(ranges.size(), threads, [&](size_t r) {
+                    for (size_t i = ranges[r].first; i < ranges[r].second; ++i) {
+                        const char* q = p + i * triangleStride + countSize;
+                        for (size_t k = 0; k < 3; ++k, q += indexSize) {
+                            double index = readBinary(q, list.type, swap);
+                            if (index < 0.0 || index >= static_cast<double>(vertexCount))
+                                valid = false;
+                            mesh.indices[i * 3 + k] = static_cast<uint32_t>(index);
+                        }
+                    }
+                });
+                if (!valid) {
+                    error = "face references a missing vertex";
+                    return false;
+                }
+                p += element.count * triangleStride;
+            }
+            else {
+                std::vector<uint32_t> face;
+                for (size_t i = 0; i < element.count; ++i) {
+                    face.clear();
+                    for (const PlyProperty& property : element.properties) {
+                        if (static_cast<size_t>(end - p) < plySize(property.list ? property.countType : property.type)) {
+                            error = "truncated face element";
+                            return false;
+                        }
+                        if (!property.list) {
+                            p += plySize(property.type);
+                            continue;
+                        }
+                        size_t count = static_cast<size_t>(readBinary(p, property.countType, swap));
+                        p += plySize(property.countType);
+                        if (static_cast<size_t>(end - p) / plySize(property.type) < count) {
+                            error = "truncated face element";
+                            return false;
+                        }
+                        for (size_t k = 0; k < count; ++k, p += plySize(property.type)) {
+                            double index = readBinary(p, property.type, swap);
+                            if (&property == &list && (index < 0.0 || index >= static_cast<double>(vertexCount))) {
+                                error = "face references a missing vertex";
+                                return false;
+                            }
+                            if (&property == &list)
+                                face.push_back(static_cast<uint32_t>(index));
+                        }
+                    }
+                    for (size_t k = 1; k + 1 < face.size(); ++k) {
+                        mesh.indices.push_back(face[0]);
+                        mesh.indices.push_back(face[k]);
+                        mesh.indices.push_back(face[k + 1]);
+                    }
+                }
+            }
+        }
+        else if (fixed) {
+            p += std::min(element.count * stride, static_cast<size_t>(end - p));
+        }
+        else {
+            // Unknown element with lists: only its size matters
+            for (size_t i = 0; i < element.count; ++i) {
+                for (const PlyProperty& property : element.properties) {
+                    size_t items = 1, size = plySize(property.type);
+                    if (property.list) {
+                        if (p + plySize(property.countType) > end)
+                            break;
+                        items = static_cast<size_t>(readBinary(p, property.countType, swap));
+                        p += plySize(property.countType);
+                    }
+                    p += std::min(items * size, static_cast<size_t>(end - p));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// ASCII PLY has one record per non-blank line, in element order. Chunks first
+// count their records to learn which element each line belongs to.
+bool loadAsciiPly(const char* begin, const char* fileBegin, const char* end, const std::vector<PlyElement>& elements, Mesh& mesh, std::string& error, unsigned threads)
+{
+    size_t vertexFirst = 0, vertexCount = 0, faceFirst = 0, faceCount = 0, first = 0;
+    const PlyElement* vertexElement = nullptr;
+    const PlyElement* faceElement = nullptr;
+    for (const PlyElement& element : elements) {
+        if (element.name == "vertex") {
+            vertexElement = &element;
+            vertexFirst = first;
+            vertexCount = element.count;
+        }
+        else if (element.name == "face" && faceIndices(element)) {
+            faceElement = &element;
+            faceFirst = first;
+            faceCount = element.count;
+        }
+        first += element.count;
+    }
+    if (!vertexElement || !faceElement) {
+        error = "PLY file has no vertex or face element";
+        return false;
+    }
+
+    std::vector<Range> chunks = splitLines(begin, end, threads);
+    std::vector<size_t> records(chunks.size() + 1, 0), corners(chunks.size() + 1, 0);
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        size_t count = 0;
+        forEachLine(chunks[i], [&](const char* p, const char* lineEnd) {
+            count += !isBlank(p, lineEnd);
+            return true;
+        });
+        records[i + 1] = count;
+    });
+    for (size_t i = 0; i < chunks.size(); ++i)
+        records[i + 1] += records[i];
+
+    // Reads one face record's vertex list, skipping any other property
+    auto readFace = [&](const char*& p, const char* lineEnd, std::vector<uint32_t>& face) {
+        face.clear();
+        for (const PlyProperty& property : faceElement->properties) {
+            float value = 0.0f;
+            if (!parseFloat(p, lineEnd, value))
+                return false;
+            if (!property.list)
+                continue;
+            size_t count = static_cast<size_t>(value);
+            for (size_t k = 0; k < count; ++k) {
+                if (!parseFloat(p, lineEnd, value))
+                    return false;
+                if (property.name == faceIndices(*faceElement)->name)
+                    face.push_back(static_cast<uint32_t>(value));
+            }
+        }
+        return true;
+    };
+
+    std::vector<ChunkError> errors(chunks.size());
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        size_t record = records[i], count = 0;
+        std::vector<uint32_t> face;
+        forEachLine(chunks[i], [&](const char* p, const char* lineEnd) {
+            if (isBlank(p, lineEnd))
+                return true;
+            if (record >= faceFirst && record < faceFirst + faceCount) {
+                if (!readFace(p, lineEnd, face)) {
+                    errors[i] = { "malformed face", p };
+                    return false;
+                }
+                count += face.size() >= 3 ? 3 * (face.size() - 2) : 0;
+            }
+            ++record;
+            return true;
+        });
+        corners[i + 1] = count;
+    });
+    if (reportError(errors, fileBegin, error))
+        return false;
+    for (size_t i = 0; i < chunks.size(); ++i)
+        corners[i + 1] += corners[i];
+
+    VertexLayout layout = vertexLayout(*vertexElement);
+    resizeVertices(mesh, vertexCount, layout);
+    mesh.indices.resize(corners.back());
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        size_t record = records[i], corner = corners[i];
+        std::vector<uint32_t> face;
+        forEachLine(chunks[i], [&](const char* p, const char* lineEnd) {
+            if (isBlank(p, lineEnd))
+                return true;
+            if (record >= vertexFirst && record < vertexFirst + vertexCount) {
+                for (int slot : layout.slots) {
+                    float value = 0.0f;
+                    if (!parseFloat(p, lineEnd, value)) {
+                        errors[i] = { "malformed vertex", p };
+                        return false;
+                    }
+                    storeVertex(mesh, record - vertexFirst, slot, value);
+                }
+            }
+            else if (record >= faceFirst && record < faceFirst + faceCount) {
+                readFace(p, lineEnd, face);
+                for (uint32_t index : face) {
+                    if (index >= vertexCount) {
+                        errors[i] = { "face references a missing vertex", p };
+                        return false;
+                    }
+                }
+                for (size_t k = 1; k + 1 < face.size(); ++k) {
+                    mesh.indices[corner++] = face[0];
+                    mesh.indices[corner++] = face[k];
+                    mesh.indices[corner++] = face[k + 1];
+                }
+            }
+            ++record;
+            return true;
+        });
+    });
+    return !reportError(errors, fileBegin, error);
+}
+
+bool loadPly(const char* begin, const char* end, Mesh& mesh, std::string& error, unsigned threads)
+{
+    const char* p = begin;
+    PlyFormat format = PlyFormat::Ascii;
+    std::vector<PlyElement> elements;
+    if (!readHeader(p, end, format, elements, error))
+        return false;
+
+    bool loaded;
+    if (format == PlyFormat::Ascii) {
+        loaded = loadAsciiPly(p, begin, end, elements, mesh, error, threads);
+    }
+    else {
+        const uint16_t probe = 1;
+        bool littleEndianHost = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+        loaded = loadBinaryPly(p, end, (format == PlyFormat::LittleEndian) != littleEndianHost, elements, mesh, error, threads);
+    }
+    if (loaded && mesh.indices.empty()) {
+        error = "no faces";
+        return false;
+    }
+    return loaded;
+}
+
+}
+
+bool MeshLoader::Load(const std::filesystem::path& path, Mesh& mesh, std::string& error, unsigned threads, Stats* stats)
+{
+    TRACE_SCOPE("MeshLoader::Load");
+    auto start = std::chrono::steady_clock::now();
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+
+    Mesh result;
+    result.name = path.stem().string();
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    bool loaded;
+    if (extension == ".obj") {
+        loaded = loadObj(begin, end, result, error, threads);
+    }
+    else if (extension == ".ply") {
+        loaded = loadPly(begin, end, result, error, threads);
+    }
+    else {
+        error = "unsupported mesh format " + extension;
+        return false;
+    }
+    if (!loaded) {
+        error = path.string() + ": " + error;
+        return false;
+    }
+
+    mesh = std::move(result);
+    if (stats) {
+        stats->bytes = file.size();
+        stats->threads = threads;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
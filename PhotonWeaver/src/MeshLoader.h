@@ -0,0 +1,33 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "pch.h"
+#include "Mesh.h"
+
+// Parallel OBJ and PLY (ASCII and binary) loader. The file is memory mapped
+// and split into chunks at line boundaries; a first parallel pass counts the
+// elements in every chunk, a second parses straight into the final arrays at
+// the chunk's offset, so nothing is parsed twice into temporaries and peak
+// memory stays close to the finished mesh. Numbers go through a small
+// locale-independent parser instead of strtod.
+//
+// OBJ corners that combine one position with different normals or UVs
+// become separate vertices; identical corners are merged through a lock-free
+// hash map, keeping vertices in first-use order so the result does not
+// depend on the thread count. Polygons are fan triangulated.
+class MeshLoader
+{
+public:
+	struct Stats {
+		size_t bytes = 0;
+		unsigned threads = 0;
+		double ms = 0.0;
+
+		double mbPerSec() const { return ms > 0.0 ? bytes / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0; }
+	};
+
+	// threads = 0 uses every hardware thread. Returns false and fills error on bad input.
+	static bool Load(const std::filesystem::path& path, Mesh& mesh, std::string& error, unsigned threads = 0, Stats* stats = nullptr);
+};
+
+#endif // MESH_LOADER_H
@@ -0,0 +1,140 @@
+#include "Packing.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+int16_t toSnorm16(float value)
+{
+    return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+float fromSnorm16(int16_t value)
+{
+    return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+}
+
+uint32_t toUnorm8(float value)
+{
+    return static_cast<uint32_t>(std::round(glm::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// Every sRGB byte decoded once, so texel decoding is a table lookup
+struct SrgbTable {
+    float linear[256];
+
+    SrgbTable()
+    {
+        for (int i = 0; i < 256; ++i)
+            linear[i] = Packing::SrgbToLinear(i / 255.0f);
+    }
+};
+
+}
+
+uint32_t Packing::EncodeOctahedral(const glm::vec3& normal)
+{
+    glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+    glm::vec2 e(n.x, n.y);
+    // The lower hemisphere folds over the diagonals
+    if (n.z < 0.0f) {
+        e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return static_cast<uint16_t>(toSnorm16(e.x)) | static_cast<uint32_t>(static_cast<uint16_t>(toSnorm16(e.y))) << 16;
+}
+
+glm::vec3 Packing::DecodeOctahedral(uint32_t bits)
+{
+    return DecodeOctahedral(glm::vec2(fromSnorm16(static_cast<int16_t>(bits & 0xffffu)), fromSnorm16(static_cast<int16_t>(bits >> 16))));
+}
+
+glm::vec3 Packing::DecodeOctahedral(const glm::vec2& e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+uint16_t Packing::FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)
+        return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    if (exponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    if (exponent <= 0) {
+        // Subnormal or zero: shift the implicit bit in and round
+        if (exponent < -10)
+            return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t midpoint = 1u << (shift - 1u);
+        if (rest > midpoint || (rest == midpoint && (half & 1u)))
+            ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = sign | static_cast<uint32_t>(exponent) << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1fffu;
+    // A carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half;
+    return static_cast<uint16_t>(half);
+}
+
+float Packing::HalfToFloat(uint16_t bits)
+{
+    uint32_t exponent = (bits >> 10) & 0x1fu;
+    uint32_t mantissa = bits & 0x3ffu;
+    float value;
+    if (exponent == 0)
+        value = std::ldexp(static_cast<float>(mantissa), -24);
+    else if (exponent == 31)
+        value = mantissa ? NAN : INFINITY;
+    else
+        value = std::ldexp(1.0f + static_cast<float>(mantissa) / 1024.0f, static_cast<int>(exponent) - 15);
+    return (bits & 0x8000u) ? -value : value;
+}
+
+uint32_t Packing::EncodeHalf2(const glm::vec2& value)
+{
+    return FloatToHalf(value.x) | static_cast<uint32_t>(FloatToHalf(value.y)) << 16;
+}
+
+glm::vec2 Packing::DecodeHalf2(uint32_t bits)
+{
+    return glm::vec2(HalfToFloat(static_cast<uint16_t>(bits & 0xffffu)), HalfToFloat(static_cast<uint16_t>(bits >> 16)));
+}
+
+float Packing::SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float Packing::LinearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+uint32_t Packing::EncodeSrgba8(const glm::vec4& linear)
+{
+    return toUnorm8(LinearToSrgb(glm::clamp(linear.r, 0.0f, 1.0f))) | toUnorm8(LinearToSrgb(glm::clamp(linear.g, 0.0f, 1.0f))) << 8
+        | toUnorm8(LinearToSrgb(glm::clamp(linear.b, 0.0f, 1.0f))) << 16 | toUnorm8(linear.a) << 24;
+}
+
+glm::vec4 Packing::DecodeSrgba8(uint32_t bits)
+{
+    static const SrgbTable table;
+    return glm::vec4(table.linear[bits & 0xffu], table.linear[(bits >> 8) & 0xffu], table.linear[(bits >> 16) & 0xffu],
+        static_cast<float>(bits >> 24) / 255.0f);
+}
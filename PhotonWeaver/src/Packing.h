@@ -0,0 +1,34 @@
+#ifndef PACKING_H
+#define PACKING_H
+
+#include "pch.h"
+
+#include <cstdint>
+
+// Compact encodings for shading attributes. default.frag carries the same
+// decoders, since GLSL 3.30 has no packing built-ins.
+class Packing
+{
+public:
+	// Unit vector to two 16-bit snorm octahedral coordinates, x in the low half.
+	// Worst-case angular error is about 0.004 degrees.
+	static uint32_t EncodeOctahedral(const glm::vec3& normal);
+	static glm::vec3 DecodeOctahedral(uint32_t bits);
+	// From coordinates in [-1, 1], as GBuffer's normal target holds them
+	static glm::vec3 DecodeOctahedral(const glm::vec2& coordinates);
+
+	// IEEE half precision, round to nearest even; x in the low half
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t bits);
+	static uint32_t EncodeHalf2(const glm::vec2& value);
+	static glm::vec2 DecodeHalf2(uint32_t bits);
+
+	// sRGB transfer function on one channel in [0, 1]
+	static float SrgbToLinear(float value);
+	static float LinearToSrgb(float value);
+	// Linear RGBA to an sRGB-encoded RGBA8 texel (alpha stays linear), R in the low byte, and back
+	static uint32_t EncodeSrgba8(const glm::vec4& linear);
+	static glm::vec4 DecodeSrgba8(uint32_t bits);
+};
+
+#endif // PACKING_H
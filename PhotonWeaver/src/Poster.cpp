@@ -0,0 +1,111 @@
+#include "Poster.h"
+#include "ImageIO.h"
+#include "TileScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+bool Poster::Render(Renderer& renderer, Shader& shader, const SceneCamera& camera, const Options& options,
+    const std::filesystem::path& path, std::string& error)
+{
+    TRACE_SCOPE("Poster::Render");
+    auto start = std::chrono::steady_clock::now();
+    if (options.width <= 0 || options.height <= 0) {
+        error = "empty image";
+        return false;
+    }
+
+    std::vector<TileRect> tiles = TileScheduler::Split(options.width, options.height, options.tileSize);
+    int side = std::max(tiles.front().width, tiles.front().height);
+    GLint maxTexture = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    side = std::min(side, static_cast<int>(maxTexture));
+
+    // One tile's worth of float target, reused for every tile
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    GLFramebuffer framebuffer = GLFramebuffer::Create();
+    GLTexture color = GLTexture::Create();
+    glBindTexture(GL_TEXTURE_2D, color.get());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, side, side, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.get(), 0);
+    auto release = [&]() {
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    };
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        error = "float tile target incomplete";
+        release();
+        return false;
+    }
+
+    ExrWriter writer;
+    if (!writer.open(path, options.width, options.height)) {
+        error = "cannot write " + path.string();
+        release();
+        return false;
+    }
+
+    int samples = std::max(1, options.samples);
+    float scale = 1.0f / samples;
+    std::vector<glm::vec4> band;
+    std::vector<glm::vec4> tilePixels;
+    size_t bandCount = 0;
+    size_t bands = 0;
+    for (size_t i = 0; i < tiles.size(); ++i)
+        bands += i == 0 || tiles[i].y != tiles[i - 1].y;
+
+    glBlendFunc(GL_ONE, GL_ONE);
+    for (size_t first = 0; first < tiles.size();) {
+        // A band is one row of tiles; Split() lists them top row first
+        size_t last = first;
+        while (last < tiles.size() && tiles[last].y == tiles[first].y)
+            ++last;
+        int bandY = tiles[first].y;
+        int bandHeight = tiles[first].height;
+        band.assign(static_cast<size_t>(options.width) * bandHeight, glm::vec4(0.0f));
+
+        for (size_t t = first; t < last; ++t) {
+            TRACE_SCOPE("poster tile");
+            const TileRect& tile = tiles[t];
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glEnable(GL_BLEND);
+            for (int s = 0; s < samples; ++s) {
+                renderer.drawTile(shader, camera, options.width, options.height, tile, glm::ivec2(0), s);
+                glFlush();
+            }
+            glDisable(GL_BLEND);
+
+            tilePixels.resize(tile.pixels());
+            glReadPixels(0, 0, tile.width, tile.height, GL_RGBA, GL_FLOAT, tilePixels.data());
+            for (int y = 0; y < tile.height; ++y) {
+                glm::vec4* row = band.data() + static_cast<size_t>(tile.y - bandY + y) * options.width + tile.x;
+                for (int x = 0; x < tile.width; ++x)
+                    row[x] = glm::vec4(glm::vec3(tilePixels[static_cast<size_t>(y) * tile.width + x]) * scale, 1.0f);
+            }
+        }
+
+        if (!writer.writeRows(band.data(), bandHeight)) {
+            error = "cannot write " + path.string();
+            release();
+            return false;
+        }
+        ++bandCount;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Poster: band " << bandCount << "/" << bands << ", " << std::fixed << std::setprecision(1) << seconds << " s"
+            << std::defaultfloat << std::endl;
+        first = last;
+    }
+
+    release();
+    if (!writer.close()) {
+        error = "cannot write " + path.string();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+#include "pch.h"
+#include "Renderer.h"
+
+// Stills of any size from the GL tracer. The image is drawn tile by tile
+// through one small float target. Whole rows of tiles are read back and
+// appended to an EXR file, so neither GL_MAX_VIEWPORT_DIMS nor memory limits
+// the output. A 16K poster keeps one band of tiles in memory, not the
+// image. Each submission is one sample pass over one tile, so even a slow
+// scene never holds the GPU long enough for the driver to reset it.
+class Poster
+{
+public:
+	struct Options {
+		int width = 3840;
+		int height = 2160;
+		// Passes per pixel, accumulated with additive blending; frameIndex 0..samples-1
+		int samples = 16;
+		int tileSize = 512;
+	};
+
+	// Prints progress once per band. False, with error, when the target or the file fails.
+	static bool Render(Renderer& renderer, Shader& shader, const SceneCamera& camera, const Options& options,
+		const std::filesystem::path& path, std::string& error);
+};
+
+#endif // POSTER_H
@@ -0,0 +1,436 @@
+#include "ProgressiveRender.h"
+#include "ImageEncoder.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+namespace {
+
+const uint32_t checkpointMagic = 0x4b435750; // "PWCK"
+const uint32_t checkpointVersion = 2;
+
+// Followed by the scene name, the output path and the shader's define block
+// (without terminators), then Accumulator's sum, sumSquares and counts
+struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t samples;
+    // Passes in the sums, which is also the next pass's frameIndex
+    int32_t passes;
+    uint32_t sceneBytes;
+    uint32_t outputBytes;
+    uint32_t variantBytes;
+    // AccumulationTarget::Storage, and its resolveInterval; the next passes
+    // must round their sums the same way for the image to match
+    uint32_t storage;
+    int32_t resolveInterval;
+    // Keeps fileBytes aligned without implicit padding
+    uint32_t reserved;
+    uint64_t fileBytes;
+};
+
+struct CheckpointCost {
+    int passes = 0;
+    // On the render thread: queueing the readback, then mapping the pixel
+    // buffers and copying them out
+    double copyMs = 0.0;
+    // On the background thread: converting and writing the file
+    double writeMs = 0.0;
+    uint64_t bytes = 0;
+    std::string error;
+};
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t pixelCount(const CheckpointHeader& header)
+{
+    return static_cast<size_t>(header.width) * header.height;
+}
+
+uint64_t checkpointBytes(const CheckpointHeader& header)
+{
+    return sizeof(CheckpointHeader) + header.sceneBytes + header.outputBytes + header.variantBytes
+        + pixelCount(header) * (sizeof(glm::vec3) + sizeof(float) + sizeof(uint32_t));
+}
+
+std::filesystem::path checkpointPath(const ProgressiveRender::Options& options)
+{
+    if (!options.checkpoint.empty())
+        return options.checkpoint;
+    std::filesystem::path path = options.output;
+    path += ".checkpoint";
+    return path;
+}
+
+// Reads up to the accumulated sums, which file is then positioned at
+bool readHeader(std::ifstream& file, const std::filesystem::path& path, CheckpointHeader& header, std::string& scene,
+    std::string& output, std::string& variant, std::string& error)
+{
+    file.open(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path.string();
+        return false;
+    }
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || ec || header.magic != checkpointMagic || header.version != checkpointVersion || header.width <= 0 || header.height <= 0
+        || header.passes < 0 || header.passes > header.samples || header.sceneBytes > 4096 || header.outputBytes > 4096
+        || header.variantBytes > 4096 || header.storage > static_cast<uint32_t>(AccumulationTarget::Storage::Float16Resolved)
+        || header.fileBytes != size || checkpointBytes(header) != size) {
+        error = path.string() + ": not a checkpoint of this version";
+        return false;
+    }
+    scene.resize(header.sceneBytes);
+    output.resize(header.outputBytes);
+    variant.resize(header.variantBytes);
+    file.read(&scene[0], header.sceneBytes);
+    file.read(&output[0], header.outputBytes);
+    file.read(&variant[0], header.variantBytes);
+    return true;
+}
+
+bool saveCheckpoint(const std::filesystem::path& path, const ProgressiveRender::Options& options, int passes,
+    const Accumulator& accumulator, uint64_t& bytes, std::string& error)
+{
+    std::string output = options.output.string();
+    CheckpointHeader header = {};
+    header.magic = checkpointMagic;
+    header.version = checkpointVersion;
+    header.width = accumulator.width;
+    header.height = accumulator.height;
+    header.samples = options.samples;
+    header.passes = passes;
+    header.sceneBytes = static_cast<uint32_t>(options.scene.size());
+    header.outputBytes = static_cast<uint32_t>(output.size());
+    header.variantBytes = static_cast<uint32_t>(options.variant.size());
+    header.storage = static_cast<uint32_t>(options.storage);
+    header.resolveInterval = std::max(1, options.resolveInterval);
+    header.fileBytes = checkpointBytes(header);
+    bytes = header.fileBytes;
+
+    // Written under a temporary name first, so a crash mid-write keeps the last checkpoint
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        auto write = [&](const void* data, size_t size) { out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)); };
+        write(&header, sizeof(header));
+        write(options.scene.data(), options.scene.size());
+        write(output.data(), output.size());
+        write(options.variant.data(), options.variant.size());
+        write(accumulator.sum.data(), accumulator.sum.size() * sizeof(glm::vec3));
+        write(accumulator.sumSquares.data(), accumulator.sumSquares.size() * sizeof(float));
+        write(accumulator.counts.data(), accumulator.counts.size() * sizeof(uint32_t));
+        if (!out) {
+            error = "cannot write " + temporary.string();
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        error = "cannot write " + path.string() + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+// <output>.albedo.exr and <output>.normal.exr, the latter in [-1, 1]
+bool writeGuides(Renderer& renderer, Shader& shader, const SceneCamera& camera, const ProgressiveRender::Options& options,
+    std::string& error)
+{
+    TRACE_SCOPE("write guides");
+    GBuffer gbuffer;
+    if (!gbuffer.create(options.gbufferFormat, options.width, options.height, error))
+        return false;
+    gbuffer.draw(renderer, shader, camera);
+    std::vector<glm::vec3> albedo, normals;
+    gbuffer.read(albedo, normals);
+    gbuffer.Delete();
+
+    const std::pair<const char*, const std::vector<glm::vec3>*> guides[] = { { ".albedo.exr", &albedo }, { ".normal.exr", &normals } };
+    for (const auto& guide : guides) {
+        ImageEncoder::Job image;
+        image.path = options.output;
+        image.path.replace_extension(guide.first);
+        image.format = ImageEncoder::Format::Exr;
+        image.width = options.width;
+        image.height = options.height;
+        image.pixels.reserve(guide.second->size());
+        for (const glm::vec3& value : *guide.second)
+            image.pixels.emplace_back(value, 1.0f);
+        if (!ImageEncoder::Write(image)) {
+            error = "cannot write " + image.path.string();
+            return false;
+        }
+    }
+    return true;
+}
+
+// The GPU layout (color sum with the count in alpha, squared luminance) to Accumulator's
+void toAccumulator(const std::vector<glm::vec4>& sums, const std::vector<float>& squares, Accumulator& accumulator)
+{
+    for (size_t i = 0; i < sums.size(); ++i) {
+        accumulator.sum[i] = glm::vec3(sums[i]);
+        accumulator.sumSquares[i] = squares[i];
+        accumulator.counts[i] = static_cast<uint32_t>(sums[i].a);
+    }
+}
+
+}
+
+bool ProgressiveRender::ReadCheckpoint(const std::filesystem::path& path, Options& options, std::string& error)
+{
+    std::ifstream file;
+    CheckpointHeader header;
+    std::string scene, output, variant;
+    if (!readHeader(file, path, header, scene, output, variant, error))
+        return false;
+    options.scene = scene;
+    options.output = output;
+    options.width = header.width;
+    options.height = header.height;
+    options.samples = header.samples;
+    options.storage = static_cast<AccumulationTarget::Storage>(header.storage);
+    options.resolveInterval = header.resolveInterval;
+    options.checkpoint = path;
+    options.resume = true;
+    return true;
+}
+
+bool ProgressiveRender::Render(Renderer& renderer, Shader& shader, const SceneCamera& camera, const Options& options, std::string& error,
+    Shader* gbufferShader)
+{
+    TRACE_SCOPE("ProgressiveRender::Render");
+    auto start = std::chrono::steady_clock::now();
+
+    GLint maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (options.width <= 0 || options.height <= 0 || options.width > maxViewport[0] || options.height > maxViewport[1]) {
+        error = "the image must be between 1x1 and " + std::to_string(maxViewport[0]) + "x" + std::to_string(maxViewport[1]);
+        return false;
+    }
+    ImageEncoder::Format format;
+    std::string extension = options.output.extension().string();
+    if (extension.empty() || !ImageEncoder::ParseFormat(extension.substr(1), format)) {
+        error = "output must end in .png, .exr or .pfm";
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(options.width) * options.height;
+    std::filesystem::path checkpoint = checkpointPath(options);
+    std::vector<glm::vec4> sums(count, glm::vec4(0.0f));
+    std::vector<float> squares(count, 0.0f);
+    int firstPass = 0;
+    if (options.resume) {
+        TRACE_SCOPE("load checkpoint");
+        std::ifstream file;
+        CheckpointHeader header;
+        std::string scene, output, variant;
+        if (!readHeader(file, checkpoint, header, scene, output, variant, error))
+            return false;
+        if (header.width != options.width || header.height != options.height) {
+            error = checkpoint.string() + " is for a " + std::to_string(header.width) + "x" + std::to_string(header.height) + " image";
+            return false;
+        }
+        // Sums of other bounces or shading, or rounded another way, would add up to neither render
+        auto storage = static_cast<AccumulationTarget::Storage>(header.storage);
+        if (storage != options.storage) {
+            error = checkpoint.string() + " accumulated in " + AccumulationTarget::StorageName(storage) + ", not "
+                + AccumulationTarget::StorageName(options.storage);
+            return false;
+        }
+        if (storage == AccumulationTarget::Storage::Float16Resolved && header.resolveInterval != std::max(1, options.resolveInterval)) {
+            error = checkpoint.string() + " resolved every " + std::to_string(header.resolveInterval) + " passes, not "
+                + std::to_string(std::max(1, options.resolveInterval));
+            return false;
+        }
+        if (variant != options.variant) {
+            error = checkpoint.string() + " was rendered by another shader variant:\n" + variant;
+            return false;
+        }
+        Accumulator accumulator;
+        accumulator.resize(header.width, header.height);
+        file.read(reinterpret_cast<char*>(accumulator.sum.data()), static_cast<std::streamsize>(count * sizeof(glm::vec3)));
+        file.read(reinterpret_cast<char*>(accumulator.sumSquares.data()), static_cast<std::streamsize>(count * sizeof(float)));
+        file.read(reinterpret_cast<char*>(accumulator.counts.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        if (!file) {
+            error = "cannot read " + checkpoint.string();
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            sums[i] = glm::vec4(accumulator.sum[i], static_cast<float>(accumulator.counts[i]));
+            squares[i] = accumulator.sumSquares[i];
+        }
+        firstPass = header.passes;
+        std::cout << "Resuming " << options.output.string() << " at pass " << firstPass << " of " << options.samples << std::endl;
+    }
+
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    // The resumed sums go straight into the targets, so nothing is cleared
+    AccumulationTarget accumulation;
+    accumulation.resolveInterval = std::max(1, options.resolveInterval);
+    auto release = [&]() {
+        glDisable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    };
+    if (!accumulation.create(options.storage, options.width, options.height, sums.data(), squares.data(), error)) {
+        release();
+        return false;
+    }
+    std::cout << "Accumulating in " << AccumulationTarget::StorageName(options.storage) << ", "
+        << accumulation.bytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    // One checkpoint at a time: read back into these, then written in the background
+    GLBuffer pixelBuffers[2] = { GLBuffer::Create(), GLBuffer::Create() };
+    const size_t bufferBytes[2] = { count * sizeof(glm::vec4), count * sizeof(float) };
+    for (int i = 0; i < 2; ++i) {
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i].get());
+        glBufferData(GL_PIXEL_PACK_BUFFER, bufferBytes[i], nullptr, GL_STREAM_READ);
+    }
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLsync readback = nullptr;
+    int readbackPasses = 0;
+    double readbackIssueMs = 0.0;
+    std::future<CheckpointCost> writing;
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    auto lastProgress = lastCheckpoint;
+    auto report = [&]() {
+        CheckpointCost cost = writing.get();
+        if (!cost.error.empty())
+            std::cerr << "ERROR::PROGRESSIVE::CHECKPOINT_NOT_WRITTEN: " << cost.error << std::endl;
+        else
+            std::cout << "Checkpoint at pass " << cost.passes << ": " << cost.bytes / (1024.0 * 1024.0) << " MB, render thread "
+                << cost.copyMs << " ms, written in " << cost.writeMs << " ms in the background" << std::endl;
+    };
+
+    glViewport(0, 0, options.width, options.height);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_BLEND);
+    for (int pass = firstPass; pass < options.samples; ++pass) {
+        renderer.draw(shader, camera, options.width, options.height, pass);
+        accumulation.endPass();
+        glFlush();
+        int passes = pass + 1;
+
+        if (readback && glClientWaitSync(readback, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            TRACE_SCOPE("copy checkpoint");
+            auto copyStart = std::chrono::steady_clock::now();
+            glDeleteSync(readback);
+            readback = nullptr;
+            std::vector<glm::vec4> sumCopy(count);
+            std::vector<float> squareCopy(count);
+            void* targets[2] = { sumCopy.data(), squareCopy.data() };
+            for (int i = 0; i < 2; ++i) {
+                GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i].get());
+                if (void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bufferBytes[i], GL_MAP_READ_BIT)) {
+                    std::memcpy(targets[i], mapped, bufferBytes[i]);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+            }
+            GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            CheckpointCost cost;
+            cost.passes = readbackPasses;
+            cost.copyMs = readbackIssueMs + msSince(copyStart);
+            writing = std::async(std::launch::async, [&options, checkpoint, cost, sumCopy = std::move(sumCopy),
+                squareCopy = std::move(squareCopy)]() mutable {
+                TRACE_SCOPE("write checkpoint");
+                auto writeStart = std::chrono::steady_clock::now();
+                Accumulator accumulator;
+                accumulator.resize(options.width, options.height);
+                toAccumulator(sumCopy, squareCopy, accumulator);
+                saveCheckpoint(checkpoint, options, cost.passes, accumulator, cost.bytes, cost.error);
+                cost.writeMs = msSince(writeStart);
+                return cost;
+            });
+        }
+        if (writing.valid() && writing.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            report();
+
+        auto now = std::chrono::steady_clock::now();
+        // Only where the half sums were just resolved anyway, so checkpoints
+        // leave the rounding, and the image, as an uninterrupted run has them
+        if (!readback && !writing.valid() && passes < options.samples && accumulation.unresolvedPasses() == 0
+            && std::chrono::duration<double>(now - lastCheckpoint).count() >= options.checkpointSeconds) {
+            // Queued behind this pass; the copy waits until the GPU has caught up
+            auto issueStart = std::chrono::steady_clock::now();
+            accumulation.bindSums();
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[0].get());
+            glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_FLOAT, nullptr);
+            glReadBuffer(GL_COLOR_ATTACHMENT1);
+            GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[1].get());
+            glReadPixels(0, 0, options.width, options.height, GL_RED, GL_FLOAT, nullptr);
+            GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            accumulation.bindPass();
+            readback = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            readbackPasses = passes;
+            lastCheckpoint = now;
+            readbackIssueMs = msSince(issueStart);
+        }
+        if (std::chrono::duration<double>(now - lastProgress).count() >= 10.0) {
+            std::cout << "Pass " << passes << "/" << options.samples << ", " << msSince(start) / 1000.0 << " s" << std::endl;
+            lastProgress = now;
+        }
+    }
+    if (readback)
+        glDeleteSync(readback);
+    if (writing.valid())
+        report();
+
+    accumulation.resolve();
+    accumulation.bindSums();
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_FLOAT, sums.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, options.width, options.height, GL_RED, GL_FLOAT, squares.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    release();
+    accumulation.Delete();
+    if (gbufferShader && !writeGuides(renderer, *gbufferShader, camera, options, error))
+        return false;
+
+    Accumulator accumulator;
+    accumulator.resize(options.width, options.height);
+    toAccumulator(sums, squares, accumulator);
+    ImageEncoder::Job image;
+    image.path = options.output;
+    image.format = format;
+    image.exposure = options.exposure;
+    image.width = options.width;
+    image.height = options.height;
+    accumulator.resolve(image.pixels);
+    if (!ImageEncoder::Write(image)) {
+        error = "cannot write " + options.output.string();
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::remove(checkpoint, ec);
+    std::cout << options.samples - firstPass << " passes in " << msSince(start) / 1000.0 << " s";
+    // From the variance sums; a single sample has none
+    if (options.samples > 1) {
+        double relativeError = 0.0;
+        for (size_t i = 0; i < count; ++i)
+            relativeError += accumulator.relativeError(i);
+        std::cout << ", mean relative error " << 100.0 * relativeError / count << "%";
+    }
+    std::cout << std::endl;
+    return true;
+}
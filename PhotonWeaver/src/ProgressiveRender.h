@@ -0,0 +1,64 @@
+#ifndef PROGRESSIVE_RENDER_H
+#define PROGRESSIVE_RENDER_H
+
+#include "pch.h"
+#include "AccumulationTarget.h"
+#include "Accumulator.h"
+#include "GBuffer.h"
+#include "Renderer.h"
+
+// Long progressive stills from the GL tracer that survive the process
+// dying. Passes are blended into float targets that hold what an
+// Accumulator holds: the color sum with the sample count in alpha, and the
+// sum of squared luminance. Every checkpointSeconds both targets are read
+// into pixel buffers behind the passes already queued. Once the GPU has
+// filled them, they are copied out and written on a background thread, so
+// the passes never wait for the disk. A checkpoint records the sums, the
+// counts and the next pass's frameIndex. Resuming from it uploads the sums
+// and carries on from that pass, and the final image is bit for bit that of
+// an uninterrupted run. With rgba16f-resolve, checkpoints wait for the next
+// resolve, so they never change where the half sums are rounded. A checkpoint
+// also records the storage and the shader variant, and resuming with others
+// fails rather than adding up sums of different renders.
+class ProgressiveRender
+{
+public:
+	struct Options {
+		// Recorded in checkpoints so --resume can load the same scene
+		std::string scene;
+		int width = 1920;
+		int height = 1080;
+		// Passes in the finished image; frameIndex 0..samples-1
+		int samples = 1024;
+		// .png, .exr or .pfm
+		std::filesystem::path output;
+		// Empty means output plus ".checkpoint"; removed once the image is written
+		std::filesystem::path checkpoint;
+		double checkpointSeconds = 300.0;
+		// Continue from the checkpoint instead of starting over
+		bool resume = false;
+		float exposure = 1.0f;
+		// The define block of the shader passed to Render() (ShaderVariantKey::defines()),
+		// bounces included; a checkpoint only resumes under the same one
+		std::string variant;
+		// How the passes are summed on the GPU; checkpoints hold float sums whatever it is
+		AccumulationTarget::Storage storage = AccumulationTarget::Storage::Float32;
+		int resolveInterval = 16;
+		// Storage of the albedo and normal guides, when Render() is given a G-buffer shader
+		GBuffer::Format gbufferFormat = GBuffer::Format::Packed;
+	};
+
+	// The render a checkpoint belongs to: scene, size, samples and output.
+	// options.checkpoint is set to path and options.resume to true.
+	static bool ReadCheckpoint(const std::filesystem::path& path, Options& options, std::string& error);
+
+	// shader must be a variant with ACCUMULATE. Prints progress and the cost
+	// of every checkpoint. False, with error, when the targets, the
+	// checkpoint or the image fail. With gbufferShader, a GBUFFER variant,
+	// the first hit's albedo and normals are also written next to the output
+	// as <name>.albedo.exr and <name>.normal.exr.
+	static bool Render(Renderer& renderer, Shader& shader, const SceneCamera& camera, const Options& options, std::string& error,
+		Shader* gbufferShader = nullptr);
+};
+
+#endif // PROGRESSIVE_RENDER_H
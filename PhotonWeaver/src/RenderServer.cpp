@@ -0,0 +1,387 @@
+#include "RenderServer.h"
+#include "CompiledScene.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+double msBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Whole number member within [low, high]; false only when present and not one
+bool optionalInt(const Json& request, const std::string& key, int low, int high, int& value, std::string& error)
+{
+    if (!request.has(key))
+        return true;
+    double number = request[key].asNumber(std::nan(""));
+    if (!(number >= low && number <= high) || number != std::floor(number)) {
+        error = key + " must be a whole number from " + std::to_string(low) + " to " + std::to_string(high);
+        return false;
+    }
+    value = static_cast<int>(number);
+    return true;
+}
+
+bool optionalVec3(const Json& object, const std::string& key, glm::vec3& value, std::string& error)
+{
+    if (!object.has(key))
+        return true;
+    const Json& array = object[key];
+    if (!array.isArray() || array.size() != 3 || !array[0].isNumber() || !array[1].isNumber() || !array[2].isNumber()) {
+        error = "camera." + key + " must be an array of three numbers";
+        return false;
+    }
+    value = glm::vec3(array[0].asNumber(), array[1].asNumber(), array[2].asNumber());
+    return true;
+}
+
+}
+
+RenderServer::RenderServer(ShaderVariants& shaders, const Options& options)
+    : shaders(shaders), options(options)
+{
+}
+
+RenderServer::~RenderServer()
+{
+    Delete();
+}
+
+bool RenderServer::start(std::string& error)
+{
+    if (!listener.listen(options.socketPath, error))
+        return false;
+    acceptor = std::thread(&RenderServer::accept, this);
+    return true;
+}
+
+void RenderServer::accept()
+{
+    TRACE_THREAD_NAME("server acceptor");
+    for (;;) {
+        auto client = std::make_shared<LocalSocket>();
+        if (!listener.accept(*client))
+            break;
+        std::unique_lock<std::mutex> lock(mutex);
+        // A burst of clients gets at most maxReaders threads; each frees its
+        // slot within the request timeout
+        for (;;) {
+            for (auto reader = readers.begin(); reader != readers.end();) {
+                if (reader->done) {
+                    reader->thread.join();
+                    reader = readers.erase(reader);
+                } else {
+                    ++reader;
+                }
+            }
+            if (stopping || readers.size() < std::max<size_t>(options.maxReaders, 1))
+                break;
+            readerDone.wait(lock);
+        }
+        if (stopping)
+            break;
+        readers.emplace_back();
+        readers.back().thread = std::thread(&RenderServer::receive, this, client, &readers.back());
+    }
+}
+
+void RenderServer::receive(std::shared_ptr<LocalSocket> client, Reader* reader)
+{
+    TRACE_THREAD_NAME("server reader");
+    std::string line, error;
+    Json request;
+    bool parsed = false;
+    // A client that never finishes its line must not hold the reader past the request timeout
+    if (client->readLine(line, 1 << 20, options.requestTimeoutSeconds)) {
+        parsed = Json::parse(line, request, error) && request.isObject();
+        if (!parsed) {
+            Json reply = Json::object();
+            reply.set("ok", false);
+            reply.set("error", error.empty() ? "expected a JSON object" : error);
+            Reply(*client, reply);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    reader->done = true;
+    readerDone.notify_one();
+    if (!parsed)
+        return;
+    if (stopping) {
+        Json reply = Json::object();
+        reply.set("ok", false);
+        reply.set("error", "server shutting down");
+        Reply(*client, reply);
+        return;
+    }
+    Job job;
+    job.request = request;
+    job.priority = static_cast<int>(std::clamp(request["priority"].asNumber(), -1e6, 1e6));
+    job.client = client;
+    job.queued = std::chrono::steady_clock::now();
+    job.id = nextId++;
+    jobs.push(job);
+    wake.notify_one();
+}
+
+void RenderServer::run()
+{
+    std::cout << "Serving on " << options.socketPath.string() << std::endl;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = jobs.top();
+            jobs.pop();
+            if (job.request["shutdown"].asBool()) {
+                stopping = true;
+                Json reply = Json::object();
+                reply.set("id", job.id);
+                reply.set("ok", true);
+                Reply(*job.client, reply);
+                return;
+            }
+        }
+        execute(job);
+    }
+}
+
+void RenderServer::execute(Job& job)
+{
+    TRACE_SCOPE("RenderServer::execute");
+    auto start = std::chrono::steady_clock::now();
+    double queueMs = msBetween(job.queued, start);
+    const Json& request = job.request;
+    Json reply = Json::object();
+    reply.set("id", job.id);
+    auto fail = [&](const std::string& message) {
+        std::cerr << "ERROR::SERVER::JOB_FAILED: job " << job.id << ": " << message << std::endl;
+        reply.set("ok", false);
+        reply.set("error", message);
+        Reply(*job.client, reply);
+    };
+
+    if (!request["scene"].isString() || !request["output"].isString())
+        return fail("scene and output are required");
+    std::filesystem::path output = request["output"].asString();
+    ImageEncoder::Format format;
+    std::string extension = output.extension().string();
+    if (extension.empty() || !ImageEncoder::ParseFormat(extension.substr(1), format))
+        return fail("output must end in .png, .exr or .pfm");
+
+    int width = 1280, height = 720, samples = 16, bounces = 5;
+    std::string error;
+    if (!optionalInt(request, "width", 1, options.maxSize, width, error) || !optionalInt(request, "height", 1, options.maxSize, height, error)
+        || !optionalInt(request, "spp", 1, 1 << 16, samples, error) || !optionalInt(request, "bounces", 1, 64, bounces, error))
+        return fail(error);
+
+    bool cached = false;
+    CachedScene* entry = scene(request["scene"].asString(), cached, error);
+    if (!entry)
+        return fail(error);
+
+    SceneCamera camera = entry->camera;
+    const Json& view = request["camera"];
+    if (!view.isNull()) {
+        if (!view.isObject())
+            return fail("camera must be an object");
+        if (!optionalVec3(view, "position", camera.position, error) || !optionalVec3(view, "target", camera.target, error)
+            || !optionalVec3(view, "up", camera.up, error))
+            return fail(error);
+        camera.fov = static_cast<float>(view["fov"].asNumber(camera.fov));
+    }
+
+    ShaderVariantKey key = ShaderVariantKey().set("MAX_BOUNCES", bounces).set("NUM_SAMPLES", 1);
+    Shader& shader = shaders.get(entry->renderer->variant(key));
+    auto loaded = std::chrono::steady_clock::now();
+
+    std::vector<glm::vec4> pixels = encoder.takeBuffer();
+    {
+        TRACE_SCOPE("render job");
+        resizeTarget(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        // Each pass adds its share of the average, as in Animation::Render
+        float weight = 1.0f / samples;
+        glBlendColor(weight, weight, weight, weight);
+        glBlendFunc(GL_CONSTANT_COLOR, GL_ONE);
+        glEnable(GL_BLEND);
+        for (int pass = 0; pass < samples; ++pass) {
+            entry->renderer->draw(shader, camera, width, height, pass);
+            glFlush();
+        }
+        glDisable(GL_BLEND);
+        pixels.resize(static_cast<size_t>(width) * height);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    auto rendered = std::chrono::steady_clock::now();
+
+    reply.set("ok", true);
+    reply.set("output", output.string());
+    reply.set("sceneCached", cached);
+    reply.set("queueMs", queueMs);
+    reply.set("loadMs", msBetween(start, loaded));
+    reply.set("renderMs", msBetween(loaded, rendered));
+
+    ImageEncoder::Job encode;
+    encode.path = output;
+    encode.format = format;
+    encode.width = width;
+    encode.height = height;
+    encode.pixels = std::move(pixels);
+    std::shared_ptr<LocalSocket> client = job.client;
+    auto queued = job.queued;
+    encode.done = [client, reply, queued](bool written, double encodeMs) mutable {
+        if (!written) {
+            reply.set("ok", false);
+            reply.set("error", "cannot write " + reply["output"].asString());
+        }
+        reply.set("encodeMs", encodeMs);
+        double totalMs = msBetween(queued, std::chrono::steady_clock::now());
+        reply.set("totalMs", totalMs);
+        std::cout << "Job " << reply["id"].asNumber() << ": " << reply["output"].asString() << " in " << totalMs << " ms (queue "
+            << reply["queueMs"].asNumber() << ", load " << reply["loadMs"].asNumber() << ", render " << reply["renderMs"].asNumber()
+            << ", encode " << encodeMs << ")" << std::endl;
+        Reply(*client, reply);
+    };
+    encoder.push(std::move(encode));
+}
+
+RenderServer::CachedScene* RenderServer::scene(const std::string& name, bool& cached, std::string& error)
+{
+    std::vector<std::string> builtins = Scene::BuiltinNames();
+    bool builtin = std::find(builtins.begin(), builtins.end(), name) != builtins.end();
+    std::filesystem::file_time_type modified;
+    if (!builtin) {
+        std::error_code statError;
+        modified = std::filesystem::last_write_time(name, statError);
+        if (statError) {
+            error = "cannot open " + name;
+            return nullptr;
+        }
+    }
+
+    auto found = std::find_if(scenes.begin(), scenes.end(), [&](const CachedScene& entry) { return entry.key == name; });
+    if (found != scenes.end()) {
+        if (found->modified == modified) {
+            scenes.splice(scenes.begin(), scenes, found);
+            cached = true;
+            return &scenes.front();
+        }
+        found->renderer->Delete();
+        scenes.erase(found);
+    }
+
+    TRACE_SCOPE("load scene");
+    CachedScene entry;
+    entry.key = name;
+    entry.modified = modified;
+    entry.renderer = std::make_unique<Renderer>();
+    if (builtin) {
+        Scene scene;
+        Scene::Builtin(name, scene);
+        scene.buildBVH();
+        entry.renderer->upload(scene);
+        entry.camera = scene.camera;
+    }
+    else {
+        CompiledScene compiled;
+        if (!compiled.load(name, error)) {
+            entry.renderer->Delete();
+            return nullptr;
+        }
+        entry.renderer->upload(compiled.geometry());
+        entry.camera = compiled.camera();
+    }
+
+    scenes.push_front(std::move(entry));
+    while (scenes.size() > std::max<size_t>(options.sceneCacheSize, 1)) {
+        scenes.back().renderer->Delete();
+        scenes.pop_back();
+    }
+    cached = false;
+    return &scenes.front();
+}
+
+void RenderServer::resizeTarget(int width, int height)
+{
+    if (framebuffer && width == targetWidth && height == targetHeight)
+        return;
+    if (!framebuffer) {
+        framebuffer = GLFramebuffer::Create();
+        color = GLTexture::Create();
+    }
+    targetWidth = width;
+    targetHeight = height;
+    glBindTexture(GL_TEXTURE_2D, color.get());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.get(), 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderServer::Reply(LocalSocket& client, const Json& reply)
+{
+    client.writeLine(reply.dump(0));
+    client.close();
+}
+
+void RenderServer::Delete()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    readerDone.notify_one();
+    listener.close();
+    if (acceptor.joinable())
+        acceptor.join();
+    // Readers still waiting on a client give up within the request timeout
+    std::list<Reader> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining.swap(readers);
+    }
+    for (Reader& reader : remaining)
+        reader.thread.join();
+    while (!jobs.empty()) {
+        Json reply = Json::object();
+        reply.set("id", jobs.top().id);
+        reply.set("ok", false);
+        reply.set("error", "server shutting down");
+        Reply(*jobs.top().client, reply);
+        jobs.pop();
+    }
+    // Lets the replies of jobs still encoding go out
+    encoder.Delete();
+    for (CachedScene& entry : scenes)
+        entry.renderer->Delete();
+    scenes.clear();
+    framebuffer.reset();
+    color.reset();
+}
+
+bool RenderServer::Submit(const std::filesystem::path& socketPath, const Json& request, std::string& reply, std::string& error)
+{
+    LocalSocket socket;
+    if (!socket.connect(socketPath, error))
+        return false;
+    if (!socket.writeLine(request.dump(0)) || !socket.readLine(reply)) {
+        error = "the server closed the connection";
+        return false;
+    }
+    return true;
+}
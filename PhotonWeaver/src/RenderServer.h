@@ -0,0 +1,132 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include "pch.h"
+#include "ImageEncoder.h"
+#include "Json.h"
+#include "LocalSocket.h"
+#include "Renderer.h"
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+// Long-running render service (--serve). Clients connect to a Unix domain
+// socket and send one job per connection as a line of JSON:
+//
+//   { "scene": "scenes/cornell.json", "output": "out.png", "width": 1280, "height": 720,
+//     "spp": 64, "bounces": 5, "priority": 0,
+//     "camera": { "position": [0, 0, 3.2], "target": [0, 0, 0], "fov": 45 } }
+//
+// Only scene and output are required; the camera defaults to the scene's and
+// the format follows the output's extension (.png, .exr or .pfm). The reply,
+// also one line, comes once the file is written:
+//
+//   { "id": 3, "ok": true, "output": "out.png", "sceneCached": true,
+//     "queueMs": 0.1, "loadMs": 0.4, "renderMs": 812, "encodeMs": 35, "totalMs": 848 }
+//
+// or { "id": 3, "ok": false, "error": "..." }. { "shutdown": true } stops the
+// server once it reaches it in the queue.
+//
+// Everything a process per render pays again each time stays warm: the GL
+// context, compiled shader variants, and an LRU cache of uploaded scenes
+// with their BVHs. Jobs run one at a time on the thread owning the context,
+// highest priority first and in arrival order within a priority. Encoding
+// overlaps the next job's render.
+class RenderServer
+{
+public:
+	struct Options {
+		std::filesystem::path socketPath = "photonweaver.sock";
+		// Scenes kept uploaded between jobs
+		size_t sceneCacheSize = 4;
+		// Largest output accepted, in pixels per side
+		int maxSize = 8192;
+		// A client that has not sent its whole request by then is dropped
+		double requestTimeoutSeconds = 5.0;
+		// Requests read at once; further clients wait in the listen backlog
+		size_t maxReaders = 16;
+	};
+
+	RenderServer(ShaderVariants& shaders, const Options& options);
+	~RenderServer();
+
+	RenderServer(const RenderServer&) = delete;
+	RenderServer& operator=(const RenderServer&) = delete;
+
+	// Starts listening; false, with error, when the socket cannot be bound
+	bool start(std::string& error);
+	// Runs jobs on the calling thread, which must own the GL context, until a shutdown request
+	void run();
+	// Stops listening, fails the jobs still queued and frees the cached scenes
+	void Delete();
+
+	// Client side: sends request and waits for the reply
+	static bool Submit(const std::filesystem::path& socketPath, const Json& request, std::string& reply, std::string& error);
+
+private:
+	struct Job {
+		uint64_t id = 0;
+		int priority = 0;
+		Json request;
+		std::shared_ptr<LocalSocket> client;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	// Reads one connection's request, so a slow client holds up no other
+	struct Reader {
+		std::thread thread;
+		bool done = false;
+	};
+
+	struct JobOrder {
+		bool operator()(const Job& a, const Job& b) const
+		{
+			return a.priority != b.priority ? a.priority < b.priority : a.id > b.id;
+		}
+	};
+
+	// The GPU copy is all a job needs, so nothing else of the scene is kept
+	struct CachedScene {
+		std::string key;
+		// Scene files are reloaded when this changes; built-in scenes have none
+		std::filesystem::file_time_type modified;
+		SceneCamera camera;
+		std::unique_ptr<Renderer> renderer;
+	};
+
+	ShaderVariants& shaders;
+	Options options;
+	LocalSocket listener;
+	std::thread acceptor;
+	ImageEncoder encoder;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Signalled when a reader finishes, for an acceptor waiting on maxReaders
+	std::condition_variable readerDone;
+	std::priority_queue<Job, std::vector<Job>, JobOrder> jobs;
+	uint64_t nextId = 1;
+	bool stopping = false;
+	// Finished ones are joined by the acceptor, the rest by Delete()
+	std::list<Reader> readers;
+
+	// Most recently used first; GL thread only
+	std::list<CachedScene> scenes;
+	GLFramebuffer framebuffer;
+	GLTexture color;
+	int targetWidth = 0, targetHeight = 0;
+
+	void accept();
+	void receive(std::shared_ptr<LocalSocket> client, Reader* reader);
+	void execute(Job& job);
+	// The cached entry for a scene, loading and uploading it on a miss
+	CachedScene* scene(const std::string& name, bool& cached, std::string& error);
+	void resizeTarget(int width, int height);
+	static void Reply(LocalSocket& client, const Json& reply);
+};
+
+#endif // RENDER_SERVER_H
@@ -0,0 +1,160 @@
+#include "RenderTargetPool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Pixel transfer format and type that go with an internal format in glTexImage2D
+void transferFormat(GLenum internalFormat, GLenum& format, GLenum& type)
+{
+    switch (internalFormat) {
+    case GL_RGBA32UI:
+        format = GL_RGBA_INTEGER;
+        type = GL_UNSIGNED_INT;
+        break;
+    case GL_R32UI:
+        format = GL_RED_INTEGER;
+        type = GL_UNSIGNED_INT;
+        break;
+    case GL_DEPTH_COMPONENT32F:
+        format = GL_DEPTH_COMPONENT;
+        type = GL_FLOAT;
+        break;
+    case GL_R32F:
+    case GL_R16F:
+        format = GL_RED;
+        type = GL_FLOAT;
+        break;
+    case GL_RG32F:
+    case GL_RG16F:
+    case GL_RG16:
+        format = GL_RG;
+        type = GL_FLOAT;
+        break;
+    case GL_R11F_G11F_B10F:
+        format = GL_RGB;
+        type = GL_FLOAT;
+        break;
+    case GL_RGBA8:
+        format = GL_RGBA;
+        type = GL_UNSIGNED_BYTE;
+        break;
+    default:
+        format = GL_RGBA;
+        type = GL_FLOAT;
+        break;
+    }
+}
+
+}
+
+RenderTargetPool& RenderTargetPool::Instance()
+{
+    static RenderTargetPool pool;
+    return pool;
+}
+
+GLuint RenderTargetPool::acquire(GLenum internalFormat, int width, int height)
+{
+    for (auto& entry : entries) {
+        if (!entry->inUse && entry->format == internalFormat && entry->width == width && entry->height == height) {
+            entry->inUse = true;
+            entry->idle = 0;
+            ++totals.inUse;
+            ++totals.reuses;
+            return entry->texture.get();
+        }
+    }
+
+    // Nothing idle fits: idle textures of this format are the old size, so they
+    // go before the new one comes; other formats belong to other targets
+    for (size_t i = entries.size(); i-- > 0;)
+        if (!entries[i]->inUse && entries[i]->format == internalFormat)
+            free(i);
+
+    auto entry = std::make_unique<Entry>();
+    entry->texture = GLTexture::Create();
+    entry->format = internalFormat;
+    entry->width = width;
+    entry->height = height;
+    entry->inUse = true;
+    entry->bytes = static_cast<size_t>(width) * height * BytesPerPixel(internalFormat);
+    GLenum format, type;
+    transferFormat(internalFormat, format, type);
+    glBindTexture(GL_TEXTURE_2D, entry->texture.get());
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    totals.bytes += entry->bytes;
+    totals.peakBytes = std::max(totals.peakBytes, totals.bytes);
+    ++totals.textures;
+    ++totals.inUse;
+    ++totals.allocations;
+    GLuint texture = entry->texture.get();
+    entries.push_back(std::move(entry));
+    return texture;
+}
+
+void RenderTargetPool::release(GLuint texture)
+{
+    if (!texture)
+        return;
+    for (auto& entry : entries) {
+        if (entry->texture.get() == texture && entry->inUse) {
+            entry->inUse = false;
+            entry->idle = 0;
+            --totals.inUse;
+            return;
+        }
+    }
+    std::cerr << "ERROR::RENDER_TARGET_POOL::UNKNOWN_TEXTURE: " << texture << std::endl;
+}
+
+void RenderTargetPool::endFrame()
+{
+    for (size_t i = entries.size(); i-- > 0;)
+        if (!entries[i]->inUse && ++entries[i]->idle > idleFrames)
+            free(i);
+}
+
+size_t RenderTargetPool::BytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat) {
+    case GL_RGBA32F:
+    case GL_RGBA32UI:
+        return 16;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_R32F:
+    case GL_R32UI:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_RGBA8:
+    case GL_R11F_G11F_B10F:
+    case GL_RG16:
+    case GL_RG16F:
+        return 4;
+    case GL_R16F:
+        return 2;
+    default:
+        return 16;
+    }
+}
+
+void RenderTargetPool::free(size_t index)
+{
+    Entry& entry = *entries[index];
+    totals.bytes -= entry.bytes;
+    --totals.textures;
+    if (entry.inUse)
+        --totals.inUse;
+    entries.erase(entries.begin() + index);
+}
+
+void RenderTargetPool::Delete()
+{
+    for (size_t i = entries.size(); i-- > 0;)
+        free(i);
+}
@@ -0,0 +1,78 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include "pch.h"
+#include "GLObject.h"
+
+#include <memory>
+#include <vector>
+
+// Textures for transient render targets, kept by format and size. Released
+// textures stay in the pool and go to the next request for the same format
+// and size, so a target that is dropped and asked for again costs no
+// allocation. A request with no match first frees the idle textures of its
+// format at other sizes, so the old and new sizes are never both allocated,
+// while idle textures of other formats wait for their own targets. Idle
+// textures that nobody asks for again are freed after a while (see
+// endFrame()). Framebuffers hold no memory and stay with their owners.
+class RenderTargetPool
+{
+public:
+	struct Stats {
+		// Texture memory held, in use or idle
+		size_t bytes = 0;
+		size_t peakBytes = 0;
+		size_t textures = 0;
+		size_t inUse = 0;
+		// Requests that needed a new texture, and those served from the pool
+		size_t allocations = 0;
+		size_t reuses = 0;
+	};
+
+	// Frames a released texture stays in the pool before it is freed
+	int idleFrames = 120;
+
+	// Returns the process wide pool; use it only where the main context is current.
+	// It outlives main, so Delete() it on every exit path before glfwTerminate.
+	static RenderTargetPool& Instance();
+
+	RenderTargetPool(const RenderTargetPool&) = delete;
+	RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+	// A width x height GL_TEXTURE_2D of internalFormat with nearest filtering,
+	// owned by the pool until release(); contents are undefined
+	GLuint acquire(GLenum internalFormat, int width, int height);
+	// Hands a texture from acquire() back; 0 is ignored
+	void release(GLuint texture);
+
+	// Counts a frame; frees textures that have been idle for idleFrames
+	void endFrame();
+	Stats stats() const { return totals; }
+
+	// Approximate size of one pixel, for the memory figures
+	static size_t BytesPerPixel(GLenum internalFormat);
+
+	// Frees every texture, in use or not
+	void Delete();
+
+private:
+	struct Entry {
+		GLTexture texture;
+		GLenum format = 0;
+		int width = 0;
+		int height = 0;
+		bool inUse = false;
+		// Frames since it was released
+		int idle = 0;
+		size_t bytes = 0;
+	};
+
+	std::vector<std::unique_ptr<Entry>> entries;
+	Stats totals;
+
+	RenderTargetPool() = default;
+
+	void free(size_t index);
+};
+
+#endif // RENDER_TARGET_POOL_H
@@ -0,0 +1,411 @@
+#include "Renderer.h"
+#include "RenderTargetPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float quadVertices[] = {
+    // positions    // texCoords
+    -1.0f,  1.0f,   0.0f, 1.0f,
+    -1.0f, -1.0f,   0.0f, 0.0f,
+     1.0f, -1.0f,   1.0f, 0.0f,
+
+    -1.0f,  1.0f,   0.0f, 1.0f,
+     1.0f, -1.0f,   1.0f, 0.0f,
+     1.0f,  1.0f,   1.0f, 1.0f
+};
+
+// Unit box around a sphere and its faces, for the visibility pass
+const float boxCorners[] = {
+    -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   -1.0f, 1.0f, -1.0f,   1.0f, 1.0f, -1.0f,
+    -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   -1.0f, 1.0f,  1.0f,   1.0f, 1.0f,  1.0f
+};
+const GLuint boxFaces[] = {
+    0, 1, 3, 0, 3, 2,   4, 6, 7, 4, 7, 5,   0, 4, 5, 0, 5, 1,
+    2, 3, 7, 2, 7, 6,   0, 2, 6, 0, 6, 4,   1, 5, 7, 1, 7, 3
+};
+
+void uploadBuffer(GLBuffer& buffer, GLTexture& texture, const void* data, size_t bytes, GLenum format = GL_RGBA32F)
+{
+    if (!buffer) {
+        buffer = GLBuffer::Create();
+        texture = GLTexture::Create();
+    }
+    // An empty buffer texture is fine as long as the shader never reads it
+    GLState::BindBuffer(GL_TEXTURE_BUFFER, buffer.get());
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), data, GL_STATIC_DRAW);
+    GLState::BindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, texture.get());
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer.get());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+}
+
+Renderer::Renderer()
+    : quadVBO(quadVertices, sizeof(quadVertices))
+{
+    quadVAO.Bind();
+    quadVAO.LinkAttrib(quadVBO, 0, 2, GL_FLOAT, 4 * sizeof(float), (void*)0);
+    quadVAO.LinkAttrib(quadVBO, 1, 2, GL_FLOAT, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    quadVAO.Unbind();
+}
+
+void Renderer::upload(const Scene& scene)
+{
+    upload(scene.geometry());
+}
+
+void Renderer::upload(const SceneGeometry& geometry)
+{
+    TRACE_SCOPE("Renderer::upload");
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    size_t texels = std::max({ geometry.sphereCount * 2, geometry.nodeCount * 2, geometry.triangleCount * 3, geometry.triangleNodeCount * 2 });
+    if (texels > static_cast<size_t>(maxTexels))
+        std::cerr << "WARNING::RENDERER::SCENE_EXCEEDS_TEXTURE_BUFFER: " << texels << " > " << maxTexels << " texels" << std::endl;
+
+    size_t sphereBytes = geometry.sphereCount * sizeof(Sphere);
+    size_t nodeBytes = geometry.nodeCount * sizeof(BVHNode);
+    uploadBuffer(sphereBuffer, sphereTexture, geometry.spheres, sphereBytes);
+    uploadBuffer(nodeBuffer, nodeTexture, geometry.nodes, nodeBytes);
+
+    size_t materialBytes = geometry.materialCount * sizeof(Material);
+    size_t triangleBytes = geometry.triangleCount * sizeof(Triangle);
+    size_t shadingBytes = geometry.triangleCount * sizeof(TriangleShading);
+    size_t triangleNodeBytes = geometry.triangleNodeCount * sizeof(BVHNode);
+    uploadBuffer(materialBuffer, materialTexture, geometry.materials, materialBytes);
+    uploadBuffer(triangleBuffer, triangleTexture, geometry.triangles, triangleBytes);
+    uploadBuffer(shadingBuffer, shadingTexture, geometry.shading, shadingBytes, GL_RGBA32UI);
+    uploadBuffer(triangleNodeBuffer, triangleNodeTexture, geometry.triangleNodes, triangleNodeBytes);
+
+    // sRGB storage, so filtering and the mip chain work on linear values as on the CPU
+    size_t textureBytes = 0;
+    textureLayers = geometry.textureLayers;
+    if (textureLayers > 0) {
+        GLint maxSize = 0, maxLayers = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        if (geometry.textureSize > maxSize || textureLayers > maxLayers)
+            std::cerr << "WARNING::RENDERER::TEXTURES_EXCEED_LIMITS: " << textureLayers << " layers of " << geometry.textureSize << std::endl;
+        if (!textureArray)
+            textureArray = GLTexture::Create();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray.get());
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_SRGB8_ALPHA8, geometry.textureSize, geometry.textureSize, textureLayers, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, geometry.texels);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        // The mip chain adds a third
+        textureBytes = static_cast<size_t>(geometry.textureSize) * geometry.textureSize * textureLayers * 4 * 4 / 3;
+    }
+
+    sphereCount = static_cast<int>(geometry.sphereCount);
+    triangleCount = static_cast<int>(geometry.triangleCount);
+    uploadedBytes = sphereBytes + nodeBytes + materialBytes + triangleBytes + shadingBytes + triangleNodeBytes + textureBytes;
+
+    // Rounded up so small changes in depth reuse the same compiled variant;
+    // the two hierarchies are walked one after the other and share the stack
+    int depth = std::max(geometry.bvhDepth, geometry.triangleBvhDepth);
+    stackSize = std::max(8, (depth + 8) / 8 * 8);
+    // Only the scatter code for these gets compiled; a scene without glass pays nothing for it
+    materialTypes = static_cast<int>(geometry.materialTypes());
+    // The visibility pass copies the new triangles when it next runs
+    if (visibility) {
+        visibility->copiedTriangles = 0;
+        visibility->current = false;
+    }
+}
+
+void Renderer::updateSpheres(const SceneGeometry& geometry)
+{
+    TRACE_SCOPE("Renderer::updateSpheres");
+    // Respecified rather than updated in place: the driver hands out fresh
+    // storage instead of waiting for a draw still reading the old
+    uploadBuffer(sphereBuffer, sphereTexture, geometry.spheres, geometry.sphereCount * sizeof(Sphere));
+    uploadBuffer(nodeBuffer, nodeTexture, geometry.nodes, geometry.nodeCount * sizeof(BVHNode));
+    if (visibility)
+        visibility->current = false;
+}
+
+ShaderVariantKey Renderer::variant(const ShaderVariantKey& key) const
+{
+    ShaderVariantKey result = key;
+    result.set("BVH_STACK_SIZE", stackSize);
+    result.set("MATERIAL_TYPES", materialTypes);
+    result.set("TRAVERSAL_STATS", collectStats);
+    result.set("TEXTURES", textureLayers > 0);
+    result.set("VISIBILITY_BUFFER", useVisibility);
+    return result;
+}
+
+void Renderer::bindScene(Shader& shader, const SceneCamera& camera, int width, int height, int frameIndex)
+{
+    shader.use();
+    {
+        TRACE_SCOPE("upload uniforms");
+        shader.setVec3("camPos", camera.position);
+        shader.setVec3("camDir", camera.direction());
+        shader.setVec3("camUp", camera.up);
+        shader.setFloat("fov", camera.fov);
+        shader.setFloat("width", static_cast<float>(width));
+        shader.setFloat("height", static_cast<float>(height));
+        shader.setVec2("tileOffset", glm::vec2(0.0f));
+        shader.setFloat("aspectRatio", static_cast<float>(width) / static_cast<float>(height));
+        shader.setInt("frameIndex", frameIndex);
+        shader.setInt("sphereCount", sphereCount);
+        shader.setInt("triangleCount", triangleCount);
+        shader.setInt("sphereData", 0);
+        shader.setInt("bvhNodes", 1);
+        shader.setInt("materialData", 2);
+        shader.setInt("triangleData", 3);
+        shader.setInt("triangleShading", 4);
+        shader.setInt("triangleNodes", 5);
+        shader.setFloat("heatmapScale", heatmapScale);
+        if (textureLayers > 0) {
+            shader.setInt("textures", 6);
+            shader.setFloat("pixelSpread", std::atan(2.0f * std::tan(glm::radians(camera.fov) * 0.5f) / static_cast<float>(height)));
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, sphereTexture.get());
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, nodeTexture.get());
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, materialTexture.get());
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, triangleTexture.get());
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_BUFFER, shadingTexture.get());
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_BUFFER, triangleNodeTexture.get());
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureLayers > 0 ? textureArray.get() : 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Renderer::draw(Shader& shader, const SceneCamera& camera, int width, int height, int frameIndex)
+{
+    if (useVisibility)
+        drawVisibility(camera, width, height);
+    bindScene(shader, camera, width, height, frameIndex);
+    if (useVisibility) {
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, visibility->primitives);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("visibility", 7);
+    }
+
+    GLint target = 0;
+    if (collectStats) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        resizeStatsTarget(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, statsFramebuffer.get());
+        const GLuint zero[4] = { 0, 0, 0, 0 };
+        glClearBufferuiv(GL_COLOR, 1, zero);
+    }
+
+    quadVAO.Bind();
+    {
+        TRACE_SCOPE("draw");
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    if (collectStats) {
+        TRACE_SCOPE("read traversal stats");
+        pixelCounters.resize(static_cast<size_t>(width) * height);
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glReadPixels(0, 0, width, height, GL_RGBA_INTEGER, GL_UNSIGNED_INT, pixelCounters.data());
+        stats = TraversalStats::FromPixels(pixelCounters);
+
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+}
+
+void Renderer::drawTile(Shader& shader, const SceneCamera& camera, int width, int height, const TileRect& rect, glm::ivec2 target,
+    int frameIndex)
+{
+    bindScene(shader, camera, width, height, frameIndex);
+    shader.setVec2("tileOffset", glm::vec2(rect.x - target.x, rect.y - target.y));
+
+    // The quad fills the viewport; the scissor keeps the rasterizer's guard band out of the neighbours
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(target.x, target.y, rect.width, rect.height);
+    glScissor(target.x, target.y, rect.width, rect.height);
+    glEnable(GL_SCISSOR_TEST);
+    quadVAO.Bind();
+    {
+        TRACE_SCOPE("draw tile");
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void Renderer::drawVisibility(const SceneCamera& camera, int width, int height)
+{
+    TRACE_SCOPE("Renderer::drawVisibility");
+    if (!visibility) {
+        visibility = std::make_unique<VisibilityPass>();
+        visibility->shaders = std::make_unique<ShaderVariants>(ShaderPath("visibility.vert"), ShaderPath("visibility.frag"));
+        visibility->boxArray.Bind();
+        visibility->box = std::make_unique<VBO>(boxCorners, sizeof(boxCorners));
+        visibility->boxIndices = std::make_unique<EBO>(boxFaces, sizeof(boxFaces));
+        visibility->boxArray.LinkAttrib(*visibility->box, 0, 3, GL_FLOAT, 3 * sizeof(float), (void*)0);
+        visibility->boxArray.Unbind();
+        visibility->framebuffer = GLFramebuffer::Create();
+    }
+    VisibilityPass& pass = *visibility;
+
+    if (pass.copiedTriangles != triangleCount && triangleCount > 0) {
+        // Copied on the GPU from the buffer the tracer reads; each Triangle is three vec4 texels
+        GLsizeiptr bytes = static_cast<GLsizeiptr>(triangleCount) * sizeof(Triangle);
+        pass.triangles = std::make_unique<VBO>(nullptr, bytes);
+        GLState::BindBuffer(GL_COPY_READ_BUFFER, triangleBuffer.get());
+        GLState::BindBuffer(GL_COPY_WRITE_BUFFER, pass.triangles->id());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+        pass.triangleArray.Bind();
+        pass.triangleArray.LinkAttrib(*pass.triangles, 0, 4, GL_FLOAT, 4 * sizeof(float), (void*)0);
+        pass.triangleArray.Unbind();
+        pass.copiedTriangles = triangleCount;
+        pass.current = false;
+    }
+
+    // Read before a resize binds the pass's framebuffer
+    GLint target = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+
+    RenderTargetPool& pool = RenderTargetPool::Instance();
+    if (!pass.primitives || width != pass.width || height != pass.height) {
+        pool.release(pass.primitives);
+        pool.release(pass.depth);
+        pass.primitives = pool.acquire(GL_R32UI, width, height);
+        pass.depth = pool.acquire(GL_DEPTH_COMPONENT32F, width, height);
+        pass.width = width;
+        pass.height = height;
+        glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer.get());
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pass.primitives, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pass.depth, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::RENDERER::VISIBILITY_TARGET_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        pass.current = false;
+    }
+
+    const SceneCamera& drawn = pass.drawnCamera;
+    if (pass.current && camera.position == drawn.position && camera.target == drawn.target && camera.up == drawn.up && camera.fov == drawn.fov)
+        return;
+    pass.drawnCamera = camera;
+    pass.current = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer.get());
+    const GLuint none[4] = { 0, 0, 0, 0 };
+    const GLfloat farthest = 1.0f;
+    glClearBufferuiv(GL_COLOR, 0, none);
+    glClearBufferfv(GL_DEPTH, 0, &farthest);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    // The basis getRayDirection builds, so a pixel's centre sees what its camera ray hits
+    glm::vec3 w = glm::normalize(camera.direction());
+    glm::vec3 u = glm::normalize(glm::cross(camera.up, w));
+    glm::vec3 v = glm::cross(w, u);
+    auto setCamera = [&](Shader& shader) {
+        shader.use();
+        shader.setVec3("camPos", camera.position);
+        shader.setVec3("camU", u);
+        shader.setVec3("camV", v);
+        shader.setVec3("camW", w);
+        shader.setFloat("tanFov", std::tan(glm::radians(camera.fov) * 0.5f));
+        shader.setFloat("aspectRatio", static_cast<float>(width) / static_cast<float>(height));
+        shader.setFloat("width", static_cast<float>(width));
+        shader.setFloat("height", static_cast<float>(height));
+    };
+
+    if (triangleCount > 0) {
+        TRACE_SCOPE("rasterize triangles");
+        setCamera(pass.shaders->get(ShaderVariantKey()));
+        pass.triangleArray.Bind();
+        glDrawArrays(GL_TRIANGLES, 0, triangleCount * 3);
+    }
+    if (sphereCount > 0) {
+        TRACE_SCOPE("rasterize spheres");
+        Shader& shader = pass.shaders->get(ShaderVariantKey().set("SPHERES", true));
+        setCamera(shader);
+        shader.setInt("sphereData", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, sphereTexture.get());
+        pass.boxArray.Bind();
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr, sphereCount);
+    }
+
+    glDisable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+void Renderer::resizeStatsTarget(int width, int height)
+{
+    if (statsFramebuffer && width == statsWidth && height == statsHeight)
+        return;
+
+    if (!statsFramebuffer)
+        statsFramebuffer = GLFramebuffer::Create();
+    statsWidth = width;
+    statsHeight = height;
+
+    RenderTargetPool& pool = RenderTargetPool::Instance();
+    pool.release(statsColor);
+    pool.release(statsCounters);
+    statsColor = pool.acquire(GL_RGBA32F, width, height);
+    statsCounters = pool.acquire(GL_RGBA32UI, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, statsFramebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, statsColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, statsCounters, 0);
+    const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::RENDERER::STATS_TARGET_INCOMPLETE" << std::endl;
+}
+
+void Renderer::Delete()
+{
+    quadVAO.Delete();
+    quadVBO.Delete();
+    for (GLTexture* texture : { &sphereTexture, &nodeTexture, &materialTexture, &triangleTexture, &shadingTexture, &triangleNodeTexture })
+        texture->reset();
+    for (GLBuffer* buffer : { &sphereBuffer, &nodeBuffer, &materialBuffer, &triangleBuffer, &shadingBuffer, &triangleNodeBuffer })
+        buffer->reset();
+    textureArray.reset();
+    textureLayers = 0;
+    statsFramebuffer.reset();
+    RenderTargetPool::Instance().release(statsColor);
+    RenderTargetPool::Instance().release(statsCounters);
+    statsColor = statsCounters = 0;
+    statsWidth = statsHeight = 0;
+    if (visibility) {
+        RenderTargetPool::Instance().release(visibility->primitives);
+        RenderTargetPool::Instance().release(visibility->depth);
+        visibility->shaders->Delete();
+        visibility.reset();
+    }
+}
+
+std::string Renderer::ShaderPath(const std::string& file)
+{
+    // Same layout main.cpp has always assumed: run from the project directory
+    return (std::filesystem::path(parentDir) / "PhotonWeaver" / "src" / "shaders" / file).string();
+}
@@ -0,0 +1,143 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "pch.h"
+#include "GLObject.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include "TraversalStats.h"
+#include "EBO.h"
+#include "VAO.h"
+#include "VBO.h"
+
+#include <memory>
+
+// Pixel rectangle of an image, origin at the bottom left as in GL
+struct TileRect {
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+
+	size_t pixels() const { return static_cast<size_t>(width) * height; }
+};
+
+// Draws default.frag over a full-screen quad. The scene lives in buffer
+// textures (spheres, triangles, their shading records, materials and one BVH
+// per primitive type) plus a mipmapped texture array, so changing it never
+// needs a recompile unless a hierarchy gets deeper than the shader's
+// traversal stack, the scene brings a material type the compiled variant
+// left out, or textures appear or go away.
+class Renderer
+{
+public:
+	Renderer();
+
+	// Copies the scene's primitives and hierarchies to the GPU; the scene must have its BVHs built
+	void upload(const Scene& scene);
+	// Same, straight from the arrays in the view (e.g. a mapped CompiledScene)
+	void upload(const SceneGeometry& geometry);
+
+	// Re-sends only the spheres and their hierarchy, e.g. after Scene::pose.
+	// The counts and depth must be those of the last upload.
+	void updateSpheres(const SceneGeometry& geometry);
+
+	// The caller's variant plus the constants the uploaded scene needs
+	ShaderVariantKey variant(const ShaderVariantKey& key) const;
+
+	// frameIndex seeds the shader's RNG; 0 reproduces the classic single frame
+	void draw(Shader& shader, const SceneCamera& camera, int width, int height, int frameIndex = 0);
+	// Draws only rect of a width x height image, into the bound framebuffer
+	// with rect's corner at target. Every pixel comes out as draw() makes it,
+	// so an image can be put together from tiles drawn in any order, over
+	// several frames, or one at a time through a target far smaller than the
+	// image. The viewport is restored afterwards; traversal stats are not collected.
+	void drawTile(Shader& shader, const SceneCamera& camera, int width, int height, const TileRect& rect, glm::ivec2 target,
+		int frameIndex = 0);
+
+	size_t sceneBytes() const { return uploadedBytes; }
+
+	// Debug counters. While enabled, draw() renders through an internal target
+	// with a second RGBA32UI attachment, reads the per-pixel counters back (a
+	// full sync, so frame times are not representative) and blits the color to
+	// the framebuffer that was bound.
+	void setStatsEnabled(bool enabled) { collectStats = enabled; }
+	bool statsEnabled() const { return collectStats; }
+	const TraversalStats& lastStats() const { return stats; }
+	const std::vector<glm::uvec4>& lastPixelCounters() const { return pixelCounters; }
+
+	// Primary visibility by rasterization. While enabled, draw() first
+	// rasterizes the triangles, and a box around each sphere that is hit
+	// analytically, into a buffer with the primitive at each pixel's centre.
+	// The VISIBILITY_BUFFER variant then takes a camera ray through the centre
+	// straight to that primitive instead of walking the hierarchies, and a
+	// jittered one walks them only for hits closer than it. The buffer is
+	// redrawn only when the camera, the size or the scene changes. drawTile()
+	// always traces, so tiles need a variant without it.
+	void setVisibilityEnabled(bool enabled) { useVisibility = enabled; }
+	bool visibilityEnabled() const { return useVisibility; }
+
+	// Traversal cost drawn as full red by the HEATMAP variant
+	float heatmapScale = 200.0f;
+
+	void Delete();
+
+	// Absolute path of a file in PhotonWeaver/src/shaders
+	static std::string ShaderPath(const std::string& file);
+
+private:
+	VBO quadVBO;
+	VAO quadVAO;
+
+	GLBuffer sphereBuffer, nodeBuffer, materialBuffer, triangleBuffer, shadingBuffer, triangleNodeBuffer;
+	// Buffer textures over the buffers above
+	GLTexture sphereTexture, nodeTexture, materialTexture, triangleTexture, shadingTexture, triangleNodeTexture;
+	// GL_TEXTURE_2D_ARRAY, one layer per scene texture
+	GLTexture textureArray;
+	int textureLayers = 0;
+	int sphereCount = 0;
+	int triangleCount = 0;
+	int stackSize = 8;
+	int materialTypes = 0;
+	size_t uploadedBytes = 0;
+
+	bool collectStats = false;
+	GLFramebuffer statsFramebuffer;
+	// From RenderTargetPool, handed back on resize and in Delete()
+	GLuint statsColor = 0, statsCounters = 0;
+	int statsWidth = 0, statsHeight = 0;
+	TraversalStats stats;
+	std::vector<glm::uvec4> pixelCounters;
+
+	// draw()'s raster pass while useVisibility is set; made on first use
+	struct VisibilityPass {
+		std::unique_ptr<ShaderVariants> shaders;
+		// The triangle buffer copied into a vertex buffer, a vertex per texel,
+		// so gl_PrimitiveID is the triangle's index
+		std::unique_ptr<VBO> triangles;
+		VAO triangleArray;
+		int copiedTriangles = 0;
+		// Unit box, drawn once per sphere
+		std::unique_ptr<VBO> box;
+		std::unique_ptr<EBO> boxIndices;
+		VAO boxArray;
+		GLFramebuffer framebuffer;
+		// From RenderTargetPool: R32UI primitives and a float depth buffer
+		GLuint primitives = 0, depth = 0;
+		int width = 0, height = 0;
+		// The camera the primitives were drawn for; cleared by a resize or an
+		// upload, so a still view rasterizes once however many passes it takes
+		SceneCamera drawnCamera;
+		bool current = false;
+	};
+	bool useVisibility = false;
+	std::unique_ptr<VisibilityPass> visibility;
+
+	void resizeStatsTarget(int width, int height);
+	void drawVisibility(const SceneCamera& camera, int width, int height);
+	// Uniforms and bindings shared by draw() and drawTile()
+	void bindScene(Shader& shader, const SceneCamera& camera, int width, int height, int frameIndex);
+};
+
+#endif // RENDERER_H
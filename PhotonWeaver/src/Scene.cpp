@@ -0,0 +1,424 @@
+#include "Scene.h"
+#include "Packing.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Same hash as the shaders, so generated scenes are identical on every platform
+uint32_t pcgHash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float randomFloat(uint32_t& state)
+{
+    state = pcgHash(state);
+    return state / 4294967296.0f;
+}
+
+Sphere makeSphere(glm::vec3 center, float radius, glm::vec3 albedo, int32_t material)
+{
+    return Sphere{ center, radius, albedo, material };
+}
+
+Material makeMaterial(Material::Type type, glm::vec3 albedo = glm::vec3(1.0f), float emission = 0.0f, float roughness = 0.0f, float ior = 1.5f)
+{
+    Material material;
+    material.albedo = albedo;
+    material.type = type;
+    material.emission = emission;
+    material.roughness = roughness;
+    material.ior = ior;
+    return material;
+}
+
+void addVertex(Mesh& mesh, glm::vec3 position)
+{
+    mesh.px.push_back(position.x);
+    mesh.py.push_back(position.y);
+    mesh.pz.push_back(position.z);
+}
+
+// Unit-radius ring around the y axis with smooth normals and UVs, on a
+// shared vertex grid so neighbouring triangles meet at identical positions
+Mesh makeTorus(float tube, int segments)
+{
+    Mesh mesh;
+    mesh.name = "torus";
+    int sides = std::max(3, segments / 2);
+    const float twoPi = 6.28318530718f;
+    for (int i = 0; i <= segments; ++i) {
+        float u = static_cast<float>(i) / segments;
+        glm::vec3 ring(std::cos(u * twoPi), 0.0f, std::sin(u * twoPi));
+        for (int j = 0; j <= sides; ++j) {
+            float v = static_cast<float>(j) / sides;
+            glm::vec3 normal = ring * std::cos(v * twoPi) + glm::vec3(0.0f, std::sin(v * twoPi), 0.0f);
+            // The seams repeat the first row and column so UVs wrap cleanly;
+            // computing them from the same angles keeps the positions identical
+            addVertex(mesh, ring + normal * tube);
+            mesh.nx.push_back(normal.x);
+            mesh.ny.push_back(normal.y);
+            mesh.nz.push_back(normal.z);
+            mesh.u.push_back(u);
+            mesh.v.push_back(v);
+        }
+    }
+    for (int i = 0; i < segments; ++i) {
+        for (int j = 0; j < sides; ++j) {
+            uint32_t a = static_cast<uint32_t>(i * (sides + 1) + j);
+            uint32_t b = a + static_cast<uint32_t>(sides + 1);
+            mesh.indices.insert(mesh.indices.end(), { a, a + 1, b, b, a + 1, b + 1 });
+        }
+    }
+    return mesh;
+}
+
+// Axis-aligned unit cube without normals, so it shades flat
+Mesh makeCube()
+{
+    Mesh mesh;
+    mesh.name = "cube";
+    for (int i = 0; i < 8; ++i)
+        addVertex(mesh, glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f));
+    mesh.indices = {
+        0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5,
+    };
+    return mesh;
+}
+
+std::vector<Bounds> sphereBounds(const std::vector<Sphere>& spheres)
+{
+    std::vector<Bounds> bounds(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        bounds[i].min = spheres[i].center - glm::vec3(spheres[i].radius);
+        bounds[i].max = spheres[i].center + glm::vec3(spheres[i].radius);
+    }
+    return bounds;
+}
+
+// The key a segment starts at and how far time is into it; u is 0 outside the keys
+template <typename Key>
+void findSegment(const std::vector<Key>& keys, float time, size_t& index, float& u)
+{
+    auto after = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key& key) { return t < key.time; });
+    u = 0.0f;
+    if (after == keys.begin()) {
+        index = 0;
+        return;
+    }
+    index = static_cast<size_t>(after - keys.begin()) - 1;
+    if (after == keys.end())
+        return;
+    float span = keys[index + 1].time - keys[index].time;
+    if (span > 0.0f)
+        u = (time - keys[index].time) / span;
+}
+
+// Uniform Catmull-Rom through the keys' positions, the end keys repeated past the ends
+template <typename Key, typename Position>
+glm::vec3 splineAt(const std::vector<Key>& keys, size_t index, float u, Position position)
+{
+    size_t last = keys.size() - 1;
+    glm::vec3 p0 = position(keys[index > 0 ? index - 1 : 0]);
+    glm::vec3 p1 = position(keys[index]);
+    glm::vec3 p2 = position(keys[std::min(index + 1, last)]);
+    glm::vec3 p3 = position(keys[std::min(index + 2, last)]);
+    float u2 = u * u;
+    float u3 = u2 * u;
+    return 0.5f * (2.0f * p1 + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 + (3.0f * (p1 - p2) + p3 - p0) * u3);
+}
+
+}
+
+CameraKey CameraKey::FromCamera(const SceneCamera& camera, float time)
+{
+    CameraKey key;
+    key.time = time;
+    key.position = camera.position;
+    key.orientation = glm::quatLookAt(camera.direction(), glm::normalize(camera.up));
+    key.fov = camera.fov;
+    return key;
+}
+
+SceneCamera SceneAnimation::cameraAt(float time, const SceneCamera& fallback) const
+{
+    if (camera.empty())
+        return fallback;
+    size_t index = 0;
+    float u = 0.0f;
+    findSegment(camera, time, index, u);
+    const CameraKey& from = camera[index];
+    const CameraKey& to = camera[std::min(index + 1, camera.size() - 1)];
+
+    glm::quat orientation = glm::slerp(from.orientation, to.orientation, u);
+    SceneCamera result;
+    result.position = splineAt(camera, index, u, [](const CameraKey& key) { return key.position; });
+    result.target = result.position + orientation * glm::vec3(0.0f, 0.0f, -1.0f);
+    result.up = orientation * glm::vec3(0.0f, 1.0f, 0.0f);
+    result.fov = glm::mix(from.fov, to.fov, u);
+    return result;
+}
+
+glm::vec3 SceneAnimation::SphereCenterAt(const SphereTrack& track, float time)
+{
+    size_t index = 0;
+    float u = 0.0f;
+    findSegment(track.keys, time, index, u);
+    return splineAt(track.keys, index, u, [](const SphereKey& key) { return key.center; });
+}
+
+Scene Scene::TwoSpheres()
+{
+    // The scene default.frag used to hardcode
+    Scene scene;
+    scene.name = "two-spheres";
+    int32_t diffuse = scene.addMaterial(makeMaterial(Material::Lambertian));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, 0.0f, -1.0f), 0.5f, glm::vec3(0.1f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, -100.5f, -1.0f), 100.0f, glm::vec3(0.1f), diffuse));
+    scene.camera.position = glm::vec3(0.0f, 0.0f, 2.0f);
+    scene.camera.target = glm::vec3(0.0f, 0.0f, -1.0f);
+    return scene;
+}
+
+Scene Scene::CornellBox()
+{
+    // Walls are huge spheres as in smallpt; radius 1000 rather than 1e5 keeps
+    // the intersection inside float precision. The front is left open.
+    Scene scene;
+    scene.name = "cornell";
+    const float wall = 1000.0f;
+    int32_t diffuse = scene.addMaterial(makeMaterial(Material::Lambertian));
+    int32_t light = scene.addMaterial(makeMaterial(Material::Emissive, glm::vec3(1.0f), 4.0f));
+    scene.spheres.push_back(makeSphere(glm::vec3(-1.0f - wall, 0.0f, 0.0f), wall, glm::vec3(0.75f, 0.25f, 0.25f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(1.0f + wall, 0.0f, 0.0f), wall, glm::vec3(0.25f, 0.25f, 0.75f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, -1.0f - wall, 0.0f), wall, glm::vec3(0.75f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, 1.0f + wall, 0.0f), wall, glm::vec3(0.75f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, 0.0f, -1.0f - wall), wall, glm::vec3(0.75f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(-0.45f, -0.6f, -0.3f), 0.4f, glm::vec3(0.95f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.45f, -0.6f, 0.3f), 0.4f, glm::vec3(0.95f), diffuse));
+    scene.spheres.push_back(makeSphere(glm::vec3(0.0f, 1.45f, 0.0f), 0.5f, glm::vec3(1.0f), light));
+    scene.camera.position = glm::vec3(0.0f, 0.0f, 3.2f);
+    scene.camera.target = glm::vec3(0.0f);
+    scene.camera.fov = 45.0f;
+    return scene;
+}
+
+Scene Scene::CornellMesh(int segments)
+{
+    Scene scene = CornellBox();
+    scene.name = "cornell-mesh";
+    // Keep the walls and the light, swap the two spheres for a brushed metal
+    // torus and a glass block, so every material type is on screen
+    scene.spheres.erase(scene.spheres.begin() + 5, scene.spheres.begin() + 7);
+
+    glm::mat4 torus = glm::translate(glm::mat4(1.0f), glm::vec3(-0.4f, -0.55f, -0.3f));
+    torus = glm::rotate(torus, glm::radians(35.0f), glm::vec3(1.0f, 0.0f, 0.2f));
+    torus = glm::scale(torus, glm::vec3(0.38f));
+    scene.addMesh(makeTorus(0.35f, segments), makeMaterial(Material::Metal, glm::vec3(0.95f, 0.75f, 0.45f), 0.0f, 0.3f), torus);
+
+    glm::mat4 cube = glm::translate(glm::mat4(1.0f), glm::vec3(0.45f, -0.65f, 0.3f));
+    cube = glm::rotate(cube, glm::radians(25.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    cube = glm::scale(cube, glm::vec3(0.7f));
+    scene.addMesh(makeCube(), makeMaterial(Material::Dielectric, glm::vec3(0.95f, 0.97f, 1.0f), 0.0f, 0.0f, 1.5f), cube);
+    return scene;
+}
+
+Scene Scene::RandomSpheres(size_t count, uint32_t seed)
+{
+    // The volume grows with the count so the density, and the per-ray work
+    // the hierarchy should keep roughly logarithmic, stays comparable
+    Scene scene;
+    scene.name = "random-" + std::to_string(count);
+    float extent = 0.6f * std::cbrt(static_cast<float>(count));
+    uint32_t state = seed;
+    int32_t diffuse = scene.addMaterial(makeMaterial(Material::Lambertian));
+    scene.spheres.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 center(randomFloat(state), randomFloat(state), randomFloat(state));
+        float radius = 0.05f + 0.15f * randomFloat(state);
+        glm::vec3 albedo(randomFloat(state), randomFloat(state), randomFloat(state));
+        scene.spheres.push_back(makeSphere((center * 2.0f - 1.0f) * extent, radius, albedo, diffuse));
+    }
+    scene.camera.position = glm::vec3(0.0f, 0.0f, extent * 2.2f);
+    scene.camera.target = glm::vec3(0.0f);
+    return scene;
+}
+
+bool Scene::Builtin(const std::string& name, Scene& scene)
+{
+    if (name == "two-spheres")
+        scene = TwoSpheres();
+    else if (name == "cornell")
+        scene = CornellBox();
+    else if (name == "cornell-mesh")
+        scene = CornellMesh();
+    else if (name == "random-10k")
+        scene = RandomSpheres(10000);
+    else if (name == "random-1m")
+        scene = RandomSpheres(1000000);
+    else
+        return false;
+
+    scene.name = name;
+    return true;
+}
+
+std::vector<std::string> Scene::BuiltinNames()
+{
+    return { "two-spheres", "cornell", "cornell-mesh", "random-10k", "random-1m" };
+}
+
+int32_t Scene::addMaterial(const Material& material)
+{
+    // Tables stay small, a few entries per scene
+    auto found = std::find(materials.begin(), materials.end(), material);
+    if (found != materials.end())
+        return static_cast<int32_t>(found - materials.begin());
+    materials.push_back(material);
+    return static_cast<int32_t>(materials.size() - 1);
+}
+
+void Scene::addMesh(const Mesh& mesh, const Material& material, const glm::mat4& transform)
+{
+    int32_t materialIndex = addMaterial(material);
+
+    // Transform every vertex once rather than every corner
+    std::vector<glm::vec3> positions(mesh.vertexCount());
+    for (uint32_t i = 0; i < positions.size(); ++i)
+        positions[i] = glm::vec3(transform * glm::vec4(mesh.position(i), 1.0f));
+    std::vector<uint32_t> normals;
+    if (mesh.hasNormals()) {
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        normals.resize(mesh.vertexCount());
+        for (uint32_t i = 0; i < normals.size(); ++i)
+            normals[i] = Packing::EncodeOctahedral(normalMatrix * mesh.normal(i));
+    }
+
+    triangles.reserve(triangles.size() + mesh.triangleCount());
+    shading.reserve(shading.size() + mesh.triangleCount());
+    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+        const uint32_t* corner = &mesh.indices[t * 3];
+        Triangle triangle = {};
+        triangle.v0 = positions[corner[0]];
+        triangle.v1 = positions[corner[1]];
+        triangle.v2 = positions[corner[2]];
+        triangle.material = materialIndex;
+        triangles.push_back(triangle);
+
+        TriangleShading record = {};
+        for (int k = 0; k < 3; ++k) {
+            if (mesh.hasNormals())
+                record.normals[k] = normals[corner[k]];
+            if (mesh.hasUVs())
+                record.uvs[k] = Packing::EncodeHalf2(glm::vec2(mesh.u[corner[k]], mesh.v[corner[k]]));
+        }
+        record.flags = (mesh.hasNormals() ? TriangleShading::HasNormals : 0u) | (mesh.hasUVs() ? TriangleShading::HasUVs : 0u);
+        shading.push_back(record);
+    }
+}
+
+void Scene::buildBVH()
+{
+    // Group the table by type so materials of one kind sit together; the
+    // stable sort keeps their relative order, and with it equal scenes equal
+    std::vector<int32_t> byType(materials.size());
+    for (size_t i = 0; i < byType.size(); ++i)
+        byType[i] = static_cast<int32_t>(i);
+    std::stable_sort(byType.begin(), byType.end(), [&](int32_t a, int32_t b) { return materials[a].type < materials[b].type; });
+    std::vector<int32_t> remap(materials.size());
+    std::vector<Material> sorted(materials.size());
+    for (size_t i = 0; i < byType.size(); ++i) {
+        remap[byType[i]] = static_cast<int32_t>(i);
+        sorted[i] = materials[byType[i]];
+    }
+    materials.swap(sorted);
+    for (Sphere& sphere : spheres)
+        sphere.material = remap[sphere.material];
+    for (Triangle& triangle : triangles)
+        triangle.material = remap[triangle.material];
+
+    bvh.Build(sphereBounds(spheres));
+
+    std::vector<Sphere> ordered(spheres.size());
+    std::vector<uint32_t> position(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        ordered[i] = spheres[bvh.order[i]];
+        position[bvh.order[i]] = static_cast<uint32_t>(i);
+    }
+    spheres.swap(ordered);
+    // Tracks follow their sphere to its new place
+    for (SphereTrack& track : animation.spheres)
+        track.sphere = position[track.sphere];
+
+    std::vector<Bounds> triangleBounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        triangleBounds[i].grow(triangles[i].v0);
+        triangleBounds[i].grow(triangles[i].v1);
+        triangleBounds[i].grow(triangles[i].v2);
+    }
+    triangleBvh.Build(triangleBounds);
+
+    std::vector<Triangle> orderedTriangles(triangles.size());
+    std::vector<TriangleShading> orderedShading(shading.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        orderedTriangles[i] = triangles[triangleBvh.order[i]];
+        orderedShading[i] = shading[triangleBvh.order[i]];
+    }
+    triangles.swap(orderedTriangles);
+    shading.swap(orderedShading);
+}
+
+uint32_t SceneGeometry::materialTypes() const
+{
+    uint32_t types = 0;
+    for (size_t i = 0; i < materialCount; ++i)
+        types |= 1u << materials[i].type;
+    return types;
+}
+
+SceneGeometry Scene::geometry() const
+{
+    SceneGeometry result;
+    result.spheres = spheres.data();
+    result.sphereCount = spheres.size();
+    result.nodes = bvh.nodes.data();
+    result.nodeCount = bvh.nodes.size();
+    result.bvhDepth = bvh.depth;
+    result.materials = materials.data();
+    result.materialCount = materials.size();
+    result.triangles = triangles.data();
+    result.shading = shading.data();
+    result.triangleCount = triangles.size();
+    result.triangleNodes = triangleBvh.nodes.data();
+    result.triangleNodeCount = triangleBvh.nodes.size();
+    result.triangleBvhDepth = triangleBvh.depth;
+    result.texels = textures.texels.data();
+    result.textureSize = textures.size;
+    result.textureLayers = textures.layers;
+    return result;
+}
+
+void Scene::pose(float time)
+{
+    if (animation.spheres.empty())
+        return;
+    for (const SphereTrack& track : animation.spheres) {
+        if (!track.keys.empty())
+            spheres[track.sphere].center = SceneAnimation::SphereCenterAt(track, time);
+    }
+    bvh.Refit(sphereBounds(spheres));
+}
+
+SceneCamera Scene::orbit(float t, float degrees) const
+{
+    SceneCamera result = camera;
+    glm::vec3 offset = camera.position - camera.target;
+    result.position = camera.target + glm::rotate(offset, glm::radians(degrees * t), glm::normalize(camera.up));
+    return result;
+}
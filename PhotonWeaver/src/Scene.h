@@ -0,0 +1,201 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "pch.h"
+#include "BVH.h"
+#include "Mesh.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// 32 bytes, uploaded as two RGBA32F texels: (center, radius), (albedo,
+// material) with the material index stored as float bits. Spheres keep an
+// albedo of their own, so any number of differently coloured spheres share one
+// material; everything else (type, emission, roughness, ior) comes from it.
+struct Sphere {
+	glm::vec3 center;
+	float radius;
+	glm::vec3 albedo;
+	int32_t material;
+};
+
+// 32 bytes, two RGBA32F texels: (albedo, type), (emission, roughness, ior,
+// texture) with the type and texture stored as int bits. Spheres and triangles refer to these by
+// index; buildBVH() sorts the table by type. Triangles take their albedo from
+// here, spheres only the rest.
+struct Material {
+	// Also the bit each type sets in SceneGeometry::materialTypes()
+	enum Type : int32_t { Lambertian = 0, Metal = 1, Dielectric = 2, Emissive = 3, TypeCount = 4 };
+
+	glm::vec3 albedo = glm::vec3(0.75f);
+	Type type = Lambertian;
+	// Emissive: radiance is albedo * emission
+	float emission = 0.0f;
+	// Metal: GGX roughness, squared into the distribution's alpha
+	float roughness = 0.0f;
+	// Dielectric: index of refraction against vacuum
+	float ior = 1.5f;
+	// Layer of the scene's TextureArray multiplying albedo at the hit's UV, or -1
+	int32_t texture = -1;
+
+	bool operator==(const Material& other) const
+	{
+		return albedo == other.albedo && type == other.type && emission == other.emission
+			&& roughness == other.roughness && ior == other.ior && texture == other.texture;
+	}
+};
+
+// 48 bytes, three RGBA32F texels: (v0, material), (v1, -), (v2, -) with the
+// material index stored as float bits; this is all the intersection loop
+// reads. Vertices are kept as they are rather than as edges, so triangles
+// sharing an edge see bit-identical endpoints and the watertight test leaves
+// no cracks between them.
+struct Triangle {
+	glm::vec3 v0;
+	int32_t material;
+	glm::vec3 v1;
+	float unused1;
+	glm::vec3 v2;
+	float unused2;
+};
+
+// 32 bytes, two RGBA32UI texels, read only for the triangle that was hit:
+// (three octahedral corner normals, flags), (three half-float corner UVs, -)
+struct TriangleShading {
+	enum Flags : uint32_t { HasNormals = 1, HasUVs = 2 };
+
+	uint32_t normals[3];
+	uint32_t flags;
+	uint32_t uvs[3];
+	uint32_t unused;
+};
+
+struct SceneCamera {
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, 2.0f);
+	glm::vec3 target = glm::vec3(0.0f, 0.0f, -1.0f);
+	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+	float fov = 60.0f;
+
+	glm::vec3 direction() const { return glm::normalize(target - position); }
+};
+
+// Camera pose at a point in time. Orientation is kept as a quaternion so
+// poses in between are slerped rather than lerped, which keeps the camera
+// turning at an even rate and never lets the view direction collapse.
+struct CameraKey {
+	float time = 0.0f;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	float fov = 60.0f;
+
+	static CameraKey FromCamera(const SceneCamera& camera, float time);
+};
+
+struct SphereKey {
+	float time = 0.0f;
+	glm::vec3 center = glm::vec3(0.0f);
+};
+
+// Keyed centers of one sphere, by its index in Scene::spheres
+struct SphereTrack {
+	uint32_t sphere = 0;
+	std::vector<SphereKey> keys;
+};
+
+// Keyframes in seconds, each list sorted by time. Positions follow a
+// Catmull-Rom spline through the keys, orientations are slerped and fov is
+// lerped; before the first and after the last key the end pose holds.
+struct SceneAnimation {
+	float duration = 0.0f;
+	float fps = 24.0f;
+	std::vector<CameraKey> camera;
+	std::vector<SphereTrack> spheres;
+
+	bool empty() const { return camera.empty() && spheres.empty(); }
+	int frameCount() const { return std::max(1, static_cast<int>(std::round(duration * fps))); }
+	float frameTime(int frame) const { return frame / fps; }
+
+	// Interpolated camera, or fallback when there are no camera keys
+	SceneCamera cameraAt(float time, const SceneCamera& fallback) const;
+	static glm::vec3 SphereCenterAt(const SphereTrack& track, float time);
+};
+
+// Non-owning view of what the tracers read: either a Scene's own arrays or
+// a compiled scene mapped from disk (see CompiledScene)
+struct SceneGeometry {
+	const Sphere* spheres = nullptr;
+	size_t sphereCount = 0;
+	const BVHNode* nodes = nullptr;
+	size_t nodeCount = 0;
+	int bvhDepth = 0;
+
+	const Material* materials = nullptr;
+	size_t materialCount = 0;
+	// triangles and shading run in parallel, in the order of the triangle BVH's leaves
+	const Triangle* triangles = nullptr;
+	const TriangleShading* shading = nullptr;
+	size_t triangleCount = 0;
+	const BVHNode* triangleNodes = nullptr;
+	size_t triangleNodeCount = 0;
+	int triangleBvhDepth = 0;
+
+	// textureLayers square layers of textureSize texels, see TextureArray
+	const uint32_t* texels = nullptr;
+	int textureSize = 0;
+	int textureLayers = 0;
+
+	// Bit (1 << type) for every Material::Type in the table
+	uint32_t materialTypes() const;
+};
+
+class Scene
+{
+public:
+	std::string name;
+	std::vector<Sphere> spheres;
+	SceneCamera camera;
+	BVH bvh;
+
+	// Shared by spheres and triangles
+	std::vector<Material> materials;
+	// Triangle meshes have their own hierarchy, traversed after the spheres'
+	std::vector<Triangle> triangles;
+	std::vector<TriangleShading> shading;
+	BVH triangleBvh;
+	// Layers named by Material::texture
+	TextureArray textures;
+	SceneAnimation animation;
+
+	// Canned scenes shared by the viewer and the benchmark
+	static Scene TwoSpheres();
+	static Scene CornellBox();
+	static Scene RandomSpheres(size_t count, uint32_t seed = 1);
+	// The Cornell box with its spheres replaced by a smooth torus mesh
+	static Scene CornellMesh(int segments = 192);
+	// "two-spheres", "cornell", "cornell-mesh", "random-10k", "random-1m"; false for unknown names
+	static bool Builtin(const std::string& name, Scene& scene);
+	static std::vector<std::string> BuiltinNames();
+
+	// Index of an equal material already in the table, else of the newly appended one
+	int32_t addMaterial(const Material& material);
+	// Appends the mesh's triangles, transformed, all with the given material
+	void addMesh(const Mesh& mesh, const Material& material, const glm::mat4& transform = glm::mat4(1.0f));
+
+	// Sorts the materials by type, rebuilds both hierarchies and reorders the
+	// primitives to match their leaves
+	void buildBVH();
+	double bvhBuildMs() const { return bvh.buildMs + triangleBvh.buildMs; }
+
+	// Moves the animated spheres to where they are at time and refits the
+	// sphere BVH around them; the hierarchy must have been built
+	void pose(float time);
+
+	SceneGeometry geometry() const;
+
+	// Fixed camera path: orbits the target by up to 'degrees' as t goes 0 to 1
+	SceneCamera orbit(float t, float degrees = 30.0f) const;
+};
+
+#endif // SCENE_H
@@ -0,0 +1,429 @@
+#include "SceneFile.h"
+#include "ImageIO.h"
+#include "MeshLoader.h"
+#include "Packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+
+bool readVec3(const Json& value, glm::vec3& result)
+{
+    if (!value.isArray() || value.size() != 3)
+        return false;
+    for (size_t i = 0; i < 3; ++i) {
+        if (!value[i].isNumber())
+            return false;
+        result[static_cast<int>(i)] = static_cast<float>(value[i].asNumber());
+    }
+    return true;
+}
+
+// Optional vec3 member; false only when present and malformed
+bool optionalVec3(const Json& object, const std::string& key, glm::vec3& result, const std::string& where, std::string& error)
+{
+    if (!object.has(key))
+        return true;
+    if (readVec3(object[key], result))
+        return true;
+    error = where + ": " + key + " must be an array of three numbers";
+    return false;
+}
+
+bool optionalNumber(const Json& object, const std::string& key, float& result, const std::string& where, std::string& error)
+{
+    if (!object.has(key))
+        return true;
+    if (object[key].isNumber()) {
+        result = static_cast<float>(object[key].asNumber());
+        return true;
+    }
+    error = where + ": " + key + " must be a number";
+    return false;
+}
+
+// Without a "type", anything with an emission is a light
+bool readMaterial(const Json& value, const std::map<std::string, int32_t>& textures, Material& material, const std::string& where,
+    std::string& error)
+{
+    if (!value.isObject()) {
+        error = where + ": expected an object";
+        return false;
+    }
+    if (!optionalVec3(value, "albedo", material.albedo, where, error)
+        || !optionalVec3(value, "color", material.albedo, where, error)
+        || !optionalNumber(value, "emission", material.emission, where, error)
+        || !optionalNumber(value, "roughness", material.roughness, where, error)
+        || !optionalNumber(value, "ior", material.ior, where, error))
+        return false;
+
+    if (value.has("texture")) {
+        auto found = textures.find(value["texture"].asString());
+        if (found == textures.end()) {
+            error = where + ": unknown texture \"" + value["texture"].asString() + "\"";
+            return false;
+        }
+        material.texture = found->second;
+    }
+
+    if (!value.has("type")) {
+        if (material.emission > 0.0f)
+            material.type = Material::Emissive;
+        return true;
+    }
+    const std::string type = value["type"].asString();
+    if (type == "lambertian")
+        material.type = Material::Lambertian;
+    else if (type == "metal")
+        material.type = Material::Metal;
+    else if (type == "dielectric")
+        material.type = Material::Dielectric;
+    else if (type == "emissive")
+        material.type = Material::Emissive;
+    else {
+        error = where + ": type must be lambertian, metal, dielectric or emissive";
+        return false;
+    }
+    return true;
+}
+
+// Keys must come in time order; each one's time is required
+bool readKeyTime(const Json& value, float previous, bool first, float& time, const std::string& where, std::string& error)
+{
+    if (!value.isObject()) {
+        error = where + ": expected an object";
+        return false;
+    }
+    if (!value["time"].isNumber()) {
+        error = where + ": missing time";
+        return false;
+    }
+    time = static_cast<float>(value["time"].asNumber());
+    if (!first && time < previous) {
+        error = where + ": keys must be in time order";
+        return false;
+    }
+    return true;
+}
+
+bool readAnimation(const Json& value, size_t sphereCount, size_t lightCount, Scene& scene, std::string& error)
+{
+    SceneAnimation& animation = scene.animation;
+    if (!value.isObject()) {
+        error = "animation: expected an object";
+        return false;
+    }
+    if (!optionalNumber(value, "fps", animation.fps, "animation", error))
+        return false;
+    if (animation.fps <= 0.0f) {
+        error = "animation: fps must be positive";
+        return false;
+    }
+
+    const std::vector<Json>& cameraKeys = value["camera"].items();
+    for (size_t i = 0; i < cameraKeys.size(); ++i) {
+        std::string where = "animation.camera[" + std::to_string(i) + "]";
+        float time = 0.0f;
+        if (!readKeyTime(cameraKeys[i], animation.camera.empty() ? 0.0f : animation.camera.back().time, i == 0, time, where, error))
+            return false;
+        // Unset values carry over from the key before, the first key's from the scene camera
+        SceneCamera camera = animation.camera.empty() ? scene.camera : animation.cameraAt(animation.camera.back().time, scene.camera);
+        if (!optionalVec3(cameraKeys[i], "position", camera.position, where, error)
+            || !optionalVec3(cameraKeys[i], "target", camera.target, where, error)
+            || !optionalVec3(cameraKeys[i], "up", camera.up, where, error)
+            || !optionalNumber(cameraKeys[i], "fov", camera.fov, where, error))
+            return false;
+        animation.camera.push_back(CameraKey::FromCamera(camera, time));
+    }
+
+    const std::vector<Json>& tracks = value["spheres"].items();
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        std::string where = "animation.spheres[" + std::to_string(i) + "]";
+        const Json& track = tracks[i];
+        SphereTrack result;
+        double index = -1.0;
+        if (track["sphere"].isNumber() && (index = track["sphere"].asNumber()) >= 0.0 && index < sphereCount)
+            result.sphere = static_cast<uint32_t>(index);
+        else if (track["light"].isNumber() && (index = track["light"].asNumber()) >= 0.0 && index < lightCount)
+            result.sphere = static_cast<uint32_t>(sphereCount + index);
+        else {
+            error = where + ": needs the index of a sphere or light";
+            return false;
+        }
+        if (index != std::floor(index)) {
+            error = where + ": index must be a whole number";
+            return false;
+        }
+
+        const std::vector<Json>& keys = track["keys"].items();
+        for (size_t k = 0; k < keys.size(); ++k) {
+            std::string keyWhere = where + ".keys[" + std::to_string(k) + "]";
+            SphereKey key;
+            if (!readKeyTime(keys[k], result.keys.empty() ? 0.0f : result.keys.back().time, k == 0, key.time, keyWhere, error))
+                return false;
+            if (!keys[k].has("center") || !readVec3(keys[k]["center"], key.center)) {
+                error = keyWhere + ": missing center";
+                return false;
+            }
+            result.keys.push_back(key);
+        }
+        if (result.keys.empty()) {
+            error = where + ": no keys";
+            return false;
+        }
+        animation.spheres.push_back(result);
+    }
+
+    // Without a duration the animation runs to its last key
+    float lastKey = 0.0f;
+    if (!animation.camera.empty())
+        lastKey = animation.camera.back().time;
+    for (const SphereTrack& track : animation.spheres)
+        lastKey = std::max(lastKey, track.keys.back().time);
+    animation.duration = lastKey;
+    if (!optionalNumber(value, "duration", animation.duration, "animation", error))
+        return false;
+    if (animation.duration < 0.0f) {
+        error = "animation: duration must not be negative";
+        return false;
+    }
+    return true;
+}
+
+bool readSphere(const Json& value, const std::map<std::string, Material>& materials, const std::map<std::string, int32_t>& textures,
+    bool light, Scene& scene, Sphere& sphere, const std::string& where, std::string& error)
+{
+    if (!value.isObject()) {
+        error = where + ": expected an object";
+        return false;
+    }
+    if (!value.has("center") || !readVec3(value["center"], sphere.center)) {
+        error = where + ": missing center";
+        return false;
+    }
+    if (!value["radius"].isNumber() || value["radius"].asNumber() <= 0.0) {
+        error = where + ": missing radius";
+        return false;
+    }
+    sphere.radius = static_cast<float>(value["radius"].asNumber());
+
+    Material material;
+    if (light) {
+        material.albedo = glm::vec3(1.0f);
+        material.emission = 1.0f;
+    }
+    if (value.has("material")) {
+        auto found = materials.find(value["material"].asString());
+        if (found == materials.end()) {
+            error = where + ": unknown material \"" + value["material"].asString() + "\"";
+            return false;
+        }
+        material = found->second;
+    }
+    // Inline values override the named material
+    if (!readMaterial(value, textures, material, where, error))
+        return false;
+
+    // The sphere keeps the albedo; the shared entry is white so spheres that
+    // differ only in colour share it
+    sphere.albedo = material.albedo;
+    material.albedo = glm::vec3(1.0f);
+    sphere.material = scene.addMaterial(material);
+    return true;
+}
+
+// Scale, then rotate about x, y and z in that order, then translate
+bool readTransform(const Json& value, glm::mat4& transform, const std::string& where, std::string& error)
+{
+    if (value.isNull())
+        return true;
+    if (!value.isObject()) {
+        error = where + ": expected an object";
+        return false;
+    }
+    glm::vec3 translate(0.0f), rotate(0.0f), scale(1.0f);
+    if (value["scale"].isNumber())
+        scale = glm::vec3(static_cast<float>(value["scale"].asNumber()));
+    else if (!optionalVec3(value, "scale", scale, where, error))
+        return false;
+    if (!optionalVec3(value, "translate", translate, where, error) || !optionalVec3(value, "rotate", rotate, where, error))
+        return false;
+
+    transform = glm::translate(glm::mat4(1.0f), translate);
+    transform = glm::rotate(transform, glm::radians(rotate.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    transform = glm::rotate(transform, glm::radians(rotate.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    transform = glm::rotate(transform, glm::radians(rotate.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform = glm::scale(transform, scale);
+    return true;
+}
+
+bool readMesh(const Json& value, const std::map<std::string, Material>& materials, const std::map<std::string, int32_t>& textures,
+    const std::filesystem::path& directory, Scene& scene, std::vector<std::filesystem::path>* dependencies, const std::string& where, std::string& error)
+{
+    if (!value.isObject()) {
+        error = where + ": expected an object";
+        return false;
+    }
+    if (!value["file"].isString()) {
+        error = where + ": missing file";
+        return false;
+    }
+
+    Material material;
+    if (value.has("material")) {
+        auto found = materials.find(value["material"].asString());
+        if (found == materials.end()) {
+            error = where + ": unknown material \"" + value["material"].asString() + "\"";
+            return false;
+        }
+        material = found->second;
+    }
+    glm::mat4 transform(1.0f);
+    if (!readMaterial(value, textures, material, where, error) || !readTransform(value["transform"], transform, where + ".transform", error))
+        return false;
+
+    std::filesystem::path file = directory / value["file"].asString();
+    if (dependencies)
+        dependencies->push_back(file);
+    Mesh mesh;
+    std::string meshError;
+    if (!MeshLoader::Load(file, mesh, meshError)) {
+        error = where + ": " + file.string() + ": " + meshError;
+        return false;
+    }
+    scene.addMesh(mesh, material, transform);
+    return true;
+}
+
+// Adds an image file as a layer of the scene's texture array. PPM holds sRGB
+// values already; EXR holds linear ones, encoded here the same way.
+bool readTexture(const Json& value, const std::filesystem::path& directory, Scene& scene,
+    std::vector<std::filesystem::path>* dependencies, const std::string& where, std::string& error)
+{
+    if (!value.isString()) {
+        error = where + ": expected a file name";
+        return false;
+    }
+    std::filesystem::path file = directory / value.asString();
+    if (dependencies)
+        dependencies->push_back(file);
+    int width = 0, height = 0;
+    std::vector<glm::vec4> pixels;
+    std::string imageError;
+    bool exr = file.extension() == ".exr";
+    bool loaded = exr ? ImageIO::ReadExr(file, width, height, pixels, imageError)
+        : ImageIO::ReadPpm(file, width, height, pixels, imageError);
+    if (!loaded) {
+        error = where + ": " + file.string() + ": " + imageError;
+        return false;
+    }
+    if (exr) {
+        for (glm::vec4& pixel : pixels) {
+            for (int c = 0; c < 3; ++c)
+                pixel[c] = Packing::LinearToSrgb(glm::clamp(pixel[c], 0.0f, 1.0f));
+        }
+    }
+    scene.textures.add(width, height, pixels);
+    return true;
+}
+
+}
+
+bool SceneFile::Parse(const Json& document, Scene& scene, std::string& error, const std::filesystem::path& directory,
+    std::vector<std::filesystem::path>* dependencies)
+{
+    if (!document.isObject()) {
+        error = "expected an object at the top level";
+        return false;
+    }
+    if (!document["spheres"].isArray() && !document["lights"].isArray() && !document["meshes"].isArray()) {
+        error = "no spheres, lights or meshes";
+        return false;
+    }
+
+    Scene result;
+    result.name = document.has("name") ? document["name"].asString() : "scene";
+
+    const Json& camera = document["camera"];
+    if (!camera.isNull()) {
+        if (!camera.isObject()) {
+            error = "camera: expected an object";
+            return false;
+        }
+        if (!optionalVec3(camera, "position", result.camera.position, "camera", error)
+            || !optionalVec3(camera, "target", result.camera.target, "camera", error)
+            || !optionalVec3(camera, "up", result.camera.up, "camera", error)
+            || !optionalNumber(camera, "fov", result.camera.fov, "camera", error))
+            return false;
+    }
+
+    if (document.has("textureSize")) {
+        double size = document["textureSize"].isNumber() ? document["textureSize"].asNumber() : 0.0;
+        int side = static_cast<int>(size);
+        if (side < 1 || side > 8192 || side != size || (side & (side - 1)) != 0) {
+            error = "textureSize must be a power of two up to 8192";
+            return false;
+        }
+        result.textures.size = side;
+    }
+    std::map<std::string, int32_t> textures;
+    for (const auto& member : document["textures"].members()) {
+        textures[member.first] = result.textures.layers;
+        if (!readTexture(member.second, directory, result, dependencies, "textures." + member.first, error))
+            return false;
+    }
+
+    std::map<std::string, Material> materials;
+    for (const auto& member : document["materials"].members()) {
+        Material material;
+        if (!readMaterial(member.second, textures, material, "materials." + member.first, error))
+            return false;
+        materials[member.first] = material;
+    }
+
+    const char* lists[] = { "spheres", "lights" };
+    for (const char* list : lists) {
+        const std::vector<Json>& items = document[list].items();
+        result.spheres.reserve(result.spheres.size() + items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            Sphere sphere;
+            std::string where = std::string(list) + "[" + std::to_string(i) + "]";
+            if (!readSphere(items[i], materials, textures, list == lists[1], result, sphere, where, error))
+                return false;
+            result.spheres.push_back(sphere);
+        }
+    }
+
+    const std::vector<Json>& meshes = document["meshes"].items();
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        if (!readMesh(meshes[i], materials, textures, directory, result, dependencies, "meshes[" + std::to_string(i) + "]", error))
+            return false;
+    }
+
+    if (document.has("animation")
+        && !readAnimation(document["animation"], document["spheres"].items().size(), document["lights"].items().size(), result, error))
+        return false;
+
+    scene = std::move(result);
+    return true;
+}
+
+bool SceneFile::Load(const std::filesystem::path& path, Scene& scene, std::string& error, std::vector<std::filesystem::path>* dependencies)
+{
+    if (dependencies)
+        dependencies->assign(1, path);
+    Json document;
+    if (!Json::load(path, document, error)) {
+        // Open failures already name the file
+        if (error.compare(0, 5, "line ") == 0)
+            error = path.string() + ": " + error;
+        return false;
+    }
+    if (!Parse(document, scene, error, path.parent_path(), dependencies)) {
+        error = path.string() + ": " + error;
+        return false;
+    }
+    return true;
+}
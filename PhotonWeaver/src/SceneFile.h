@@ -0,0 +1,53 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "pch.h"
+#include "Json.h"
+#include "Scene.h"
+
+// Hand-edited JSON scene description:
+//
+// {
+//   "name": "cornell",
+//   "camera": { "position": [0, 0, 3.2], "target": [0, 0, 0], "up": [0, 1, 0], "fov": 45 },
+//   "textures": { "checker": "textures/checker.ppm" },
+//   "materials": { "white": { "albedo": [0.75, 0.75, 0.75] },
+//                  "floor": { "albedo": [1, 1, 1], "texture": "checker" },
+//                  "gold": { "type": "metal", "albedo": [0.95, 0.75, 0.45], "roughness": 0.3 },
+//                  "glass": { "type": "dielectric", "ior": 1.5 } },
+//   "spheres": [ { "center": [0, -0.6, 0], "radius": 0.4, "material": "white" } ],
+//   "lights": [ { "center": [0, 1.45, 0], "radius": 0.5, "color": [1, 1, 1], "emission": 4 } ],
+//   "meshes": [ { "file": "meshes/cube.obj", "material": "white",
+//                 "transform": { "translate": [0, -0.6, 0], "rotate": [0, 30, 0], "scale": 0.5 } } ],
+//   "animation": { "fps": 24, "duration": 4,
+//                  "camera": [ { "time": 0, "position": [0, 0, 3.2] }, { "time": 4, "position": [2, 0, 2.4], "fov": 40 } ],
+//                  "spheres": [ { "sphere": 0, "keys": [ { "time": 0, "center": [0, -0.6, 0] }, { "time": 2, "center": [0, 0.2, 0] } ] } ] }
+// }
+//
+// A material's "type" is lambertian (the default), metal (GGX, "roughness"),
+// dielectric ("ior") or emissive ("emission"); one with an emission and no
+// type is emissive. Spheres and meshes take either a named material or inline
+// material values, which override the named ones. Lights are emissive
+// spheres. A material's "texture" multiplies its albedo; textures are PPM
+// (sRGB) or EXR (linear) files, resampled to one power-of-two size, the
+// first texture's unless "textureSize" sets it. Mesh files (OBJ or PLY, see
+// MeshLoader) and textures are relative to the scene file; the transform
+// scales, rotates about x, y and z in degrees, then translates. At least one of "spheres", "lights" or
+// "meshes" is required. Loading does not build the BVHs.
+//
+// The optional "animation" keys the camera and the centers of spheres
+// ("sphere") or lights ("light"), by index in their list, at times in
+// seconds; see SceneAnimation. A camera key leaves out what does not
+// change, and duration defaults to the last key's time.
+class SceneFile
+{
+public:
+	// Returns false and fills error ("spheres[2]: missing radius") on bad input.
+	// Mesh and texture files are looked up in directory and, when dependencies is given, appended to it.
+	static bool Parse(const Json& document, Scene& scene, std::string& error, const std::filesystem::path& directory = std::filesystem::path(),
+		std::vector<std::filesystem::path>* dependencies = nullptr);
+	// dependencies, when given, receives every file the scene was read from, the scene file first
+	static bool Load(const std::filesystem::path& path, Scene& scene, std::string& error, std::vector<std::filesystem::path>* dependencies = nullptr);
+};
+
+#endif // SCENE_FILE_H
@@ -1,10 +1,65 @@
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "Trace.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <regex>
+
+namespace {
+
+// Places the defines right after the #version line and restores the original
+// line numbering, so compiler messages still point into the file on disk
+std::string injectDefines(const std::string& code, const std::string& defines)
 {
+    if (defines.empty())
+        return code;
+
+    size_t version = code.find("#version");
+    if (version == std::string::npos)
+        return defines + "#line 1\n" + code;
+
+    size_t lineEnd = code.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return code + "\n" + defines;
+
+    int nextLine = 2 + static_cast<int>(std::count(code.begin(), code.begin() + version, '\n'));
+    return code.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + code.substr(lineEnd + 1);
+}
+
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+    TRACE_SCOPE("Shader::Shader");
+    auto startTime = std::chrono::steady_clock::now();
+
     // 1. Retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
     std::string fragmentCode;
+    ReadSources(vertexPath, fragmentPath, defines, vertexCode, fragmentCode);
+
+    // 2. Reuse a linked binary from a previous run when the driver accepts it
+    ShaderCache& cache = ShaderCache::Instance();
+    uint64_t programKey = cache.key(vertexCode, fragmentCode, defines);
+    program = cache.load(programKey);
+    bool cacheHit = static_cast<bool>(program);
+
+    // 3. Otherwise compile and link from source, then remember the result
+    if (!cacheHit) {
+        program = GLProgram(StartBuild(vertexCode, fragmentCode));
+        if (FinishBuild(program.get(), vertexPath, fragmentPath))
+            cache.store(programKey, program.get());
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Shader " << std::filesystem::path(fragmentPath).filename().string() << " ready in " << elapsed
+              << " ms (" << (cacheHit ? "warm, binary cache" : "cold, compiled") << ")" << std::endl;
+}
+
+bool Shader::ReadSources(const char* vertexPath, const char* fragmentPath, const std::string& defines, std::string& vertexCode, std::string& fragmentCode)
+{
     std::ifstream vShaderFile;
     std::ifstream fShaderFile;
     // Ensure ifstream objects can throw exceptions:
@@ -22,79 +77,147 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         vShaderFile.close();
         fShaderFile.close();
         // Convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = injectDefines(vShaderStream.str(), defines);
+        fragmentCode = injectDefines(fShaderStream.str(), defines);
     }
     catch (std::ifstream::failure& e) {
         std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+        return false;
     }
+    return true;
+}
+
+GLuint Shader::StartBuild(const std::string& vertexCode, const std::string& fragmentCode)
+{
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
-    // 2. Compile shaders
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
-
     // Vertex Shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
+    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
-    // Print compile errors if any
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    };
 
     // Fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
+
+    // Shader Program; status is only queried in FinishBuild so that drivers
+    // with KHR_parallel_shader_compile can keep working in the background
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    ShaderCache::Instance().prepare(program);
+    glLinkProgram(program);
+    return program;
+}
+
+bool Shader::FinishBuild(GLuint program, const char* vertexPath, const char* fragmentPath)
+{
+    int success;
+
+    GLuint shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+
     // Print compile errors if any
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    };
-
-    // Shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    // Print linking errors if any
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    for (GLsizei i = 0; i < count; ++i) {
+        GLint type;
+        glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            bool vertex = type == GL_VERTEX_SHADER;
+            std::cerr << (vertex ? "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" : "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n")
+                      << MapLog(InfoLog(shaders[i], false), vertex ? vertexPath : fragmentPath) << std::endl;
+        }
     }
 
+    // Print linking errors if any
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << InfoLog(program, true) << std::endl;
+
     // Delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    for (GLsizei i = 0; i < count; ++i) {
+        glDetachShader(program, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    return success != 0;
+}
+
+bool Shader::HasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::string Shader::InfoLog(GLuint object, bool isProgram)
+{
+    GLint length = 0;
+    if (isProgram)
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    else
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    if (length <= 1)
+        return "";
+
+    std::string log(length, '\0');
+    if (isProgram)
+        glGetProgramInfoLog(object, length, NULL, &log[0]);
+    else
+        glGetShaderInfoLog(object, length, NULL, &log[0]);
+    log.resize(length - 1);
+    return log;
+}
+
+std::string Shader::MapLog(const std::string& log, const char* path)
+{
+    // Drivers prefix messages with the source string index instead of a file:
+    // "0:12(5): error" (Mesa), "0(12) : error" (NVIDIA), "ERROR: 0:12:" (AMD/Intel).
+    // Rewrite that prefix to "file(12)" so IDEs and terminals can jump to it.
+    static const std::regex location(R"(^(ERROR: |WARNING: )?0[:(](\d+)\)?(\(\d+\))?)");
+    std::string file = std::filesystem::path(path).filename().string();
+
+    std::istringstream lines(log);
+    std::string line;
+    std::string mapped;
+    while (std::getline(lines, line)) {
+        mapped += std::regex_replace(line, location, "$1" + file + "($2)", std::regex_constants::format_first_only);
+        mapped += '\n';
+    }
+    return mapped;
 }
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    GLState::UseProgram(program.get());
 }
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(glGetUniformLocation(program.get(), name.c_str()), (int)value);
 }
 void Shader::setInt(const std::string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(glGetUniformLocation(program.get(), name.c_str()), value);
 }
 void Shader::setFloat(const std::string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(glGetUniformLocation(program.get(), name.c_str()), value);
+}
+void Shader::setVec2(const std::string& name, const glm::vec2& value) const {
+    glUniform2fv(glGetUniformLocation(program.get(), name.c_str()), 1, &value[0]);
 }
 void Shader::setVec3(const std::string& name, const glm::vec3& value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(glGetUniformLocation(program.get(), name.c_str()), 1, &value[0]);
 }
 void Shader::setVec4(const std::string& name, const glm::vec4& value) const {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(glGetUniformLocation(program.get(), name.c_str()), 1, &value[0]);
 }
\ No newline at end of file
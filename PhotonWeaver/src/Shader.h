@@ -2,21 +2,34 @@
 #define SHADER_H
 
 #include "pch.h"
+#include "GLObject.h"
 
 class Shader
 {
 public:
-	unsigned int ID;
+	// ShaderReloader swaps a rebuilt program in; the old one is deleted by the assignment
+	GLProgram program;
 
-	Shader(const char* vertexPath, const char* fragmentPath);
+	// defines are inserted after the #version line of both stages, e.g. "#define MAX_BOUNCES 4\n"
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
 
+	GLuint id() const { return program.get(); }
 	void use();
 
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
+	void setVec2(const std::string& name, const glm::vec2& value) const;
 	void setVec3(const std::string& name, const glm::vec3& value) const;
 	void setVec4(const std::string& name, const glm::vec4& value) const;
+
+	// Building blocks shared with ShaderReloader, which runs them on a background context
+	static bool ReadSources(const char* vertexPath, const char* fragmentPath, const std::string& defines, std::string& vertexCode, std::string& fragmentCode);
+	static GLuint StartBuild(const std::string& vertexCode, const std::string& fragmentCode);
+	static bool FinishBuild(GLuint program, const char* vertexPath, const char* fragmentPath);
+	static bool HasExtension(const char* name);
+	static std::string InfoLog(GLuint object, bool isProgram);
+	static std::string MapLog(const std::string& log, const char* path);
 };
 
 #endif
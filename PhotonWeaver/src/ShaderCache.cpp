@@ -0,0 +1,169 @@
+#include "ShaderCache.h"
+#include "Shader.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const uint32_t cacheMagic = 0x43535750; // "PWSC"
+const uint32_t cacheVersion = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+// 64-bit FNV-1a; a separator byte keeps "ab"+"c" and "a"+"bc" apart
+uint64_t hashString(uint64_t hash, const std::string& text)
+{
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+    return hash;
+}
+
+std::string glString(GLenum name)
+{
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+}
+
+ShaderCache& ShaderCache::Instance()
+{
+    static ShaderCache cache;
+    return cache;
+}
+
+ShaderCache::ShaderCache()
+{
+    driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+    directory = std::filesystem::current_path() / "shadercache";
+
+    bool core41 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+    if (!core41 && !Shader::HasExtension("GL_ARB_get_program_binary"))
+        return;
+
+    getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+    programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+    programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+
+    // Some drivers expose the entry points but no binary formats at all
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    enabled = getProgramBinary && programBinary && programParameteri && formats > 0;
+}
+
+void ShaderCache::setDirectory(const std::filesystem::path& newDirectory)
+{
+    directory = newDirectory;
+}
+
+uint64_t ShaderCache::key(const std::string& vertexCode, const std::string& fragmentCode, const std::string& defines) const
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashString(hash, vertexCode);
+    hash = hashString(hash, fragmentCode);
+    hash = hashString(hash, defines);
+    hash = hashString(hash, driver);
+    return hash;
+}
+
+void ShaderCache::prepare(GLuint program) const
+{
+    if (enabled)
+        programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+std::filesystem::path ShaderCache::entryPath(uint64_t programKey) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(programKey));
+    return directory / name;
+}
+
+GLProgram ShaderCache::load(uint64_t programKey) const
+{
+    if (!enabled)
+        return GLProgram();
+
+    std::filesystem::path path = entryPath(programKey);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return GLProgram();
+
+    CacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != cacheMagic || header.version != cacheVersion || header.key != programKey)
+        return GLProgram();
+
+    // A corrupt length must not turn into a huge allocation before the read fails
+    std::error_code sizeError;
+    uintmax_t fileSize = std::filesystem::file_size(path, sizeError);
+    if (sizeError || header.length > fileSize - sizeof(header))
+        return GLProgram();
+
+    std::vector<char> binary(header.length);
+    file.read(binary.data(), binary.size());
+    if (!file)
+        return GLProgram();
+
+    GLProgram program = GLProgram::Create();
+    programBinary(program.get(), header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    // The driver is free to reject a binary it produced earlier, e.g. after an update
+    GLint success = 0;
+    glGetProgramiv(program.get(), GL_LINK_STATUS, &success);
+    if (!success) {
+        program.reset();
+        file.close();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::cerr << "WARNING::SHADER_CACHE::BINARY_REJECTED: " << path.string() << std::endl;
+        return GLProgram();
+    }
+    return program;
+}
+
+void ShaderCache::store(uint64_t programKey, GLuint program) const
+{
+    if (!enabled)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    getProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    // Write to a temporary name first so a crash never leaves a truncated entry behind
+    std::filesystem::path path = entryPath(programKey);
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "WARNING::SHADER_CACHE::WRITE_FAILED: " << temporary.string() << std::endl;
+            return;
+        }
+        CacheHeader header = { cacheMagic, cacheVersion, programKey, format, static_cast<uint32_t>(length) };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+    }
+    std::filesystem::rename(temporary, path, ec);
+}
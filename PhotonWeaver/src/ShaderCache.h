@@ -0,0 +1,61 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include "pch.h"
+#include "GLObject.h"
+
+#include <cstdint>
+
+// The bundled GLAD loader only covers GL 3.3 core, so the program binary
+// entry points (GL 4.1 / ARB_get_program_binary) are resolved by hand.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// Persists linked programs on disk through glGetProgramBinary/glProgramBinary.
+// Entries are keyed by the shader sources, the injected defines and the
+// driver identification strings, so a driver update simply misses the cache.
+class ShaderCache
+{
+public:
+	// Returns the process wide cache; requires a current GL context on first use.
+	static ShaderCache& Instance();
+
+	bool supported() const { return enabled; }
+	void setDirectory(const std::filesystem::path& newDirectory);
+	const std::filesystem::path& getDirectory() const { return directory; }
+
+	uint64_t key(const std::string& vertexCode, const std::string& fragmentCode, const std::string& defines) const;
+
+	// Marks a program so the driver keeps its binary around; call before glLinkProgram.
+	void prepare(GLuint program) const;
+
+	// Creates a program from the cached binary, or returns 0 on a miss or a rejected binary.
+	GLProgram load(uint64_t programKey) const;
+	void store(uint64_t programKey, GLuint program) const;
+
+private:
+	typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+	GetProgramBinaryProc getProgramBinary = nullptr;
+	ProgramBinaryProc programBinary = nullptr;
+	ProgramParameteriProc programParameteri = nullptr;
+
+	bool enabled = false;
+	std::string driver;
+	std::filesystem::path directory;
+
+	ShaderCache();
+
+	std::filesystem::path entryPath(uint64_t programKey) const;
+};
+
+#endif // SHADER_CACHE_H
@@ -0,0 +1,249 @@
+#include "ShaderReloader.h"
+#include "ShaderCache.h"
+#include "Trace.h"
+
+namespace {
+
+// Short label for log lines, e.g. "default.frag [MAX_BOUNCES 3, SHADOW_RAY]"
+std::string describe(const std::string& fragmentPath, const std::string& defines)
+{
+    std::string label = std::filesystem::path(fragmentPath).filename().string();
+    if (defines.empty())
+        return label;
+
+    std::string list;
+    std::istringstream lines(defines);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, 8, "#define ") == 0)
+            line = line.substr(8);
+        list += (list.empty() ? "" : ", ") + line;
+    }
+    return label + " [" + list + "]";
+}
+
+}
+
+ShaderReloader::ShaderReloader(GLFWwindow* mainWindow)
+{
+    // Both the KHR and the ARB flavour share the same enum value
+    parallelCompile = Shader::HasExtension("GL_KHR_parallel_shader_compile") || Shader::HasExtension("GL_ARB_parallel_shader_compile");
+    if (parallelCompile) {
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (!maxShaderCompilerThreads)
+            maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+
+    // Programs and fences are shared between the two contexts
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    compilerWindow = glfwCreateWindow(1, 1, "PhotonWeaver shader compiler", NULL, mainWindow);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (compilerWindow)
+        worker = std::thread(&ShaderReloader::run, this);
+    else
+        std::cerr << "WARNING::SHADER_RELOADER::NO_SHARED_CONTEXT: reloading on the main thread" << std::endl;
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    Delete();
+}
+
+void ShaderReloader::Delete()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    for (Result& result : results)
+        inFlight.push_back(std::move(result));
+    for (Result& result : inFlight) {
+        if (result.fence)
+            glDeleteSync(result.fence);
+        result.program.reset();
+    }
+    results.clear();
+    inFlight.clear();
+    inlineBuilds.clear();
+
+    if (compilerWindow)
+        glfwDestroyWindow(compilerWindow);
+    compilerWindow = nullptr;
+}
+
+void ShaderReloader::watch(ShaderVariants& variants)
+{
+    watched.push_back(&variants);
+
+    std::filesystem::path directory = std::filesystem::path(variants.getFragmentPath()).parent_path();
+    for (const auto& watcher : watchers) {
+        if (watcher->getDirectory() == directory)
+            return;
+    }
+    watchers.push_back(std::make_unique<FileWatcher>(directory));
+}
+
+void ShaderReloader::update()
+{
+    TRACE_SCOPE("ShaderReloader::update");
+
+    for (const auto& watcher : watchers) {
+        for (const std::string& changedFile : watcher->poll())
+            queue(changedFile);
+    }
+
+    // Main thread fallback: only finish builds the driver reports as done
+    for (size_t i = 0; i < inlineBuilds.size(); ) {
+        if (!ready(inlineBuilds[i].second.get())) {
+            ++i;
+            continue;
+        }
+        Result result = build(inlineBuilds[i].first, std::move(inlineBuilds[i].second));
+        swap(result);
+        inlineBuilds.erase(inlineBuilds.begin() + i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.insert(inFlight.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+        results.clear();
+    }
+
+    // Swap in programs whose fence has signalled; a zero timeout never blocks
+    for (size_t i = 0; i < inFlight.size(); ) {
+        Result& result = inFlight[i];
+        if (result.fence) {
+            if (glClientWaitSync(result.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                ++i;
+                continue;
+            }
+            glDeleteSync(result.fence);
+            result.fence = 0;
+        }
+        swap(result);
+        inFlight.erase(inFlight.begin() + i);
+    }
+}
+
+void ShaderReloader::queue(const std::string& changedFile)
+{
+    for (ShaderVariants* variants : watched) {
+        bool affected = std::filesystem::path(variants->getVertexPath()).filename() == changedFile
+            || std::filesystem::path(variants->getFragmentPath()).filename() == changedFile;
+        if (!affected)
+            continue;
+
+        for (const auto& variant : variants->all()) {
+            Job job;
+            job.target = variant.second.get();
+            job.generation = ++generations[job.target];
+            job.vertexPath = variants->getVertexPath();
+            job.fragmentPath = variants->getFragmentPath();
+            job.defines = variant.first;
+
+            std::cout << "Reloading " << describe(job.fragmentPath, job.defines) << std::endl;
+
+            if (compilerWindow) {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(job);
+            }
+            else if (Shader::ReadSources(job.vertexPath.c_str(), job.fragmentPath.c_str(), job.defines, job.vertexCode, job.fragmentCode)) {
+                inlineBuilds.emplace_back(job, GLProgram(Shader::StartBuild(job.vertexCode, job.fragmentCode)));
+            }
+        }
+    }
+    wake.notify_one();
+}
+
+void ShaderReloader::run()
+{
+    TRACE_THREAD_NAME("shader compiler");
+    glfwMakeContextCurrent(compilerWindow);
+    if (maxShaderCompilerThreads)
+        maxShaderCompilerThreads(0xFFFFFFFF);
+
+    for (;;) {
+        std::vector<Job> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                break;
+            batch.assign(jobs.begin(), jobs.end());
+            jobs.clear();
+        }
+
+        TRACE_SCOPE("shader rebuild");
+
+        // Issue every build before waiting on any, so the driver can overlap them
+        std::vector<GLProgram> programs;
+        for (Job& job : batch) {
+            bool read = Shader::ReadSources(job.vertexPath.c_str(), job.fragmentPath.c_str(), job.defines, job.vertexCode, job.fragmentCode);
+            programs.push_back(GLProgram(read ? Shader::StartBuild(job.vertexCode, job.fragmentCode) : 0));
+        }
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            Result result = { batch[i].target, batch[i].generation, GLProgram(), 0, false, describe(batch[i].fragmentPath, batch[i].defines) };
+            if (programs[i]) {
+                while (!ready(programs[i].get()))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                result = build(batch[i], std::move(programs[i]));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
+
+bool ShaderReloader::ready(GLuint program) const
+{
+    GLint done = GL_TRUE;
+    if (parallelCompile)
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+ShaderReloader::Result ShaderReloader::build(const Job& job, GLProgram program) const
+{
+    Result result = { job.target, job.generation, std::move(program), 0, false, describe(job.fragmentPath, job.defines) };
+
+    result.success = Shader::FinishBuild(result.program.get(), job.vertexPath.c_str(), job.fragmentPath.c_str());
+    if (!result.success) {
+        result.program.reset();
+        return result;
+    }
+
+    ShaderCache& cache = ShaderCache::Instance();
+    cache.store(cache.key(job.vertexCode, job.fragmentCode, job.defines), result.program.get());
+
+    // The main context may only use the program once this context's work is visible
+    result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    return result;
+}
+
+void ShaderReloader::swap(Result& result)
+{
+    if (!result.success) {
+        std::cerr << "Reload of " << result.description << " failed, keeping the previous program" << std::endl;
+        return;
+    }
+
+    // A newer edit was queued while this one compiled; its result will follow
+    if (generations[result.target] != result.generation) {
+        result.program.reset();
+        return;
+    }
+
+    result.target->program = std::move(result.program);
+    std::cout << "Reloaded " << result.description << std::endl;
+}
@@ -0,0 +1,92 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include "pch.h"
+
+#include "FileWatcher.h"
+#include "GLObject.h"
+#include "ShaderVariants.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Hot-reloads shader variants when their source files change on disk.
+// Rebuilds run on a hidden window whose context shares objects with the
+// main one, and the finished program is swapped into the Shader only after
+// it linked and its fence signalled, so the render loop never waits on the
+// compiler. A failed build is reported and the previous program stays.
+class ShaderReloader
+{
+public:
+	explicit ShaderReloader(GLFWwindow* mainWindow);
+	~ShaderReloader();
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	// Starts watching the directory holding the variants' sources
+	void watch(ShaderVariants& variants);
+
+	// Call once per frame on the main thread
+	void update();
+
+	// Stops the compiler thread; must run before glfwTerminate
+	void Delete();
+
+private:
+	struct Job {
+		Shader* target;
+		unsigned int generation;
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::string defines;
+		std::string vertexCode;
+		std::string fragmentCode;
+	};
+
+	struct Result {
+		Shader* target;
+		unsigned int generation;
+		GLProgram program;
+		GLsync fence;
+		bool success;
+		std::string description;
+	};
+
+	typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+	GLFWwindow* compilerWindow = nullptr;
+	bool parallelCompile = false;
+	MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+
+	std::vector<ShaderVariants*> watched;
+	std::vector<std::unique_ptr<FileWatcher>> watchers;
+	std::map<Shader*, unsigned int> generations;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	std::vector<Result> results;
+	bool stopping = false;
+
+	// Worker results waiting for their fence, main thread only
+	std::vector<Result> inFlight;
+	// Main thread fallback when no shared context could be created
+	std::vector<std::pair<Job, GLProgram>> inlineBuilds;
+
+	void queue(const std::string& changedFile);
+	void run();
+	bool ready(GLuint program) const;
+	Result build(const Job& job, GLProgram program) const;
+	void swap(Result& result);
+};
+
+#endif // SHADER_RELOADER_H
@@ -0,0 +1,60 @@
+#include "ShaderVariants.h"
+
+ShaderVariantKey& ShaderVariantKey::set(const std::string& flag, bool enabled)
+{
+    if (enabled)
+        flags.insert(flag);
+    else
+        flags.erase(flag);
+    return *this;
+}
+
+ShaderVariantKey& ShaderVariantKey::set(const std::string& constant, int value)
+{
+    constants[constant] = value;
+    return *this;
+}
+
+bool ShaderVariantKey::has(const std::string& flag) const
+{
+    return flags.count(flag) != 0;
+}
+
+int ShaderVariantKey::get(const std::string& constant, int fallback) const
+{
+    auto it = constants.find(constant);
+    return it != constants.end() ? it->second : fallback;
+}
+
+std::string ShaderVariantKey::defines() const
+{
+    // std::set/std::map iterate in order, so equal keys give identical text
+    std::string block;
+    for (const std::string& flag : flags)
+        block += "#define " + flag + "\n";
+    for (const auto& constant : constants)
+        block += "#define " + constant.first + " " + std::to_string(constant.second) + "\n";
+    return block;
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+}
+
+Shader& ShaderVariants::get(const ShaderVariantKey& key)
+{
+    std::string defines = key.defines();
+    auto it = variants.find(defines);
+    if (it != variants.end())
+        return *it->second;
+
+    auto shader = std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), defines);
+    return *variants.emplace(defines, std::move(shader)).first->second;
+}
+
+void ShaderVariants::Delete()
+{
+    // Each Shader deletes its program
+    variants.clear();
+}
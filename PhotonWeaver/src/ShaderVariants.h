@@ -0,0 +1,53 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "pch.h"
+
+#include "Shader.h"
+
+#include <map>
+#include <memory>
+#include <set>
+
+// Compile-time configuration of a shader: feature flags become bare #defines,
+// constants become "#define NAME value" so loops over them can be unrolled.
+class ShaderVariantKey
+{
+public:
+	std::set<std::string> flags;
+	std::map<std::string, int> constants;
+
+	ShaderVariantKey& set(const std::string& flag, bool enabled);
+	ShaderVariantKey& set(const std::string& constant, int value);
+
+	bool has(const std::string& flag) const;
+	int get(const std::string& constant, int fallback) const;
+
+	// Deterministic define block; also serves as the cache key
+	std::string defines() const;
+};
+
+// Lazily compiled permutations of one vertex/fragment pair. Every variant
+// stays alive once built, so switching back to a previous setting is free.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath);
+
+	Shader& get(const ShaderVariantKey& key);
+
+	size_t size() const { return variants.size(); }
+	// Built variants keyed by their define block
+	const std::map<std::string, std::unique_ptr<Shader>>& all() const { return variants; }
+	const std::string& getVertexPath() const { return vertexPath; }
+	const std::string& getFragmentPath() const { return fragmentPath; }
+
+	void Delete();
+
+private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::map<std::string, std::unique_ptr<Shader>> variants;
+};
+
+#endif // SHADER_VARIANTS_H
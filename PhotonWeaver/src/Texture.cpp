@@ -0,0 +1,90 @@
+#include "Texture.h"
+#include "Packing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+uint64_t nextId()
+{
+    static std::atomic<uint64_t> counter(0);
+    return ++counter;
+}
+
+int wrap(int value, int size)
+{
+    value %= size;
+    return value < 0 ? value + size : value;
+}
+
+// Bilinear lookup of a linear image at texel coordinates, repeating at the edges
+glm::vec4 bilinear(const std::vector<glm::vec4>& image, int width, int height, float x, float y)
+{
+    x -= 0.5f;
+    y -= 0.5f;
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    float fx = x - x0;
+    float fy = y - y0;
+    auto at = [&](int tx, int ty) { return image[static_cast<size_t>(wrap(ty, height)) * width + wrap(tx, width)]; };
+    return glm::mix(glm::mix(at(x0, y0), at(x0 + 1, y0), fx), glm::mix(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx), fy);
+}
+
+}
+
+int TextureArray::add(int width, int height, const std::vector<glm::vec4>& pixels, int maxSize)
+{
+    if (size == 0) {
+        size = 1;
+        while (size < std::max(width, height) && size < maxSize)
+            size *= 2;
+    }
+
+    // Filtered in linear space; shrinking averages several bilinear taps per texel so nothing is skipped
+    std::vector<glm::vec4> linear(pixels.size());
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        const glm::vec4& p = pixels[i];
+        linear[i] = glm::vec4(Packing::SrgbToLinear(p.r), Packing::SrgbToLinear(p.g), Packing::SrgbToLinear(p.b), p.a);
+    }
+    int tapsX = std::max(1, (width + size - 1) / size);
+    int tapsY = std::max(1, (height + size - 1) / size);
+    float scaleX = static_cast<float>(width) / size;
+    float scaleY = static_cast<float>(height) / size;
+
+    size_t first = texels.size();
+    texels.resize(first + static_cast<size_t>(size) * size);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            glm::vec4 sum(0.0f);
+            for (int j = 0; j < tapsY; ++j) {
+                for (int i = 0; i < tapsX; ++i) {
+                    float sx = (x + (i + 0.5f) / tapsX) * scaleX;
+                    float sy = (y + (j + 0.5f) / tapsY) * scaleY;
+                    sum += bilinear(linear, width, height, sx, sy);
+                }
+            }
+            texels[first + static_cast<size_t>(y) * size + x] = Packing::EncodeSrgba8(sum / static_cast<float>(tapsX * tapsY));
+        }
+    }
+    id = nextId();
+    return layers++;
+}
+
+void TextureArray::assign(int layerSize, const uint32_t* data, size_t texelCount)
+{
+    size_t layerTexels = static_cast<size_t>(layerSize) * layerSize;
+    size = layerSize;
+    layers = layerTexels ? static_cast<int>(texelCount / layerTexels) : 0;
+    texels.assign(data, data + static_cast<size_t>(layers) * layerTexels);
+    id = nextId();
+}
+
+int TextureArray::levels() const
+{
+    int count = 1;
+    for (int side = size; side > 1; side /= 2)
+        ++count;
+    return count;
+}
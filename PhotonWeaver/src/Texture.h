@@ -0,0 +1,36 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vector>
+
+// Every texture of a scene, resampled to one square power-of-two size and
+// stacked as the layers of an sRGB RGBA8 array. This is the layout of the
+// GL_TEXTURE_2D_ARRAY the renderer uploads, so a material names its texture
+// by layer and nothing is bound per material. Rows run bottom first, so v = 0
+// is the bottom edge as in GL; textures repeat.
+struct TextureArray {
+	// Side of every layer; 0 until the first texture picks it, unless set beforehand
+	int size = 0;
+	int layers = 0;
+	// layers * size * size texels, see Packing::EncodeSrgba8
+	std::vector<uint32_t> texels;
+	// New on every change, so a cache can tell a different array from a copy of the same one
+	uint64_t id = 0;
+
+	// Adds an image (sRGB-encoded RGBA in [0, 1], bottom row first) as a new
+	// layer and returns its index. Without a size yet, the image's larger side
+	// rounded up to a power of two (at most maxSize) becomes it.
+	int add(int width, int height, const std::vector<glm::vec4>& pixels, int maxSize = 1024);
+	// Takes over texels laid out as above, e.g. from a compiled scene
+	void assign(int layerSize, const uint32_t* data, size_t texelCount);
+
+	const uint32_t* layer(int index) const { return texels.data() + static_cast<size_t>(index) * size * size; }
+	size_t bytes() const { return texels.size() * sizeof(uint32_t); }
+	// Mip levels down to 1x1
+	int levels() const;
+};
+
+#endif // TEXTURE_H
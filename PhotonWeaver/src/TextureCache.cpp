@@ -0,0 +1,215 @@
+#include "TextureCache.h"
+#include "Packing.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Spreads the low 16 bits of v to the even bit positions
+uint32_t spreadBits(uint32_t v)
+{
+    v &= 0xffffu;
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+uint32_t morton(uint32_t x, uint32_t y)
+{
+    return spreadBits(x) | spreadBits(y) << 1;
+}
+
+uint64_t tileKey(int layer, int level, int tileX, int tileY)
+{
+    return static_cast<uint64_t>(layer) << 40 | static_cast<uint64_t>(level) << 32 | static_cast<uint64_t>(tileY) << 16 | static_cast<uint64_t>(tileX);
+}
+
+}
+
+void TextureCache::Stats::add(const Stats& other)
+{
+    hits += other.hits;
+    misses += other.misses;
+    evictions += other.evictions;
+    peakBytes = std::max(peakBytes, other.peakBytes);
+}
+
+TextureCache::TextureCache(size_t budgetBytes)
+    : budgetBytes(budgetBytes)
+{
+}
+
+void TextureCache::bind(const TextureArray& textures)
+{
+    array = &textures;
+    if (textures.id != boundId) {
+        clear();
+        boundId = textures.id;
+    }
+}
+
+void TextureCache::clear()
+{
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.recent.clear();
+        shard.resident.clear();
+        shard.bytes = 0;
+    }
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::tile(int layer, int level, int tileX, int tileY)
+{
+    uint64_t key = tileKey(layer, level, tileX, tileY);
+    // Neighbouring tiles land in different shards
+    Shard& shard = shards[(key * 0x9e3779b97f4a7c15ull) >> 60];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.resident.find(key);
+        if (found != shard.resident.end()) {
+            shard.stats.hits++;
+            shard.recent.splice(shard.recent.begin(), shard.recent, found->second.position);
+            return found->second.tile;
+        }
+        shard.stats.misses++;
+    }
+
+    // Made outside the lock; two threads may both make a tile, and the second keeps the first's
+    std::shared_ptr<const Tile> made = makeTile(layer, level, tileX, tileY);
+    size_t tileBytes = made->texels.size() * sizeof(uint32_t);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.resident.find(key);
+    if (found != shard.resident.end())
+        return found->second.tile;
+    size_t shardBudget = budgetBytes / ShardCount;
+    while (!shard.recent.empty() && shard.bytes + tileBytes > shardBudget) {
+        auto victim = shard.resident.find(shard.recent.back());
+        shard.bytes -= victim->second.tile->texels.size() * sizeof(uint32_t);
+        shard.resident.erase(victim);
+        shard.recent.pop_back();
+        shard.stats.evictions++;
+    }
+    shard.recent.push_front(key);
+    shard.resident[key] = Entry{ made, shard.recent.begin() };
+    shard.bytes += tileBytes;
+    shard.stats.peakBytes = std::max(shard.stats.peakBytes, shard.bytes);
+    return made;
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::makeTile(int layer, int level, int tileX, int tileY)
+{
+    TRACE_SCOPE("TextureCache::makeTile");
+    int levelSize = std::max(array->size >> level, 1);
+    auto made = std::make_shared<Tile>();
+    made->side = std::min(TileSize, levelSize);
+    made->texels.resize(static_cast<size_t>(made->side) * made->side);
+    int x0 = tileX * made->side;
+    int y0 = tileY * made->side;
+
+    if (level == 0) {
+        const uint32_t* source = array->layer(layer);
+        for (int y = 0; y < made->side; ++y) {
+            for (int x = 0; x < made->side; ++x)
+                made->texels[morton(x, y)] = source[static_cast<size_t>(y0 + y) * array->size + x0 + x];
+        }
+        return made;
+    }
+
+    // Each texel averages the 2x2 below it; those come from one tile of the finer level
+    // when this tile is the whole level, else from a 2x2 block of them
+    int fineSide = std::min(TileSize, levelSize * 2);
+    std::shared_ptr<const Tile> fine;
+    int fineX = -1, fineY = -1;
+    for (int y = 0; y < made->side; ++y) {
+        for (int x = 0; x < made->side; ++x) {
+            glm::vec4 sum(0.0f);
+            for (int j = 0; j < 2; ++j) {
+                for (int i = 0; i < 2; ++i) {
+                    int fx = (x0 + x) * 2 + i;
+                    int fy = (y0 + y) * 2 + j;
+                    if (fx / fineSide != fineX || fy / fineSide != fineY) {
+                        fineX = fx / fineSide;
+                        fineY = fy / fineSide;
+                        fine = tile(layer, level - 1, fineX, fineY);
+                    }
+                    sum += Packing::DecodeSrgba8(fine->texels[morton(fx % fineSide, fy % fineSide)]);
+                }
+            }
+            made->texels[morton(x, y)] = Packing::EncodeSrgba8(sum * 0.25f);
+        }
+    }
+    return made;
+}
+
+glm::vec4 TextureCache::bilinear(int layer, int level, glm::vec2 uv)
+{
+    int levelSize = std::max(array->size >> level, 1);
+    int side = std::min(TileSize, levelSize);
+    float x = uv.x * levelSize - 0.5f;
+    float y = uv.y * levelSize - 0.5f;
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    float fx = x - x0;
+    float fy = y - y0;
+
+    // The four taps usually share a tile; fetch it once
+    std::shared_ptr<const Tile> current;
+    int currentX = -1, currentY = -1;
+    glm::vec4 taps[4];
+    for (int k = 0; k < 4; ++k) {
+        int tx = (x0 + (k & 1)) & (levelSize - 1);
+        int ty = (y0 + (k >> 1)) & (levelSize - 1);
+        if (tx / side != currentX || ty / side != currentY) {
+            currentX = tx / side;
+            currentY = ty / side;
+            current = tile(layer, level, currentX, currentY);
+        }
+        taps[k] = Packing::DecodeSrgba8(current->texels[morton(tx % side, ty % side)]);
+    }
+    return glm::mix(glm::mix(taps[0], taps[1], fx), glm::mix(taps[2], taps[3], fx), fy);
+}
+
+glm::vec4 TextureCache::sample(int layer, glm::vec2 uv, float lod)
+{
+    if (!array || layer < 0 || layer >= array->layers)
+        return glm::vec4(1.0f);
+    uv -= glm::floor(uv);
+    float maxLevel = static_cast<float>(array->levels() - 1);
+    lod = glm::clamp(lod, 0.0f, maxLevel);
+    int level = static_cast<int>(lod);
+    float blend = lod - level;
+    glm::vec4 fine = bilinear(layer, level, uv);
+    if (blend == 0.0f)
+        return fine;
+    return glm::mix(fine, bilinear(layer, level + 1, uv), blend);
+}
+
+size_t TextureCache::residentBytes() const
+{
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+TextureCache::Stats TextureCache::takeStats()
+{
+    Stats total;
+    size_t peaks = 0;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.add(shard.stats);
+        peaks += shard.stats.peakBytes;
+        shard.stats = Stats();
+        shard.stats.peakBytes = shard.bytes;
+    }
+    // Shards peak at different times; the sum of their peaks bounds the whole
+    total.peakBytes = peaks;
+    return total;
+}
@@ -0,0 +1,95 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "pch.h"
+#include "Texture.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// CPU counterpart of the renderer's mipmapped texture array. Every mip level
+// is cut into 32x32 tiles of sRGB RGBA8 texels, 4 KB each, with the texels
+// of a tile in Morton order. A bilinear footprint, and the lookups of nearby
+// rays, then touch one or two cache lines rather than two rows apart.
+//
+// Tiles are made on demand. Level 0 tiles are copied from the array, and each
+// coarser tile is box filtered in linear space from the level below, as
+// glGenerateMipmap does. Tiles are kept least recently used first under a
+// fixed memory budget, so only the levels that ray cones actually select
+// take up memory. The tile table is split into shards with a lock each, and
+// tiles are handed out as shared pointers, so lookups from the tracer's
+// threads rarely contend.
+class TextureCache
+{
+public:
+	static const int TileSize = 32;
+
+	struct Stats {
+		// Tile lookups that found the tile resident, and tiles that had to be made
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		size_t peakBytes = 0;
+
+		double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 1.0; }
+		void add(const Stats& other);
+	};
+
+	explicit TextureCache(size_t budgetBytes);
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Samples textures from now on. Tiles made for an array with the same id are kept;
+	// the array must outlive its use.
+	void bind(const TextureArray& textures);
+
+	// Trilinear lookup of layer at uv, repeating, between the two mip levels
+	// around lod (log2 of level-0 texels per footprint). Returns linear RGBA.
+	glm::vec4 sample(int layer, glm::vec2 uv, float lod);
+
+	// Side of level 0 of the bound array
+	int size() const { return array ? array->size : 0; }
+	size_t budget() const { return budgetBytes; }
+	size_t residentBytes() const;
+	// Counters since construction or the last call; resident tiles stay
+	Stats takeStats();
+
+private:
+	struct Tile {
+		int side;
+		// side * side texels in Morton order
+		std::vector<uint32_t> texels;
+	};
+
+	struct Entry {
+		std::shared_ptr<const Tile> tile;
+		std::list<uint64_t>::iterator position;
+	};
+
+	struct Shard {
+		mutable std::mutex mutex;
+		// Most recently used first
+		std::list<uint64_t> recent;
+		std::unordered_map<uint64_t, Entry> resident;
+		size_t bytes = 0;
+		Stats stats;
+	};
+
+	static const int ShardCount = 16;
+
+	const TextureArray* array = nullptr;
+	uint64_t boundId = 0;
+	size_t budgetBytes;
+	Shard shards[ShardCount];
+
+	// Returns a tile, making it when it is not resident
+	std::shared_ptr<const Tile> tile(int layer, int level, int tileX, int tileY);
+	std::shared_ptr<const Tile> makeTile(int layer, int level, int tileX, int tileY);
+	glm::vec4 bilinear(int layer, int level, glm::vec2 uv);
+	void clear();
+};
+
+#endif // TEXTURE_CACHE_H
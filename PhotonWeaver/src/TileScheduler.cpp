@@ -0,0 +1,120 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+std::vector<TileRect> TileScheduler::Split(int width, int height, int size)
+{
+    // Without a context (the CPU tiles of DistributedRender) only size limits them
+    GLint maxViewport[2] = { 0, 0 };
+    if (glGetIntegerv)
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    int side = std::max(1, size);
+    if (maxViewport[0] > 0 && maxViewport[1] > 0)
+        side = std::min({ side, static_cast<int>(maxViewport[0]), static_cast<int>(maxViewport[1]) });
+
+    std::vector<TileRect> result;
+    int rows = (height + side - 1) / side;
+    int columns = (width + side - 1) / side;
+    result.reserve(static_cast<size_t>(rows) * columns);
+    // Image rows count from the bottom; the top row of tiles goes first
+    for (int row = rows - 1; row >= 0; --row) {
+        for (int column = 0; column < columns; ++column) {
+            TileRect tile;
+            tile.x = column * side;
+            tile.y = row * side;
+            tile.width = std::min(side, width - tile.x);
+            tile.height = std::min(side, height - tile.y);
+            result.push_back(tile);
+        }
+    }
+    return result;
+}
+
+void TileScheduler::reset(int width, int height)
+{
+    tiles = Split(width, height, tileSize);
+    cursor = 0;
+    totalPixels = static_cast<size_t>(width) * height;
+    issuedPixels = 0;
+}
+
+float TileScheduler::progress() const
+{
+    return totalPixels ? static_cast<float>(issuedPixels) / static_cast<float>(totalPixels) : 1.0f;
+}
+
+std::vector<TileRect> TileScheduler::beginBatch()
+{
+    if (batchOpen)
+        endBatch();
+    collect();
+    std::vector<TileRect> batch;
+    if (done())
+        return batch;
+
+    // Until something has been timed, one tile a frame is the safe guess
+    double spent = 0.0;
+    size_t pixels = 0;
+    do {
+        const TileRect& tile = tiles[cursor++];
+        batch.push_back(tile);
+        pixels += tile.pixels();
+        spent += costPerPixel * tile.pixels();
+    } while (!done() && costPerPixel > 0.0 && spent + costPerPixel * tiles[cursor].pixels() <= budgetMs);
+    issuedPixels += pixels;
+
+    if (freeQueries.empty()) {
+        GLuint queries[8];
+        glGenQueries(8, queries);
+        freeQueries.insert(freeQueries.end(), queries, queries + 8);
+    }
+    Batch timed{ freeQueries.back(), pixels };
+    freeQueries.pop_back();
+    glBeginQuery(GL_TIME_ELAPSED, timed.query);
+    pending.push_back(timed);
+    batchOpen = true;
+    return batch;
+}
+
+void TileScheduler::endBatch()
+{
+    if (!batchOpen)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    batchOpen = false;
+    // Submits the batch now, so it runs while the CPU prepares the next frame
+    glFlush();
+}
+
+void TileScheduler::collect()
+{
+    // Queries finish in order; stop at the first one still running
+    while (!pending.empty()) {
+        GLint available = 0;
+        glGetQueryObjectiv(pending.front().query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(pending.front().query, GL_QUERY_RESULT, &nanoseconds);
+        if (pending.front().pixels > 0) {
+            double measured = nanoseconds * 1e-6 / pending.front().pixels;
+            // Jumps up to a heavier view at once and eases back down, so a
+            // change of view can overshoot the budget for a frame at most
+            costPerPixel = measured > costPerPixel ? measured : costPerPixel + 0.25 * (measured - costPerPixel);
+        }
+        freeQueries.push_back(pending.front().query);
+        pending.pop_front();
+    }
+}
+
+void TileScheduler::Delete()
+{
+    if (batchOpen)
+        endBatch();
+    for (const Batch& batch : pending)
+        freeQueries.push_back(batch.query);
+    pending.clear();
+    if (!freeQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+    freeQueries.clear();
+}
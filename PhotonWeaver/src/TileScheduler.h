@@ -0,0 +1,73 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include "pch.h"
+#include "Renderer.h"
+
+#include <deque>
+#include <vector>
+
+// Hands out a frame's tiles a few at a time, so no single submission keeps
+// the GPU busy for long. Drivers reset a GPU that sits in one command for a
+// couple of seconds, and a viewer that waits on a long frame stops
+// responding. How many tiles go out per frame follows a GPU time budget.
+// The cost per pixel comes from GL_TIME_ELAPSED queries around each batch,
+// read back only once they are available, so the CPU never waits on them.
+//
+// Tiles run top row first, left to right, so rows of tiles complete in the
+// order a streamed image file (see ExrWriter) is written in.
+class TileScheduler
+{
+public:
+	// Side of a tile in pixels; Split() clamps it to GL_MAX_VIEWPORT_DIMS
+	int tileSize = 256;
+	// GPU time a frame's batch should take
+	double budgetMs = 8.0;
+
+	TileScheduler() = default;
+	TileScheduler(const TileScheduler&) = delete;
+	TileScheduler& operator=(const TileScheduler&) = delete;
+
+	// Starts a new pass over a width x height image; the cost estimate carries over
+	void reset(int width, int height);
+	bool done() const { return cursor == tiles.size(); }
+	// Fraction of the image's pixels handed out so far
+	float progress() const;
+
+	// This frame's tiles: as many as the budget allows by the current cost
+	// estimate, and always at least one while any remain. Brackets them with
+	// a timer query until endBatch().
+	std::vector<TileRect> beginBatch();
+	void endBatch();
+
+	// Estimated GPU milliseconds per pixel; 0 until a batch has been timed
+	double msPerPixel() const { return costPerPixel; }
+
+	void Delete();
+
+	// The tiles of a width x height image in the order above, at most size
+	// pixels on a side and never more than the viewport can hold, when a
+	// context is current
+	static std::vector<TileRect> Split(int width, int height, int size);
+
+private:
+	struct Batch {
+		GLuint query;
+		size_t pixels;
+	};
+
+	std::vector<TileRect> tiles;
+	size_t cursor = 0;
+	size_t totalPixels = 0;
+	size_t issuedPixels = 0;
+	double costPerPixel = 0.0;
+
+	std::deque<Batch> pending;
+	std::vector<GLuint> freeQueries;
+	bool batchOpen = false;
+
+	// Folds finished batches into the estimate without waiting for the rest
+	void collect();
+};
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,213 @@
+#include "Trace.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TRACE_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_HAS_TSC 1
+#endif
+
+std::atomic<bool> Trace::active(false);
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// 64K events (1.5 MB) per thread, a power of two so wrapping is a mask
+const uint64_t ringCapacity = 1 << 16;
+
+struct ThreadBuffer {
+    std::array<TraceEvent, ringCapacity> events;
+    std::atomic<uint64_t> head{ 0 };
+    uint32_t tid = 0;
+    std::string name;
+    // GPU events are already in nanoseconds, CPU events are in ticks
+    bool nanoseconds = false;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::set<std::string> strings;
+
+    std::chrono::steady_clock::time_point startTime;
+    uint64_t startTicks = 0;
+    int64_t gpuOffsetNs = 0;
+
+    ThreadBuffer gpu;
+};
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadBuffer* localBuffer = nullptr;
+
+ThreadBuffer& threadBuffer()
+{
+    // Registration is the only locked step, and it happens once per thread;
+    // buffers outlive their threads so worker zones survive until export
+    if (!localBuffer) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+        localBuffer = reg.buffers.back().get();
+        localBuffer->tid = static_cast<uint32_t>(reg.buffers.size());
+        localBuffer->name = localBuffer->tid == 1 ? "main" : "thread " + std::to_string(localBuffer->tid);
+    }
+    return *localBuffer;
+}
+
+void push(ThreadBuffer& buffer, const char* name, uint64_t start, uint64_t end)
+{
+    // Single producer: the slot is written before the head is published
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head & (ringCapacity - 1)] = { name, start, end };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void writeEscaped(std::ostream& out, const char* text)
+{
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            out << '\\';
+        out << *c;
+    }
+}
+
+}
+
+uint64_t Trace::ticks()
+{
+#ifdef TRACE_HAS_TSC
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+uint64_t Trace::nowNs()
+{
+    auto elapsed = std::chrono::steady_clock::now() - registry().startTime;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Trace::enable()
+{
+    Registry& reg = registry();
+    reg.startTime = std::chrono::steady_clock::now();
+    reg.startTicks = ticks();
+    reg.gpu.name = "GPU";
+    reg.gpu.tid = 0;
+    reg.gpu.nanoseconds = true;
+    threadBuffer();
+    active.store(true, std::memory_order_release);
+}
+
+void Trace::record(const char* name, uint64_t startTicks, uint64_t endTicks)
+{
+    push(threadBuffer(), name, startTicks, endTicks);
+}
+
+void Trace::syncGpuClock(uint64_t gpuNs)
+{
+    registry().gpuOffsetNs = static_cast<int64_t>(gpuNs) - static_cast<int64_t>(nowNs());
+}
+
+void Trace::recordGpu(const char* name, uint64_t gpuStartNs, uint64_t gpuEndNs)
+{
+    if (!enabled())
+        return;
+
+    int64_t offset = registry().gpuOffsetNs;
+    push(registry().gpu, name, gpuStartNs - offset, gpuEndNs - offset);
+}
+
+void Trace::setThreadName(const std::string& name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+const char* Trace::intern(const std::string& text)
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.strings.insert(text).first->c_str();
+}
+
+bool Trace::writeChromeJson(const std::filesystem::path& path)
+{
+    Registry& reg = registry();
+    if (!enabled())
+        return false;
+
+    // Calibrate ticks against the steady clock over the whole session
+    uint64_t endTicks = ticks();
+    uint64_t endNs = nowNs();
+    double nsPerTick = endTicks > reg.startTicks ? static_cast<double>(endNs) / (endTicks - reg.startTicks) : 1.0;
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "ERROR::TRACE::FILE_NOT_WRITTEN: " << path.string() << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    std::vector<ThreadBuffer*> buffers;
+    buffers.push_back(&reg.gpu);
+    for (auto& buffer : reg.buffers)
+        buffers.push_back(buffer.get());
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t written = 0;
+    for (ThreadBuffer* buffer : buffers) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"";
+        writeEscaped(out, buffer->name.c_str());
+        out << "\"}}";
+        first = false;
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > ringCapacity ? head - ringCapacity : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            const TraceEvent& event = buffer->events[i & (ringCapacity - 1)];
+            double startNs, durationNs;
+            if (buffer->nanoseconds) {
+                startNs = static_cast<double>(static_cast<int64_t>(event.start));
+                durationNs = static_cast<double>(event.end - event.start);
+            }
+            else {
+                startNs = static_cast<double>(static_cast<int64_t>(event.start - reg.startTicks)) * nsPerTick;
+                durationNs = static_cast<double>(event.end - event.start) * nsPerTick;
+            }
+
+            // Chrome trace timestamps are microseconds
+            out << ",\n{\"name\":\"";
+            writeEscaped(out, event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << startNs / 1000.0 << ",\"dur\":" << durationNs / 1000.0 << "}";
+            ++written;
+        }
+    }
+    out << "\n]}\n";
+
+    std::cout << "Wrote " << written << " trace events to " << path.string() << std::endl;
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "pch.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Timeline recorder exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Every thread appends to its own fixed-size ring, so recording a zone is two
+// timestamp reads and one release store; the oldest events are overwritten
+// when a ring fills up. Zones only record after enable(). Building without
+// PHOTONWEAVER_TRACE, defined only in the Profile configuration, turns
+// TRACE_SCOPE into nothing at all.
+class Trace
+{
+public:
+	static void enable();
+	static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+	// Raw clock used for zones; converted to nanoseconds on export
+	static uint64_t ticks();
+	// Nanoseconds since enable() on the steady clock
+	static uint64_t nowNs();
+
+	static void record(const char* name, uint64_t startTicks, uint64_t endTicks);
+	// GPU events use the GL_TIMESTAMP clock; syncGpuClock pairs it with nowNs()
+	static void syncGpuClock(uint64_t gpuNs);
+	static void recordGpu(const char* name, uint64_t gpuStartNs, uint64_t gpuEndNs);
+
+	// Names the calling thread's track in the exported timeline
+	static void setThreadName(const std::string& name);
+
+	// Strings handed to record() must outlive the trace; this keeps a copy
+	static const char* intern(const std::string& text);
+
+	// Reads every thread's ring unsynchronized, so the threads that record
+	// must have been joined or stopped first
+	static bool writeChromeJson(const std::filesystem::path& path);
+
+private:
+	static std::atomic<bool> active;
+};
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name) : name(name), start(Trace::enabled() ? Trace::ticks() : 0) {}
+	~TraceScope()
+	{
+		if (start)
+			Trace::record(name, start, Trace::ticks());
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef PHOTONWEAVER_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,39 @@
+#include "TraversalStats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+TraversalStats TraversalStats::FromPixels(const std::vector<glm::uvec4>& counters)
+{
+    TraversalStats stats;
+    stats.pixels = counters.size();
+    for (const glm::uvec4& pixel : counters) {
+        stats.nodes += pixel.x;
+        stats.prims += pixel.y;
+        stats.rays += pixel.z;
+        stats.bounces += pixel.w;
+        stats.maxNodes = std::max(stats.maxNodes, pixel.x);
+        stats.maxPrims = std::max(stats.maxPrims, pixel.y);
+    }
+    return stats;
+}
+
+void TraversalStats::add(const TraversalStats& other)
+{
+    pixels += other.pixels;
+    nodes += other.nodes;
+    prims += other.prims;
+    rays += other.rays;
+    bounces += other.bounces;
+    maxNodes = std::max(maxNodes, other.maxNodes);
+    maxPrims = std::max(maxPrims, other.maxPrims);
+}
+
+std::string TraversalStats::summary() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << nodesPerRay() << " nodes/ray, " << primsPerRay() << " prims/ray, "
+        << raysPerPixel() << " rays/px, " << bouncesPerPixel() << " bounces/px, worst pixel " << maxNodes << " nodes";
+    return out.str();
+}
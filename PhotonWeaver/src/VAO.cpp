@@ -1,24 +1,26 @@
 #include "VAO.h"
 
-VAO::VAO() {
-    glGenVertexArrays(1, &ID);
+VAO::VAO()
+    : array(GLVertexArray::Create())
+{
 }
 
 void VAO::LinkAttrib(VBO& vbo, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset) {
+    // The attribute records the buffer bound now; the GL_ARRAY_BUFFER binding
+    // itself is not VAO state, so it is left as it is
     vbo.Bind();
     glVertexAttribPointer(layout, numComponents, type, GL_FALSE, stride, offset);
     glEnableVertexAttribArray(layout);
-    vbo.Unbind(); // Unbinding VBO is not necessary here as VBO is not part of VAO state
 }
 
 void VAO::Bind() const {
-    glBindVertexArray(ID);
+    GLState::BindVertexArray(array.get());
 }
 
 void VAO::Unbind() const {
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
 }
 
 void VAO::Delete() {
-    glDeleteVertexArrays(1, &ID);
-}
\ No newline at end of file
+    array.reset();
+}
@@ -2,14 +2,17 @@
 #define VAO_H
 
 #include "pch.h"
+#include "GLObject.h"
 #include "VBO.h"
 
 class VAO {
 public:
-    GLuint ID;
-
     VAO();
 
+    GLuint id() const { return array.get(); }
+
+    // The VAO must be bound. vbo stays bound afterwards, so linking several
+    // attributes of one buffer binds it once.
     void LinkAttrib(VBO& vbo, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
 
     void Bind() const;
@@ -17,6 +20,9 @@ public:
     void Unbind() const;
 
     void Delete();
+
+private:
+    GLVertexArray array;
 };
 
 #endif // !VAO_H
@@ -1,19 +1,20 @@
 #include "VBO.h"
 
-VBO::VBO(const void* vertices, GLsizeiptr size) {
-    glGenBuffers(1, &ID);
-    glBindBuffer(GL_ARRAY_BUFFER, ID);
+VBO::VBO(const void* vertices, GLsizeiptr size)
+    : buffer(GLBuffer::Create())
+{
+    Bind();
     glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
 }
 
 void VBO::Bind() const {
-    glBindBuffer(GL_ARRAY_BUFFER, ID);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, buffer.get());
 }
 
 void VBO::Unbind() const {
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void VBO::Delete() {
-    glDeleteBuffers(1, &ID);
-}
\ No newline at end of file
+    buffer.reset();
+}
@@ -1,18 +1,22 @@
 #ifndef VBO_H
 #define VBO_H
 #include "pch.h"
+#include "GLObject.h"
 
 class VBO {
 public:
-    GLuint ID;
-
     VBO(const void* vertices, GLsizeiptr size);
 
+    GLuint id() const { return buffer.get(); }
+
     void Bind() const;
 
     void Unbind() const;
 
     void Delete();
+
+private:
+    GLBuffer buffer;
 };
 
 #endif // !VBO_H
@@ -1,60 +1,304 @@
 #include "pch.h"
 #include "Shader.h"
-#include "VAO.h"
-#include "VBO.h"
-#include "EBO.h"
+#include "ShaderVariants.h"
+#include "ShaderReloader.h"
+#include "GLState.h"
+#include "GpuProfiler.h"
+#include "Trace.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "CompiledScene.h"
 #include "Camera.h"
+#include "TileScheduler.h"
+#include "Poster.h"
+#include "FrameCapture.h"
+#include "Animation.h"
+#include "SceneFile.h"
+#include "RenderServer.h"
+#include "RenderTargetPool.h"
+#include "DistributedRender.h"
+#include "ProgressiveRender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
 
 // Set Variables
 // glm::vec3 camPos = glm::vec3(0.0f, 0.0f, 3.0f);
 // glm::vec3 camDir = glm::vec3(0.0f, 0.0f, -1.0f);
 // glm::vec3 camUp = glm::vec3(0.0f, 1.0f, 0.0f);
 float fov = 60.0f;
-glm::vec3 sphereCenter = glm::vec3(0.0f, 0.0f, -5.0f);
-float aspectRatio = 800.0f / 600.0f;
-float sphereRadius = 1.0f;
-glm::vec4 materialColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
 
-Shader* globalShader = nullptr; // Initialize to nullptr
+// Size the frame is rendered at; follows the window once a resize settles
 auto width = 800;
 auto height = 600;
+// The window's framebuffer as last reported, and when it last changed
+int windowWidth = 800;
+int windowHeight = 600;
+double resizedAt = 0.0;
+// A drag reports a new size every few pixels; targets are only reallocated
+// once the size has held this long, and the frame is stretched until then
+const double resizeSettleSeconds = 0.25;
 
+// Passes averaged into a still view before the viewer stops tracing (--view-spp)
+int viewSamples = 64;
+// Storage of the view's running mean (--view-format); RGBA16F halves it and is
+// good to about a thousandth at the default pass count
+GLenum viewFormat = GL_RGBA32F;
+// While idle the loop still wakes this often, e.g. for shader reloads
+const double idleWaitSeconds = 0.25;
 
+// Compile-time tracer configuration, switched with the keyboard (see key_callback)
+ShaderVariantKey tracerVariant = ShaderVariantKey()
+	.set("MAX_BOUNCES", 5)
+	.set("NUM_SAMPLES", 1);
 
-//float samples_per_pixel = 1.0f;
-//float pixel_sample_square = 1.0f;
+// Per-pixel traversal counters; costs a readback every frame while on (see key_callback)
+bool collectTraversalStats = false;
 
-float quadVertices[] = {
-	// positions    // texCoords
-	-1.0f,  1.0f,   0.0f, 1.0f,
-	-1.0f, -1.0f,   0.0f, 0.0f,
-	 1.0f, -1.0f,   1.0f, 0.0f,
 
-	-1.0f,  1.0f,   0.0f, 1.0f,
-	 1.0f, -1.0f,   1.0f, 0.0f,
-	 1.0f,  1.0f,   1.0f, 1.0f
-};
 
-void framebuffer_size_callback(GLFWwindow* window, int newWidth, int newHeight) {
+//float samples_per_pixel = 1.0f;
+//float pixel_sample_square = 1.0f;
+
+void framebuffer_size_callback(GLFWwindow*, int newWidth, int newHeight) {
 	// Update the viewport
 	glViewport(0, 0, newWidth, newHeight);
 
-	// Update width and height variables
-	width = newWidth;
-	height = newHeight;
+	// The render size catches up in the main loop once resizing stops
+	windowWidth = newWidth;
+	windowHeight = newHeight;
+	resizedAt = glfwGetTime();
+}
+
+void key_callback(GLFWwindow*, int key, int, int action, int) {
+	if (action != GLFW_PRESS)
+		return;
+
+	// 1-9 select the bounce count, +/- the samples per pixel, N, R and H toggle features,
+	// T toggles the traversal counters.
+	// Each combination is compiled once and then reused from the variant cache.
+	if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9)
+		tracerVariant.set("MAX_BOUNCES", key - GLFW_KEY_0);
+	else if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD)
+		tracerVariant.set("NUM_SAMPLES", std::min(tracerVariant.get("NUM_SAMPLES", 1) * 2, 64));
+	else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT)
+		tracerVariant.set("NUM_SAMPLES", std::max(tracerVariant.get("NUM_SAMPLES", 1) / 2, 1));
+	else if (key == GLFW_KEY_N)
+		tracerVariant.set("SHADE_NORMALS", !tracerVariant.has("SHADE_NORMALS"));
+	else if (key == GLFW_KEY_R)
+		tracerVariant.set("SHADOW_RAY", !tracerVariant.has("SHADOW_RAY"));
+	else if (key == GLFW_KEY_H)
+		tracerVariant.set("HEATMAP", !tracerVariant.has("HEATMAP"));
+	else if (key == GLFW_KEY_T)
+		collectTraversalStats = !collectTraversalStats;
+}
+
+int main(int argc, char** argv) {
+	// --gpu-profile prints the per-pass GPU timing table once a second
+	// --trace <file> records CPU and GPU zones and writes a Chrome trace on exit
+	// --scene <name|file.json> picks a built-in scene or loads a scene file
+	// --tiles draws the view a few tiles per frame under a GPU time budget (see TileScheduler)
+	// --view-spp <n> sets the passes averaged into a still view before the viewer goes idle, 64 by default
+	// --view-format <rgba32f|rgba16f> stores the view's running mean in full or half precision
+	// --raster-primary rasterizes camera-ray hits into a visibility buffer and traces from there (not with --tiles)
+	// --poster <WxH> <file.exr> renders the scene's camera to a streamed EXR of any size and exits
+	// --poster-spp <n> sets the poster's sample passes per pixel
+	// --capture <dir> saves every frame to dir without stalling the GPU (see FrameCapture)
+	// --capture-format <png|exr|pfm> picks the captured files' format, png by default
+	// --animate <WxH> <dir> renders the scene file's animation (a turntable without one) to dir and exits
+	// --anim-spp <n> and --anim-ms <ms> set the passes per frame, or the GPU time budget per frame
+	// --serve runs render jobs sent to a Unix domain socket until told to stop (see RenderServer)
+	// --submit <job.json> sends a job to a running server and prints its reply
+	// --socket <path> is the server's socket, photonweaver.sock by default
+	// --distribute <n> <WxH> <file> renders the scene on the CPU across n worker processes and exits (see DistributedRender)
+	// --dist-spp <n> and --dist-tile <px> set the distributed render's samples per pixel and tile size
+	// --worker <socket> renders tiles for a coordinator; --distribute starts these itself
+	// --progressive <WxH> <file> accumulates a still pass by pass with periodic checkpoints and exits (see ProgressiveRender)
+	// --progressive-spp <n> and --checkpoint-every <s> set its passes and the seconds between checkpoints
+	// --resume <file.checkpoint> continues a progressive render from its checkpoint, scene, size and --progressive-format included
+	// --progressive-format <rgba32f|rgba16f|rgba16f-resolve> sums its passes in float, half, or half resolved into float (see AccumulationTarget)
+	// --resolve-every <n> sets the passes rgba16f-resolve sums at half precision, 16 by default
+	// --guides <full|packed> also writes its first-hit albedo and normals as <file>.albedo.exr and <file>.normal.exr (see GBuffer)
+	bool logGpuProfile = false;
+	bool tiled = false;
+	bool rasterPrimary = false;
+	std::string tracePath;
+	std::string sceneArg = "two-spheres";
+	std::string posterPath;
+	Poster::Options posterOptions;
+	FrameCapture::Options captureOptions;
+	Animation::Options animationOptions;
+	bool serve = false;
+	std::string submitPath;
+	RenderServer::Options serverOptions;
+	std::string distributedPath;
+	DistributedRender::Options distributedOptions;
+	std::string workerSocket;
+	ProgressiveRender::Options progressiveOptions;
+	int progressiveSamples = 0;
+	bool writeGuides = false;
+	std::string resumePath;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--gpu-profile")
+			logGpuProfile = true;
+		else if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "--scene" && i + 1 < argc)
+			sceneArg = argv[++i];
+		else if (arg == "--tiles")
+			tiled = true;
+		else if (arg == "--poster" && i + 2 < argc) {
+			std::string size = argv[++i];
+			posterPath = argv[++i];
+			if (std::sscanf(size.c_str(), "%dx%d", &posterOptions.width, &posterOptions.height) != 2) {
+				std::cerr << "ERROR::ARGS::POSTER_SIZE: expected WxH, got " << size << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--raster-primary")
+			rasterPrimary = true;
+		else if (arg == "--view-spp" && i + 1 < argc)
+			viewSamples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--poster-spp" && i + 1 < argc)
+			posterOptions.samples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--animate" && i + 2 < argc) {
+			std::string size = argv[++i];
+			animationOptions.directory = argv[++i];
+			if (std::sscanf(size.c_str(), "%dx%d", &animationOptions.width, &animationOptions.height) != 2) {
+				std::cerr << "ERROR::ARGS::ANIMATION_SIZE: expected WxH, got " << size << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--anim-spp" && i + 1 < argc)
+			animationOptions.samples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--anim-ms" && i + 1 < argc)
+			animationOptions.budgetMs = std::atof(argv[++i]);
+		else if (arg == "--serve")
+			serve = true;
+		else if (arg == "--submit" && i + 1 < argc)
+			submitPath = argv[++i];
+		else if (arg == "--socket" && i + 1 < argc)
+			serverOptions.socketPath = distributedOptions.socketPath = argv[++i];
+		else if (arg == "--distribute" && i + 3 < argc) {
+			distributedOptions.workers = std::max(0, std::atoi(argv[++i]));
+			std::string size = argv[++i];
+			distributedPath = argv[++i];
+			if (std::sscanf(size.c_str(), "%dx%d", &distributedOptions.width, &distributedOptions.height) != 2) {
+				std::cerr << "ERROR::ARGS::DISTRIBUTE_SIZE: expected WxH, got " << size << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--dist-spp" && i + 1 < argc)
+			distributedOptions.samples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--dist-tile" && i + 1 < argc)
+			distributedOptions.tileSize = std::max(8, std::atoi(argv[++i]));
+		else if (arg == "--worker" && i + 1 < argc)
+			workerSocket = argv[++i];
+		else if (arg == "--progressive" && i + 2 < argc) {
+			std::string size = argv[++i];
+			progressiveOptions.output = argv[++i];
+			if (std::sscanf(size.c_str(), "%dx%d", &progressiveOptions.width, &progressiveOptions.height) != 2) {
+				std::cerr << "ERROR::ARGS::PROGRESSIVE_SIZE: expected WxH, got " << size << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--progressive-spp" && i + 1 < argc)
+			progressiveSamples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--checkpoint-every" && i + 1 < argc)
+			progressiveOptions.checkpointSeconds = std::atof(argv[++i]);
+		else if (arg == "--resume" && i + 1 < argc)
+			resumePath = argv[++i];
+		else if (arg == "--progressive-format" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (!AccumulationTarget::ParseStorage(format, progressiveOptions.storage)) {
+				std::cerr << "ERROR::ARGS::PROGRESSIVE_FORMAT: expected rgba32f, rgba16f or rgba16f-resolve, got " << format << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--resolve-every" && i + 1 < argc)
+			progressiveOptions.resolveInterval = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--guides" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (!GBuffer::ParseFormat(format, progressiveOptions.gbufferFormat)) {
+				std::cerr << "ERROR::ARGS::GUIDES_FORMAT: expected full or packed, got " << format << std::endl;
+				return -1;
+			}
+			writeGuides = true;
+		}
+		else if (arg == "--view-format" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (format == "rgba32f" || format == "rgba16f")
+				viewFormat = format == "rgba16f" ? GL_RGBA16F : GL_RGBA32F;
+			else {
+				std::cerr << "ERROR::ARGS::VIEW_FORMAT: expected rgba32f or rgba16f, got " << format << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+			captureOptions.directory = argv[++i];
+		else if (arg == "--capture-format" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (!ImageEncoder::ParseFormat(format, captureOptions.format)) {
+				std::cerr << "ERROR::ARGS::CAPTURE_FORMAT: expected png, exr or pfm, got " << format << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	// A client needs no window at all
+	if (!submitPath.empty()) {
+		Json request;
+		std::string reply, error;
+		if (!Json::load(submitPath, request, error) || !RenderServer::Submit(serverOptions.socketPath, request, reply, error)) {
+			std::cerr << "ERROR::SUBMIT::FAILED: " << error << std::endl;
+			return -1;
+		}
+		std::cout << reply << std::endl;
+		Json parsed;
+		return Json::parse(reply, parsed, error) && parsed["ok"].asBool() ? 0 : 1;
+	}
 
-	// Update aspect ratio
-	aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+	// Nor do the CPU tracer's coordinator and workers
+	if (!workerSocket.empty())
+		return DistributedRender::Work(workerSocket);
+	if (!distributedPath.empty()) {
+		std::string error;
+		distributedOptions.scene = sceneArg;
+		if (!DistributedRender::Render(distributedOptions, argv[0], distributedPath, error)) {
+			std::cerr << "ERROR::DISTRIBUTED::NOT_WRITTEN: " << error << std::endl;
+			return -1;
+		}
+		std::cout << "Image written to " << distributedPath << std::endl;
+		return 0;
+	}
 
-	// Update the aspect ratio uniform in the shader if the shader is available
-	if (globalShader != nullptr) {
-		globalShader->use();
-		globalShader->setFloat("aspectRatio", aspectRatio);
+	// A resumed render is the one its checkpoint was taken from; more passes may be asked for
+	if (!resumePath.empty()) {
+		std::string error;
+		if (!ProgressiveRender::ReadCheckpoint(resumePath, progressiveOptions, error)) {
+			std::cerr << "ERROR::ARGS::RESUME: " << error << std::endl;
+			return -1;
+		}
+		sceneArg = progressiveOptions.scene;
 	}
-}
+	if (progressiveSamples > 0)
+		progressiveOptions.samples = progressiveSamples;
+	progressiveOptions.scene = sceneArg;
 
+#ifdef PHOTONWEAVER_TRACE
+	if (!tracePath.empty())
+		Trace::enable();
+#else
+	if (!tracePath.empty())
+		std::cerr << "Tracing was compiled out; build the Profile configuration (PHOTONWEAVER_TRACE) to use --trace" << std::endl;
+#endif
+
+	auto startupBegin = std::chrono::steady_clock::now();
 
-int main() {
 	// Initialize GLFW
 	if (!glfwInit()) {
 		std::cout << "Failed to initialize GLFW" << std::endl;
@@ -64,6 +308,10 @@ int main() {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// A poster, an animation, a progressive still or the server only needs the context
+	bool offline = !posterPath.empty() || !animationOptions.directory.empty() || serve || !progressiveOptions.output.empty();
+	if (offline)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	// Create a GLFWwindow object
 	GLFWwindow* window = glfwCreateWindow(width, height, "PhotonWeaver", NULL, NULL);
@@ -78,6 +326,7 @@ int main() {
 	//glfwSwapInterval(0); // Disable VSync
 
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetKeyCallback(window, key_callback);
 
 	// Initialize GLAD
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -89,24 +338,116 @@ int main() {
 	// Set the viewport
 	glViewport(0, 0, 800, 600);
 
-	// Shader instantiation
-	std::string vertDir = parentDir + "\\PhotonWeaver\\src\\shaders\\Ray.vert";
-	std::string fragDir = parentDir + "\\PhotonWeaver\\src\\shaders\\Ray.frag";
+	// Jobs bring their own scenes; the server keeps them and the shader variants warm
+	if (serve) {
+		ShaderVariants serverShaders(Renderer::ShaderPath("default.vert"), Renderer::ShaderPath("default.frag"));
+		RenderServer server(serverShaders, serverOptions);
+		std::string error;
+		if (!server.start(error)) {
+			std::cerr << "ERROR::SERVER::NOT_STARTED: " << error << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		server.run();
+		// Joins the acceptor, readers and encoders, so no thread still records zones
+		server.Delete();
+		serverShaders.Delete();
+		// The pool outlives main; empty it while the context is still current
+		RenderTargetPool::Instance().Delete();
+		if (!tracePath.empty())
+			Trace::writeChromeJson(tracePath);
+		glfwTerminate();
+		return 0;
+	}
 
-	Shader shader(vertDir.c_str(), fragDir.c_str());
-	globalShader = &shader;
+	// Scene and renderer instantiation. Scene files go through the compiled
+	// cache, so after the first run they are mapped and uploaded in place.
+	Renderer renderer;
+	SceneCamera sceneCamera;
+	// An animation moves the scene every frame, so it keeps the Scene itself
+	Scene animatedScene;
+	{
+		Scene scene;
+		CompiledScene compiled;
+		std::string error;
+		if (!animationOptions.directory.empty()) {
+			if (!Scene::Builtin(sceneArg, animatedScene) && !SceneFile::Load(sceneArg, animatedScene, error)) {
+				std::cerr << "ERROR::SCENE::NOT_LOADED: " << error << std::endl;
+				glfwTerminate();
+				return -1;
+			}
+			animatedScene.buildBVH();
+			renderer.upload(animatedScene);
+			sceneCamera = animatedScene.camera;
+		}
+		else if (Scene::Builtin(sceneArg, scene)) {
+			scene.buildBVH();
+			renderer.upload(scene);
+			sceneCamera = scene.camera;
+		}
+		else if (compiled.load(sceneArg, error)) {
+			renderer.upload(compiled.geometry());
+			sceneCamera = compiled.camera();
+			std::cout << "Scene " << compiled.name() << ": " << compiled.geometry().sphereCount << " spheres, " << compiled.geometry().triangleCount << " triangles, "
+				<< (compiled.fromCache() ? "mapped" : "compiled") << " in " << compiled.loadMs() << " ms" << std::endl;
+		}
+		else {
+			std::cerr << "ERROR::SCENE::NOT_LOADED: " << error << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+	}
+	fov = sceneCamera.fov;
 
-	Camera camera(width, height, glm::vec3(0.0f, 0.0f, 2.0f));
+	// Shader instantiation
+	ShaderVariants tracerShaders(Renderer::ShaderPath("default.vert"), Renderer::ShaderPath("default.frag"));
+	Shader* shader = &tracerShaders.get(renderer.variant(tracerVariant));
+
+	if (offline) {
+		std::string error;
+		bool written = false;
+		if (!animationOptions.directory.empty()) {
+			animationOptions.format = captureOptions.format;
+			written = Animation::Render(renderer, *shader, animatedScene, animationOptions, error);
+			if (written)
+				std::cout << "Animation written to " << animationOptions.directory.string() << std::endl;
+			else
+				std::cerr << "ERROR::ANIMATION::NOT_WRITTEN: " << error << std::endl;
+		}
+		else if (!progressiveOptions.output.empty()) {
+			ShaderVariantKey accumulatingKey = renderer.variant(ShaderVariantKey(tracerVariant).set("ACCUMULATE", true));
+			Shader& accumulating = tracerShaders.get(accumulatingKey);
+			progressiveOptions.variant = accumulatingKey.defines();
+			Shader* guides = writeGuides ? &tracerShaders.get(renderer.variant(ShaderVariantKey(tracerVariant).set("GBUFFER", true))) : nullptr;
+			written = ProgressiveRender::Render(renderer, accumulating, sceneCamera, progressiveOptions, error, guides);
+			if (written)
+				std::cout << "Image written to " << progressiveOptions.output.string() << std::endl;
+			else
+				std::cerr << "ERROR::PROGRESSIVE::NOT_WRITTEN: " << error << std::endl;
+		}
+		else {
+			written = Poster::Render(renderer, *shader, sceneCamera, posterOptions, posterPath, error);
+			if (written)
+				std::cout << "Poster written to " << posterPath << std::endl;
+			else
+				std::cerr << "ERROR::POSTER::NOT_WRITTEN: " << error << std::endl;
+		}
+		tracerShaders.Delete();
+		renderer.Delete();
+		RenderTargetPool::Instance().Delete();
+		if (!tracePath.empty())
+			Trace::writeChromeJson(tracePath);
+		glfwTerminate();
+		return written ? 0 : -1;
+	}
 
-	// VBO and VAO instantiation
-	VBO vbo(quadVertices, sizeof(quadVertices));
-	VAO vao;
+	// Edits to the shader sources are rebuilt in the background and swapped in when linked
+	ShaderReloader shaderReloader(window);
+	shaderReloader.watch(tracerShaders);
 
-	// Bind VAO and link it with VBO
-	vao.Bind();
-	vao.LinkAttrib(vbo, 0, 2, GL_FLOAT, 4 * sizeof(float), (void*)0);
-	vao.LinkAttrib(vbo, 1, 2, GL_FLOAT, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-	vao.Unbind();  // Unbind VAO to prevent unintended modifications.
+	Camera camera(width, height, sceneCamera.position);
+	camera.Orientation = sceneCamera.direction();
+	camera.Up = sceneCamera.up;
 
 	float lastFrame = 0.0f; // Time of last frame
 	float deltaTime = 0.0f; // Time between current frame and last frame
@@ -114,26 +455,78 @@ int main() {
 	float cameraSpeed = 1.0f;
 
 
-	shader.use();
-	shader.setFloat("aspectRatio", width / height);
-
 	double lastTime = glfwGetTime();
 	int nbFrames = 0;
+	// Binds issued and dropped by GLState over the current second
+	GLState::Counts bindCounts;
+
+	GpuProfiler gpuProfiler;
+
+	// The view builds up in a float target and is copied to the window every
+	// frame, stretched while a resize settles. Each frame adds one pass, up to
+	// viewSamples; with --tiles, a GPU time budget's worth of tiles of a single
+	// pass. Any change to the view, the size or the variant starts it over.
+	// Once it is complete nothing is traced: the loop sleeps in
+	// glfwWaitEventsTimeout and redisplays the target when it wakes.
+	TileScheduler tileScheduler;
+	RenderTargetPool& targetPool = RenderTargetPool::Instance();
+	GLFramebuffer viewFramebuffer = GLFramebuffer::Create();
+	// From the target pool, swapped for one of the new size when the render size changes
+	GLuint viewColor = 0;
+	int viewTargetWidth = 0, viewTargetHeight = 0;
+	SceneCamera shownView;
+	const Shader* shownShader = nullptr;
+	GLuint shownProgram = 0;
+	int viewPasses = 0;
+	bool idle = false;
+
+	std::unique_ptr<FrameCapture> frameCapture;
+	if (!captureOptions.directory.empty())
+		frameCapture = std::make_unique<FrameCapture>(captureOptions);
+
+	// Compare against a second launch to see what the shader binary cache saves
+	double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+	std::cout << "Startup took " << startupMs << " ms" << std::endl;
 
 	// Main loop
 	while (!glfwWindowShouldClose(window))
 	{
+		TRACE_SCOPE("frame");
+
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
+		// Reads back whatever GPU timings have landed since, without waiting
+		gpuProfiler.beginFrame();
+
+		GLState::Counts frameBinds = GLState::TakeCounts();
+		bindCounts.issued += frameBinds.issued;
+		bindCounts.skipped += frameBinds.skipped;
+
 		// Input handling (example: camera movement)
 		// Update FPS counter
 		nbFrames++;
 		if (currentFrame - lastTime >= 1.0) {
-			// Update the window title with the FPS count
-			std::string title = "PhotonWeaver - FPS: " + std::to_string(nbFrames);
+			// Update the window title with the FPS count and the average GPU time per pass
+			std::string title = "PhotonWeaver - FPS: " + std::to_string(nbFrames) + gpuProfiler.summary();
+			// Per frame: bind and use-program calls sent, and those skipped as redundant
+			title += " | binds " + std::to_string(bindCounts.issued / nbFrames) + " (skipped " + std::to_string(bindCounts.skipped / nbFrames) + ")";
+			bindCounts = GLState::Counts();
+			RenderTargetPool::Stats targets = targetPool.stats();
+			title += " | targets " + std::to_string(targets.bytes >> 20) + " MB in " + std::to_string(targets.textures);
+			if (idle)
+				title += " | idle";
+			else if (!tiled)
+				title += " | pass " + std::to_string(viewPasses) + "/" + std::to_string(viewSamples);
+			if (renderer.statsEnabled()) {
+				std::string traversal = renderer.lastStats().summary();
+				title += " | " + traversal;
+				std::cout << "Traversal: " << traversal << std::endl;
+			}
 			glfwSetWindowTitle(window, title.c_str());
+			if (logGpuProfile)
+				gpuProfiler.print(std::cout);
 
 			// Reset timer and frame count
 			nbFrames = 0;
@@ -147,44 +540,145 @@ int main() {
 		camera.Inputs(window, deltaTime);
 		camera.updateMatrix(45.0f, 0.1f, 100.0f);
 
-		shader.use();
+		shaderReloader.update();
 
-		// Update camera uniforms
-		shader.setVec3("camPos", camera.Position);
-		shader.setVec3("camDir", camera.Orientation);
-		shader.setVec3("camUp", camera.Up);
-		shader.setFloat("fov", fov);
-		//shader.setInt("pixel_sample_square", pixel_sample_square);
-		//shader.setInt("samples_per_pixel", samples_per_pixel);
+		// Picks up a keyboard change; only a never-seen combination compiles
+		renderer.setStatsEnabled(collectTraversalStats);
+		// Tiles always trace their camera rays
+		renderer.setVisibilityEnabled(rasterPrimary && !tiled);
+		shader = &tracerShaders.get(renderer.variant(tracerVariant));
 
-		// Set sphere uniforms
-		shader.setVec3("sphereCenter", sphereCenter);
-		shader.setFloat("sphereRadius", sphereRadius);
+		// The viewer's camera drives the tracer; fov stays a global setting
+		SceneCamera view;
+		view.position = camera.Position;
+		view.target = camera.Position + camera.Orientation;
+		view.up = camera.Up;
+		view.fov = fov;
 
-		shader.setFloat("width", (float)width);
-		shader.setFloat("height", (float)height);
-
-		// Set material color uniform
-		shader.setVec4("materialColor", materialColor);
-
-		// Since aspect ratio can change with window resizing,
-		// set it in the framebuffer size callback
-		shader.setFloat("aspectRatio", aspectRatio);
+		if ((windowWidth != width || windowHeight != height) && glfwGetTime() - resizedAt >= resizeSettleSeconds) {
+			width = windowWidth;
+			height = windowHeight;
+		}
+		bool stretched = width != windowWidth || height != windowHeight;
+		// Copies a width x height frame to the window, stretched while the two differ
+		auto present = [&](const GLFramebuffer& source) {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, source.get());
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, stretched ? GL_LINEAR : GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		};
+
+		idle = false;
+		if (width > 0 && height > 0) {
+			if (width != viewTargetWidth || height != viewTargetHeight) {
+				viewTargetWidth = width;
+				viewTargetHeight = height;
+				targetPool.release(viewColor);
+				viewColor = targetPool.acquire(viewFormat, width, height);
+				glBindFramebuffer(GL_FRAMEBUFFER, viewFramebuffer.get());
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, viewColor, 0);
+				shownShader = nullptr;
+			}
+			// A reloaded shader keeps its Shader but gets a new program
+			bool viewChanged = view.position != shownView.position || view.target != shownView.target || view.up != shownView.up || view.fov != shownView.fov;
+			if (viewChanged || shader != shownShader || shader->id() != shownProgram) {
+				shownView = view;
+				shownShader = shader;
+				shownProgram = shader->id();
+				viewPasses = 0;
+				if (tiled)
+					tileScheduler.reset(width, height);
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER, viewFramebuffer.get());
+			// Idle frames open no "trace" pass, so they do not pull its average toward zero
+			if (tiled) {
+				std::vector<TileRect> batch = tileScheduler.beginBatch();
+				if (!batch.empty())
+					gpuProfiler.begin("trace");
+				for (const TileRect& tile : batch)
+					renderer.drawTile(*shader, view, width, height, tile, glm::ivec2(tile.x, tile.y));
+				tileScheduler.endBatch();
+				if (!batch.empty())
+					gpuProfiler.end();
+				idle = tileScheduler.done();
+			}
+			// The counters are read from a single pass, so with them on one is enough
+			else if (viewPasses < (renderer.statsEnabled() ? 1 : viewSamples)) {
+				gpuProfiler.begin("trace");
+				// Running mean: pass n goes in with weight 1 / (n + 1)
+				float weight = 1.0f / (viewPasses + 1);
+				glBlendColor(weight, weight, weight, weight);
+				glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+				glEnable(GL_BLEND);
+				glViewport(0, 0, width, height);
+				renderer.draw(*shader, view, width, height, viewPasses);
+				glViewport(0, 0, windowWidth, windowHeight);
+				glDisable(GL_BLEND);
+				++viewPasses;
+				gpuProfiler.end();
+			}
+			else
+				idle = true;
+		}
 
-		vao.Bind();
+		// Reads the float view before present() turns it into 8-bit window pixels
+		if (frameCapture && width > 0 && height > 0 && windowWidth > 0 && windowHeight > 0) {
+			gpuProfiler.begin("capture");
+			frameCapture->capture(viewFramebuffer, width, height);
+			gpuProfiler.end();
+		}
 
-		glDrawArrays(GL_TRIANGLES, 0, 6);  // Or glDrawElements if using EBO
+		targetPool.endFrame();
 
 		camera.setSpeed(cameraSpeed);
 
 		// Swap buffers and poll events
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		{
+			TRACE_SCOPE("swap");
+			gpuProfiler.begin("present");
+			// Tiles left over from the previous view show until redrawn
+			if (width > 0 && height > 0)
+				present(viewFramebuffer);
+			glfwSwapBuffers(window);
+			gpuProfiler.end();
+		}
+		// Captures need every frame, and a stretched frame is waiting on the resize to settle.
+		// A minimized window has nothing to draw or capture until it is restored.
+		bool minimized = windowWidth == 0 || windowHeight == 0;
+		if ((idle && !frameCapture && !stretched) || minimized) {
+			TRACE_SCOPE("wait events");
+			glfwWaitEventsTimeout(idleWaitSeconds);
+			// Time asleep is not time the camera moved for
+			lastFrame = static_cast<float>(glfwGetTime());
+		}
+		else {
+			TRACE_SCOPE("poll events");
+			glfwPollEvents();
+		}
 	}
 
-	vao.Delete();
-	vbo.Delete();
-	// ebo.Delete();  // If using EBO
+	if (frameCapture) {
+		frameCapture->Delete();
+		FrameCapture::Stats stats = frameCapture->stats();
+		std::cout << "Captured " << stats.captured << " frames (" << stats.encoder.written << " written, " << stats.encoder.failed << " failed); "
+			<< "waited " << stats.ringStallMs << " ms on readbacks in " << stats.ringStalls << " frames and " << stats.encoder.blockedMs << " ms on encoders" << std::endl;
+	}
+	tileScheduler.Delete();
+	viewFramebuffer.reset();
+	targetPool.release(viewColor);
+	gpuProfiler.Delete();
+	shaderReloader.Delete();
+	tracerShaders.Delete();
+	renderer.Delete();
+	RenderTargetPool::Stats targets = targetPool.stats();
+	std::cout << "Render targets: peak " << (targets.peakBytes >> 20) << " MB, " << targets.allocations << " allocations, "
+		<< targets.reuses << " reused" << std::endl;
+	targetPool.Delete();
+
+	// Only once the capture encoders and the shader compiler have stopped recording
+	if (!tracePath.empty())
+		Trace::writeChromeJson(tracePath);
 
 	// Terminate GLFW
 	glfwTerminate();
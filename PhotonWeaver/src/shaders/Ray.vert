@@ -1,6 +0,0 @@
-#version 330 core
-layout (location = 0) in vec2 aPos; // Full-screen quad vertices
-
-void main() {
-    gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); // Output position to fragment shader
-}
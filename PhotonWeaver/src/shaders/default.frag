@@ -1,19 +1,116 @@
 #version 330 core
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
 
+// Compile-time configuration, injected by ShaderVariants after the #version line.
+// The fallbacks below keep the file usable on its own.
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 5 // Maximum number of bounces per path
+#endif
+#ifndef NUM_SAMPLES
+#define NUM_SAMPLES 1 // Number of samples per pixel
+#endif
+#ifndef BVH_STACK_SIZE
+#define BVH_STACK_SIZE 32 // Traversal stack depth, at least the depth of the scene's BVH
+#endif
+#ifndef MATERIAL_TYPES
+#define MATERIAL_TYPES 15 // Bit (1 << type) per material type the scene uses; code for the rest is left out
+#endif
+// Optional features:
+//   SHADOW_RAY     single bounce with a random shadow ray instead of the bounce loop
+//   SHADE_NORMALS  visualise surface normals instead of tracing paths
+//   R2_SAMPLER     jitter samples along a per-pixel rotated R2 sequence instead of the RNG
+//   TRAVERSAL_STATS  write per-pixel (nodes visited, primitives tested, rays, bounces)
+//                    to a second, integer render target
+//   HEATMAP        show traversal cost (nodes + primitives per sample) in false color
+//   TEXTURES       the scene has a texture array; textured materials multiply
+//                  their albedo by it, at a mip level picked by ray cones
+//   ACCUMULATE     also write the squared luminance to a second, float render
+//                  target; with additive blending the two targets gather
+//                  Accumulator's sums (color, samples in alpha, luminance squared).
+//                  Not combined with TRAVERSAL_STATS, which uses the same slot
+//   GBUFFER        also write the first hit's albedo and its normal, octahedral
+//                  encoded into [0, 1], to a second and third render target
+//                  (see GBuffer). Not combined with ACCUMULATE or TRAVERSAL_STATS
+
+#ifdef TRAVERSAL_STATS
+layout(location = 1) out uvec4 TraversalCounts;
+#endif
+#ifdef ACCUMULATE
+layout(location = 1) out vec4 SquaredLuminance;
+#endif
+#ifdef GBUFFER
+layout(location = 1) out vec4 Albedo;
+layout(location = 2) out vec4 Normal;
+// Set by the bounce loop's rayColor at the first hit; a miss gives the
+// background and a normal facing the camera. Left zero by SHADOW_RAY and SHADE_NORMALS.
+vec3 firstAlbedo = vec3(0.0);
+vec3 firstNormal = vec3(0.0);
+#endif
+#if defined(TRAVERSAL_STATS) || defined(HEATMAP)
+#define COUNT(counter) counter++
+#else
+#define COUNT(counter)
+#endif
+
+uniform float width;
+uniform float height;
+uniform vec2 tileOffset; // Image pixel of the viewport's origin, see Renderer::drawTile
 uniform vec3 camPos;
 uniform vec3 camDir;
 uniform vec3 camUp;
 uniform float fov; // Field of view in degrees
 uniform float aspectRatio;
+uniform int frameIndex; // Seeds the RNG, so progressive frames give independent samples
 
 uniform vec3 ambientColor; // Define ambient color
 
-const int maxBounces = 5; // Define the maximum number of bounces
+// Scene, see Renderer::upload. Spheres are two texels each, (center, radius)
+// and (albedo, material); BVH nodes are two texels each, (min, leftFirst) and
+// (max, count) with the integers stored as float bits.
+uniform samplerBuffer sphereData;
+uniform samplerBuffer bvhNodes;
+uniform int sphereCount;
+
+// Meshes, see Scene::addMesh. Triangles are three texels, (v0, material) (v1, -)
+// (v2, -); their shading records two RGBA32UI texels, (three octahedral
+// normals, flags) and (three half-float UVs, -). Triangles have a BVH of their
+// own in the same layout.
+uniform samplerBuffer triangleData;
+uniform usamplerBuffer triangleShading;
+uniform samplerBuffer triangleNodes;
+uniform int triangleCount;
+
+// Materials, shared by spheres and triangles and sorted by type, are two
+// texels, (albedo, type) and (emission, roughness, ior, texture); see Scene.h.
+// Spheres use their own albedo instead of the material's.
+uniform samplerBuffer materialData;
+
+#ifdef TEXTURES
+// One sRGB layer per texture, mipmapped; a material's texture is its layer
+uniform sampler2DArray textures;
+// Angle one pixel subtends at the camera: the spread of a primary ray cone
+uniform float pixelSpread;
+#endif
+
+#define MATERIAL_LAMBERTIAN 0
+#define MATERIAL_METAL 1
+#define MATERIAL_DIELECTRIC 2
+#define MATERIAL_EMISSIVE 3
+
+uniform float heatmapScale; // Cost shown as full red in HEATMAP mode
 
+#ifdef VISIBILITY_BUFFER
+// What Renderer's raster pass saw at each pixel's centre: 0 for nothing,
+// sphere index + 1, or triangle index + 1 with the top bit set
+uniform usampler2D visibility;
+// Set by main() for the camera ray and taken by the next hit()
+bool primaryPending = false;
+uint primaryId;
+// The ray goes through the pixel's centre, so the raster result is its hit
+bool primaryExact;
+#endif
 
 const float pi = 3.14159265359;
-const int num_samples = 100; // Number of samples per pixel
 
 struct Ray {
     vec3 origin;
@@ -22,30 +119,45 @@ struct Ray {
 
 struct HitRecord {
     vec3 hitPoint;
-    vec3 normal;
+    vec3 normal; // Faces back at the ray
     float t;
     bool hit;
+    bool frontFace; // The ray arrived from the outside of the surface
     vec3 materialColor; // Include material color here
+    int materialType;
+    float emission;
+    float roughness;
+    float ior;
+    vec2 uv; // Interpolated mesh UVs (barycentrics without them); on spheres only when textured
+    int texture; // Layer of the texture array, or -1
+    float lodBias; // Half log2 of UV area over world area, for the ray cone LOD
 };
 
 struct Sphere {
     vec3 center;
     float radius;
     vec3 materialColor; // Material color of the sphere
+    int material;
 };
 
-struct Hittable {
-    Sphere sphere;
-};
+uint rngState;
 
-struct HittableList {
-    Hittable hittables[2]; // Change the size according to the number of hittable objects
-    int size;
-};
+// Traversal counters for the current pixel, see TRAVERSAL_STATS and HEATMAP
+uint statNodes = 0u;
+uint statPrims = 0u;
+uint statRays = 0u;
+uint statBounces = 0u;
+
+// PCG hash, cheap and good enough for per-pixel sampling
+uint pcg_hash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
 
 float random_float() {
-    // Use a simple pseudo-random number generator
-    return fract(sin(gl_FragCoord.x * 12.9898 + gl_FragCoord.y * 78.233) * 43758.5453);
+    rngState = pcg_hash(rngState);
+    return float(rngState) / 4294967296.0;
 }
 
 // Function to calculate ray direction from camera through pixel
@@ -53,12 +165,12 @@ vec3 getRayDirection(vec2 uv, vec3 camPos, vec3 camDir, vec3 camUp, float fov, f
     vec3 w = normalize(camDir);
     vec3 u = normalize(cross(camUp, w));
     vec3 v = cross(w, u);
-    
+
     float tanFov = tan(radians(fov / 2.0));
     uv = uv * 2.0 - 1.0;
     uv.x *= aspectRatio * tanFov;
     uv.y *= tanFov;
-    
+
     return normalize(u * uv.x + v * uv.y + w);
 }
 
@@ -69,12 +181,12 @@ bool intersectSphere(vec3 ro, vec3 rd, Sphere sphere, out float t) {
     float b = 2.0 * dot(oc, rd);
     float c = dot(oc, oc) - sphere.radius * sphere.radius;
     float discriminant = b * b - 4 * a * c;
-    
+
     if (discriminant > 0.0) {
         float discSqrt = sqrt(discriminant);
         float t0 = (-b - discSqrt) / (2.0 * a);
         float t1 = (-b + discSqrt) / (2.0 * a);
-        
+
         if (t0 > 0.0 && t0 < t1) {
             t = t0;
             return true;
@@ -83,40 +195,305 @@ bool intersectSphere(vec3 ro, vec3 rd, Sphere sphere, out float t) {
             return true;
         }
     }
-    
+
     return false;
 }
 
-// Function to compute intersection with hittable objects
-bool hit(HittableList list, Ray r, out HitRecord rec) {
-    HitRecord tempRec;
-    bool hitAnything = false;
-    float closestSoFar = 100000.0; // Some large value
-    
-    for (int i = 0; i < list.size; ++i) {
-        if (intersectSphere(r.origin, r.direction, list.hittables[i].sphere, tempRec.t)) {
-            if (tempRec.t < closestSoFar) {
-                hitAnything = true;
-                closestSoFar = tempRec.t;
-                tempRec.hitPoint = r.origin + tempRec.t * r.direction;
-                tempRec.normal = normalize(tempRec.hitPoint - list.hittables[i].sphere.center);
-                tempRec.hit = true;
-                tempRec.materialColor = list.hittables[i].sphere.materialColor; // Assign material color
+// Per-ray constants of the watertight triangle test (Woop, Benthin and Wald
+// 2013): the ray's dominant axis kz and the shear that maps it onto +z
+struct RayShear {
+    int kx;
+    int ky;
+    int kz;
+    vec3 s;
+};
+
+RayShear rayShear(vec3 dir) {
+    RayShear shear;
+    vec3 a = abs(dir);
+    shear.kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    shear.kx = shear.kz == 2 ? 0 : shear.kz + 1;
+    shear.ky = shear.kx == 2 ? 0 : shear.kx + 1;
+    // Keeps the winding, so a hit always has edge functions of one sign
+    if (dir[shear.kz] < 0.0) {
+        int k = shear.kx;
+        shear.kx = shear.ky;
+        shear.ky = k;
+    }
+    shear.s = vec3(dir[shear.kx] / dir[shear.kz], dir[shear.ky] / dir[shear.kz], 1.0 / dir[shear.kz]);
+    return shear;
+}
+
+// Watertight ray/triangle test. The vertices are translated and sheared into
+// ray space and the 2D edge functions evaluated there; a shared edge gives
+// both triangles bit-identical values, so a ray through it hits at least one
+// of them. Edge functions of exactly zero count as inside (there is no
+// double-precision recheck in GLSL 3.30). bary weights v0, v1 and v2.
+bool intersectTriangle(Ray r, RayShear shear, int index, out float t, out vec3 bary) {
+    vec3 a = texelFetch(triangleData, index * 3).xyz - r.origin;
+    vec3 b = texelFetch(triangleData, index * 3 + 1).xyz - r.origin;
+    vec3 c = texelFetch(triangleData, index * 3 + 2).xyz - r.origin;
+    float ax = a[shear.kx] - shear.s.x * a[shear.kz];
+    float ay = a[shear.ky] - shear.s.y * a[shear.kz];
+    float bx = b[shear.kx] - shear.s.x * b[shear.kz];
+    float by = b[shear.ky] - shear.s.y * b[shear.kz];
+    float cx = c[shear.kx] - shear.s.x * c[shear.kz];
+    float cy = c[shear.ky] - shear.s.y * c[shear.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    t = 0.0;
+    bary = vec3(0.0);
+    if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+        return false;
+    float det = u + v + w;
+    if (det == 0.0)
+        return false;
+
+    float tScaled = u * (shear.s.z * a[shear.kz]) + v * (shear.s.z * b[shear.kz]) + w * (shear.s.z * c[shear.kz]);
+    t = tScaled / det;
+    bary = vec3(u, v, w) / det;
+    return t > 0.0;
+}
+
+// Packing::DecodeOctahedral
+float snorm16(uint bits) {
+    return max(float(int(bits << 16) >> 16) / 32767.0, -1.0);
+}
+
+vec3 octDecode(uint bits) {
+    vec2 e = vec2(snorm16(bits), snorm16(bits >> 16));
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+#ifdef GBUFFER
+// Packing::EncodeOctahedral before the snorm rounding, so in [-1, 1]
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    // The lower hemisphere folds over the diagonals
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+#endif
+
+// Packing::HalfToFloat for the low 16 bits; UVs are finite, so no inf or NaN
+float halfToFloat(uint bits) {
+    uint exponent = (bits >> 10) & 0x1fu;
+    float mantissa = float(bits & 0x3ffu);
+    float value = exponent == 0u ? mantissa * exp2(-24.0) : (1.0 + mantissa / 1024.0) * exp2(float(exponent) - 15.0);
+    return (bits & 0x8000u) != 0u ? -value : value;
+}
+
+vec2 halfDecode2(uint bits) {
+    return vec2(halfToFloat(bits & 0xffffu), halfToFloat(bits >> 16));
+}
+
+Sphere fetchSphere(int index) {
+    vec4 a = texelFetch(sphereData, index * 2);
+    vec4 b = texelFetch(sphereData, index * 2 + 1);
+    return Sphere(a.xyz, a.w, b.xyz, floatBitsToInt(b.w));
+}
+
+// Entry distance into a BVH node's box, or a huge value when it is missed
+float intersectNode(samplerBuffer nodes, int node, vec3 origin, vec3 invDir, float closest) {
+    COUNT(statNodes);
+    vec3 t1 = (texelFetch(nodes, node * 2).xyz - origin) * invDir;
+    vec3 t2 = (texelFetch(nodes, node * 2 + 1).xyz - origin) * invDir;
+    vec3 tNear = min(t1, t2);
+    vec3 tFar = max(t1, t2);
+    float tmin = max(max(tNear.x, tNear.y), tNear.z);
+    float tmax = min(min(tFar.x, tFar.y), tFar.z);
+    return tmax >= max(tmin, 0.0) && tmin < closest ? tmin : 1e30;
+}
+
+// Walks one hierarchy, the spheres' or the triangles', tightening closestSoFar.
+// Returns the nearest primitive hit, or -1, and its barycentrics for triangles.
+int traverse(samplerBuffer nodes, bool triangles, Ray r, vec3 invDir, RayShear shear, inout float closestSoFar, inout vec3 bary) {
+    int hitIndex = -1;
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = intersectNode(nodes, 0, r.origin, invDir, closestSoFar) < 1e30 ? 0 : -1;
+    while (node >= 0) {
+        vec4 lo = texelFetch(nodes, node * 2);
+        vec4 hi = texelFetch(nodes, node * 2 + 1);
+        int leftFirst = floatBitsToInt(lo.w);
+        int count = floatBitsToInt(hi.w);
+        if (count > 0) {
+            for (int i = leftFirst; i < leftFirst + count; ++i) {
+                COUNT(statPrims);
+                float t;
+                vec3 b = vec3(0.0);
+                bool found = triangles ? intersectTriangle(r, shear, i, t, b) : intersectSphere(r.origin, r.direction, fetchSphere(i), t);
+                if (found && t < closestSoFar) {
+                    closestSoFar = t;
+                    hitIndex = i;
+                    bary = b;
+                }
+            }
+        } else {
+            // Visit the nearer child first so the far one is often culled
+            int nearChild = leftFirst;
+            int farChild = leftFirst + 1;
+            float nearDist = intersectNode(nodes, nearChild, r.origin, invDir, closestSoFar);
+            float farDist = intersectNode(nodes, farChild, r.origin, invDir, closestSoFar);
+            if (nearDist > farDist) {
+                nearChild = leftFirst + 1;
+                farChild = leftFirst;
+                float d = nearDist; nearDist = farDist; farDist = d;
+            }
+            if (nearDist < 1e30) {
+                if (farDist < 1e30 && sp < BVH_STACK_SIZE)
+                    stack[sp++] = farChild;
+                node = nearChild;
+                continue;
             }
         }
+        node = sp > 0 ? stack[--sp] : -1;
     }
-    
-    rec = tempRec;
-    return hitAnything;
+    return hitIndex;
 }
 
-vec3 random_unit_vector() {
-    // Generate a random vector on the unit sphere
-    while (true) {
-        vec3 p = vec3(random_float(), random_float(), random_float()) * 2.0 - vec3(1.0);
-        if (length(p) < 1.0)
-            return normalize(p);
+// Function to compute the closest intersection, walking the spheres' BVH and
+// then the triangles' against the same closest distance
+bool hit(Ray r, out HitRecord rec) {
+    rec.hit = false;
+    COUNT(statRays);
+
+    vec3 invDir = 1.0 / r.direction;
+    float closestSoFar = 100000.0; // Some large value
+    vec3 bary = vec3(0.0);
+    int sphereIndex = -1;
+    int triangleIndex = -1;
+    bool traced = true;
+#ifdef VISIBILITY_BUFFER
+    // The rasterized primitive: taken as is for a ray through the pixel's
+    // centre, otherwise its distance only prunes the traversals below
+    int hintSphere = -1;
+    int hintTriangle = -1;
+    if (primaryPending) {
+        primaryPending = false;
+        if (primaryId == 0u && primaryExact)
+            return false;
+        float t;
+        vec3 b = vec3(0.0);
+        int index = int(primaryId & 0x7fffffffu) - 1;
+        bool triangle = (primaryId & 0x80000000u) != 0u;
+        if (primaryId != 0u && (triangle ? intersectTriangle(r, rayShear(r.direction), index, t, b)
+                : intersectSphere(r.origin, r.direction, fetchSphere(index), t)) && t < closestSoFar) {
+            closestSoFar = t;
+            bary = b;
+            hintSphere = triangle ? -1 : index;
+            hintTriangle = triangle ? index : -1;
+            traced = !primaryExact;
+        }
     }
+#endif
+    if (traced) {
+        if (sphereCount > 0)
+            sphereIndex = traverse(bvhNodes, false, r, invDir, RayShear(0, 0, 0, vec3(0.0)), closestSoFar, bary);
+        // Anything found here is closer than the sphere hit
+        if (triangleCount > 0)
+            triangleIndex = traverse(triangleNodes, true, r, invDir, rayShear(r.direction), closestSoFar, bary);
+    }
+#ifdef VISIBILITY_BUFFER
+    // Nothing closer turned up: the hint stands
+    if (sphereIndex < 0 && triangleIndex < 0) {
+        sphereIndex = hintSphere;
+        triangleIndex = hintTriangle;
+    }
+#endif
+
+    if (sphereIndex < 0 && triangleIndex < 0)
+        return false;
+
+    rec.t = closestSoFar;
+    rec.hitPoint = r.origin + closestSoFar * r.direction;
+    rec.hit = true;
+    int material;
+    if (triangleIndex >= 0) {
+        vec4 v0 = texelFetch(triangleData, triangleIndex * 3);
+        vec3 v1 = texelFetch(triangleData, triangleIndex * 3 + 1).xyz;
+        vec3 v2 = texelFetch(triangleData, triangleIndex * 3 + 2).xyz;
+        // Triangles are two-sided: face the normal back at the ray. The
+        // winding still tells a dielectric which side is its inside.
+        vec3 normal = normalize(cross(v1 - v0.xyz, v2 - v0.xyz));
+        rec.frontFace = dot(normal, r.direction) <= 0.0;
+        if (!rec.frontFace)
+            normal = -normal;
+
+        uvec4 s0 = texelFetch(triangleShading, triangleIndex * 2);
+        uvec4 s1 = texelFetch(triangleShading, triangleIndex * 2 + 1);
+        rec.normal = normal;
+        if ((s0.w & 1u) != 0u) {
+            vec3 shadingNormal = normalize(bary.x * octDecode(s0.x) + bary.y * octDecode(s0.y) + bary.z * octDecode(s0.z));
+            rec.normal = dot(shadingNormal, normal) < 0.0 ? -shadingNormal : shadingNormal;
+        }
+        rec.uv = (s0.w & 2u) != 0u ? bary.x * halfDecode2(s1.x) + bary.y * halfDecode2(s1.y) + bary.z * halfDecode2(s1.z) : bary.yz;
+
+        material = floatBitsToInt(v0.w);
+        rec.materialColor = texelFetch(materialData, material * 2).xyz;
+#ifdef TEXTURES
+        // Constant over the triangle: its area in UV space against world space.
+        // Barycentrics span a UV area of 1.
+        float uvArea = 1.0;
+        if ((s0.w & 2u) != 0u) {
+            vec2 t0 = halfDecode2(s1.x);
+            vec2 e1 = halfDecode2(s1.y) - t0;
+            vec2 e2 = halfDecode2(s1.z) - t0;
+            uvArea = abs(e1.x * e2.y - e1.y * e2.x);
+        }
+        rec.lodBias = 0.5 * log2(max(uvArea, 1e-20) / max(length(cross(v1 - v0.xyz, v2 - v0.xyz)), 1e-20));
+#endif
+    } else {
+        Sphere sphere = fetchSphere(sphereIndex);
+        vec3 outward = normalize(rec.hitPoint - sphere.center);
+        rec.frontFace = dot(outward, r.direction) <= 0.0;
+        rec.normal = rec.frontFace ? outward : -outward;
+        rec.materialColor = sphere.materialColor; // Assign material color
+        rec.uv = vec2(0.0);
+        material = sphere.material;
+#ifdef TEXTURES
+        // Longitude and latitude; the whole UV square covers 4 pi r^2
+        rec.uv = vec2(atan(outward.z, outward.x) / (2.0 * pi) + 0.5, asin(clamp(outward.y, -1.0, 1.0)) / pi + 0.5);
+        rec.lodBias = 0.5 * log2(1.0 / (4.0 * pi * sphere.radius * sphere.radius));
+#endif
+    }
+
+    rec.materialType = floatBitsToInt(texelFetch(materialData, material * 2).w);
+    vec4 parameters = texelFetch(materialData, material * 2 + 1);
+    rec.emission = parameters.x;
+    rec.roughness = parameters.y;
+    rec.ior = parameters.z;
+    rec.texture = floatBitsToInt(parameters.w);
+    return true;
+}
+
+#ifdef TEXTURES
+// Multiplies in the hit's texture. The ray cone reaching the hit is
+// coneWidth wide; its footprint grows as the surface turns away, and the
+// mip level is log2 of that footprint in texels.
+void applyTexture(inout HitRecord rec, vec3 direction, float coneWidth) {
+    if (rec.texture < 0)
+        return;
+    float size = float(textureSize(textures, 0).x);
+    float lod = rec.lodBias + log2(size) + log2(max(coneWidth, 1e-8)) - log2(max(abs(dot(rec.normal, direction)), 1e-3));
+    rec.materialColor *= textureLod(textures, vec3(rec.uv, float(rec.texture)), lod).rgb;
+}
+#endif
+
+vec3 random_unit_vector() {
+    // Uniform direction on the unit sphere
+    float z = random_float() * 2.0 - 1.0;
+    float phi = 2.0 * pi * random_float();
+    float r = sqrt(max(0.0, 1.0 - z * z));
+    return vec3(r * cos(phi), r * sin(phi), z);
 }
 
 vec3 random_on_hemisphere(const vec3 normal) {
@@ -129,90 +506,300 @@ vec3 random_on_hemisphere(const vec3 normal) {
     }
 }
 
-vec3 rayColorSingleSample(Ray r, HittableList list, vec3 bgStartColor, vec3 bgEndColor) {
+// Blue through green and yellow to red as t goes from 0 to 1
+vec3 heatmap(float t) {
+    t = clamp(t, 0.0, 1.0);
+    return clamp(vec3(1.5) - abs(4.0 * t - vec3(3.0, 2.0, 1.0)), 0.0, 1.0);
+}
+
+vec3 background(Ray r, vec3 bgStartColor, vec3 bgEndColor) {
+    vec3 unitDirection = normalize(r.direction);
+    float t = 0.5 * (unitDirection.y + 1.0);
+    return mix(bgStartColor, bgEndColor, t);
+}
+
+#if defined(SHADE_NORMALS)
+
+vec3 rayColor(Ray r, vec3 bgStartColor, vec3 bgEndColor) {
+    HitRecord rec;
+    if (hit(r, rec)) {
+        return 0.5 * (rec.normal + vec3(1.0));
+    }
+    return background(r, bgStartColor, bgEndColor);
+}
+
+#elif defined(SHADOW_RAY)
+
+vec3 rayColor(Ray r, vec3 bgStartColor, vec3 bgEndColor) {
     vec3 accumulatedColor = vec3(0.0);
 
     // Perform a single bounce
     HitRecord rec;
-    if (hit(list, r, rec)) {
+    if (hit(r, rec)) {
+        COUNT(statBounces);
+#ifdef TEXTURES
+        applyTexture(rec, r.direction, pixelSpread * rec.t);
+#endif
         vec3 normal = normalize(rec.normal);
 
         // Simulate light bounces by casting a shadow ray towards random directions
-        vec3 shadowDir = random_unit_vector();
+        vec3 shadowDir = random_on_hemisphere(normal);
         Ray shadowRay;
-        shadowRay.origin = rec.hitPoint;
+        shadowRay.origin = rec.hitPoint + 0.001 * normal;
         shadowRay.direction = shadowDir;
 
         // Check for shadow intersection
         HitRecord shadowRec;
-        bool shadowHit = hit(list, shadowRay, shadowRec);
+        bool shadowHit = hit(shadowRay, shadowRec);
 
         // If in shadow, return ambient color only, otherwise return the material color
-        if (shadowHit && shadowRec.t < length(shadowDir)) {
+        if (shadowHit) {
             accumulatedColor = ambientColor; // Ambient color or background color
         } else {
             accumulatedColor = rec.materialColor;
         }
     } else {
         // If the ray misses any objects, return the background gradient color
-        vec3 unitDirection = normalize(r.direction);
-        float t = 0.5 * (unitDirection.y + 1.0);
-        accumulatedColor = mix(bgStartColor, bgEndColor, t);
+        accumulatedColor = background(r, bgStartColor, bgEndColor);
     }
 
     return accumulatedColor;
 }
 
-vec3 rayColor(Ray r, HittableList list, vec3 bgStartColor, vec3 bgEndColor) {
-    vec3 accumulatedColor = vec3(0.0);
+#else
 
-    // Perform a fixed number of bounces
-    for (int bounce = 0; bounce < maxBounces; ++bounce) {
-        HitRecord rec;
-        if (hit(list, r, rec)) {
-            vec3 normal = normalize(rec.normal);
-            vec3 reflectDir = reflect(r.direction, normal);
+// Scatter functions, one per material type. Each picks the next direction for
+// a ray arriving along d at a surface with normal n (facing back at the ray)
+// and returns the throughput weight, the BSDF times the cosine over the
+// sampling pdf; false absorbs the path. Only the types in MATERIAL_TYPES are
+// compiled, so a scene pays for none of the others.
 
-            // Perturb the reflection direction within a cone to introduce roughness
-            float roughness = 0.1; // Adjust the roughness factor as needed
-            reflectDir = normalize(reflectDir + roughness * random_on_hemisphere(normal));
+#if (MATERIAL_TYPES & (1 << MATERIAL_LAMBERTIAN)) != 0
+// Cosine-weighted, so the weight is just the albedo
+bool scatterLambertian(HitRecord rec, vec3 d, out vec3 direction, out vec3 weight) {
+    vec3 n = rec.normal;
+    vec3 s = n + random_unit_vector();
+    direction = dot(s, s) > 1e-8 ? normalize(s) : n;
+    weight = rec.materialColor;
+    return true;
+}
+#endif
 
-            r.origin = rec.hitPoint + 0.001 * normal;
-            r.direction = reflectDir;
+#if (MATERIAL_TYPES & (1 << MATERIAL_METAL)) != 0
+// Smith masking for GGX, one direction
+float smithG1(float cosTheta, float alpha2) {
+    return 2.0 * cosTheta / (cosTheta + sqrt(alpha2 + (1.0 - alpha2) * cosTheta * cosTheta));
+}
 
-            // Accumulate material color with some attenuation factor
-            accumulatedColor += rec.materialColor * 0.5; // Adjust the attenuation factor as needed
-        } else {
+// GGX microfacet reflection: samples a half vector from the distribution and
+// reflects about it. With F0 = albedo (Schlick) the weight is
+// F * G * (v.h) / ((n.h) (n.v)).
+bool scatterMetal(HitRecord rec, vec3 d, out vec3 direction, out vec3 weight) {
+    vec3 n = rec.normal;
+    float alpha = max(rec.roughness * rec.roughness, 1e-4);
+    float alpha2 = alpha * alpha;
+    float u1 = random_float();
+    float u2 = random_float();
+    float phi = 2.0 * pi * u1;
+    float cosTheta = sqrt((1.0 - u2) / (1.0 + (alpha2 - 1.0) * u2));
+    float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+    vec3 t = normalize(cross(abs(n.x) > 0.5 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), n));
+    vec3 b = cross(n, t);
+    vec3 h = normalize(t * (sinTheta * cos(phi)) + b * (sinTheta * sin(phi)) + n * cosTheta);
+
+    direction = reflect(d, h);
+    weight = vec3(0.0);
+    float nDotL = dot(n, direction);
+    if (nDotL <= 0.0)
+        return false;
+    float nDotV = max(dot(n, -d), 1e-4);
+    float vDotH = max(dot(-d, h), 1e-4);
+    float nDotH = max(dot(n, h), 1e-4);
+    vec3 fresnel = rec.materialColor + (1.0 - rec.materialColor) * pow(1.0 - vDotH, 5.0);
+    weight = fresnel * (smithG1(nDotV, alpha2) * smithG1(nDotL, alpha2) * vDotH / (nDotH * nDotV));
+    return true;
+}
+#endif
+
+#if (MATERIAL_TYPES & (1 << MATERIAL_DIELECTRIC)) != 0
+// Smooth glass: reflects with the Schlick Fresnel probability (always under
+// total internal reflection), else refracts; albedo tints both
+bool scatterDielectric(HitRecord rec, vec3 d, out vec3 direction, out vec3 weight) {
+    vec3 n = rec.normal;
+    float eta = rec.frontFace ? 1.0 / rec.ior : rec.ior;
+    float cosI = min(dot(-d, n), 1.0);
+    float sinT2 = eta * eta * (1.0 - cosI * cosI);
+    float r0 = (1.0 - eta) / (1.0 + eta);
+    r0 *= r0;
+    float fresnel = r0 + (1.0 - r0) * pow(1.0 - cosI, 5.0);
+    if (sinT2 > 1.0 || random_float() < fresnel)
+        direction = reflect(d, n);
+    else
+        direction = refract(d, n, eta);
+    weight = rec.materialColor;
+    return true;
+}
+#endif
+
+vec3 rayColor(Ray r, vec3 bgStartColor, vec3 bgEndColor) {
+    vec3 accumulatedColor = vec3(0.0);
+    vec3 throughput = vec3(1.0);
+#ifdef TEXTURES
+    // Ray cone: width at the last hit and spread angle, widened by rough bounces
+    float coneWidth = 0.0;
+    float coneSpread = pixelSpread;
+#endif
+
+    // Perform a fixed number of bounces
+    for (int bounce = 0; bounce < MAX_BOUNCES; ++bounce) {
+        HitRecord rec;
+        if (!hit(r, rec)) {
             // If no intersection, return background color
-            vec3 unitDirection = normalize(r.direction);
-            float t = 0.5 * (unitDirection.y + 1.0);
-            accumulatedColor += mix(bgStartColor, bgEndColor, t);
+            accumulatedColor += throughput * background(r, bgStartColor, bgEndColor);
+#ifdef GBUFFER
+            if (bounce == 0) {
+                firstAlbedo = background(r, bgStartColor, bgEndColor);
+                firstNormal = -r.direction;
+            }
+#endif
             break; // Exit loop if no intersection
         }
+#ifdef TEXTURES
+        coneWidth += coneSpread * rec.t;
+        applyTexture(rec, r.direction, coneWidth);
+#endif
+#ifdef GBUFFER
+        if (bounce == 0) {
+            firstAlbedo = rec.materialColor;
+            firstNormal = rec.normal;
+        }
+#endif
+
+#if (MATERIAL_TYPES & (1 << MATERIAL_EMISSIVE)) != 0
+        // Lights end the path
+        if (rec.materialType == MATERIAL_EMISSIVE) {
+            accumulatedColor += throughput * rec.materialColor * rec.emission;
+            break;
+        }
+#endif
+
+        COUNT(statBounces);
+        vec3 direction;
+        vec3 weight;
+        bool scattered = false;
+        // Dispatch on the type ID; the table is sorted by type, so neighbouring
+        // pixels usually take the same branch
+        switch (rec.materialType) {
+#if (MATERIAL_TYPES & (1 << MATERIAL_LAMBERTIAN)) != 0
+        case MATERIAL_LAMBERTIAN:
+            scattered = scatterLambertian(rec, r.direction, direction, weight);
+            break;
+#endif
+#if (MATERIAL_TYPES & (1 << MATERIAL_METAL)) != 0
+        case MATERIAL_METAL:
+            scattered = scatterMetal(rec, r.direction, direction, weight);
+            break;
+#endif
+#if (MATERIAL_TYPES & (1 << MATERIAL_DIELECTRIC)) != 0
+        case MATERIAL_DIELECTRIC:
+            scattered = scatterDielectric(rec, r.direction, direction, weight);
+            break;
+#endif
+        default:
+            break;
+        }
+        if (!scattered)
+            break;
+#ifdef TEXTURES
+        // Diffuse bounces spread the cone to about a radian; glossy ones by alpha
+        if (rec.materialType == MATERIAL_LAMBERTIAN)
+            coneSpread += 1.0;
+        else if (rec.materialType == MATERIAL_METAL)
+            coneSpread += rec.roughness * rec.roughness;
+#endif
+
+        // Leave on the side the new direction points to: refraction goes through
+        r.origin = rec.hitPoint + 0.001 * (dot(direction, rec.normal) >= 0.0 ? rec.normal : -rec.normal);
+        r.direction = direction;
+        throughput *= weight;
     }
 
     return accumulatedColor;
 }
 
-
+#endif
 
 void main() {
-    Sphere sphere1 = Sphere(vec3(0.0, 0.0, -1.0), 0.5, vec3(0.1)); // Gray sphere
-    Sphere sphere2 = Sphere(vec3(0.0, -100.5, -1.0), 100.0, vec3(0.1)); // Gray sphere
-    HittableList list;
-    list.hittables[0] = Hittable(sphere1);
-    list.hittables[1] = Hittable(sphere2);
-    list.size = 2;
-   
-    Ray r;
-    r.origin = camPos;
-    r.direction = getRayDirection(gl_FragCoord.xy / vec2(800.0, 600.0), camPos, camDir, camUp, fov, aspectRatio);
-    
     vec3 bgStartColor = vec3(1.0, 1.0, 1.0); // White
     vec3 bgEndColor = vec3(0.5, 0.7, 1.0); // Light blue
-    
-    // Calculate ray color with light bounces
-    vec3 color = rayColor(r, list, bgStartColor, bgEndColor);
-    
-    FragColor = vec4(color, 1.0);
+
+    vec2 resolution = vec2(width, height);
+    uint pixelCount = uint(width) * uint(height);
+    // Pixel of the whole image, so a tile traces exactly what a full frame would there
+    vec2 pixel = gl_FragCoord.xy + tileOffset;
+    rngState = pcg_hash(uint(pixel.x) + uint(pixel.y) * uint(width) + uint(frameIndex) * pixelCount);
+
+    // Progressive frames jitter even at one sample so the edges converge too
+    bool jittered = NUM_SAMPLES > 1 || frameIndex > 0;
+#ifdef R2_SAMPLER
+    vec2 rotation = vec2(0.0);
+    if (jittered) {
+        rotation.x = random_float();
+        rotation.y = random_float();
+    }
+#endif
+
+    // Calculate ray color with light bounces, averaged over jittered samples
+    vec3 color = vec3(0.0);
+#ifdef GBUFFER
+    vec3 albedoSum = vec3(0.0);
+    vec3 normalSum = vec3(0.0);
+#endif
+    for (int s = 0; s < NUM_SAMPLES; ++s) {
+        vec2 jitter = vec2(0.0);
+        if (jittered) {
+#ifdef R2_SAMPLER
+            // R2 steps are 1/g and 1/g^2 for the plastic number g
+            jitter = fract(0.5 + vec2(0.7548776662, 0.5698402910) * float(frameIndex * NUM_SAMPLES + s) + rotation) - 0.5;
+#else
+            jitter.x = random_float();
+            jitter.y = random_float();
+            jitter -= 0.5;
+#endif
+        }
+
+        Ray r;
+        r.origin = camPos;
+        r.direction = getRayDirection((pixel + jitter) / resolution, camPos, camDir, camUp, fov, aspectRatio);
+#ifdef VISIBILITY_BUFFER
+        primaryPending = true;
+        primaryId = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+        primaryExact = !jittered;
+#endif
+
+        color += rayColor(r, bgStartColor, bgEndColor);
+#ifdef GBUFFER
+        albedoSum += firstAlbedo;
+        normalSum += firstNormal;
+#endif
+    }
+
+#ifdef HEATMAP
+    FragColor = vec4(heatmap(float(statNodes + statPrims) / float(NUM_SAMPLES) / heatmapScale), 1.0);
+#else
+    FragColor = vec4(color / float(NUM_SAMPLES), 1.0);
+#endif
+#ifdef TRAVERSAL_STATS
+    TraversalCounts = uvec4(statNodes, statPrims, statRays, statBounces);
+#endif
+#ifdef ACCUMULATE
+    float luminance = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
+    SquaredLuminance = vec4(luminance * luminance, 0.0, 0.0, 0.0);
+#endif
+#ifdef GBUFFER
+    Albedo = vec4(albedoSum / float(NUM_SAMPLES), 1.0);
+    // Samples with opposite normals cancel; the camera-facing one stands in
+    vec3 normal = dot(normalSum, normalSum) > 0.0 ? normalize(normalSum) : -normalize(camDir);
+    Normal = vec4(octEncode(normal) * 0.5 + 0.5, 0.0, 1.0);
+#endif
 }
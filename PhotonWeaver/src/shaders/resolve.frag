@@ -0,0 +1,15 @@
+#version 330 core
+// AccumulationTarget::resolve: the half precision sums of the last passes,
+// added into the float sums by blending
+layout(location = 0) out vec4 Sum;
+layout(location = 1) out vec4 SquaredLuminance;
+
+uniform sampler2D sums;
+uniform sampler2D squares;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    Sum = texelFetch(sums, pixel, 0);
+    SquaredLuminance = texelFetch(squares, pixel, 0);
+}
@@ -0,0 +1,56 @@
+#version 330 core
+// Writes the primitive seen at each pixel's centre, as default.frag's
+// VISIBILITY_BUFFER variant reads it: 0 for none, sphere index + 1, or
+// triangle index + 1 with the top bit set. Depth is distance along the view
+// axis over farPlane, in a float depth buffer, so near and far surfaces
+// resolve alike.
+layout(location = 0) out uint Primitive;
+
+uniform vec3 camPos;
+uniform vec3 camU;
+uniform vec3 camV;
+uniform vec3 camW;
+uniform float tanFov;
+uniform float aspectRatio;
+uniform float width;
+uniform float height;
+
+const float farPlane = 100000.0;
+
+#ifdef SPHERES
+uniform samplerBuffer sphereData;
+flat in int sphereIndex;
+
+// The camera ray through this pixel's centre, as in default.frag
+vec3 rayDirection() {
+    vec2 uv = gl_FragCoord.xy / vec2(width, height) * 2.0 - 1.0;
+    return normalize(camU * (uv.x * aspectRatio * tanFov) + camV * (uv.y * tanFov) + camW);
+}
+#else
+in float viewDepth;
+#endif
+
+void main()
+{
+#ifdef SPHERES
+    // The box only bounds the sphere; the sphere itself is hit analytically
+    vec4 sphere = texelFetch(sphereData, sphereIndex * 2);
+    vec3 rd = rayDirection();
+    vec3 oc = camPos - sphere.xyz;
+    float b = dot(oc, rd);
+    float c = dot(oc, oc) - sphere.w * sphere.w;
+    float discriminant = b * b - c;
+    if (discriminant <= 0.0)
+        discard;
+    float root = sqrt(discriminant);
+    // The far side when the camera is inside
+    float t = -b - root > 0.0 ? -b - root : -b + root;
+    if (t <= 0.0)
+        discard;
+    gl_FragDepth = t * dot(rd, camW) / farPlane;
+    Primitive = uint(sphereIndex) + 1u;
+#else
+    gl_FragDepth = viewDepth / farPlane;
+    Primitive = (uint(gl_PrimitiveID) + 1u) | 0x80000000u;
+#endif
+}
@@ -0,0 +1,49 @@
+#version 330 core
+// Renderer's visibility pass: scene triangles, or with SPHERES one box per
+// sphere (instanced), projected exactly as default.frag casts camera rays
+layout (location = 0) in vec4 aPos;
+
+uniform vec3 camPos;
+// Camera basis as in getRayDirection: right, up and forward
+uniform vec3 camU;
+uniform vec3 camV;
+uniform vec3 camW;
+uniform float tanFov; // Tangent of half the field of view
+uniform float aspectRatio;
+
+#ifdef SPHERES
+uniform samplerBuffer sphereData;
+flat out int sphereIndex;
+#else
+out float viewDepth; // Distance along camW, written as depth by the fragment shader
+#endif
+
+const float nearPlane = 1e-4;
+const float farPlane = 100000.0; // The tracer's largest hit distance
+
+vec4 project(vec3 p) {
+    vec3 d = p - camPos;
+    float z = dot(d, camW);
+    return vec4(dot(d, camU) / (aspectRatio * tanFov), dot(d, camV) / tanFov,
+        z * (farPlane + nearPlane) / (farPlane - nearPlane) - 2.0 * farPlane * nearPlane / (farPlane - nearPlane), z);
+}
+
+void main()
+{
+#ifdef SPHERES
+    // aPos is a corner of the unit box; the box around the sphere covers its outline
+    sphereIndex = gl_InstanceID;
+    vec4 sphere = texelFetch(sphereData, gl_InstanceID * 2);
+    vec3 offset = abs(camPos - sphere.xyz);
+    if (max(offset.x, max(offset.y, offset.z)) <= sphere.w * 1.001) {
+        // From inside the box it would be clipped away; its +z and -z faces cover the screen instead
+        gl_Position = vec4(aPos.xy, 0.0, 1.0);
+        return;
+    }
+    gl_Position = project(sphere.xyz + aPos.xyz * sphere.w * 1.001);
+#else
+    vec4 position = project(aPos.xyz);
+    viewDepth = position.w;
+    gl_Position = position;
+#endif
+}
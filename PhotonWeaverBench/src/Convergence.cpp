@@ -0,0 +1,204 @@
+#include "Convergence.h"
+#include "Accumulator.h"
+#include "CpuTracer.h"
+#include "ImageIO.h"
+#include "ImageMetrics.h"
+#include "Json.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace {
+
+struct Config {
+    std::string name;
+    CpuTracer::Sampler sampler = CpuTracer::Sampler::Pcg;
+    bool adaptive = false;
+};
+
+// The reference draws from its own RNG stream so it never shares samples with the measured runs
+const uint32_t referenceStream = 1;
+// Part of the cached reference's name; bump when the light transport or the sampling changes so stale references are not reused
+const int referenceVersion = 3;
+// Adaptive runs trace every pixel for this many passes before trusting the variance
+const uint32_t adaptiveWarmupPasses = 4;
+// ...and then every this many passes, so pixels that looked converged by luck get revisited
+const uint32_t adaptiveFullPassInterval = 8;
+const float adaptiveThreshold = 0.02f;
+
+bool parseConfig(const std::string& name, Config& config)
+{
+    config.name = name;
+    if (name == "pcg" || name == "pcg-adaptive")
+        config.sampler = CpuTracer::Sampler::Pcg;
+    else if (name == "r2" || name == "r2-adaptive")
+        config.sampler = CpuTracer::Sampler::R2;
+    else
+        return false;
+    config.adaptive = name.size() > 9 && name.compare(name.size() - 9, 9, "-adaptive") == 0;
+    return true;
+}
+
+bool loadReference(const Scene& scene, const Convergence::Options& options, std::vector<glm::vec4>& reference)
+{
+    std::filesystem::path path = options.referenceDir / (scene.name + "_" + std::to_string(options.width) + "x" + std::to_string(options.height)
+        + "_b" + std::to_string(options.maxBounces) + "_" + std::to_string(options.referenceSpp) + "spp_v" + std::to_string(referenceVersion) + ".exr");
+
+    int width = 0, height = 0;
+    std::string error;
+    if (ImageIO::ReadExr(path, width, height, reference, error) && width == options.width && height == options.height) {
+        std::cout << "Reference " << path.string() << " (cached)" << std::endl;
+        return true;
+    }
+
+    std::cout << "Rendering reference at " << options.referenceSpp << " spp..." << std::flush;
+    auto start = std::chrono::steady_clock::now();
+    CpuTracer tracer;
+    tracer.settings.maxBounces = options.maxBounces;
+    tracer.settings.stream = referenceStream;
+    Accumulator accumulator;
+    accumulator.resize(options.width, options.height);
+    std::vector<glm::vec4> pixels;
+    for (int pass = 0; pass < options.referenceSpp; ++pass) {
+        tracer.settings.frameIndex = pass;
+        tracer.render(scene, scene.camera, options.width, options.height, pixels);
+        accumulator.add(pixels);
+    }
+    accumulator.resolve(reference);
+    std::cout << " " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+
+    std::error_code ignored;
+    std::filesystem::create_directories(options.referenceDir, ignored);
+    if (ImageIO::WriteExr(path, options.width, options.height, reference))
+        std::cout << "Reference cached in " << path.string() << std::endl;
+    return true;
+}
+
+Json runConfig(const Scene& scene, const Config& config, const Convergence::Options& options, const std::vector<glm::vec4>& reference)
+{
+    CpuTracer tracer;
+    tracer.settings.maxBounces = options.maxBounces;
+    tracer.settings.sampler = config.sampler;
+
+    Accumulator accumulator;
+    accumulator.resize(options.width, options.height);
+    std::vector<glm::vec4> pixels, resolved;
+    std::vector<uint8_t> mask;
+
+    Json curve = Json::array();
+    Json timeToTarget;
+    ImageMetrics::Error last;
+    double renderMs = 0.0;
+    uint32_t nextEvaluation = 1;
+
+    // Only rendering, accumulation and mask building count against the budget;
+    // the error evaluation is bookkeeping and runs with the clock stopped
+    for (uint32_t pass = 0; renderMs < options.budgetMs; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        const std::vector<uint8_t>* activeMask = nullptr;
+        if (config.adaptive && pass >= adaptiveWarmupPasses && pass % adaptiveFullPassInterval != 0) {
+            if (accumulator.buildMask(adaptiveThreshold, mask) == 0)
+                std::fill(mask.begin(), mask.end(), 1);
+            activeMask = &mask;
+        }
+        tracer.settings.frameIndex = pass;
+        tracer.render(scene, scene.camera, options.width, options.height, pixels, activeMask);
+        accumulator.add(pixels, activeMask);
+        renderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Roughly logarithmic sampling of the curve, plus the final state
+        bool done = renderMs >= options.budgetMs;
+        if (pass + 1 < nextEvaluation && !done)
+            continue;
+        nextEvaluation = std::max(pass + 2, static_cast<uint32_t>((pass + 1) * 1.25f));
+
+        accumulator.resolve(resolved);
+        last = ImageMetrics::Compare(resolved, reference, options.width, options.height);
+        double spp = static_cast<double>(accumulator.totalSamples()) / (static_cast<double>(options.width) * options.height);
+
+        Json point = Json::object();
+        point.set("ms", renderMs);
+        point.set("spp", spp);
+        point.set("rmse", last.rmse);
+        point.set("relMse", last.relMse);
+        point.set("flip", last.flip);
+        curve.push(point);
+
+        if (timeToTarget.isNull() && last.rmse <= options.targetRmse)
+            timeToTarget = Json(renderMs);
+    }
+
+    std::cout << "  " << std::left << std::setw(14) << config.name << std::right << std::fixed << std::setprecision(4)
+        << "rmse " << last.rmse << "  relMSE " << last.relMse << "  flip " << last.flip << "  target ";
+    if (timeToTarget.isNull())
+        std::cout << "not reached";
+    else
+        std::cout << std::setprecision(0) << timeToTarget.asNumber() << " ms";
+    std::cout << std::defaultfloat << std::endl;
+
+    Json result = Json::object();
+    result.set("name", config.name);
+    result.set("sampler", config.sampler == CpuTracer::Sampler::R2 ? "r2" : "pcg");
+    result.set("adaptive", config.adaptive);
+    result.set("timeToTargetMs", timeToTarget);
+    result.set("finalRmse", last.rmse);
+    result.set("finalRelMse", last.relMse);
+    result.set("finalFlip", last.flip);
+    result.set("curve", curve);
+    return result;
+}
+
+}
+
+std::vector<std::string> Convergence::ConfigNames()
+{
+    return { "pcg", "r2", "pcg-adaptive", "r2-adaptive" };
+}
+
+int Convergence::Run(const Options& options)
+{
+    std::vector<Config> configs;
+    for (const std::string& name : options.configs) {
+        Config config;
+        if (!parseConfig(name, config)) {
+            std::cerr << "ERROR::CONVERGENCE::UNKNOWN_CONFIG: " << name << std::endl;
+            return 2;
+        }
+        configs.push_back(config);
+    }
+
+    Scene scene;
+    if (!Scene::Builtin(options.scene, scene)) {
+        std::cerr << "ERROR::CONVERGENCE::UNKNOWN_SCENE: " << options.scene << std::endl;
+        return 2;
+    }
+    scene.buildBVH();
+
+    std::vector<glm::vec4> reference;
+    loadReference(scene, options, reference);
+
+    std::cout << "Convergence on " << scene.name << " " << options.width << "x" << options.height << ", "
+        << options.budgetMs << " ms per configuration, target RMSE " << options.targetRmse << std::endl;
+
+    Json results = Json::object();
+    results.set("version", 1);
+    results.set("scene", scene.name);
+    results.set("width", options.width);
+    results.set("height", options.height);
+    results.set("maxBounces", options.maxBounces);
+    results.set("referenceSpp", options.referenceSpp);
+    results.set("budgetMs", options.budgetMs);
+    results.set("targetRmse", options.targetRmse);
+    Json& list = results.set("configs", Json::array());
+    for (const Config& config : configs)
+        list.push(runConfig(scene, config, options, reference));
+
+    if (!results.save(options.outPath)) {
+        std::cerr << "ERROR::CONVERGENCE::FILE_NOT_WRITTEN: " << options.outPath << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << options.outPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include "pch.h"
+
+#include <vector>
+
+// Time-to-quality benchmark. A high-spp reference is rendered once per scene,
+// resolution and bounce count and cached as EXR; each sampler configuration
+// then renders progressively on the CPU tracer for a fixed wall-clock budget,
+// and its error against the reference is recorded as a curve over time.
+class Convergence
+{
+public:
+	struct Options {
+		std::string scene = "cornell";
+		int width = 320;
+		int height = 180;
+		int maxBounces = 5;
+		int referenceSpp = 1024;
+		double budgetMs = 4000.0;
+		// The reported time to quality is when RMSE first drops to this
+		double targetRmse = 0.05;
+		std::vector<std::string> configs = { "pcg", "r2", "pcg-adaptive", "r2-adaptive" };
+		std::string outPath = "convergence.json";
+		std::filesystem::path referenceDir = "bench_reference";
+	};
+
+	// Returns the process exit code
+	static int Run(const Options& options);
+
+	static std::vector<std::string> ConfigNames();
+};
+
+#endif // CONVERGENCE_H
@@ -0,0 +1,166 @@
+#include "Formats.h"
+#include "AccumulationTarget.h"
+#include "GBuffer.h"
+#include "ImageMetrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+namespace {
+
+// Memory figures are given for a 4K frame, whatever size was measured
+const double pixels4k = 3840.0 * 2160.0;
+
+double mbAt4k(size_t bytesPerPixel)
+{
+    return bytesPerPixel * pixels4k / (1024.0 * 1024.0);
+}
+
+// The accumulated mean (sum over count) of every pixel
+bool accumulate(Renderer& renderer, Shader& shader, const SceneCamera& camera, int width, int height, AccumulationTarget::Storage storage,
+    const Formats::Options& options, std::vector<glm::vec4>& mean, double& msPerPass, int& resolves)
+{
+    AccumulationTarget target;
+    target.resolveInterval = options.resolveInterval;
+    std::string error;
+    if (!target.create(storage, width, height, nullptr, nullptr, error)) {
+        std::cerr << "ERROR::FORMATS::NO_TARGET: " << error << std::endl;
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_BLEND);
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < options.passes; ++pass) {
+        target.bindPass();
+        renderer.draw(shader, camera, width, height, pass);
+        target.endPass();
+    }
+    target.resolve();
+    glFinish();
+    msPerPass = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.passes;
+    resolves = target.resolves();
+
+    mean.resize(static_cast<size_t>(width) * height);
+    target.bindSums();
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, mean.data());
+    glDisable(GL_BLEND);
+    target.Delete();
+    for (glm::vec4& pixel : mean)
+        pixel = glm::vec4(glm::vec3(pixel) / std::max(pixel.a, 1.0f), 1.0f);
+    return true;
+}
+
+double maxDifference(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference)
+{
+    double worst = 0.0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        glm::vec3 difference = glm::abs(glm::vec3(image[i]) - glm::vec3(reference[i]));
+        worst = std::max(worst, static_cast<double>(std::max(difference.x, std::max(difference.y, difference.z))));
+    }
+    return worst;
+}
+
+}
+
+Json Formats::Measure(Renderer& renderer, ShaderVariants& shaders, const std::string& scene, const SceneCamera& camera,
+    int width, int height, const Options& options)
+{
+    Json result = Json::object();
+    result.set("scene", scene);
+    Json& accumulation = result.set("accumulation", Json::array());
+
+    ShaderVariantKey key = ShaderVariantKey()
+        .set("MAX_BOUNCES", options.maxBounces)
+        .set("NUM_SAMPLES", 1);
+    Shader& accumulating = shaders.get(renderer.variant(ShaderVariantKey(key).set("ACCUMULATE", true)));
+    const AccumulationTarget::Storage storages[] = {
+        AccumulationTarget::Storage::Float32, AccumulationTarget::Storage::Float16, AccumulationTarget::Storage::Float16Resolved,
+    };
+    std::vector<glm::vec4> reference;
+    for (AccumulationTarget::Storage storage : storages) {
+        std::vector<glm::vec4> mean;
+        double msPerPass = 0.0;
+        int resolves = 0;
+        if (!accumulate(renderer, accumulating, camera, width, height, storage, options, mean, msPerPass, resolves))
+            continue;
+        // The first storage is float32, the reference for the others
+        if (reference.empty())
+            reference = mean;
+        ImageMetrics::Error error = ImageMetrics::Compare(mean, reference, width, height);
+        double maxError = maxDifference(mean, reference);
+
+        Json entry = Json::object();
+        entry.set("storage", AccumulationTarget::StorageName(storage));
+        entry.set("bytesPerPixel", AccumulationTarget::BytesPerPixel(storage));
+        entry.set("mbAt4k", mbAt4k(AccumulationTarget::BytesPerPixel(storage)));
+        entry.set("passMbAt4k", mbAt4k(AccumulationTarget::PassBytesPerPixel(storage)));
+        entry.set("resolves", resolves);
+        entry.set("msPerPass", msPerPass);
+        entry.set("rmse", error.rmse);
+        entry.set("relMse", error.relMse);
+        entry.set("flip", error.flip);
+        entry.set("maxError", maxError);
+        accumulation.push(entry);
+        std::cout << std::fixed << std::setprecision(2)
+            << "  " << std::left << std::setw(14) << scene << std::setw(16) << AccumulationTarget::StorageName(storage) << std::right
+            << std::setw(8) << mbAt4k(AccumulationTarget::BytesPerPixel(storage)) << " MB at 4K"
+            << std::setw(8) << mbAt4k(AccumulationTarget::PassBytesPerPixel(storage)) << " MB blended/pass"
+            << std::setw(9) << msPerPass << " ms/pass" << std::scientific << std::setprecision(2)
+            << std::setw(11) << error.rmse << " RMSE" << std::setw(11) << maxError << " max" << std::defaultfloat << std::endl;
+    }
+
+    // Guides are drawn once, through pixel centres, so both formats see the same values
+    Json& guides = result.set("gbuffer", Json::array());
+    Shader& gbufferShader = shaders.get(renderer.variant(ShaderVariantKey(key).set("GBUFFER", true)));
+    std::vector<glm::vec3> referenceAlbedo, referenceNormals;
+    for (GBuffer::Format format : { GBuffer::Format::Float32, GBuffer::Format::Packed }) {
+        GBuffer gbuffer;
+        std::string error;
+        if (!gbuffer.create(format, width, height, error)) {
+            std::cerr << "ERROR::FORMATS::NO_GBUFFER: " << error << std::endl;
+            continue;
+        }
+        gbuffer.draw(renderer, gbufferShader, camera);
+        std::vector<glm::vec3> albedo, normals;
+        gbuffer.read(albedo, normals);
+        gbuffer.Delete();
+        if (referenceAlbedo.empty()) {
+            referenceAlbedo = albedo;
+            referenceNormals = normals;
+        }
+
+        double albedoSquares = 0.0, albedoMax = 0.0, angleSum = 0.0, angleMax = 0.0;
+        for (size_t i = 0; i < albedo.size(); ++i) {
+            glm::vec3 difference = glm::abs(albedo[i] - referenceAlbedo[i]);
+            albedoSquares += glm::dot(difference, difference) / 3.0;
+            albedoMax = std::max(albedoMax, static_cast<double>(std::max(difference.x, std::max(difference.y, difference.z))));
+            // acos loses small angles to rounding; atan2 keeps them
+            glm::dvec3 normal(normals[i]), referenceNormal(referenceNormals[i]);
+            double angle = glm::degrees(std::atan2(glm::length(glm::cross(normal, referenceNormal)), glm::dot(normal, referenceNormal)));
+            angleSum += angle;
+            angleMax = std::max(angleMax, angle);
+        }
+        double albedoRmse = std::sqrt(albedoSquares / albedo.size());
+
+        Json entry = Json::object();
+        entry.set("format", GBuffer::FormatName(format));
+        entry.set("bytesPerPixel", GBuffer::BytesPerPixel(format));
+        entry.set("mbAt4k", mbAt4k(GBuffer::BytesPerPixel(format)));
+        entry.set("albedoRmse", albedoRmse);
+        entry.set("albedoMaxError", albedoMax);
+        entry.set("normalMeanDegrees", angleSum / albedo.size());
+        entry.set("normalMaxDegrees", angleMax);
+        guides.push(entry);
+        std::cout << std::fixed << std::setprecision(2)
+            << "  " << std::left << std::setw(14) << scene << std::setw(16) << (std::string("gbuffer-") + GBuffer::FormatName(format)) << std::right
+            << std::setw(8) << mbAt4k(GBuffer::BytesPerPixel(format)) << " MB at 4K" << std::scientific << std::setprecision(2)
+            << std::setw(11) << albedoRmse << " albedo RMSE" << std::setw(11) << albedoMax << " max"
+            << std::setw(11) << angleMax << " deg normal max" << std::defaultfloat << std::endl;
+    }
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef FORMATS_H
+#define FORMATS_H
+
+#include "pch.h"
+#include "Json.h"
+#include "Renderer.h"
+#include "ShaderVariants.h"
+
+// Storage format benchmark. The GL tracer accumulates the same passes in
+// every AccumulationTarget storage and draws the G-buffer in both GBuffer
+// formats. Each format's loss against the float32 result is recorded along
+// with the memory and blend traffic it costs at 4K.
+class Formats
+{
+public:
+	struct Options {
+		int passes = 256;
+		int resolveInterval = 16;
+		int maxBounces = 5;
+		std::string outPath = "formats.json";
+	};
+
+	// One scene's entry, for the scene uploaded to renderer; prints a line per format
+	static Json Measure(Renderer& renderer, ShaderVariants& shaders, const std::string& scene, const SceneCamera& camera,
+		int width, int height, const Options& options);
+};
+
+#endif // FORMATS_H
@@ -0,0 +1,697 @@
+#include "pch.h"
+#include "ClusterCache.h"
+#include "ClusterFile.h"
+#include "CompiledScene.h"
+#include "Convergence.h"
+#include "Formats.h"
+#include "CpuTracer.h"
+#include "GLObject.h"
+#include "GpuProfiler.h"
+#include "Json.h"
+#include "MeshLoader.h"
+#include "Renderer.h"
+#include "RenderTargetPool.h"
+#include "Scene.h"
+#include "ShaderVariants.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// photonweaver_bench: renders canned scenes along a fixed camera path on the
+// CPU tracer and on the GL tracer (an offscreen float target, so llvmpipe in a
+// headless session works too), writes the numbers as JSON and compares them
+// with a stored baseline. Any metric outside the tolerance fails the run.
+
+namespace {
+
+struct Options {
+	std::vector<std::string> scenes = Scene::BuiltinNames();
+	bool cpu = true;
+	bool gl = true;
+	int width = 640;
+	int height = 360;
+	int warmup = 2;
+	int frames = 8;
+	int maxBounces = 5;
+	int samples = 1;
+	std::string outPath = "bench_results.json";
+	std::string baselinePath = "bench_baseline.json";
+	double tolerance = 0.10;
+	bool writeBaseline = false;
+	bool converge = false;
+	Convergence::Options convergence;
+	bool formats = false;
+	Formats::Options formatsOptions;
+	// Adds a "stream" CPU run from a cluster file under this cache budget; 0 skips it
+	double streamBudgetMb = 0.0;
+	uint32_t clusterKb = 64;
+	std::string meshPath;
+};
+
+struct Result {
+	std::string scene;
+	std::string backend;
+	size_t spheres = 0;
+	size_t triangles = 0;
+	// Both hierarchies together
+	size_t bvhNodes = 0;
+	int bvhDepth = 0;
+	double bvhBuildMs = 0.0;
+	double msPerFrame = 0.0;
+	double minMs = 0.0;
+	double gpuMs = 0.0;
+	double mraysPerSec = 0.0;
+	// False when only primary rays could be counted
+	bool raysExact = false;
+	double nodesPerRay = 0.0;
+	double primsPerRay = 0.0;
+	double peakRssMb = 0.0;
+	// Streamed runs only, per frame
+	double cacheHitRate = 0.0;
+	double ioStallMs = 0.0;
+	double clusterMbRead = 0.0;
+};
+
+// Process-wide peak, so backends and scenes run from smallest to largest
+double peakRssMb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	return 0.0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+	return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+float pathPosition(const Options& options, int frame)
+{
+	// Warm-up frames sit at the start of the path; measured frames sweep it
+	return options.frames > 1 ? static_cast<float>(std::max(frame, 0)) / (options.frames - 1) : 0.0f;
+}
+
+void fillScene(Result& result, const Scene& scene)
+{
+	result.scene = scene.name;
+	result.spheres = scene.spheres.size();
+	result.triangles = scene.triangles.size();
+	result.bvhNodes = scene.bvh.nodes.size() + scene.triangleBvh.nodes.size();
+	result.bvhDepth = std::max(scene.bvh.depth, scene.triangleBvh.depth);
+	result.bvhBuildMs = scene.bvhBuildMs();
+}
+
+Result runCpu(const Scene& scene, const Options& options)
+{
+	CpuTracer tracer;
+	tracer.settings.maxBounces = options.maxBounces;
+	tracer.settings.samples = options.samples;
+
+	std::vector<glm::vec4> pixels;
+	for (int i = 0; i < options.warmup; ++i)
+		tracer.render(scene, scene.orbit(0.0f), options.width, options.height, pixels);
+
+	Result result;
+	fillScene(result, scene);
+	result.backend = "cpu";
+	result.raysExact = true;
+	result.minMs = 1e30;
+
+	TraversalStats traversal;
+	double totalMs = 0.0;
+	for (int i = 0; i < options.frames; ++i) {
+		CpuTracer::Stats stats = tracer.render(scene, scene.orbit(pathPosition(options, i)), options.width, options.height, pixels);
+		traversal.add(stats.traversal);
+		totalMs += stats.ms;
+		result.minMs = std::min(result.minMs, stats.ms);
+	}
+
+	result.msPerFrame = totalMs / options.frames;
+	result.mraysPerSec = traversal.rays / (totalMs * 1000.0);
+	result.nodesPerRay = traversal.nodesPerRay();
+	result.primsPerRay = traversal.primsPerRay();
+	result.peakRssMb = peakRssMb();
+	return result;
+}
+
+// The CPU tracer on the scene cut into clusters on disk, read through an LRU
+// cache with the given budget. Warm-up frames leave the cache warm, as it
+// would be in a viewer.
+Result runStreamed(const Scene& scene, const Options& options)
+{
+	Result result;
+	fillScene(result, scene);
+	result.backend = "stream";
+	result.raysExact = true;
+
+	std::error_code ec;
+	std::filesystem::path directory = std::filesystem::current_path() / "scenecache";
+	std::filesystem::create_directories(directory, ec);
+	std::filesystem::path path = directory / (scene.name + ".pwclusters");
+	ClusterFile file;
+	std::string error;
+	if (!ClusterFile::Write(scene, path, error, options.clusterKb * 1024) || !file.open(path, error)) {
+		std::cerr << "ERROR::BENCH::NO_CLUSTER_FILE: " << error << std::endl;
+		return result;
+	}
+	ClusterCache cache(file, static_cast<size_t>(options.streamBudgetMb * 1024.0 * 1024.0));
+
+	CpuTracer tracer;
+	tracer.settings.maxBounces = options.maxBounces;
+	tracer.settings.samples = options.samples;
+	std::vector<glm::vec4> pixels;
+	for (int i = 0; i < options.warmup; ++i)
+		tracer.render(cache, scene.orbit(0.0f), options.width, options.height, pixels);
+
+	TraversalStats traversal;
+	ClusterCache::Stats streaming;
+	double totalMs = 0.0;
+	result.minMs = 1e30;
+	for (int i = 0; i < options.frames; ++i) {
+		CpuTracer::Stats stats = tracer.render(cache, scene.orbit(pathPosition(options, i)), options.width, options.height, pixels);
+		traversal.add(stats.traversal);
+		streaming.add(stats.streaming);
+		totalMs += stats.ms;
+		result.minMs = std::min(result.minMs, stats.ms);
+	}
+
+	result.msPerFrame = totalMs / options.frames;
+	result.mraysPerSec = traversal.rays / (totalMs * 1000.0);
+	result.nodesPerRay = traversal.nodesPerRay();
+	result.primsPerRay = traversal.primsPerRay();
+	result.cacheHitRate = streaming.hitRate();
+	result.ioStallMs = streaming.stallMs / options.frames;
+	result.clusterMbRead = streaming.bytesRead / (1024.0 * 1024.0) / options.frames;
+	result.peakRssMb = peakRssMb();
+	std::cout << "  " << scene.name << ": " << file.clusterCount() << " clusters, " << file.geometryBytes() / (1024.0 * 1024.0)
+		<< " MB on disk, cache budget " << options.streamBudgetMb << " MB" << std::endl;
+	return result;
+}
+
+class GlBackend
+{
+public:
+	bool init(const Options& options)
+	{
+		if (!glfwInit()) {
+			std::cerr << "ERROR::BENCH::GLFW_INIT_FAILED" << std::endl;
+			return false;
+		}
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(64, 64, "photonweaver_bench", NULL, NULL);
+		if (!window) {
+			std::cerr << "ERROR::BENCH::NO_GL_CONTEXT" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(window);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			std::cerr << "ERROR::BENCH::GLAD_INIT_FAILED" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		std::cout << "GL renderer: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+		// Render into a float target of the requested size, never the window
+		colorTexture = GLTexture::Create();
+		glBindTexture(GL_TEXTURE_2D, colorTexture.get());
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, options.width, options.height, 0, GL_RGBA, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		framebuffer = GLFramebuffer::Create();
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture.get(), 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "ERROR::BENCH::FRAMEBUFFER_INCOMPLETE" << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			framebuffer.reset();
+			colorTexture.reset();
+			glfwTerminate();
+			window = nullptr;
+			return false;
+		}
+		glViewport(0, 0, options.width, options.height);
+
+		renderer = std::make_unique<Renderer>();
+		shaders = std::make_unique<ShaderVariants>(Renderer::ShaderPath("default.vert"), Renderer::ShaderPath("default.frag"));
+		return true;
+	}
+
+	Result run(const Scene& scene, const Options& options)
+	{
+		renderer->upload(scene);
+		ShaderVariantKey key = ShaderVariantKey()
+			.set("MAX_BOUNCES", options.maxBounces)
+			.set("NUM_SAMPLES", options.samples);
+		// Compiling (or loading from the binary cache) is not part of the measurement
+		Shader& shader = shaders->get(renderer->variant(key));
+
+		for (int i = 0; i < options.warmup; ++i)
+			renderer->draw(shader, scene.orbit(0.0f), options.width, options.height);
+		glFinish();
+
+		Result result;
+		fillScene(result, scene);
+		result.backend = "gl";
+		result.minMs = 1e30;
+
+		double totalMs = 0.0;
+		GpuProfiler sceneProfiler(options.frames);
+		for (int i = 0; i < options.frames; ++i) {
+			sceneProfiler.beginFrame();
+			auto start = std::chrono::steady_clock::now();
+			sceneProfiler.begin("trace");
+			renderer->draw(shader, scene.orbit(pathPosition(options, i)), options.width, options.height);
+			sceneProfiler.end();
+			// glFinish makes the wall clock cover the whole frame, not just its submission
+			glFinish();
+			double ms = elapsedMs(start);
+			totalMs += ms;
+			result.minMs = std::min(result.minMs, ms);
+		}
+		sceneProfiler.beginFrame();
+		for (const GpuProfiler::PassStats& pass : sceneProfiler.stats())
+			result.gpuMs = pass.avgMs;
+		sceneProfiler.Delete();
+
+		// The counters cost a second render target and a readback, so the same
+		// frames are traced again untimed to count every ray the timed ones cast
+		TraversalStats traversal;
+		renderer->setStatsEnabled(true);
+		Shader& countingShader = shaders->get(renderer->variant(key));
+		for (int i = 0; i < options.frames; ++i) {
+			renderer->draw(countingShader, scene.orbit(pathPosition(options, i)), options.width, options.height);
+			traversal.add(renderer->lastStats());
+		}
+		renderer->setStatsEnabled(false);
+
+		result.msPerFrame = totalMs / options.frames;
+		result.raysExact = traversal.rays > 0;
+		if (result.raysExact)
+			result.mraysPerSec = traversal.rays / (totalMs * 1000.0);
+		else
+			result.mraysPerSec = static_cast<double>(options.width) * options.height * options.samples * options.frames / (totalMs * 1000.0);
+		result.nodesPerRay = traversal.nodesPerRay();
+		result.primsPerRay = traversal.primsPerRay();
+		result.peakRssMb = peakRssMb();
+		return result;
+	}
+
+	// Storage formats on this scene, from the first camera of the path
+	Json runFormats(const Scene& scene, const Options& options)
+	{
+		renderer->upload(scene);
+		Json result = Formats::Measure(*renderer, *shaders, scene.name, scene.orbit(0.0f), options.width, options.height, options.formatsOptions);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+		return result;
+	}
+
+	void shutdown()
+	{
+		if (!window)
+			return;
+		shaders->Delete();
+		renderer->Delete();
+		// The renderer's targets come from the pool, which would otherwise free them after glfwTerminate
+		RenderTargetPool::Instance().Delete();
+		framebuffer.reset();
+		colorTexture.reset();
+		glfwTerminate();
+		window = nullptr;
+	}
+
+private:
+	GLFWwindow* window = nullptr;
+	GLFramebuffer framebuffer;
+	GLTexture colorTexture;
+	std::unique_ptr<Renderer> renderer;
+	std::unique_ptr<ShaderVariants> shaders;
+};
+
+Json toJson(const Result& result)
+{
+	Json json = Json::object();
+	json.set("scene", result.scene);
+	json.set("backend", result.backend);
+	json.set("spheres", result.spheres);
+	json.set("triangles", result.triangles);
+	json.set("bvhNodes", result.bvhNodes);
+	json.set("bvhDepth", result.bvhDepth);
+	json.set("bvhBuildMs", result.bvhBuildMs);
+	json.set("msPerFrame", result.msPerFrame);
+	json.set("minMs", result.minMs);
+	json.set("gpuMs", result.gpuMs);
+	json.set("mraysPerSec", result.mraysPerSec);
+	json.set("raysExact", result.raysExact);
+	json.set("nodesPerRay", result.nodesPerRay);
+	json.set("primsPerRay", result.primsPerRay);
+	json.set("peakRssMb", result.peakRssMb);
+	if (result.backend == "stream") {
+		json.set("cacheHitRate", result.cacheHitRate);
+		json.set("ioStallMs", result.ioStallMs);
+		json.set("clusterMbRead", result.clusterMbRead);
+	}
+	return json;
+}
+
+Json settingsJson(const Options& options)
+{
+	Json json = Json::object();
+	json.set("width", options.width);
+	json.set("height", options.height);
+	json.set("warmup", options.warmup);
+	json.set("frames", options.frames);
+	json.set("maxBounces", options.maxBounces);
+	json.set("samples", options.samples);
+	if (options.streamBudgetMb > 0.0) {
+		json.set("streamBudgetMb", options.streamBudgetMb);
+		json.set("clusterKb", options.clusterKb);
+	}
+	return json;
+}
+
+// Returns the number of regressions; metrics are compared only when the
+// baseline was recorded with the same settings
+int compare(const Json& results, const Json& baseline, double tolerance)
+{
+	if (baseline["settings"].dump(0) != results["settings"].dump(0)) {
+		std::cerr << "ERROR::BENCH::BASELINE_SETTINGS_DIFFER: " << baseline["settings"].dump(0)
+			<< " vs " << results["settings"].dump(0) << std::endl;
+		return 1;
+	}
+
+	struct Metric {
+		const char* name;
+		bool higherIsBetter;
+		// Below this the metric is timer noise and is not compared
+		double floor;
+	};
+	const Metric metrics[] = {
+		{ "msPerFrame", false, 0.5 },
+		{ "mraysPerSec", true, 0.0 },
+		{ "bvhBuildMs", false, 5.0 },
+		{ "peakRssMb", false, 16.0 },
+		{ "cacheHitRate", true, 0.0 },
+		{ "ioStallMs", false, 1.0 },
+	};
+
+	int regressions = 0;
+	for (const Json& result : results["results"].items()) {
+		const Json* base = nullptr;
+		for (const Json& candidate : baseline["results"].items()) {
+			if (candidate["scene"].asString() == result["scene"].asString() && candidate["backend"].asString() == result["backend"].asString())
+				base = &candidate;
+		}
+		if (!base) {
+			std::cout << "  " << result["scene"].asString() << "/" << result["backend"].asString() << ": no baseline entry" << std::endl;
+			continue;
+		}
+
+		for (const Metric& metric : metrics) {
+			double now = result[metric.name].asNumber();
+			double then = (*base)[metric.name].asNumber();
+			if (then <= metric.floor)
+				continue;
+			double change = (now - then) / then;
+			bool worse = metric.higherIsBetter ? change < -tolerance : change > tolerance;
+			if (worse) {
+				std::cerr << std::fixed << std::setprecision(2)
+					<< "REGRESSION " << result["scene"].asString() << "/" << result["backend"].asString() << " " << metric.name
+					<< ": " << then << " -> " << now << " (" << std::showpos << change * 100.0 << std::noshowpos
+					<< "%, tolerance " << tolerance * 100.0 << "%)" << std::defaultfloat << std::endl;
+				++regressions;
+			}
+		}
+	}
+	return regressions;
+}
+
+void printResult(const Result& result)
+{
+	std::cout << std::fixed << std::setprecision(2)
+		<< "  " << std::left << std::setw(14) << result.scene << std::setw(7) << result.backend << std::right
+		<< std::setw(10) << result.msPerFrame << " ms/frame"
+		<< std::setw(10) << result.mraysPerSec << (result.raysExact ? " Mrays/s" : " Mprimary/s")
+		<< std::setw(8) << result.nodesPerRay << " nodes/ray"
+		<< std::setw(10) << result.bvhBuildMs << " ms BVH"
+		<< std::setw(9) << result.peakRssMb << " MB peak";
+	if (result.backend == "stream")
+		std::cout << std::setw(8) << result.cacheHitRate * 100.0 << "% cache hits" << std::setw(9) << result.ioStallMs << " ms I/O stall";
+	std::cout << std::defaultfloat << std::endl;
+}
+
+// Loads one mesh with 1, 2, 4... threads up to the hardware count, to see the loader scale
+int runMeshLoad(const std::string& path)
+{
+	unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> counts;
+	for (unsigned threads = 1; threads < hardware; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(hardware);
+
+	std::cout << "Loading " << path << std::endl;
+	for (unsigned threads : counts) {
+		Mesh mesh;
+		MeshLoader::Stats stats;
+		std::string error;
+		if (!MeshLoader::Load(path, mesh, error, threads, &stats)) {
+			std::cerr << "ERROR::BENCH::MESH_NOT_LOADED: " << error << std::endl;
+			return 1;
+		}
+		std::cout << std::fixed << std::setprecision(1)
+			<< std::setw(5) << threads << " threads" << std::setw(10) << stats.ms << " ms" << std::setw(10) << stats.mbPerSec() << " MB/s"
+			<< std::setw(12) << mesh.vertexCount() << " vertices" << std::setw(12) << mesh.triangleCount() << " triangles"
+			<< std::setw(9) << mesh.bytes() / (1024.0 * 1024.0) << " MB mesh" << std::setw(9) << peakRssMb() << " MB peak"
+			<< std::defaultfloat << std::endl;
+	}
+	return 0;
+}
+
+std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> parts;
+	std::stringstream stream(list);
+	std::string part;
+	while (std::getline(stream, part, ','))
+		if (!part.empty())
+			parts.push_back(part);
+	return parts;
+}
+
+void usage()
+{
+	std::cout << "usage: photonweaver_bench [options]\n"
+		<< "  --scenes a,b,c       subset of two-spheres,cornell,cornell-mesh,random-10k,random-1m,\n"
+		<< "                       or scene files (.json)\n"
+		<< "  --backend cpu|gl|both\n"
+		<< "  --width N --height N --warmup N --frames N --bounces N --samples N\n"
+		<< "  --out FILE           results (default bench_results.json)\n"
+		<< "  --baseline FILE      baseline to compare with (default bench_baseline.json)\n"
+		<< "  --tolerance F        allowed relative regression (default 0.10)\n"
+		<< "  --write-baseline     store these results as the new baseline\n"
+		<< "  --stream-budget MB   also run the CPU tracer out of core, through a cluster cache of this size\n"
+		<< "  --cluster-kb N       cluster size for --stream-budget (default 64)\n"
+		<< "time to quality (CPU tracer, first scene only, 320x180 cornell unless given):\n"
+		<< "  --converge           error against a cached reference over time (default out convergence.json)\n"
+		<< "  --configs a,b,c      subset of pcg,r2,pcg-adaptive,r2-adaptive\n"
+		<< "  --reference-spp N --budget-ms F --target-rmse F\n"
+		<< "storage formats (GL tracer, at --width x --height):\n"
+		<< "  --formats            accumulation and G-buffer formats against float32 (default out formats.json)\n"
+		<< "  --passes N --resolve-every N\n"
+		<< "mesh loading:\n"
+		<< "  --load-mesh FILE     load an OBJ or PLY file with 1, 2, 4... threads and report MB/s" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--scenes" && hasValue) {
+			options.scenes = split(argv[++i]);
+			if (!options.scenes.empty())
+				options.convergence.scene = options.scenes.front();
+		}
+		else if (arg == "--backend" && hasValue) {
+			std::string backend = argv[++i];
+			options.cpu = backend == "cpu" || backend == "both";
+			options.gl = backend == "gl" || backend == "both";
+		}
+		else if (arg == "--width" && hasValue)
+			options.width = options.convergence.width = std::atoi(argv[++i]);
+		else if (arg == "--height" && hasValue)
+			options.height = options.convergence.height = std::atoi(argv[++i]);
+		else if (arg == "--warmup" && hasValue)
+			options.warmup = std::atoi(argv[++i]);
+		else if (arg == "--frames" && hasValue)
+			options.frames = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--bounces" && hasValue)
+			options.maxBounces = options.convergence.maxBounces = options.formatsOptions.maxBounces = std::atoi(argv[++i]);
+		else if (arg == "--samples" && hasValue)
+			options.samples = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--out" && hasValue)
+			options.outPath = options.convergence.outPath = options.formatsOptions.outPath = argv[++i];
+		else if (arg == "--baseline" && hasValue)
+			options.baselinePath = argv[++i];
+		else if (arg == "--tolerance" && hasValue)
+			options.tolerance = std::atof(argv[++i]);
+		else if (arg == "--write-baseline")
+			options.writeBaseline = true;
+		else if (arg == "--converge")
+			options.converge = true;
+		else if (arg == "--formats")
+			options.formats = true;
+		else if (arg == "--passes" && hasValue)
+			options.formatsOptions.passes = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--resolve-every" && hasValue)
+			options.formatsOptions.resolveInterval = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--configs" && hasValue)
+			options.convergence.configs = split(argv[++i]);
+		else if (arg == "--reference-spp" && hasValue)
+			options.convergence.referenceSpp = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--budget-ms" && hasValue)
+			options.convergence.budgetMs = std::atof(argv[++i]);
+		else if (arg == "--target-rmse" && hasValue)
+			options.convergence.targetRmse = std::atof(argv[++i]);
+		else if (arg == "--stream-budget" && hasValue)
+			options.streamBudgetMb = std::atof(argv[++i]);
+		else if (arg == "--cluster-kb" && hasValue)
+			options.clusterKb = static_cast<uint32_t>(std::max(4, std::atoi(argv[++i])));
+		else if (arg == "--load-mesh" && hasValue)
+			options.meshPath = argv[++i];
+		else {
+			usage();
+			return arg == "--help" ? 0 : 2;
+		}
+	}
+
+	// Scene, size, bounces and --out carry over; the rest have their own defaults
+	if (options.converge)
+		return Convergence::Run(options.convergence);
+	if (!options.meshPath.empty())
+		return runMeshLoad(options.meshPath);
+
+	GlBackend gl;
+	if ((options.gl || options.formats) && !gl.init(options)) {
+		std::cerr << "ERROR::BENCH::GL_BACKEND_UNAVAILABLE (try --backend cpu, or run under xvfb-run with LIBGL_ALWAYS_SOFTWARE=1)" << std::endl;
+		return 1;
+	}
+
+	Json results = Json::object();
+	results.set("version", 1);
+	results.set("settings", settingsJson(options));
+	Json& list = results.set("results", Json::array());
+
+	if (options.formats)
+		std::cout << "Storage formats at " << options.width << "x" << options.height << ", " << options.formatsOptions.passes
+			<< " passes per accumulation format" << std::endl;
+	else
+		std::cout << "Rendering " << options.width << "x" << options.height << ", " << options.warmup << " warm-up + "
+			<< options.frames << " measured frames per scene" << std::endl;
+	for (const std::string& name : options.scenes) {
+		// Scene files come through the compiled cache, so their BVH build time reads as 0 once cached
+		Scene scene;
+		if (Scene::Builtin(name, scene)) {
+			scene.buildBVH();
+		}
+		else {
+			CompiledScene compiled;
+			std::string error;
+			if (!compiled.load(name, error)) {
+				std::cerr << "ERROR::BENCH::UNKNOWN_SCENE: " << error << std::endl;
+				return 2;
+			}
+			std::cout << "  " << compiled.name() << ": " << (compiled.fromCache() ? "mapped" : "compiled") << " in "
+				<< compiled.loadMs() << " ms" << std::endl;
+			scene = compiled.toScene();
+		}
+
+		if (options.formats) {
+			list.push(gl.runFormats(scene, options));
+			continue;
+		}
+		if (options.cpu) {
+			Result result = runCpu(scene, options);
+			printResult(result);
+			list.push(toJson(result));
+		}
+		if (options.cpu && options.streamBudgetMb > 0.0) {
+			Result result = runStreamed(scene, options);
+			printResult(result);
+			list.push(toJson(result));
+		}
+		if (options.gl) {
+			Result result = gl.run(scene, options);
+			printResult(result);
+			list.push(toJson(result));
+		}
+	}
+	gl.shutdown();
+
+	if (options.formats) {
+		if (!results.save(options.formatsOptions.outPath)) {
+			std::cerr << "ERROR::BENCH::FILE_NOT_WRITTEN: " << options.formatsOptions.outPath << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << options.formatsOptions.outPath << std::endl;
+		return 0;
+	}
+
+	if (!results.save(options.outPath)) {
+		std::cerr << "ERROR::BENCH::FILE_NOT_WRITTEN: " << options.outPath << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << options.outPath << std::endl;
+
+	if (options.writeBaseline) {
+		if (!results.save(options.baselinePath)) {
+			std::cerr << "ERROR::BENCH::FILE_NOT_WRITTEN: " << options.baselinePath << std::endl;
+			return 1;
+		}
+		std::cout << "Baseline stored in " << options.baselinePath << std::endl;
+		return 0;
+	}
+
+	Json baseline;
+	std::string error;
+	if (!Json::load(options.baselinePath, baseline, error)) {
+		std::cout << "No baseline compared (" << error << "); run with --write-baseline to record one" << std::endl;
+		return 0;
+	}
+
+	int regressions = compare(results, baseline, options.tolerance);
+	if (regressions > 0) {
+		std::cerr << "FAILED: " << regressions << " metric(s) regressed against " << options.baselinePath << std::endl;
+		return 1;
+	}
+	std::cout << "All metrics within " << options.tolerance * 100.0 << "% of " << options.baselinePath << std::endl;
+	return 0;
+}